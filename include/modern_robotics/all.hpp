@@ -5,5 +5,9 @@
 #include "modern_robotics/rigid_body_motions.hpp"
 #include "modern_robotics/forward_kinematics.hpp"
 #include "modern_robotics/velocity_kinematics_and_statics.hpp"
+#include "modern_robotics/manipulability_map.hpp"
+#include "modern_robotics/inverse_kinematics.hpp"
+#include "modern_robotics/analytic_inverse_kinematics.hpp"
+#include "modern_robotics/ik_seed_database.hpp"
 
 #endif
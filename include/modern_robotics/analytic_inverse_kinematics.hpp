@@ -0,0 +1,85 @@
+#ifndef MODERN_ROBOTICS__ANALYTIC_INVERSE_KINEMATICS_HPP___
+#define MODERN_ROBOTICS__ANALYTIC_INVERSE_KINEMATICS_HPP___
+
+#include <cstdint>
+#include <vector>
+#include <armadillo>
+
+#include "modern_robotics/forward_kinematics.hpp"
+#include "modern_robotics/inverse_kinematics.hpp"
+
+namespace mr
+{
+/// \defgroup analytic_inverse_kinematics Closed-Form Inverse Kinematics
+
+/// \ingroup analytic_inverse_kinematics
+/// \brief The kinematic structures with a closed-form inverse kinematics solution
+enum class ArmGeometry : uint8_t
+{
+  General, /// no supported structure; only numerical inverse kinematics applies
+  SphericalWrist, /// axes 1 and 2 intersect, 2 and 3 are parallel, 4, 5 and 6
+                  /// meet in the wrist center
+  OffsetWrist /// UR-style: axes 2, 3 and 4 are parallel and axes 5 and 6 intersect
+};
+
+/// \ingroup analytic_inverse_kinematics
+/// \brief Closed-form inverse kinematics of 6R arms
+/// \details The constructor checks the screw axes at the home position for a
+///          supported structure and extracts the axis directions, points and
+///          intersections once. Solutions are assembled from the Paden-Kahan
+///          subproblems in the space frame, so no particular choice of base or
+///          tool frame is required.
+class AnalyticIK
+{
+public:
+  /// \brief Analyzes the geometry of a 6R arm
+  /// \param list The joint screw axes at the home position, Blist or Slist
+  ///             depending on frame
+  /// \param M The home configuration of the end-effector
+  /// \param frame The frame the screw axes are expressed in
+  AnalyticIK(
+    const std::vector<arma::vec6> & list,
+    const arma::mat44 & M,
+    const IKFrame frame = IKFrame::Space
+  );
+
+  /// \brief The structure detected from the screw axes
+  ArmGeometry geometry() const;
+
+  /// \brief Enumerates every closed-form solution
+  /// \param T The desired end-effector configuration Tsd
+  /// \return Up to 8 distinct solutions with angles in [-pi, pi], each
+  ///         verified against the forward kinematics; empty if T is
+  ///         unreachable or the geometry is General
+  const std::vector<arma::vec> SolveAll(const arma::mat44 & T) const;
+
+  /// \brief Computes the solution closest to an initial guess
+  /// \param T The desired end-effector configuration Tsd
+  /// \param thetalist0 An initial guess of joint angles
+  /// \param options The settings of the numerical fallback
+  /// \return The closed-form solution nearest to thetalist0, shifted by
+  ///         multiples of 2 pi towards it, among those inside the joint
+  ///         limits of options. Falls back to IKinSpaceDLS when the geometry
+  ///         is General or no such closed-form solution exists.
+  /// \details Throws std::invalid_argument if thetalist0 or the limits do
+  ///          not have one entry per joint.
+  const IKResult Solve(
+    const arma::mat44 & T,
+    const arma::vec & thetalist0,
+    const IKOptions & options = IKOptions()
+  ) const;
+
+private:
+  std::vector<arma::vec6> Slist_;
+  std::vector<Joint> joints_;
+  arma::mat44 M_;
+  arma::mat44 Minv_;
+  ArmGeometry geometry_ = ArmGeometry::General;
+  std::vector<arma::vec3> w_; /// The joint axis directions
+  std::vector<arma::vec3> q_; /// A point on every joint axis
+  arma::vec3 shoulder_; /// SphericalWrist: the intersection of axes 1 and 2
+  arma::vec3 wrist_; /// The wrist center, or the intersection of axes 5 and 6
+};
+}
+
+#endif /// MODERN_ROBOTICS__ANALYTIC_INVERSE_KINEMATICS_HPP___
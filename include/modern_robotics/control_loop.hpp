@@ -0,0 +1,329 @@
+#ifndef MODERN_ROBOTICS__CONTROL_LOOP_HPP___
+#define MODERN_ROBOTICS__CONTROL_LOOP_HPP___
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <armadillo>
+
+#include "modern_robotics/dynamics_of_open_chains.hpp"
+
+namespace mr
+{
+/// \defgroup control_loop Control Loop
+
+/// \ingroup control_loop
+/// \brief Lock-free mailbox from one writer thread to one reader thread that
+///        always delivers the latest value
+/// \details Holds three copies of the value. The writer fills its back copy
+///          and swaps it with the middle copy, the reader swaps the middle copy
+///          with its front copy when a fresh one is waiting. Each copy is owned
+///          by one side at a time, so neither side ever waits for the other,
+///          and values made of containers of a fixed size are copied without
+///          heap allocation.
+template<typename T>
+class TripleBuffer
+{
+public:
+  /// \brief Fills all three copies with the same value
+  /// \param initial The value the reader sees until the first write
+  explicit TripleBuffer(const T & initial)
+  : buffers_{initial, initial, initial}
+  {
+  }
+
+  /// \brief The copy the writer may fill, valid until the next Publish
+  T & back()
+  {
+    return buffers_[back_];
+  }
+
+  /// \brief Hands the back copy to the reader
+  void Publish()
+  {
+    back_ = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel) & kIndex;
+  }
+
+  /// \brief Copies a value into the back copy and hands it to the reader
+  /// \param value The new value
+  void Write(const T & value)
+  {
+    back() = value;
+    Publish();
+  }
+
+  /// \brief Takes the latest published copy, if there is a new one
+  /// \return Whether front() changed
+  bool Update()
+  {
+    if ((middle_.load(std::memory_order_relaxed) & kFresh) == 0) {
+      return false;
+    }
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kIndex;
+    return true;
+  }
+
+  /// \brief The copy the reader holds, valid until the next Update
+  const T & front() const
+  {
+    return buffers_[front_];
+  }
+
+private:
+  static constexpr uint8_t kIndex = 0x3;
+  static constexpr uint8_t kFresh = 0x4;
+
+  T buffers_[3];
+  uint8_t back_ = 0; /// Owned by the writer
+  std::atomic<uint8_t> middle_{1}; /// The index of the middle copy and the fresh flag
+  uint8_t front_ = 2; /// Owned by the reader
+};
+
+/// \ingroup control_loop
+/// \brief Sequence lock publishing a fixed number of doubles from one writer
+///        to any number of readers
+/// \details The writer never waits. A reader retries whenever the writer
+///          updated the values while they were being copied, so it always
+///          sees one complete write. The values are stored as relaxed atomics,
+///          so concurrent copies are well-defined.
+class SeqLock
+{
+public:
+  /// \brief Allocates the values, initially zero
+  /// \param size The number of values
+  explicit SeqLock(const size_t size);
+
+  /// \brief The number of values
+  size_t size() const;
+
+  /// \brief Publishes new values
+  /// \param data The values, size() of them
+  void Write(const arma::vec & data);
+
+  /// \brief Copies the values once
+  /// \param data The values, resized if needed
+  /// \return Whether the copy is consistent, i.e. no write overlapped it
+  bool TryRead(arma::vec & data) const;
+
+  /// \brief Copies the values, retrying until the copy is consistent
+  /// \param data The values, resized if needed
+  void Read(arma::vec & data) const;
+
+private:
+  size_t size_;
+  std::atomic<uint64_t> sequence_{0}; /// Odd while a write is in progress
+  std::unique_ptr<std::atomic<double>[]> data_;
+};
+
+/// \ingroup control_loop
+/// \brief The reference joint state a ControlLoop tracks
+struct ControlSetpoint
+{
+  arma::vec thetalistd; /// n-vector of reference joint variables
+  arma::vec dthetalistd; /// n-vector of reference joint velocities
+  arma::vec ddthetalistd; /// n-vector of reference joint accelerations
+};
+
+/// \ingroup control_loop
+/// \brief The measured state and command of one control cycle
+struct ControlLoopState
+{
+  uint64_t cycle = 0; /// The index of the cycle
+  double time = 0.0; /// The deadline of the cycle, in seconds since the loop started
+  arma::vec thetalist; /// n-vector of measured joint variables
+  arma::vec dthetalist; /// n-vector of measured joint velocities
+  arma::vec taulist; /// n-vector of commanded joint forces/torques
+};
+
+/// \ingroup control_loop
+/// \brief Timing statistics of a ControlLoop, all durations in seconds
+struct ControlLoopStats
+{
+  uint64_t cycles = 0; /// The number of cycles run
+  uint64_t overruns = 0; /// The number of cycles that finished after the next deadline
+  double latency_mean = 0.0; /// The mean delay of the wakeups after their deadlines
+  double latency_max = 0.0; /// The largest delay of a wakeup after its deadline
+  double period_mean = 0.0; /// The mean time between consecutive wakeups
+  double period_stddev = 0.0; /// The standard deviation of the time between wakeups
+  double period_min = 0.0; /// The shortest time between consecutive wakeups
+  double period_max = 0.0; /// The longest time between consecutive wakeups
+  double compute_mean = 0.0; /// The mean time from wakeup to the torque command
+  double compute_max = 0.0; /// The longest time from wakeup to the torque command
+};
+
+/// \ingroup control_loop
+/// \brief Settings of a ControlLoop
+struct ControlLoopOptions
+{
+  /// The control period, in seconds
+  double period = 1e-3;
+  /// The SCHED_FIFO priority of the loop thread, 1 to 99, or 0 to keep the
+  /// default scheduler
+  int priority = 0;
+  /// The CPU the loop thread is pinned to, or -1 to leave it unpinned
+  int cpu = -1;
+};
+
+/// \ingroup control_loop
+/// \brief The sensors and actuators a ControlLoop drives
+/// \details Both functions are called from the loop thread only, once per
+///          cycle, and should not block or allocate.
+class RobotInterface
+{
+public:
+  virtual ~RobotInterface() = default;
+
+  /// \brief Measures the joint state
+  /// \param thetalist n-vector of joint variables
+  /// \param dthetalist n-vector of joint velocities
+  virtual void Read(arma::vec & thetalist, arma::vec & dthetalist) = 0;
+
+  /// \brief Commands the joint forces/torques
+  /// \param taulist n-vector of joint forces/torques
+  virtual void Write(const arma::vec & taulist) = 0;
+};
+
+/// \ingroup control_loop
+/// \brief A simulated robot advancing its forward dynamics on every command
+/// \details Each Write holds the torques for one timestep and takes intRes
+///          Euler steps of DynamicsWorkspace::ForwardDynamics, as the plant of
+///          SimulateControl does, so it runs in the loop without allocation.
+class SimulatedRobot : public RobotInterface
+{
+public:
+  /// \brief Sets up the plant
+  /// \param thetalist n-vector of initial joint variables
+  /// \param dthetalist n-vector of initial joint velocities
+  /// \param g Gravity vector g
+  /// \param Mlist List of link frames {i} relative to {i-1} at the home position
+  /// \param Glist Spatial inertia matrices Gi of the links
+  /// \param Slist Screw axes Si of the joints in a space frame
+  /// \param dt The timestep each command is held for
+  /// \param intRes The number of Euler steps per timestep, at least 1
+  /// \details Throws std::invalid_argument if the joint vectors do not have
+  ///          one entry per joint, dt is not positive or intRes is 0.
+  SimulatedRobot(
+    const arma::vec & thetalist,
+    const arma::vec & dthetalist,
+    const arma::vec3 & g,
+    const std::vector<arma::mat44> & Mlist,
+    const std::vector<arma::mat66> & Glist,
+    const std::vector<arma::vec6> & Slist,
+    const double dt,
+    const size_t intRes = 1
+  );
+
+  void Read(arma::vec & thetalist, arma::vec & dthetalist) override;
+
+  void Write(const arma::vec & taulist) override;
+
+private:
+  DynamicsWorkspace dynamics_;
+  arma::vec3 g_;
+  double dt_;
+  size_t intRes_;
+  arma::vec6 Ftip_;
+  arma::vec thetalist_;
+  arma::vec dthetalist_;
+  arma::vec ddthetalist_;
+};
+
+/// \ingroup control_loop
+/// \brief The control law of a ControlLoop
+/// \details Called from the loop thread with the state of the cycle and the
+///          latest setpoint, it writes the joint forces/torques into taulist,
+///          which holds n entries. It should not block or allocate.
+using ControlLaw = std::function<
+  void (const ControlLoopState & state, const ControlSetpoint & setpoint, arma::vec & taulist)>;
+
+/// \ingroup control_loop
+/// \brief Runs a control law at a fixed rate on a dedicated thread
+/// \details Every cycle sleeps until an absolute deadline with
+///          clock_nanosleep, so the rate does not drift with the time spent
+///          computing, then reads the robot, takes the latest setpoint from a
+///          TripleBuffer, evaluates the control law, writes the torques and
+///          publishes the state and timing statistics through SeqLocks. Other
+///          threads therefore never block the loop. A cycle that finishes
+///          after the next deadline counts as an overrun, and the missed
+///          deadlines are skipped rather than run back to back.
+class ControlLoop
+{
+public:
+  /// \brief Sets up a loop without starting it
+  /// \param robot The robot to control; it must outlive the loop
+  /// \param law The control law
+  /// \param setpoint The setpoint until the first SetSetpoint
+  /// \param options The period and real-time scheduling settings
+  /// \details Throws std::invalid_argument if the period is not positive or
+  ///          the setpoint vectors differ in length.
+  ControlLoop(
+    RobotInterface & robot,
+    const ControlLaw & law,
+    const ControlSetpoint & setpoint,
+    const ControlLoopOptions & options = ControlLoopOptions()
+  );
+
+  /// \brief Stops the loop if it is running
+  ~ControlLoop();
+
+  ControlLoop(const ControlLoop &) = delete;
+  ControlLoop & operator=(const ControlLoop &) = delete;
+
+  /// \brief Starts the loop thread and returns once it has applied the
+  ///        scheduling settings
+  /// \details Failing to apply SCHED_FIFO or the CPU affinity, e.g. without
+  ///          the privileges, is not an error; see scheduled(). A loop that
+  ///          ended on an error may be restarted without calling Stop, which
+  ///          discards that error. Throws std::runtime_error if the loop is
+  ///          already running.
+  void Start();
+
+  /// \brief Stops the loop thread and waits for it to finish
+  /// \details Rethrows an exception thrown by the control law or the robot,
+  ///          which also ends the loop.
+  void Stop();
+
+  /// \brief Whether the loop thread is running
+  bool running() const;
+
+  /// \brief Whether the requested SCHED_FIFO priority and CPU affinity were applied
+  bool scheduled() const;
+
+  /// \brief Sends a new setpoint to the loop
+  /// \param setpoint The setpoint, with vectors of the initial lengths
+  /// \details Never blocks. Must be called from one thread at a time.
+  void SetSetpoint(const ControlSetpoint & setpoint);
+
+  /// \brief The state of the latest cycle
+  /// \param state The state, resized if needed
+  /// \details Never blocks the loop; safe to call from any thread.
+  void State(ControlLoopState & state) const;
+
+  /// \brief The timing statistics so far
+  /// \details Never blocks the loop; safe to call from any thread.
+  const ControlLoopStats stats() const;
+
+private:
+  /// \brief The body of the loop thread
+  void Run();
+
+  RobotInterface & robot_;
+  ControlLaw law_;
+  ControlLoopOptions options_;
+  size_t n_;
+  TripleBuffer<ControlSetpoint> setpoint_;
+  SeqLock state_; /// cycle, time, thetalist, dthetalist, taulist
+  SeqLock stats_; /// The running sums of the statistics
+  std::thread thread_;
+  std::atomic<bool> running_{false};
+  std::atomic<bool> stop_{false};
+  std::atomic<bool> scheduled_{false};
+  std::exception_ptr error_;
+};
+}
+
+#endif /// MODERN_ROBOTICS__CONTROL_LOOP_HPP___
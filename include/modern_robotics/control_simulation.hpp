@@ -0,0 +1,115 @@
+#ifndef MODERN_ROBOTICS__CONTROL_SIMULATION_HPP___
+#define MODERN_ROBOTICS__CONTROL_SIMULATION_HPP___
+
+#include <functional>
+#include <vector>
+#include <armadillo>
+
+#include "modern_robotics/dynamics_of_open_chains.hpp"
+
+namespace mr
+{
+/// \defgroup control_simulation Control Simulation
+
+/// \ingroup control_simulation
+/// \brief The integration scheme of the simulated plant
+enum class Integrator
+{
+  Euler, /// Explicit Euler, as EulerStep
+  SemiImplicitEuler, /// Velocities first, then positions with the new velocities
+  RK4 /// Classical fourth-order Runge-Kutta with the torques held over the step
+};
+
+/// \ingroup control_simulation
+/// \brief A controller evaluated by SimulateClosedLoop
+/// \details Called with the index i of the control step, the simulated time of
+///          the sample and the measured joint variables and velocities, it
+///          writes the commanded joint forces/torques into taulist, which holds
+///          the n entries of the previous command.
+using ControllerFunction = std::function<
+  void (const size_t i, const double t, const arma::vec & thetalist,
+  const arma::vec & dthetalist, arma::vec & taulist)>;
+
+/// \ingroup control_simulation
+/// \brief Receives the samples of SimulateClosedLoop as they are produced
+/// \details Called once per control step, right after the controller, with
+///          the same arguments and the command it produced.
+using SimulationObserver = std::function<
+  void (const size_t i, const double t, const arma::vec & thetalist,
+  const arma::vec & dthetalist, const arma::vec & taulist)>;
+
+/// \ingroup control_simulation
+/// \brief Settings of SimulateClosedLoop
+struct SimulationOptions
+{
+  /// The period of the controller, in seconds
+  double controller_dt = 1e-3;
+  /// The integration step of the plant, in seconds, independent of controller_dt
+  double plant_dt = 1e-4;
+  /// The integration scheme of the plant
+  Integrator integrator = Integrator::Euler;
+  /// The time from the sample of a command to its application, in seconds
+  double actuator_delay = 0.0;
+  /// The torques applied before the first command arrives, or empty for zeros
+  arma::vec initial_torque;
+  /// The spatial force applied by the end-effector at a time, expressed in
+  /// frame {n+1}, or empty for no force
+  std::function<const arma::vec6(const double t)> Ftip;
+  /// The gearing, rotor inertia and friction of the plant; with a cache, set
+  /// them on the cache instead
+  ActuatorModel actuators;
+  /// The cache to evaluate the plant with, or null for one of its own. It must
+  /// be of the actual model; a controller that evaluates the same model
+  /// through it at the sampled states saves the plant those evaluations.
+  DynamicsCache * cache = nullptr;
+};
+
+/// \ingroup control_simulation
+/// \brief The end of a closed-loop simulation
+struct SimulationResult
+{
+  arma::vec thetalist; /// The final joint variables
+  arma::vec dthetalist; /// The final joint velocities
+  size_t plant_steps; /// The number of integration steps taken
+};
+
+/// \ingroup control_simulation
+/// \brief Simulates any controller in closed loop with a robot
+/// \param thetalist n-vector of initial joint variables
+/// \param dthetalist n-vector of initial joint velocities
+/// \param g Actual gravity vector g
+/// \param Mlist Actual list of link frames i relative to i-1 at the home position
+/// \param Glist Actual spatial inertia matrices Gi of the links
+/// \param Slist Screw axes Si of the joints in a space frame
+/// \param controller The controller
+/// \param steps The number of control steps; the simulation covers
+///              steps * controller_dt seconds
+/// \param options The rates, integrator, actuator delay and tip force
+/// \param observer Receives every sample, or empty
+/// \return The final state and the number of integration steps
+/// \details Control step i samples the plant at the first integration step
+///          at or after i * controller_dt. Its command takes effect at the
+///          first integration step at least actuator_delay later, with the
+///          previous command held until then.
+///          The plant uses a DynamicsCache and the delayed commands a
+///          preallocated ring buffer, so the loop performs no heap allocation
+///          of its own and the results are streamed to the observer instead of
+///          being stored. Throws std::invalid_argument if the initial state
+///          does not have one entry per joint, the controller is empty, a rate
+///          is not positive, the delay is negative or the cache is of another
+///          number of joints.
+const SimulationResult SimulateClosedLoop(
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist,
+  const arma::vec3 & g,
+  const std::vector<arma::mat44> & Mlist,
+  const std::vector<arma::mat66> & Glist,
+  const std::vector<arma::vec6> & Slist,
+  const ControllerFunction & controller,
+  const size_t steps,
+  const SimulationOptions & options = SimulationOptions(),
+  const SimulationObserver & observer = nullptr
+);
+}
+
+#endif /// MODERN_ROBOTICS__CONTROL_SIMULATION_HPP___
@@ -1,8 +1,11 @@
 #ifndef MODERN_ROBOTICS__DYNAMICS_OF_OPEN_CHAINS___
 #define MODERN_ROBOTICS__DYNAMICS_OF_OPEN_CHAINS___
 
+#include <vector>
 #include <armadillo>
 
+#include "modern_robotics/forward_kinematics.hpp"
+
 namespace mr
 {
 /// \defgroup dynamics_open_open_chains Chapter 8: Dynamics of Open Chains
@@ -13,6 +16,13 @@ namespace mr
 /// \details Used to calculate the Lie bracket [V1, V2] = [adV1]V2
 const arma::mat66 ad(const arma::vec6 & V);
 
+/// \brief Computes the Lie bracket of two twists
+/// \param V A 6-vector spatial velocity
+/// \param W A 6-vector spatial velocity
+/// \return The Lie bracket [V, W] = [adV]W
+/// \details Equivalent to ad(V) * W, without forming the 6x6 matrix.
+const arma::vec6 adMap(const arma::vec6 & V, const arma::vec6 & W);
+
 const arma::vec InverseDynamics(
   const arma::vec & thetalist,
   const arma::vec & dthetalist,
@@ -235,6 +245,408 @@ ForwardDynamicsTrajectory(
   const double dt,
   const int intRes
 );
+
+/// \ingroup dynamics_open_open_chains
+/// \brief The gearing, rotor inertia and friction of the joint actuators
+/// \details Every list holds one entry per joint, or is empty for none. A
+///          motor drives its joint through a gearhead of ratio G, so its rotor
+///          adds the apparent inertia G^2 I_rotor to the diagonal of the mass
+///          matrix. The friction, given at the joints, opposes the joint rate
+///          dtheta with the Stribeck model
+///          (Fc + (Fs - Fc) exp(-(dtheta / vs)^2)) sign(dtheta) + Fv dtheta.
+struct ActuatorModel
+{
+  /// The gear ratios G of motor to joint speed; empty for direct drives, G = 1
+  arma::vec gear_ratio;
+  /// The rotor inertias about the motor axes
+  arma::vec rotor_inertia;
+  /// The Coulomb friction forces/torques Fc
+  arma::vec coulomb;
+  /// The viscous friction coefficients Fv
+  arma::vec viscous;
+  /// The breakaway friction forces/torques Fs at rest; empty for Fs = Fc
+  arma::vec static_friction;
+  /// The Stribeck velocities vs over which the friction falls from Fs to Fc;
+  /// empty or zero for Fs = Fc
+  arma::vec stribeck_velocity;
+  /// A rate scale below which sign(dtheta) is smoothed as tanh(dtheta / smoothing),
+  /// so that integrators do not chatter around rest; 0 for the exact sign
+  double smoothing = 0.0;
+};
+
+/// \ingroup dynamics_open_open_chains
+/// \brief Computes the apparent rotor inertias of the actuators
+/// \param actuators The actuator model
+/// \param n The number of joints
+/// \return The n-vector of G^2 I_rotor, which add to the diagonal of the mass matrix
+/// \details Throws std::invalid_argument if a list of actuators is neither
+///          empty nor of n entries, or the smoothing or a Stribeck velocity
+///          is negative.
+const arma::vec ApparentRotorInertias(const ActuatorModel & actuators, const size_t n);
+
+/// \ingroup dynamics_open_open_chains
+/// \brief Computes the joint friction of the actuators
+/// \param dthetalist A list of joint rates
+/// \param actuators The actuator model
+/// \return The joint forces/torques required to overcome the friction at dthetalist
+/// \details Throws std::invalid_argument like ApparentRotorInertias.
+const arma::vec FrictionForces(const arma::vec & dthetalist, const ActuatorModel & actuators);
+
+/// \ingroup dynamics_open_open_chains
+/// \brief Computes the inverse dynamics of an open chain with its actuators
+/// \param thetalist n-vector of joint variables
+/// \param dthetalist n-vector of joint rates
+/// \param ddthetalist n-vector of joint accelerations
+/// \param g Gravity vector g
+/// \param Ftip Spatial force applied by the end-effector expressed in frame {n+1}
+/// \param Mlist List of link frames i relative to i-1 at the home position
+/// \param Glist Spatial inertia matrices Gi of the links
+/// \param Slist Screw axes Si of the joints in a space frame
+/// \param actuators The actuator model
+/// \return The n-vector of required joint forces/torques, the rigid-body ones
+///         plus the rotor inertia and friction forces
+const arma::vec InverseDynamics(
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist,
+  const arma::vec & ddthetalist,
+  const arma::vec & g,
+  const arma::vec6 & Ftip,
+  const std::vector<arma::mat44> & Mlist,
+  const std::vector<arma::mat66> & Glist,
+  const std::vector<arma::vec6> & Slist,
+  const ActuatorModel & actuators
+);
+
+/// \ingroup dynamics_open_open_chains
+/// \brief Computes the mass matrix of an open chain with its actuators
+/// \param thetalist A list of joint variables
+/// \param Mlist List of link frames i relative to i-1 at the home position
+/// \param Glist Spatial inertia matrices Gi of the links
+/// \param Slist Screw axes Si of the joints in a space frame
+/// \param actuators The actuator model
+/// \return The rigid-body mass matrix with the apparent rotor inertias added
+///         to its diagonal
+const arma::mat MassMatrix(
+  const arma::vec & thetalist,
+  const std::vector<arma::mat44> & Mlist,
+  const std::vector<arma::mat66> & Glist,
+  const std::vector<arma::vec6> & Slist,
+  const ActuatorModel & actuators
+);
+
+/// \ingroup dynamics_open_open_chains
+/// \brief Computes the forward dynamics of an open chain with its actuators
+/// \param thetalist A list of joint variables
+/// \param dthetalist A list of joint rates
+/// \param taulist An n-vector of joint forces/torques
+/// \param g Gravity vector g
+/// \param Ftip Spatial force applied by the end-effector expressed in frame {n+1}
+/// \param Mlist List of link frames i relative to i-1 at the home position
+/// \param Glist Spatial inertia matrices Gi of the links
+/// \param Slist Screw axes Si of the joints in a space frame
+/// \param actuators The actuator model
+/// \return The resulting joint accelerations
+/// \details Solves (M + diag(G^2 I_rotor)) ddthetalist =
+///          taulist - c - g - J^T Ftip - friction, the inverse of the
+///          InverseDynamics above.
+const arma::vec ForwardDynamics(
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist,
+  const arma::vec & taulist,
+  const arma::vec3 & g,
+  const arma::vec6 & Ftip,
+  const std::vector<arma::mat44> & Mlist,
+  const std::vector<arma::mat66> & Glist,
+  const std::vector<arma::vec6> & Slist,
+  const ActuatorModel & actuators
+);
+
+/// \ingroup dynamics_open_open_chains
+/// \brief Preallocated storage and per-chain constants for repeated dynamics
+///        evaluations of one open chain
+/// \details The constructor computes the screw axes Ai of the joints in their
+///          link frames, classifies them for closed-form exponentials and
+///          inverts the link frames once. The member functions then evaluate
+///          the dynamics without heap allocation, so a workspace suits control
+///          loops; it is not thread-safe, use one per thread.
+class DynamicsWorkspace
+{
+public:
+  /// \brief Prepares the workspace for an open chain
+  /// \param Mlist List of link frames i relative to i-1 at the home position
+  /// \param Glist Spatial inertia matrices Gi of the links
+  /// \param Slist Screw axes Si of the joints in a space frame, in the format
+  ///              of a matrix with axes as the columns
+  /// \details Throws std::invalid_argument unless there are n screw axes, n
+  ///          inertias and n + 1 link frames.
+  DynamicsWorkspace(
+    const std::vector<arma::mat44> & Mlist,
+    const std::vector<arma::mat66> & Glist,
+    const std::vector<arma::vec6> & Slist
+  );
+
+  /// \brief The number of joints
+  size_t size() const;
+
+  /// \brief Includes the actuators in every evaluation that follows
+  /// \param actuators The actuator model
+  /// \details InverseDynamics adds the rotor inertia and friction forces,
+  ///          MassMatrix the apparent rotor inertias, and ForwardDynamics and
+  ///          its derivatives invert both. The model is validated and stored
+  ///          once, so evaluations stay free of heap allocation. Throws
+  ///          std::invalid_argument like ApparentRotorInertias.
+  void SetActuators(const ActuatorModel & actuators);
+
+  /// \brief Computes the inverse dynamics into preallocated storage
+  /// \param thetalist n-vector of joint variables
+  /// \param dthetalist n-vector of joint rates
+  /// \param ddthetalist n-vector of joint accelerations
+  /// \param g Gravity vector g
+  /// \param Ftip Spatial force applied by the end-effector expressed in frame {n+1}
+  /// \param taulist The n-vector of required joint forces/torques, resized to
+  ///                n if needed
+  /// \details The same recursive Newton-Euler algorithm as InverseDynamics,
+  ///          with the adjoint maps applied through rotations and positions
+  ///          instead of forming 6x6 matrices.
+  void InverseDynamics(
+    const arma::vec & thetalist,
+    const arma::vec & dthetalist,
+    const arma::vec & ddthetalist,
+    const arma::vec3 & g,
+    const arma::vec6 & Ftip,
+    arma::vec & taulist
+  );
+
+  /// \brief Computes the mass matrix into preallocated storage
+  /// \param thetalist n-vector of joint variables
+  /// \param M The nxn mass matrix, resized if needed
+  /// \details Uses the composite rigid body algorithm, which builds all n
+  ///          columns from one sweep of link transforms instead of n calls of
+  ///          InverseDynamics.
+  void MassMatrix(const arma::vec & thetalist, arma::mat & M);
+
+  /// \brief Computes the forward dynamics into preallocated storage
+  /// \param thetalist n-vector of joint variables
+  /// \param dthetalist n-vector of joint rates
+  /// \param taulist n-vector of joint forces/torques
+  /// \param g Gravity vector g
+  /// \param Ftip Spatial force applied by the end-effector expressed in frame {n+1}
+  /// \param ddthetalist The n-vector of joint accelerations, resized if needed
+  /// \details Solves M ddthetalist = taulist - c - g - J^T Ftip with a
+  ///          Cholesky factorization of the mass matrix instead of its inverse.
+  ///          Throws std::runtime_error if the mass matrix is not positive
+  ///          definite.
+  void ForwardDynamics(
+    const arma::vec & thetalist,
+    const arma::vec & dthetalist,
+    const arma::vec & taulist,
+    const arma::vec3 & g,
+    const arma::vec6 & Ftip,
+    arma::vec & ddthetalist
+  );
+
+  /// \brief Computes the forward dynamics and their derivatives into
+  ///        preallocated storage
+  /// \param thetalist n-vector of joint variables
+  /// \param dthetalist n-vector of joint rates
+  /// \param taulist n-vector of joint forces/torques
+  /// \param g Gravity vector g
+  /// \param Ftip Spatial force applied by the end-effector expressed in frame {n+1}
+  /// \param ddthetalist The n-vector of joint accelerations, resized if needed
+  /// \param dtheta The nxn derivative of ddthetalist with respect to thetalist
+  /// \param ddtheta The nxn derivative of ddthetalist with respect to dthetalist
+  /// \param dtau The nxn derivative of ddthetalist with respect to taulist
+  /// \details Because InverseDynamics at the forward dynamics accelerations
+  ///          returns taulist, the torque derivative is M^-1 and the state
+  ///          derivatives are -M^-1 times those of InverseDynamics at fixed
+  ///          accelerations, which are taken by central differences. All of
+  ///          them reuse the Cholesky factor of ForwardDynamics. Throws
+  ///          std::runtime_error if the mass matrix is not positive definite.
+  void ForwardDynamicsDerivatives(
+    const arma::vec & thetalist,
+    const arma::vec & dthetalist,
+    const arma::vec & taulist,
+    const arma::vec3 & g,
+    const arma::vec6 & Ftip,
+    arma::vec & ddthetalist,
+    arma::mat & dtheta,
+    arma::mat & ddtheta,
+    arma::mat & dtau
+  );
+
+private:
+  /// \brief Computes the link transforms T_{i,i-1} at thetalist
+  void Transforms(const arma::vec & thetalist);
+
+  /// \brief Adds the rotor inertia forces for ddthetalist, unless null, and
+  ///        the friction at dthetalist to taulist
+  void AddActuatorForces(
+    const arma::vec & dthetalist,
+    const arma::vec * ddthetalist,
+    arma::vec & taulist
+  ) const;
+
+  /// \brief Runs the Newton-Euler recursions on the current link transforms
+  void Recursion(
+    const arma::vec & dthetalist,
+    const arma::vec & ddthetalist,
+    const arma::vec3 & g,
+    const arma::vec6 & Ftip,
+    arma::vec & taulist
+  );
+
+  std::vector<Joint> joints_; /// The screw axes Ai in the link frames
+  std::vector<arma::mat44> Minv_; /// The inverse link frames M_{i,i-1}, n + 1 of them
+  std::vector<arma::mat66> Glist_;
+  std::vector<arma::mat44> T_; /// The link transforms T_{i,i-1} at the last configuration
+  std::vector<arma::vec6> V_; /// The link twists
+  std::vector<arma::vec6> Vd_; /// The link accelerations
+  std::vector<arma::mat66> Ic_; /// The composite inertias of the subtrees
+  arma::mat66 Ad_;
+  arma::mat66 IAd_; /// Ic_(i+1) [Ad_T(i+1)]
+  arma::mat M_;
+  arma::vec bias_;
+  arma::vec zeros_;
+  arma::vec theta_;
+  arma::vec dtheta_;
+  arma::vec tauplus_;
+  arma::vec tauminus_;
+  bool actuated_ = false;
+  ActuatorModel actuators_; /// With every list of n entries
+  arma::vec armature_; /// The apparent rotor inertias
+};
+
+/// \ingroup dynamics_open_open_chains
+/// \brief The mass matrix, its Cholesky factor and the bias forces of one open
+///        chain, memoized on the configuration they were computed at
+/// \details A controller and a plant that share a model evaluate these terms
+///          at the same state once per control step: the controller for
+///          M(theta) ddtheta + c + g, the plant for the first forward dynamics
+///          of its integration step. Sharing a cache between them computes the
+///          terms once. Each term keeps the exact arguments it was computed
+///          with and is reused only while they compare equal, so a cache never
+///          returns stale values; Invalidate drops them all, for instance when
+///          the storage of the arguments is reused for another robot state.
+///          Like DynamicsWorkspace, a cache performs no heap allocation after
+///          construction and is not thread-safe.
+class DynamicsCache
+{
+public:
+  /// \brief Prepares an empty cache for an open chain
+  /// \param Mlist List of link frames i relative to i-1 at the home position
+  /// \param Glist Spatial inertia matrices Gi of the links
+  /// \param Slist Screw axes Si of the joints in a space frame
+  /// \details Throws std::invalid_argument unless there are n screw axes, n
+  ///          inertias and n + 1 link frames.
+  DynamicsCache(
+    const std::vector<arma::mat44> & Mlist,
+    const std::vector<arma::mat66> & Glist,
+    const std::vector<arma::vec6> & Slist
+  );
+
+  /// \brief The number of joints
+  size_t size() const;
+
+  /// \brief Includes the actuators in every term from now on
+  /// \param actuators The actuator model
+  /// \details As DynamicsWorkspace::SetActuators: the mass matrix and its
+  ///          factor gain the apparent rotor inertias and the bias the
+  ///          friction. Invalidates the cache.
+  void SetActuators(const ActuatorModel & actuators);
+
+  /// \brief The mass matrix M(thetalist), computed on a miss
+  /// \param thetalist n-vector of joint variables
+  /// \return The nxn mass matrix, valid until the next call on the cache
+  const arma::mat & MassMatrix(const arma::vec & thetalist);
+
+  /// \brief The lower Cholesky factor L of M(thetalist) = L L^T, computed on a miss
+  /// \param thetalist n-vector of joint variables
+  /// \return The nxn factor, of which only the lower triangle is meaningful,
+  ///         valid until the next call on the cache
+  /// \details Throws std::runtime_error if the mass matrix is not positive
+  ///          definite.
+  const arma::mat & CholeskyFactor(const arma::vec & thetalist);
+
+  /// \brief The Coriolis, centripetal, gravity and friction forces, computed on a miss
+  /// \param thetalist n-vector of joint variables
+  /// \param dthetalist n-vector of joint rates
+  /// \param g Gravity vector g
+  /// \return The n-vector of bias forces, valid until the next call on the cache
+  const arma::vec & Bias(
+    const arma::vec & thetalist,
+    const arma::vec & dthetalist,
+    const arma::vec3 & g
+  );
+
+  /// \brief Computes the inverse dynamics without tip force from the cached terms
+  /// \param thetalist n-vector of joint variables
+  /// \param dthetalist n-vector of joint rates
+  /// \param ddthetalist n-vector of joint accelerations
+  /// \param g Gravity vector g
+  /// \param taulist The n-vector M ddthetalist plus the bias forces, resized if needed
+  void InverseDynamics(
+    const arma::vec & thetalist,
+    const arma::vec & dthetalist,
+    const arma::vec & ddthetalist,
+    const arma::vec3 & g,
+    arma::vec & taulist
+  );
+
+  /// \brief Computes the forward dynamics from the cached terms
+  /// \param thetalist n-vector of joint variables
+  /// \param dthetalist n-vector of joint rates
+  /// \param taulist n-vector of joint forces/torques
+  /// \param g Gravity vector g
+  /// \param Ftip Spatial force applied by the end-effector expressed in frame {n+1}
+  /// \param ddthetalist The n-vector of joint accelerations, resized if needed
+  /// \details Solves L L^T ddthetalist = taulist - c - g - J^T Ftip. The tip
+  ///          force is not part of the cached bias: a nonzero one costs an
+  ///          extra Newton-Euler pass when the bias is reused, and is folded
+  ///          into the uncached pass otherwise. Throws std::runtime_error if the
+  ///          mass matrix is not positive definite.
+  void ForwardDynamics(
+    const arma::vec & thetalist,
+    const arma::vec & dthetalist,
+    const arma::vec & taulist,
+    const arma::vec3 & g,
+    const arma::vec6 & Ftip,
+    arma::vec & ddthetalist
+  );
+
+  /// \brief Drops every cached term
+  void Invalidate();
+
+  /// \brief The number of lookups of a term that were served from the cache
+  size_t hits() const;
+
+  /// \brief The number of lookups of a term that had to compute it
+  size_t misses() const;
+
+private:
+  /// \brief Whether bias_ holds the bias at the arguments, which become its key
+  bool BiasMatches(
+    const arma::vec & thetalist,
+    const arma::vec & dthetalist,
+    const arma::vec3 & g
+  );
+
+  DynamicsWorkspace dynamics_;
+  arma::vec thetaM_; /// The configuration of M_
+  arma::vec thetaL_; /// The configuration of L_
+  arma::vec thetab_; /// The state and gravity of bias_
+  arma::vec dthetab_;
+  arma::vec3 gb_;
+  bool validM_ = false;
+  bool validL_ = false;
+  bool validb_ = false;
+  arma::mat M_;
+  arma::mat L_;
+  arma::vec bias_;
+  arma::vec zeros_;
+  arma::vec tip_; /// The joint forces J^T Ftip
+  size_t hits_ = 0;
+  size_t misses_ = 0;
+};
 } /// namespace mr
 
 #endif /// MODERN_ROBOTICS__DYNAMICS_OF_OPEN_CHAINS___
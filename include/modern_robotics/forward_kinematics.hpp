@@ -2,12 +2,60 @@
 #define MODERN_ROBOTICS__FORWARD_KINEMATICS_HPP___
 
 
+#include <cstdint>
+#include <vector>
 #include <armadillo>
 
 namespace mr
 {
 /// \defgroup forward_kinematics Chapter 4: Forward Kinematics
 
+/// \ingroup forward_kinematics
+/// \brief Joint type deduced from a screw axis
+enum class JointType : uint8_t
+{
+  Revolute, /// unit angular part, exponential by Rodrigues' formula
+  Prismatic, /// zero angular part, exponential is a pure translation
+  General /// any other screw, exponential by MatrixExp6
+};
+
+/// \ingroup forward_kinematics
+/// \brief A joint screw axis classified once, so that the product of
+///        exponentials can dispatch to a specialized closed-form exponential
+struct Joint
+{
+  arma::vec6 S; /// The screw axis of the joint
+  JointType type; /// The joint type deduced from S
+  int axis; /// 0, 1 or 2 when a revolute axis is aligned with x, y or z, -1 otherwise
+};
+
+/// \ingroup forward_kinematics
+/// \brief Classifies a screw axis as a revolute, prismatic or general joint
+/// \param S A screw axis
+/// \return The classified joint
+/// \details A screw with |omega| = 1 is revolute (any pitch), a screw with
+///          omega = 0 is prismatic, anything else is general. Revolute axes
+///          parallel to a coordinate axis are flagged so that only the non-zero
+///          entries of the rotation are written.
+const Joint ClassifyJoint(const arma::vec6 & S);
+
+/// \ingroup forward_kinematics
+/// \brief Classifies every screw axis of an open chain
+/// \param Slist The joint screw axes, in the format of a matrix with axes as
+///              the columns
+/// \return The classified joints, in the same order as Slist
+const std::vector<Joint> ClassifyJoints(const std::vector<arma::vec6> & Slist);
+
+/// \ingroup forward_kinematics
+/// \brief Computes the matrix exponential e^{[S]theta} of a classified joint
+/// \param joint A classified joint
+/// \param theta The joint coordinate
+/// \return The matrix exponential of [S]theta
+/// \details Revolute joints use Rodrigues' formula with a known unit axis and
+///          a single sin/cos evaluation, prismatic joints are a translation by
+///          v theta, general joints fall back to MatrixExp6.
+const arma::mat44 JointExp6(const Joint & joint, const double theta);
+
 /// \ingroup forward_kinematics
 /// \brief Computes forward kinematics in the body frame for an open chain robot
 /// \param M The home configuration (position and orientation) of the end-effector
@@ -39,6 +87,36 @@ const arma::mat44 FKinSpace(
   const std::vector<arma::vec6> & Slist,
   const arma::vec & thetalist
 );
+
+/// \ingroup forward_kinematics
+/// \brief Computes forward kinematics in the body frame for a chain of
+///        classified joints
+/// \param M The home configuration (position and orientation) of the end-effector
+/// \param Blist The classified joint screw axes in the end-effector frame
+/// \param thetalist A list of joint coordinates
+/// \return A homogeneous transformation matrix representing the end-
+///         effector frame when the joints are at the specified coordinates
+///         (i.t.o Body Frame)
+const arma::mat44 FKinBody(
+  const arma::mat44 & M,
+  const std::vector<Joint> & Blist,
+  const arma::vec & thetalist
+);
+
+/// \ingroup forward_kinematics
+/// \brief Computes forward kinematics in the space frame for a chain of
+///        classified joints
+/// \param M The home configuration (position and orientation) of the end-effector
+/// \param Slist The classified joint screw axes in the space frame
+/// \param thetalist A list of joint coordinates
+/// \return A homogeneous transformation matrix representing the end-
+///         effector frame when the joints are at the specified coordinates
+///         (i.t.o Space Frame)
+const arma::mat44 FKinSpace(
+  const arma::mat44 & M,
+  const std::vector<Joint> & Slist,
+  const arma::vec & thetalist
+);
 } /// namespace mr
 
 #endif /// MODERN_ROBOTICS__FORWARD_KINEMATICS_HPP___
@@ -0,0 +1,132 @@
+#ifndef MODERN_ROBOTICS__GAIN_TUNING_HPP___
+#define MODERN_ROBOTICS__GAIN_TUNING_HPP___
+
+#include <cstdint>
+#include <vector>
+#include <armadillo>
+
+namespace mr
+{
+/// \defgroup gain_tuning Computed Torque Gain Tuning
+
+/// \ingroup gain_tuning
+/// \brief The closed-loop simulation a set of gains is scored on
+/// \details The fields are the arguments of SimulateControl other than the gains.
+struct GainTuningProblem
+{
+  arma::vec thetalist; /// n-vector of initial joint variables
+  arma::vec dthetalist; /// n-vector of initial joint velocities
+  arma::vec3 g; /// Actual gravity vector g
+  std::vector<arma::vec6> Ftipmat; /// The spatial tip force at every step
+  std::vector<arma::mat44> Mlist; /// Actual link frames i relative to i-1
+  std::vector<arma::mat66> Glist; /// Actual spatial inertia matrices Gi
+  std::vector<arma::vec6> Slist; /// Screw axes Si of the joints in a space frame
+  std::vector<arma::vec> thetamatd; /// The desired joint variables at every step
+  std::vector<arma::vec> dthetamatd; /// The desired joint velocities at every step
+  std::vector<arma::vec> ddthetamatd; /// The desired joint accelerations at every step
+  arma::vec3 gtilde; /// The gravity vector of the controller's model
+  std::vector<arma::mat44> Mtildelist; /// The link frames of the controller's model
+  std::vector<arma::mat66> Gtildelist; /// The link inertias of the controller's model
+  double dt; /// The timestep between points on the reference trajectory
+  size_t intRes = 1; /// The number of Euler steps per timestep, at least 1
+};
+
+/// \ingroup gain_tuning
+/// \brief Per-joint computed torque gains
+struct ControlGains
+{
+  arma::vec kp; /// The proportional gain of every joint
+  arma::vec ki; /// The integral gain of every joint
+  arma::vec kd; /// The derivative gain of every joint
+};
+
+/// \ingroup gain_tuning
+/// \brief The scores of one set of gains
+struct GainScore
+{
+  ControlGains gains; /// The gains
+  double tracking_error; /// The RMS joint error over the trajectory, inf if unstable
+  double effort; /// The RMS joint torque over the trajectory, inf if unstable
+};
+
+/// \ingroup gain_tuning
+/// \brief Every evaluated set of gains and the Pareto front among them
+struct GainTuningResult
+{
+  std::vector<GainScore> candidates; /// The evaluated gains, in evaluation order
+  std::vector<size_t> pareto; /// The indices of the candidates no other
+                              /// candidate beats in both scores, by
+                              /// increasing tracking error
+};
+
+/// \ingroup gain_tuning
+/// \brief Settings of the evolution strategy of GainSearch
+struct GainSearchOptions
+{
+  /// The gains the search starts from; every gain must be positive
+  ControlGains initial;
+  /// The initial step size, in the natural logarithm of the gains
+  double sigma = 0.5;
+  /// The number of candidates per generation, at least 2
+  size_t population = 16;
+  /// The number of generations
+  size_t generations = 20;
+  /// The weight of the effort against the tracking error in the fitness
+  double effort_weight = 1e-3;
+  /// The seed of the random number generator, for reproducible searches
+  uint64_t random_seed = 0;
+  /// The number of worker threads, 0 to use one per hardware thread
+  size_t num_threads = 0;
+};
+
+/// \ingroup gain_tuning
+/// \brief Builds a grid of gains identical for each joint
+/// \param n The number of joints
+/// \param kp The proportional gains to try
+/// \param ki The integral gains to try
+/// \param kd The derivative gains to try
+/// \return One set of gains per combination, with kp varying fastest
+const std::vector<ControlGains> GainGrid(
+  const size_t n,
+  const std::vector<double> & kp,
+  const std::vector<double> & ki,
+  const std::vector<double> & kd
+);
+
+/// \ingroup gain_tuning
+/// \brief Scores sets of gains on the closed-loop simulation in parallel
+/// \param problem The closed-loop simulation
+/// \param candidates The gains to score
+/// \param num_threads The number of worker threads, 0 to use one per hardware thread
+/// \return The scores of every candidate and their Pareto front
+/// \details Runs the same loop as SimulateControl with a
+///          ComputedTorqueController and a DynamicsWorkspace plant. Each worker
+///          owns one controller and one plant, so the robot models are set up
+///          once per thread rather than once per step. The tracking error is
+///          measured after every timestep, like the eint update of
+///          SimulateControl. Throws std::invalid_argument if the problem is
+///          inconsistent.
+const GainTuningResult GainSweep(
+  const GainTuningProblem & problem,
+  const std::vector<ControlGains> & candidates,
+  const size_t num_threads = 0
+);
+
+/// \ingroup gain_tuning
+/// \brief Searches for gains with a separable CMA-ES
+/// \param problem The closed-loop simulation
+/// \param options The search settings
+/// \return Every candidate evaluated during the search and their Pareto front
+/// \details Searches the logarithm of the gains, so they stay positive, with a
+///          diagonal covariance and cumulative step-size adaptation. Each
+///          generation is scored in parallel as in GainSweep, ranked by
+///          tracking_error + effort_weight * effort. Throws
+///          std::invalid_argument if the initial gains are not positive or do
+///          not have one entry per joint.
+const GainTuningResult GainSearch(
+  const GainTuningProblem & problem,
+  const GainSearchOptions & options
+);
+}
+
+#endif /// MODERN_ROBOTICS__GAIN_TUNING_HPP___
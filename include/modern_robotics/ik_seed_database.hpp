@@ -0,0 +1,131 @@
+#ifndef MODERN_ROBOTICS__IK_SEED_DATABASE_HPP___
+#define MODERN_ROBOTICS__IK_SEED_DATABASE_HPP___
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <armadillo>
+
+#include "modern_robotics/utils.hpp"
+#include "modern_robotics/inverse_kinematics.hpp"
+
+namespace mr
+{
+/// \defgroup ik_seed_database Inverse Kinematics Seed Databases
+
+/// \ingroup ik_seed_database
+/// \brief Settings for sampling an inverse kinematics seed database
+struct IKSeedDatabaseOptions
+{
+  /// The lower bounds joint samples are drawn from, one per joint
+  arma::vec lower;
+  /// The upper bounds joint samples are drawn from, one per joint
+  arma::vec upper;
+  /// The number of joint samples
+  size_t num_samples = 10000;
+  /// The seed of the random number generator, for reproducible databases
+  uint64_t random_seed = 0;
+  /// The length, in the units of the screw axes, that one radian of
+  /// orientation difference counts as in the pose distance
+  double orientation_weight = 0.1;
+  /// The number of worker threads, 0 to use one per hardware thread
+  size_t num_threads = 0;
+};
+
+/// \ingroup ik_seed_database
+/// \brief Sampled (pose, joint) pairs stored as an implicit kd-tree
+/// \details Every record holds the end-effector position, its orientation as
+///          a unit quaternion (w, x, y, z) and the joint coordinates, so a
+///          record is 7 + num_joints doubles. Records are ordered as a
+///          balanced kd-tree over the position: the root of the range
+///          [lo, hi) is its middle record, and the split axis cycles through
+///          x, y and z with the depth.
+struct IKSeedDatabase
+{
+  size_t num_joints; /// The number of joints of every record
+  double orientation_weight; /// The length one radian of orientation counts as
+  std::vector<double> records; /// The records in kd-tree order
+};
+
+/// \ingroup ik_seed_database
+/// \brief Samples the joint space and builds a seed database
+/// \param list The joint screw axes at the home position, Blist or Slist
+///             depending on frame
+/// \param M The home configuration of the end-effector
+/// \param frame The frame the screw axes are expressed in
+/// \param options The sampling settings
+/// \return The seed database
+/// \details The forward kinematics of all samples run in parallel. Throws
+///          std::invalid_argument if the bounds do not have one entry per joint.
+const IKSeedDatabase BuildIKSeedDatabase(
+  const std::vector<arma::vec6> & list,
+  const arma::mat44 & M,
+  const IKFrame frame,
+  const IKSeedDatabaseOptions & options
+);
+
+/// \ingroup ik_seed_database
+/// \brief Finds the sampled joint coordinates whose pose is nearest to T
+/// \param database The seed database
+/// \param T The desired end-effector configuration Tsd
+/// \return The joint coordinates of the nearest record, an initial guess for
+///         IKinSpace or IKinBody
+/// \details The distance is sqrt(|dp|^2 + (orientation_weight * dangle)^2).
+///          The kd-tree prunes on the position alone, which never exceeds the
+///          full distance, so the result is exact. Throws std::runtime_error if
+///          the database is empty.
+const arma::vec NearestIKSeed(const IKSeedDatabase & database, const arma::mat44 & T);
+
+/// \ingroup ik_seed_database
+/// \brief Writes a seed database to a binary file
+/// \param database The seed database
+/// \param filename The path of the file to write
+/// \details The file holds a fixed header followed by the records as float64,
+///          all 8-byte aligned so that the file can be memory-mapped by
+///          IKSeedDatabaseView. Throws std::runtime_error if the file cannot be
+///          written.
+void SaveIKSeedDatabase(const IKSeedDatabase & database, const std::string & filename);
+
+/// \ingroup ik_seed_database
+/// \brief Read-only, memory-mapped view of a seed database file
+class IKSeedDatabaseView
+{
+public:
+  /// \brief Maps a file written by SaveIKSeedDatabase
+  /// \param filename The path of the seed database file
+  /// \details Throws std::runtime_error if the file cannot be opened or is not
+  ///          a seed database file.
+  explicit IKSeedDatabaseView(const std::string & filename);
+
+  IKSeedDatabaseView(const IKSeedDatabaseView &) = delete;
+  IKSeedDatabaseView & operator=(const IKSeedDatabaseView &) = delete;
+  IKSeedDatabaseView(IKSeedDatabaseView && other) noexcept;
+  IKSeedDatabaseView & operator=(IKSeedDatabaseView && other) noexcept;
+  ~IKSeedDatabaseView();
+
+  /// \brief The number of joints of every record
+  size_t num_joints() const;
+
+  /// \brief The length one radian of orientation difference counts as
+  double orientation_weight() const;
+
+  /// \brief The number of records
+  size_t size() const;
+
+  /// \brief Finds the sampled joint coordinates whose pose is nearest to T
+  /// \param T The desired end-effector configuration Tsd
+  /// \return The joint coordinates of the nearest record
+  /// \details Same as NearestIKSeed, reading the records in place. Throws
+  ///          std::runtime_error if the database is empty.
+  const arma::vec Nearest(const arma::mat44 & T) const;
+
+private:
+  MappedFile file_;
+  size_t num_joints_ = 0;
+  double orientation_weight_ = 0.0;
+  const double * records_ = nullptr;
+  size_t size_ = 0;
+};
+}
+
+#endif /// MODERN_ROBOTICS__IK_SEED_DATABASE_HPP___
@@ -2,6 +2,13 @@
 #define MODERN_ROBOTICS__INVERSE_KINEMATICS_HPP___
 
 #include <armadillo>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
 #include <vector>
 #include <utility>
 
@@ -9,6 +16,74 @@ namespace mr
 {
 /// \defgroup inverse_kinematics Chapter 6: Inverse Kinematics
 
+/// \ingroup inverse_kinematics
+/// \brief Settings of an iterative inverse kinematics solve
+struct IKOptions
+{
+  /// The maximum number of iterations
+  size_t max_iterations = 20;
+  /// The wall-clock budget of the solve in seconds
+  double time_budget = std::numeric_limits<double>::infinity();
+  /// The tolerance on the norm of the angular part of the error twist
+  double eomg = 1e-3;
+  /// The tolerance on the norm of the linear part of the error twist
+  double ev = 1e-3;
+  /// The largest change of any joint in one iteration; longer steps are
+  /// scaled down along their direction
+  double max_step = std::numeric_limits<double>::infinity();
+  /// The lower joint limits, one per joint, or empty for no limits
+  arma::vec lower;
+  /// The upper joint limits, one per joint, or empty for no limits
+  arma::vec upper;
+  /// Writes a secondary joint motion z at thetalist into its second argument,
+  /// e.g. a gain times ManipulabilityGradient; the damped least-squares
+  /// solvers follow it in the null space of the Jacobian. Empty for none.
+  /// IKinPath and IKinMultiStart call it from several threads at once.
+  std::function<void(const arma::vec & thetalist, arma::vec & z)> null_space;
+};
+
+/// \ingroup inverse_kinematics
+/// \brief Whether a joint of an inverse kinematics solution sits on a limit
+enum class JointLimitStatus : int8_t
+{
+  AtLower = -1, /// the joint is on its lower limit
+  Free = 0, /// the joint is strictly inside its limits
+  AtUpper = 1 /// the joint is on its upper limit
+};
+
+/// \ingroup inverse_kinematics
+/// \brief Why an iterative inverse kinematics solve stopped
+enum class IKTermination : uint8_t
+{
+  Converged, /// the tolerances were met
+  MaxIterations, /// the iteration limit was reached
+  Timeout, /// the time budget ran out
+  Stalled, /// no step could reduce the error any further
+  Cancelled /// another thread asked the solve to stop
+};
+
+/// \ingroup inverse_kinematics
+/// \brief The frame the joint screw axes of a solver are expressed in
+enum class IKFrame : uint8_t
+{
+  Body, /// Blist, in the end-effector frame
+  Space /// Slist, in the space frame
+};
+
+/// \ingroup inverse_kinematics
+/// \brief The outcome of an iterative inverse kinematics solve
+struct IKResult
+{
+  arma::vec thetalist; /// The final joint angles
+  bool success; /// true if the tolerances were met
+  size_t iterations; /// The number of iterations used
+  double angular_error; /// The norm of the angular part of the final error twist
+  double linear_error; /// The norm of the linear part of the final error twist
+  double wall_time; /// The wall-clock duration of the solve in seconds
+  IKTermination termination; /// Why the solve stopped
+  std::vector<JointLimitStatus> limits; /// The limit status of every joint
+};
+
 /// \ingroup inverse_kinematics
 /// \brief Computes inverse kinematics in the body frame for an open chain robot
 /// \param Blist The joint screw axes in the end-effector frame when the
@@ -72,6 +147,360 @@ const std::pair<const arma::vec, bool> IKinSpace(
   const double emog,
   const double ev
 );
+
+/// \ingroup inverse_kinematics
+/// \brief Computes inverse kinematics in the body frame with configurable limits
+/// \param Blist The joint screw axes in the end-effector frame when the
+///              manipulator is at the home position, in the format of a
+///              matrix with axes as the columns
+/// \param M The home configuration of the end-effector
+/// \param T The desired end-effector configuration Tsd
+/// \param thetalist0 An initial guess of joint angles that are close to satisfying Tsd
+/// \param options The iteration limit, time budget, tolerances and step limit
+/// \return The joint angles together with the statistics of the solve
+/// \details Uses the same Newton-Raphson iteration as the overload taking
+///          emog and ev. Joint limits are enforced by projecting every
+///          iterate onto them; IKinBodyDLS handles them more accurately.
+const IKResult IKinBody(
+  const std::vector<arma::vec6> & Blist,
+  const arma::mat44 & M,
+  const arma::mat44 & T,
+  const arma::vec & thetalist0,
+  const IKOptions & options
+);
+
+/// \ingroup inverse_kinematics
+/// \brief Computes inverse kinematics in the space frame with configurable limits
+/// \param Slist The joint screw axes in the space frame when the
+///              manipulator is at the home position, in the format of a
+///              matrix with axes as the columns
+/// \param M The home configuration of the end-effector
+/// \param T The desired end-effector configuration Tsd
+/// \param thetalist0 An initial guess of joint angles that are close to satisfying Tsd
+/// \param options The iteration limit, time budget, tolerances and step limit
+/// \return The joint angles together with the statistics of the solve
+/// \details Uses the same Newton-Raphson iteration as the overload taking
+///          emog and ev. Joint limits are enforced by projecting every
+///          iterate onto them; IKinSpaceDLS handles them more accurately.
+const IKResult IKinSpace(
+  const std::vector<arma::vec6> & Slist,
+  const arma::mat44 & M,
+  const arma::mat44 & T,
+  const arma::vec & thetalist0,
+  const IKOptions & options
+);
+
+/// \ingroup inverse_kinematics
+/// \brief Computes inverse kinematics in the body frame with damped least squares
+/// \param Blist The joint screw axes in the end-effector frame when the
+///              manipulator is at the home position, in the format of a
+///              matrix with axes as the columns
+/// \param M The home configuration of the end-effector
+/// \param T The desired end-effector configuration Tsd
+/// \param thetalist0 An initial guess of joint angles that are close to satisfying Tsd
+/// \param emog A small positive tolerance on the end-effector orientation error
+/// \param ev A small positive tolerance on the end-effector linear position error
+/// \return The joint angles, success flag, iteration count and final residuals
+/// \details Levenberg-Marquardt iteration: every step solves
+///          (Jb Jb^T + lambda^2 I) x = Vb with a 6x6 Cholesky factorization and
+///          moves by Jb^T x. lambda^2 shrinks after steps that reduce the error
+///          and grows after steps that do not, so the step stays bounded near
+///          singularities. The maximum number of iterations is hardcoded to 50.
+const IKResult IKinBodyDLS(
+  const std::vector<arma::vec6> & Blist,
+  const arma::mat44 & M,
+  const arma::mat44 & T,
+  const arma::vec & thetalist0,
+  const double emog,
+  const double ev
+);
+
+/// \ingroup inverse_kinematics
+/// \brief Computes inverse kinematics in the space frame with damped least squares
+/// \param Slist The joint screw axes in the space frame when the
+///              manipulator is at the home position, in the format of a
+///              matrix with axes as the columns
+/// \param M The home configuration of the end-effector
+/// \param T The desired end-effector configuration Tsd
+/// \param thetalist0 An initial guess of joint angles that are close to satisfying Tsd
+/// \param emog A small positive tolerance on the end-effector orientation error
+/// \param ev A small positive tolerance on the end-effector linear position error
+/// \return The joint angles, success flag, iteration count and final residuals
+/// \details The space-frame counterpart of IKinBodyDLS, solving
+///          (Js Js^T + lambda^2 I) x = Vs.
+const IKResult IKinSpaceDLS(
+  const std::vector<arma::vec6> & Slist,
+  const arma::mat44 & M,
+  const arma::mat44 & T,
+  const arma::vec & thetalist0,
+  const double emog,
+  const double ev
+);
+
+/// \ingroup inverse_kinematics
+/// \brief Computes damped least-squares inverse kinematics in the body frame
+///        with configurable limits
+/// \param Blist The joint screw axes in the end-effector frame when the
+///              manipulator is at the home position, in the format of a
+///              matrix with axes as the columns
+/// \param M The home configuration of the end-effector
+/// \param T The desired end-effector configuration Tsd
+/// \param thetalist0 An initial guess of joint angles that are close to satisfying Tsd
+/// \param options The iteration limit, time budget, tolerances and step limit
+/// \return The joint angles together with the statistics of the solve
+/// \details Rejected trial steps count as iterations. The solve reports
+///          IKTermination::Stalled once the damping has grown so large that
+///          no further progress is possible. With joint limits, every step
+///          solves the damped least-squares problem inside the box
+///          lower <= thetalist + dtheta <= upper by an active-set iteration:
+///          joints whose step leaves the box are pinned to the limit and the
+///          step is re-solved for the remaining joints. A secondary motion
+///          from options.null_space is added in the null space of the
+///          Jacobian with the same factorization; it shapes the path to the
+///          solution and the solve still stops once the tolerances are met,
+///          so a redundant arm ends in the solution the secondary objective
+///          favours along the way. Throws
+///          std::invalid_argument if the limits do not have one entry per joint.
+const IKResult IKinBodyDLS(
+  const std::vector<arma::vec6> & Blist,
+  const arma::mat44 & M,
+  const arma::mat44 & T,
+  const arma::vec & thetalist0,
+  const IKOptions & options
+);
+
+/// \ingroup inverse_kinematics
+/// \brief Computes damped least-squares inverse kinematics in the space frame
+///        with configurable limits
+/// \param Slist The joint screw axes in the space frame when the
+///              manipulator is at the home position, in the format of a
+///              matrix with axes as the columns
+/// \param M The home configuration of the end-effector
+/// \param T The desired end-effector configuration Tsd
+/// \param thetalist0 An initial guess of joint angles that are close to satisfying Tsd
+/// \param options The iteration limit, time budget, tolerances and step limit
+/// \return The joint angles together with the statistics of the solve
+const IKResult IKinSpaceDLS(
+  const std::vector<arma::vec6> & Slist,
+  const arma::mat44 & M,
+  const arma::mat44 & T,
+  const arma::vec & thetalist0,
+  const IKOptions & options
+);
+
+/// \ingroup inverse_kinematics
+/// \brief Checks the joint limits of inverse kinematics options
+/// \param options The options with the lower and upper joint limits
+/// \param n The number of joints
+/// \details Throws std::invalid_argument unless the limits are either both
+///          empty or both have one entry per joint.
+void CheckJointLimits(const IKOptions & options, const size_t n);
+
+/// \ingroup inverse_kinematics
+/// \brief Computes the limit status of every joint of a solution
+/// \param thetalist The joint angles of the solution
+/// \param options The options with joint limits accepted by CheckJointLimits
+/// \param limits Resized to one status per joint, all Free without limits
+/// \details A joint within 1e-9 of a limit counts as on it.
+void JointLimitStatuses(
+  const arma::vec & thetalist,
+  const IKOptions & options,
+  std::vector<JointLimitStatus> & limits
+);
+
+/// \ingroup inverse_kinematics
+/// \brief Deadline-bounded damped least-squares inverse kinematics for real-time loops
+/// \details The constructor classifies the joints and allocates every buffer
+///          the iteration needs; Solve then runs the same Levenberg-Marquardt
+///          iteration as IKinBodyDLS/IKinSpaceDLS without any heap allocation.
+///          Steps are only accepted when they reduce the error, so the iterate
+///          returned on a timeout is the best one found.
+class RealTimeIK
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  /// \brief Prepares a solver for one robot
+  /// \param list The joint screw axes at the home position, Blist or Slist
+  ///             depending on frame
+  /// \param M The home configuration of the end-effector
+  /// \param frame The frame the screw axes are expressed in
+  /// \param options The iteration limit, time budget, tolerances and step limit
+  RealTimeIK(
+    const std::vector<arma::vec6> & list,
+    const arma::mat44 & M,
+    const IKFrame frame,
+    const IKOptions & options = IKOptions()
+  );
+
+  RealTimeIK(RealTimeIK && other) noexcept;
+  RealTimeIK & operator=(RealTimeIK && other) noexcept;
+  ~RealTimeIK();
+
+  /// \brief Solves for a target within the time budget of the options
+  /// \param T The desired end-effector configuration Tsd
+  /// \param thetalist0 An initial guess with one entry per joint
+  /// \return The solution and statistics, valid until the next call to Solve
+  const IKResult & Solve(const arma::mat44 & T, const arma::vec & thetalist0);
+
+  /// \brief Solves for a target before an absolute deadline
+  /// \param T The desired end-effector configuration Tsd
+  /// \param thetalist0 An initial guess with one entry per joint
+  /// \param deadline The monotonic-clock time at which the solve must stop
+  /// \return The solution and statistics, valid until the next call to Solve
+  /// \details The time budget of the options is ignored. Throws
+  ///          std::invalid_argument if thetalist0 has the wrong size.
+  const IKResult & Solve(
+    const arma::mat44 & T,
+    const arma::vec & thetalist0,
+    const Clock::time_point deadline
+  );
+
+  /// \brief Solves for a target before an absolute deadline or until cancelled
+  /// \param T The desired end-effector configuration Tsd
+  /// \param thetalist0 An initial guess with one entry per joint
+  /// \param deadline The monotonic-clock time at which the solve must stop
+  /// \param cancel A flag another thread sets to stop the solve
+  /// \return The solution and statistics, valid until the next call to Solve
+  /// \details The flag is checked before every iteration; a solve that sees
+  ///          it set ends with IKTermination::Cancelled.
+  const IKResult & Solve(
+    const arma::mat44 & T,
+    const arma::vec & thetalist0,
+    const Clock::time_point deadline,
+    const std::atomic<bool> & cancel
+  );
+
+  /// \brief The options used by Solve
+  const IKOptions & options() const;
+
+private:
+  /// \brief Runs the iteration, cancellable if cancel is not null
+  const IKResult & Iterate(
+    const arma::mat44 & T,
+    const arma::vec & thetalist0,
+    const Clock::time_point deadline,
+    const std::atomic<bool> * cancel
+  );
+
+  struct Workspace;
+  std::unique_ptr<Workspace> workspace_;
+  IKResult result_;
+};
+
+/// \ingroup inverse_kinematics
+/// \brief Settings of an inverse kinematics solve along a path of poses
+struct PathIKOptions
+{
+  /// The settings of the solve at every pose
+  IKOptions ik;
+  /// The largest change of any joint between consecutive poses; larger
+  /// changes are reported as discontinuities
+  double max_joint_step = 0.5;
+  /// The number of poses solved serially by one worker, 0 to solve the
+  /// whole path on the calling thread
+  size_t segment_length = 64;
+  /// The number of worker threads, 0 to use one per hardware thread
+  size_t num_threads = 0;
+};
+
+/// \ingroup inverse_kinematics
+/// \brief The joint trajectory found along a path of poses
+struct PathIKResult
+{
+  std::vector<arma::vec> thetamat; /// The joint angles at every pose, in path order
+  std::vector<size_t> failures; /// The poses at which the solve did not converge
+  std::vector<size_t> discontinuities; /// Poses more than max_joint_step from the previous one
+  bool success; /// true if every pose converged without discontinuities
+};
+
+/// \ingroup inverse_kinematics
+/// \brief Computes inverse kinematics along a path of end-effector poses
+/// \param list The joint screw axes at the home position, Blist or Slist
+///             depending on frame
+/// \param M The home configuration of the end-effector
+/// \param frame The frame the screw axes are expressed in
+/// \param traj The end-effector poses, e.g. from ScrewTrajectory or CartesianTrajectory
+/// \param thetalist0 An initial guess of joint angles that are close to satisfying traj[0]
+/// \param options The per-pose solve settings, continuity threshold and parallelism
+/// \return The joint trajectory, with one entry per pose
+/// \details The path is cut into segments of segment_length poses. A serial
+///          pass first solves the head of every segment, each seeded from the
+///          solution at the previous head and the first from thetalist0. The
+///          segments are then solved in parallel with RealTimeIK, each pose
+///          warm-started from the previous solution. A serial stitching pass
+///          finally re-solves the head of every segment
+///          from the end of the previous one until it rejoins the same branch,
+///          so branch flips at segment boundaries do not reach the output.
+const PathIKResult IKinPath(
+  const std::vector<arma::vec6> & list,
+  const arma::mat44 & M,
+  const IKFrame frame,
+  const std::vector<arma::mat44> & traj,
+  const arma::vec & thetalist0,
+  const PathIKOptions & options = PathIKOptions()
+);
+
+/// \ingroup inverse_kinematics
+/// \brief Settings of a multi-start inverse kinematics solve
+struct MultiStartIKOptions
+{
+  /// The settings of the solve from every seed
+  IKOptions ik;
+  /// Explicit initial guesses; random seeds are drawn when empty
+  std::vector<arma::vec> seeds;
+  /// The number of random seeds drawn when seeds is empty
+  size_t num_seeds = 16;
+  /// The lower bounds random seeds are drawn from; ik.lower when empty, or
+  /// -pi when both are empty
+  arma::vec lower;
+  /// The upper bounds random seeds are drawn from; ik.upper when empty, or
+  /// pi when both are empty
+  arma::vec upper;
+  /// The state of the random number generator drawing the seeds
+  uint64_t random_seed = 0;
+  /// true to solve every seed and collect all distinct solutions instead of
+  /// stopping at the first one that converges
+  bool collect_all = false;
+  /// The largest joint difference under which two solutions are the same
+  double distinct_tolerance = 1e-3;
+  /// The number of worker threads, 0 to use one per hardware thread
+  size_t num_threads = 0;
+};
+
+/// \ingroup inverse_kinematics
+/// \brief The outcome of a multi-start inverse kinematics solve
+struct MultiStartIKResult
+{
+  IKResult best; /// The first converged solve, or the one with the smallest error
+  std::vector<arma::vec> solutions; /// The distinct converged solutions, in seed order
+  size_t attempts; /// The number of seeds that were solved
+};
+
+/// \ingroup inverse_kinematics
+/// \brief Computes inverse kinematics from many initial guesses in parallel
+/// \param list The joint screw axes at the home position, Blist or Slist
+///             depending on frame
+/// \param M The home configuration of the end-effector
+/// \param frame The frame the screw axes are expressed in
+/// \param T The desired end-effector configuration Tsd
+/// \param options The seeds, per-seed solve settings and parallelism
+/// \return The best solve, the distinct solutions and the number of attempts
+/// \details Each worker owns a RealTimeIK workspace and takes seeds from a
+///          shared counter. Unless collect_all is set, the first solve that
+///          converges cancels the solves still in flight, which end at their
+///          next iteration and do not count as attempts. Every call starts
+///          its worker threads and allocates their workspaces, so it is not
+///          meant for a real-time loop; use RealTimeIK there. Throws
+///          std::invalid_argument if the seeds or joint limits do not have
+///          one entry per joint.
+const MultiStartIKResult IKinMultiStart(
+  const std::vector<arma::vec6> & list,
+  const arma::mat44 & M,
+  const IKFrame frame,
+  const arma::mat44 & T,
+  const MultiStartIKOptions & options = MultiStartIKOptions()
+);
 }
 
 #endif
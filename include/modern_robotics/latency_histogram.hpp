@@ -0,0 +1,171 @@
+#ifndef MODERN_ROBOTICS__LATENCY_HISTOGRAM_HPP___
+#define MODERN_ROBOTICS__LATENCY_HISTOGRAM_HPP___
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mr
+{
+/// \defgroup latency_histogram Latency Histograms
+
+/// \ingroup latency_histogram
+/// \brief The contents of a LatencyHistogram at one instant, durations in seconds
+struct LatencySnapshot
+{
+  std::string name; /// The name the histogram was registered under
+  uint64_t count = 0; /// The number of recorded durations
+  double min = 0.0; /// The shortest duration
+  double max = 0.0; /// The longest duration
+  double mean = 0.0; /// The mean duration
+  double p50 = 0.0; /// The median
+  double p90 = 0.0; /// The 90th percentile
+  double p99 = 0.0; /// The 99th percentile
+  double p999 = 0.0; /// The 99.9th percentile
+  /// The non-empty buckets as pairs of the longest duration they hold and
+  /// their count, by increasing duration
+  std::vector<std::pair<double, uint64_t>> buckets;
+};
+
+/// \ingroup latency_histogram
+/// \brief Lock-free histogram of durations with bounded relative error
+/// \details Buckets durations in nanoseconds on the log-linear scale of HDR
+///          histograms: exact below 128 ns, then 64 buckets per power of two,
+///          so every duration up to about 18 minutes is kept to within 1.6%.
+///          Longer ones are clamped. Record only performs relaxed atomic
+///          increments, so any number of threads may record while others take
+///          snapshots, and no thread ever waits.
+class LatencyHistogram
+{
+public:
+  /// \brief Sets up an empty histogram
+  /// \param name The name shown in snapshots and reports
+  explicit LatencyHistogram(const std::string & name = "");
+
+  /// \brief The name shown in snapshots and reports
+  const std::string & name() const;
+
+  /// \brief Records one duration
+  /// \param nanoseconds The duration in nanoseconds
+  void Record(const uint64_t nanoseconds);
+
+  /// \brief Records one duration
+  /// \param duration The duration
+  void Record(const std::chrono::steady_clock::duration duration);
+
+  /// \brief The number of recorded durations
+  uint64_t count() const;
+
+  /// \brief Computes a percentile from the current counts
+  /// \param q The fraction of durations at or below the result, 0 to 1
+  /// \return The longest duration of the bucket holding the percentile,
+  ///         clamped to the longest recorded duration, in seconds, or 0 if
+  ///         nothing was recorded
+  double Percentile(const double q) const;
+
+  /// \brief Copies the current counts without stopping the recording threads
+  /// \return The statistics and non-empty buckets of the histogram
+  /// \details Durations recorded during the copy may be partially included.
+  const LatencySnapshot Snapshot() const;
+
+  /// \brief Clears all counts
+  /// \details Durations recorded during the reset may be partially kept.
+  void Reset();
+
+private:
+  static constexpr unsigned kSubBits = 7;
+  static constexpr unsigned kMaxBits = 40;
+  static constexpr size_t kHalf = size_t{1} << (kSubBits - 1);
+  static constexpr size_t kBuckets = (kMaxBits - kSubBits + 2) * kHalf;
+
+  /// \brief The bucket of a duration in nanoseconds
+  static size_t Index(const uint64_t nanoseconds);
+
+  /// \brief The longest duration in nanoseconds a bucket holds
+  static uint64_t Upper(const size_t index);
+
+  std::string name_;
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> sum_{0};
+  std::atomic<uint64_t> min_;
+  std::atomic<uint64_t> max_{0};
+  std::atomic<uint64_t> counts_[kBuckets];
+};
+
+/// \ingroup latency_histogram
+/// \brief Records the lifetime of a scope into a LatencyHistogram
+class LatencyTimer
+{
+public:
+  /// \brief Starts timing
+  /// \param histogram The histogram the duration is recorded into
+  explicit LatencyTimer(LatencyHistogram & histogram)
+  : histogram_(histogram),
+    start_(std::chrono::steady_clock::now())
+  {
+  }
+
+  /// \brief Records the time since construction
+  ~LatencyTimer()
+  {
+    histogram_.Record(std::chrono::steady_clock::now() - start_);
+  }
+
+  LatencyTimer(const LatencyTimer &) = delete;
+  LatencyTimer & operator=(const LatencyTimer &) = delete;
+
+private:
+  LatencyHistogram & histogram_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+/// \ingroup latency_histogram
+/// \brief Finds or creates the process-wide histogram of a name
+/// \param name The name of the histogram
+/// \return The histogram, which lives until the process exits
+/// \details Takes a lock, so call it once per site, not per measurement;
+///          MR_LATENCY_SCOPE keeps the result in a function-local static.
+LatencyHistogram & RegisterLatencyHistogram(const std::string & name);
+
+/// \ingroup latency_histogram
+/// \brief Takes snapshots of all registered histograms
+/// \return One snapshot per histogram, in the order of registration
+/// \details Never blocks threads that are recording.
+const std::vector<LatencySnapshot> LatencySnapshots();
+
+/// \ingroup latency_histogram
+/// \brief Clears all registered histograms
+void ResetLatencyHistograms();
+
+/// \ingroup latency_histogram
+/// \brief Formats snapshots as a table, durations in microseconds
+/// \param snapshots The snapshots
+/// \return One line per snapshot with its count, min, mean, percentiles and max
+const std::string LatencyReport(const std::vector<LatencySnapshot> & snapshots);
+
+/// \ingroup latency_histogram
+/// \brief Formats snapshots as JSON, durations in seconds
+/// \param snapshots The snapshots
+/// \return An object with a "histograms" array holding every field of every
+///         snapshot, the buckets as [duration, count] pairs
+const std::string LatencyReportJson(const std::vector<LatencySnapshot> & snapshots);
+}
+
+/// \ingroup latency_histogram
+/// \brief Records the latency of the enclosing scope into the registered
+///        histogram of a name
+/// \details Compiles to nothing unless MODERN_ROBOTICS_LATENCY_HISTOGRAMS is
+///          defined, which the MR_LATENCY_HISTOGRAMS CMake option does for
+///          the library's own hot entry points.
+#ifdef MODERN_ROBOTICS_LATENCY_HISTOGRAMS
+#define MR_LATENCY_SCOPE(name) \
+  static ::mr::LatencyHistogram & mr_latency_histogram = ::mr::RegisterLatencyHistogram(name); \
+  const ::mr::LatencyTimer mr_latency_timer(mr_latency_histogram)
+#else
+#define MR_LATENCY_SCOPE(name) static_cast<void>(0)
+#endif
+
+#endif /// MODERN_ROBOTICS__LATENCY_HISTOGRAM_HPP___
@@ -0,0 +1,159 @@
+#ifndef MODERN_ROBOTICS__MANIPULABILITY_MAP_HPP___
+#define MODERN_ROBOTICS__MANIPULABILITY_MAP_HPP___
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <armadillo>
+
+#include "modern_robotics/utils.hpp"
+#include "modern_robotics/velocity_kinematics_and_statics.hpp"
+
+namespace mr
+{
+/// \defgroup manipulability_map Workspace Manipulability Maps
+
+/// \ingroup manipulability_map
+/// \brief One axis of a regular grid
+/// \details The grid values along the axis are lower + i * (upper - lower) / (count - 1)
+///          for i in [0, count); a single-point axis only holds lower.
+struct GridAxis
+{
+  double lower; /// The first grid value
+  double upper; /// The last grid value
+  uint64_t count; /// The number of grid values, at least 1
+};
+
+/// \ingroup manipulability_map
+/// \brief The space a manipulability map is sampled over
+enum class GridSpace : uint32_t
+{
+  Joint, /// one grid axis per joint coordinate
+  Cartesian /// three grid axes for the end-effector position x, y, z
+};
+
+/// \ingroup manipulability_map
+/// \brief Manipulability measures sampled over a regular grid
+/// \details Cells are stored with the first axis varying fastest. Cartesian
+///          cells that the inverse kinematics could not reach hold NaN.
+struct ManipulabilityMap
+{
+  GridSpace space; /// The space the grid axes live in
+  ManipulabilityPart part; /// The rows of the Jacobian the measures describe
+  std::vector<GridAxis> axes; /// The grid axes
+  std::vector<ManipulabilityMeasures> cells; /// The measures at every grid point
+};
+
+/// \ingroup manipulability_map
+/// \brief Computes the grid value of every axis at a flat cell index
+/// \param axes The grid axes
+/// \param index A flat cell index, with the first axis varying fastest
+/// \return The grid point, one value per axis
+const arma::vec GridPoint(const std::vector<GridAxis> & axes, const size_t index);
+
+/// \ingroup manipulability_map
+/// \brief Evaluates manipulability measures over a joint-space grid in parallel
+/// \param Blist The joint screw axes in the end-effector frame when the
+///              manipulator is at the home position, in the format of a
+///              matrix with axes as the columns
+/// \param axes One grid axis per joint
+/// \param part The rows of the body Jacobian the measures describe
+/// \param num_threads The number of worker threads, 0 to use one per hardware thread
+/// \return The manipulability map
+const ManipulabilityMap JointManipulabilityMap(
+  const std::vector<arma::vec6> & Blist,
+  const std::vector<GridAxis> & axes,
+  const ManipulabilityPart part = ManipulabilityPart::Twist,
+  const size_t num_threads = 0
+);
+
+/// \ingroup manipulability_map
+/// \brief Evaluates manipulability measures over a grid of end-effector
+///        positions in parallel
+/// \param Blist The joint screw axes in the end-effector frame when the
+///              manipulator is at the home position, in the format of a
+///              matrix with axes as the columns
+/// \param M The home configuration of the end-effector
+/// \param R The end-effector orientation held at every grid point
+/// \param axes Three grid axes for the x, y and z positions
+/// \param thetalist0 The initial guess used by the inverse kinematics at every grid point
+/// \param eomg The orientation tolerance of the inverse kinematics
+/// \param ev The position tolerance of the inverse kinematics
+/// \param part The rows of the body Jacobian the measures describe
+/// \param num_threads The number of worker threads, 0 to use one per hardware thread
+/// \return The manipulability map, with NaN measures at unreachable points
+/// \details Each grid point is solved with IKinBody and the measures are
+///          evaluated at the solution. Throws std::invalid_argument unless
+///          there are exactly three axes.
+const ManipulabilityMap CartesianManipulabilityMap(
+  const std::vector<arma::vec6> & Blist,
+  const arma::mat44 & M,
+  const arma::mat33 & R,
+  const std::vector<GridAxis> & axes,
+  const arma::vec & thetalist0,
+  const double eomg,
+  const double ev,
+  const ManipulabilityPart part = ManipulabilityPart::Twist,
+  const size_t num_threads = 0
+);
+
+/// \ingroup manipulability_map
+/// \brief Writes a manipulability map to a binary grid file
+/// \param map The manipulability map
+/// \param filename The path of the file to write
+/// \details The file holds a fixed header, the grid axes and then three
+///          float32 values per cell, all 8-byte aligned so that the file can
+///          be memory-mapped by ManipulabilityMapView. Throws
+///          std::runtime_error if the file cannot be written.
+void SaveManipulabilityMap(const ManipulabilityMap & map, const std::string & filename);
+
+/// \ingroup manipulability_map
+/// \brief Read-only, memory-mapped view of a manipulability grid file
+class ManipulabilityMapView
+{
+public:
+  /// \brief Maps a file written by SaveManipulabilityMap
+  /// \param filename The path of the grid file
+  /// \details Throws std::runtime_error if the file cannot be opened or is not
+  ///          a manipulability grid file.
+  explicit ManipulabilityMapView(const std::string & filename);
+
+  ManipulabilityMapView(const ManipulabilityMapView &) = delete;
+  ManipulabilityMapView & operator=(const ManipulabilityMapView &) = delete;
+  ManipulabilityMapView(ManipulabilityMapView && other) noexcept;
+  ManipulabilityMapView & operator=(ManipulabilityMapView && other) noexcept;
+  ~ManipulabilityMapView();
+
+  /// \brief The space the grid axes live in
+  GridSpace space() const;
+
+  /// \brief The rows of the Jacobian the measures describe
+  ManipulabilityPart part() const;
+
+  /// \brief The grid axes
+  const std::vector<GridAxis> & axes() const;
+
+  /// \brief The number of cells in the grid
+  size_t size() const;
+
+  /// \brief The measures stored at a flat cell index
+  /// \param index A flat cell index, with the first axis varying fastest
+  const ManipulabilityMeasures at(const size_t index) const;
+
+  /// \brief The measures stored at the grid point nearest to a query point
+  /// \param point One value per grid axis; values outside the grid are clamped
+  /// \details Throws std::invalid_argument unless point holds one finite value
+  ///          per axis.
+  const ManipulabilityMeasures Lookup(const arma::vec & point) const;
+
+private:
+  MappedFile file_;
+  GridSpace space_ = GridSpace::Joint;
+  ManipulabilityPart part_ = ManipulabilityPart::Twist;
+  std::vector<GridAxis> axes_;
+  const float * cells_ = nullptr;
+  size_t size_ = 0;
+};
+}
+
+#endif /// MODERN_ROBOTICS__MANIPULABILITY_MAP_HPP___
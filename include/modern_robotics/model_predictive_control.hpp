@@ -0,0 +1,136 @@
+#ifndef MODERN_ROBOTICS__MODEL_PREDICTIVE_CONTROL_HPP___
+#define MODERN_ROBOTICS__MODEL_PREDICTIVE_CONTROL_HPP___
+
+#include <vector>
+#include <armadillo>
+
+#include "modern_robotics/dynamics_of_open_chains.hpp"
+
+namespace mr
+{
+/// \defgroup model_predictive_control Model Predictive Control
+
+/// \ingroup model_predictive_control
+/// \brief Settings of a LinearMPC
+struct LinearMPCOptions
+{
+  /// The number of predicted steps H
+  size_t horizon = 10;
+  /// The timestep between reference points, also the prediction timestep
+  double dt = 1e-3;
+  /// The 2n x 2n weight of the state error [theta - thetad; dtheta - dthetad]
+  /// at the predicted steps 1 to H - 1
+  arma::mat Q;
+  /// The n x n weight of the deviation from the feedforward torques
+  arma::mat R;
+  /// The 2n x 2n weight of the state error at the last predicted step
+  arma::mat Qf;
+  /// The lowest torque of every joint, or empty for no limits
+  arma::vec tau_min;
+  /// The highest torque of every joint, or empty for no limits
+  arma::vec tau_max;
+  /// The largest number of ADMM iterations per solve, which bounds the solve time
+  size_t max_iterations = 50;
+  /// The primal and dual residual, in units of torque, below which a solve stops
+  double tolerance = 1e-4;
+  /// The ADMM penalty, or 0 to use the mean diagonal of the QP Hessian
+  double rho = 0.0;
+};
+
+/// \ingroup model_predictive_control
+/// \brief Linear model predictive tracking controller for joint trajectories
+/// \details Every cycle linearizes the Euler-discretized dynamics at the
+///          current reference point with
+///          DynamicsWorkspace::ForwardDynamicsDerivatives, predicts the state
+///          error over the horizon about the feedforward torques of the
+///          reference and condenses the tracking cost into a QP in the torque
+///          deviations alone. Without torque limits the QP is solved exactly by
+///          a Cholesky factorization. With limits it is solved by ADMM,
+///          warm-started from the previous solution shifted by one step, for at
+///          most max_iterations iterations, so the worst-case solve time is
+///          fixed. All buffers are allocated by the constructor; steps perform
+///          no heap allocation.
+class LinearMPC
+{
+public:
+  /// \brief Sets up the controller
+  /// \param g Gravity vector g of the model
+  /// \param Mlist List of link frames {i} relative to {i-1} at the home position
+  /// \param Glist Spatial inertia matrices Gi of the links
+  /// \param Slist Screw axes Si of the joints in a space frame
+  /// \param options The horizon, weights and solver settings
+  /// \details Throws std::invalid_argument if the weights or the torque
+  ///          limits do not match the number of joints, or if the horizon or dt
+  ///          is not positive.
+  LinearMPC(
+    const arma::vec3 & g,
+    const std::vector<arma::mat44> & Mlist,
+    const std::vector<arma::mat66> & Glist,
+    const std::vector<arma::vec6> & Slist,
+    const LinearMPCOptions & options
+  );
+
+  /// \brief Computes the joint torques of one control cycle
+  /// \param thetalist n-vector of joint variables
+  /// \param dthetalist n-vector of joint rates
+  /// \param thetamatd The desired joint variables of the whole trajectory
+  /// \param dthetamatd The desired joint velocities of the whole trajectory
+  /// \param ddthetamatd The desired joint accelerations of the whole trajectory
+  /// \param i The index of the current reference point; the horizon holds the
+  ///          last point once it runs past the end of the trajectory
+  /// \return The joint forces/torques
+  /// \details Throws std::invalid_argument if i is past the end of the
+  ///          trajectory and std::runtime_error if the QP is not positive
+  ///          definite.
+  const arma::vec & Step(
+    const arma::vec & thetalist,
+    const arma::vec & dthetalist,
+    const std::vector<arma::vec> & thetamatd,
+    const std::vector<arma::vec> & dthetamatd,
+    const std::vector<arma::vec> & ddthetamatd,
+    const size_t i
+  );
+
+  /// \brief Discards the warm start, e.g. before tracking a new trajectory
+  void Reset();
+
+  /// \brief The number of QP iterations of the last step
+  size_t iterations() const;
+
+  /// \brief Whether the QP of the last step met the tolerance
+  bool converged() const;
+
+private:
+  DynamicsWorkspace dynamics_;
+  arma::vec3 g_;
+  LinearMPCOptions options_;
+  size_t n_;
+  size_t H_;
+  bool bounded_;
+  bool warm_ = false;
+  size_t iterations_ = 0;
+  bool converged_ = false;
+  arma::vec ddthetalist_;
+  arma::mat Dtheta_; /// The derivatives of the accelerations
+  arma::mat Ddtheta_;
+  arma::mat Dtau_;
+  arma::mat A_; /// The 2n x 2n state matrix of the error dynamics
+  arma::mat B_; /// The 2n x n input matrix of the error dynamics
+  arma::mat Gamma_; /// The 2nH x nH map from torque deviations to predicted errors
+  arma::mat QGamma_;
+  arma::mat L_; /// The QP Hessian, then its Cholesky factor
+  arma::vec xref_; /// The reference states at steps 0 to H
+  arma::vec tauref_; /// The feedforward torques at steps 0 to H - 1
+  arma::vec z_; /// The predicted errors without torque deviations, steps 0 to H
+  arma::vec qz_;
+  arma::vec f_;
+  arma::vec lo_;
+  arma::vec hi_;
+  arma::vec u_;
+  arma::vec zeta_; /// The ADMM copy of u_ projected onto the limits
+  arma::vec y_; /// The ADMM multipliers
+  arma::vec taulist_;
+};
+}
+
+#endif /// MODERN_ROBOTICS__MODEL_PREDICTIVE_CONTROL_HPP___
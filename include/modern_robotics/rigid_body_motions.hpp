@@ -88,6 +88,14 @@ const arma::vec6 se3ToVec(const arma::mat44 & se3mat);
 /// \return The 6x6 adjoint representation [AdT] of T
 const arma::mat66 Adjoint(const arma::mat44 & T);
 
+/// \ingroup rigid_body_motions
+/// \brief Maps a twist through the adjoint representation of a transformation
+/// \param T A homogeneous transformation matrix
+/// \param V A 6-vector twist
+/// \return The twist [AdT]V
+/// \details Equivalent to Adjoint(T) * V, without forming the 6x6 matrix.
+const arma::vec6 AdjointMap(const arma::mat44 & T, const arma::vec6 & V);
+
 /// \ingroup rigid_body_motions
 /// \brief Takes a parametric description of a screw axis and converts it to a
 ///        normalized screw axis
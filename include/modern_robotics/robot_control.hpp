@@ -5,6 +5,10 @@
 #include <vector>
 #include <armadillo>
 
+#include "modern_robotics/forward_kinematics.hpp"
+#include "modern_robotics/inverse_kinematics.hpp"
+#include "modern_robotics/dynamics_of_open_chains.hpp"
+
 namespace mr
 {
 /// \defgroup robot_control Chapter 11. Robot Control
@@ -43,6 +47,132 @@ const arma::vec ComputeTorque(
   const double kd
 );
 
+/// \ingroup robot_control
+/// \brief Stateful computed torque controller with per-joint or full gains
+/// \details Holds the gains, a DynamicsWorkspace of the robot model and the
+///          integral of the joint errors. Because the inverse dynamics are
+///          linear in the accelerations, M(theta) (Kp ep + Ki ei + Kd ed) plus
+///          the inverse dynamics at ddthetalistd equals one inverse dynamics
+///          pass at ddthetalistd + Kp ep + Ki ei + Kd ed. Step therefore
+///          produces the torques of ComputeTorque without forming the mass
+///          matrix, and performs no heap allocation.
+class ComputedTorqueController
+{
+public:
+  /// \brief Sets up a controller with gains identical for each joint
+  /// \param g Gravity vector g of the model
+  /// \param Mlist List of link frames {i} relative to {i-1} at the home position
+  /// \param Glist Spatial inertia matrices Gi of the links
+  /// \param Slist Screw axes Si of the joints in a space frame
+  /// \param kp The feedback proportional gain
+  /// \param ki The feedback integral gain
+  /// \param kd The feedback derivative gain
+  ComputedTorqueController(
+    const arma::vec3 & g,
+    const std::vector<arma::mat44> & Mlist,
+    const std::vector<arma::mat66> & Glist,
+    const std::vector<arma::vec6> & Slist,
+    const double kp,
+    const double ki,
+    const double kd
+  );
+
+  /// \brief Sets up a controller with per-joint gains
+  /// \param g Gravity vector g of the model
+  /// \param Mlist List of link frames {i} relative to {i-1} at the home position
+  /// \param Glist Spatial inertia matrices Gi of the links
+  /// \param Slist Screw axes Si of the joints in a space frame
+  /// \param kp The diagonal of the proportional gain matrix
+  /// \param ki The diagonal of the integral gain matrix
+  /// \param kd The diagonal of the derivative gain matrix
+  /// \details Throws std::invalid_argument if a gain does not have one entry
+  ///          per joint.
+  ComputedTorqueController(
+    const arma::vec3 & g,
+    const std::vector<arma::mat44> & Mlist,
+    const std::vector<arma::mat66> & Glist,
+    const std::vector<arma::vec6> & Slist,
+    const arma::vec & kp,
+    const arma::vec & ki,
+    const arma::vec & kd
+  );
+
+  /// \brief Sets up a controller with full gain matrices
+  /// \param g Gravity vector g of the model
+  /// \param Mlist List of link frames {i} relative to {i-1} at the home position
+  /// \param Glist Spatial inertia matrices Gi of the links
+  /// \param Slist Screw axes Si of the joints in a space frame
+  /// \param Kp The nxn proportional gain matrix
+  /// \param Ki The nxn integral gain matrix
+  /// \param Kd The nxn derivative gain matrix
+  /// \details Throws std::invalid_argument if a gain is not nxn.
+  ComputedTorqueController(
+    const arma::vec3 & g,
+    const std::vector<arma::mat44> & Mlist,
+    const std::vector<arma::mat66> & Glist,
+    const std::vector<arma::vec6> & Slist,
+    const arma::mat & Kp,
+    const arma::mat & Ki,
+    const arma::mat & Kd
+  );
+
+  /// \brief Computes the joint torques and accumulates the joint error
+  /// \param thetalist n-vector of joint variables
+  /// \param dthetalist n-vector of joint rates
+  /// \param thetalistd n-vector of reference joint variables
+  /// \param dthetalistd n-vector of reference joint velocities
+  /// \param ddthetalistd n-vector of reference joint accelerations
+  /// \return The joint forces/torques, equal to ComputeTorque with the
+  ///         current eint; eint then becomes eint + (thetalistd - thetalist)
+  const arma::vec & Step(
+    const arma::vec & thetalist,
+    const arma::vec & dthetalist,
+    const arma::vec & thetalistd,
+    const arma::vec & dthetalistd,
+    const arma::vec & ddthetalistd
+  );
+
+  /// \brief Replaces the gains with per-joint gains
+  /// \param kp The diagonal of the proportional gain matrix
+  /// \param ki The diagonal of the integral gain matrix
+  /// \param kd The diagonal of the derivative gain matrix
+  /// \details Throws std::invalid_argument if a gain does not have one entry
+  ///          per joint.
+  void SetGains(const arma::vec & kp, const arma::vec & ki, const arma::vec & kd);
+
+  /// \brief Includes the actuators of the model in the torques
+  /// \param actuators The actuator model
+  /// \details The inverse dynamics then feed forward the rotor inertia and
+  ///          friction forces as well; see DynamicsWorkspace::SetActuators.
+  void SetActuators(const ActuatorModel & actuators);
+
+  /// \brief The time-integral of the joint errors
+  const arma::vec & eint() const;
+
+  /// \brief Replaces the time-integral of the joint errors
+  /// \param eint n-vector of the time-integral of joint errors
+  void SetIntegralError(const arma::vec & eint);
+
+  /// \brief Clears the time-integral of the joint errors
+  void Reset();
+
+private:
+  DynamicsWorkspace dynamics_;
+  arma::vec3 g_;
+  bool diagonal_;
+  arma::vec kp_; /// The diagonal gains
+  arma::vec ki_;
+  arma::vec kd_;
+  arma::mat Kp_; /// The full gain matrices
+  arma::mat Ki_;
+  arma::mat Kd_;
+  arma::vec eint_;
+  arma::vec ep_;
+  arma::vec ed_;
+  arma::vec ddthetalist_;
+  arma::vec taulist_;
+};
+
 /// \ingroup robot_control
 /// \brief Simulates the computed torque controller over a given desired trajectory
 /// \param thetalist n-vector of initial joint variables
@@ -75,9 +205,14 @@ const arma::vec ComputeTorque(
 /// \return taumat: An Nxn matrix of the controllers commanded joint forces/
 ///                 torques, where each row of n forces/torques corresponds
 ///                 to a single time instant
-/// \return thetamat: An Nxn matrix of actual joint angles
+/// \return thetamat: An Nxn matrix of actual joint angles at the end of each timestep
 ///                   The end of this function plots all the actual and desired joint angles
 ///                   using matplotlib and random libraries.
+/// \details The controller and the plant evaluate their dynamics through a
+///          DynamicsCache each. When gtilde, Mtildelist and Gtildelist equal
+///          the actual values exactly, they share one, and the first forward
+///          dynamics of each step reuses the mass matrix and bias forces the
+///          controller has just computed at the same state.
 const std::tuple<std::vector<arma::vec>, std::vector<arma::vec>>
 SimulateControl(
   const arma::vec & thetalist,
@@ -99,6 +234,220 @@ SimulateControl(
   const double dt,
   const size_t intRes
 );
+
+/// \ingroup robot_control
+/// \brief Settings of a ResolvedRateController
+struct ResolvedRateOptions
+{
+  /// The manipulability sqrt(det(J J^T)) below which damping is applied, or
+  /// sqrt(det(J^T J)) with fewer than six joints
+  double manipulability_threshold = 1e-3;
+  /// The damping lambda^2 applied at a singularity; it grows smoothly from 0
+  /// at manipulability_threshold to this value at zero manipulability
+  double max_damping = 1e-2;
+  /// The largest speed of every joint, or empty for no limits
+  arma::vec max_velocity;
+};
+
+/// \ingroup robot_control
+/// \brief Streaming resolved-rate controller mapping end-effector twists to
+///        joint velocities
+/// \details The controller keeps the joint coordinates, the end-effector
+///          configuration and the Jacobian of its arm. Every Step solves
+///          dtheta = J^T (J J^T + damping I)^-1 V, optionally with a secondary
+///          motion in the null space of J, scales it uniformly so that no joint
+///          exceeds its velocity limit and integrates it over the cycle. The
+///          damping follows Nakamura's manipulability-based schedule, so far
+///          from singularities the solve is the exact pseudoinverse. One
+///          Cholesky factorization per step serves both the manipulability
+///          and the solve. With fewer than six joints J J^T is singular, so
+///          the controller works with J^T J instead and solves the equivalent
+///          dtheta = (J^T J + damping I)^-1 J^T V. Steps perform no heap
+///          allocation.
+class ResolvedRateController
+{
+public:
+  /// \brief Sets up the controller at an initial configuration
+  /// \param list The joint screw axes at the home position, Blist or Slist
+  ///             depending on frame
+  /// \param M The home configuration of the end-effector
+  /// \param frame The frame of the screw axes, the Jacobian and the commanded twists
+  /// \param thetalist0 The initial joint coordinates
+  /// \param options The controller settings
+  /// \details Throws std::invalid_argument if thetalist0 or the velocity
+  ///          limits do not have one entry per joint.
+  ResolvedRateController(
+    const std::vector<arma::vec6> & list,
+    const arma::mat44 & M,
+    const IKFrame frame,
+    const arma::vec & thetalist0,
+    const ResolvedRateOptions & options = ResolvedRateOptions()
+  );
+
+  /// \brief Replaces the joint coordinates, e.g. with measured encoder values
+  /// \param thetalist The joint coordinates
+  void SetJointState(const arma::vec & thetalist);
+
+  /// \brief Runs one control cycle
+  /// \param V The commanded end-effector twist, in the frame of the controller
+  /// \param dt The cycle time
+  /// \return The commanded joint velocities
+  const arma::vec & Step(const arma::vec6 & V, const double dt);
+
+  /// \brief Runs one control cycle with a secondary objective
+  /// \param V The commanded end-effector twist, in the frame of the controller
+  /// \param dt The cycle time
+  /// \param z The secondary joint motion, followed in the null space of J
+  /// \return The commanded joint velocities
+  const arma::vec & Step(const arma::vec6 & V, const double dt, const arma::vec & z);
+
+  /// \brief The current joint coordinates
+  const arma::vec & thetalist() const;
+
+  /// \brief The joint velocities commanded by the last step
+  const arma::vec & dthetalist() const;
+
+  /// \brief The current end-effector configuration
+  const arma::mat44 & T() const;
+
+  /// \brief The Jacobian at the current joint coordinates
+  const arma::mat & jacobian() const;
+
+  /// \brief The damping applied in the last step
+  double damping() const;
+
+  /// \brief The factor the last step was scaled by to meet the velocity
+  ///        limits, 1 when no limit was active
+  double scale() const;
+
+private:
+  void Update();
+
+  std::vector<Joint> joints_;
+  arma::mat44 M_;
+  IKFrame frame_;
+  ResolvedRateOptions options_;
+  arma::vec thetalist_;
+  arma::vec dthetalist_;
+  arma::vec zero_;
+  arma::mat44 T_;
+  arma::mat J_;
+  arma::mat G_; /// J J^T, or J^T J with fewer than six joints
+  arma::mat L_; /// The Cholesky factor of G_ + damping I
+  double damping_ = 0.0;
+  double scale_ = 1.0;
+};
+
+/// \ingroup robot_control
+/// \brief Operational-space controller for Cartesian impedance and force control
+/// \details Makes the end-effector behave as a mass-spring-damper about a desired
+///          configuration with the task-space inertia
+///          Lambda = (Jb M^-1 Jb^T)^-1 of the arm, in the end-effector frame.
+///          The commanded torques are
+///          tau = Jb^T (Lambda (a - dJb/dt dtheta) + Fd) + h(theta, dtheta), where
+///          a is the feedforward plus impedance acceleration and h the Coriolis
+///          and gravity torques, so with Fd = 0 the end-effector accelerates at a.
+///          M^-1 is never formed: the mass matrix from the composite rigid body
+///          algorithm is factored as L L^T, Lambda^-1 is Y^T Y with
+///          Y = L^-1 Jb^T, and Lambda is recovered from the Cholesky factor of
+///          that 6x6 matrix. Steps perform no heap allocation.
+class OperationalSpaceController
+{
+public:
+  /// \brief Sets up the controller
+  /// \param g Gravity vector g of the model
+  /// \param Mlist List of link frames {i} relative to {i-1} at the home
+  ///              position; the last one is the end-effector frame
+  /// \param Glist Spatial inertia matrices Gi of the links
+  /// \param Slist Screw axes Si of the joints in a space frame
+  /// \param Kp The 6x6 stiffness acting on the error twist
+  /// \param Kd The 6x6 damping acting on the twist error
+  /// \param damping Added to the diagonal of Lambda^-1 so that Lambda stays
+  ///                bounded near singularities; 0 for the exact inertia
+  /// \details Throws std::invalid_argument unless there are n screw axes, n
+  ///          inertias and n + 1 link frames.
+  OperationalSpaceController(
+    const arma::vec3 & g,
+    const std::vector<arma::mat44> & Mlist,
+    const std::vector<arma::mat66> & Glist,
+    const std::vector<arma::vec6> & Slist,
+    const arma::mat66 & Kp,
+    const arma::mat66 & Kd,
+    const double damping = 1e-6
+  );
+
+  /// \brief Computes the joint torques of one control cycle
+  /// \param thetalist n-vector of joint variables
+  /// \param dthetalist n-vector of joint rates
+  /// \param Td The desired end-effector configuration
+  /// \param Vd The desired end-effector twist, in the desired frame
+  /// \param dVd The desired end-effector acceleration, in the desired frame
+  /// \param Fd The feedforward wrench the end-effector applies, in the
+  ///           end-effector frame
+  /// \return The joint forces/torques
+  /// \details Throws std::runtime_error if the mass matrix or Lambda^-1 is not
+  ///          positive definite.
+  const arma::vec & Step(
+    const arma::vec & thetalist,
+    const arma::vec & dthetalist,
+    const arma::mat44 & Td,
+    const arma::vec6 & Vd,
+    const arma::vec6 & dVd,
+    const arma::vec6 & Fd
+  );
+
+  /// \brief Computes the joint torques of one control cycle with a secondary
+  ///        joint torque for redundant arms
+  /// \param thetalist n-vector of joint variables
+  /// \param dthetalist n-vector of joint rates
+  /// \param Td The desired end-effector configuration
+  /// \param Vd The desired end-effector twist, in the desired frame
+  /// \param dVd The desired end-effector acceleration, in the desired frame
+  /// \param Fd The feedforward wrench the end-effector applies, in the
+  ///           end-effector frame
+  /// \param tau0 n-vector of secondary joint torques, e.g. joint damping
+  /// \return The joint forces/torques
+  /// \details tau0 is projected by the dynamically consistent null space
+  ///          I - Jb^T Lambda Jb M^-1, so it does not accelerate the end-effector.
+  const arma::vec & Step(
+    const arma::vec & thetalist,
+    const arma::vec & dthetalist,
+    const arma::mat44 & Td,
+    const arma::vec6 & Vd,
+    const arma::vec6 & dVd,
+    const arma::vec6 & Fd,
+    const arma::vec & tau0
+  );
+
+  /// \brief The end-effector configuration of the last step
+  const arma::mat44 & T() const;
+
+  /// \brief The body Jacobian of the last step
+  const arma::mat & jacobian() const;
+
+  /// \brief The task-space inertia Lambda of the last step
+  const arma::mat66 & lambda() const;
+
+private:
+  DynamicsWorkspace dynamics_;
+  arma::vec3 g_;
+  std::vector<Joint> joints_; /// The screw axes Bi in the end-effector frame
+  arma::mat44 M_;
+  arma::mat66 Kp_;
+  arma::mat66 Kd_;
+  double damping_;
+  arma::mat44 T_;
+  arma::mat J_;
+  arma::mat L_; /// The Cholesky factor of the mass matrix
+  arma::mat Y_; /// L^-1 Jb^T
+  arma::mat66 A_; /// The Cholesky factor of Lambda^-1
+  arma::mat66 lambda_;
+  arma::vec zeros_;
+  arma::vec h_;
+  arma::vec x_;
+  arma::vec y_;
+  arma::vec taulist_;
+};
 }
 
 #endif
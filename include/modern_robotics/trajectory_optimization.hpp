@@ -0,0 +1,102 @@
+#ifndef MODERN_ROBOTICS__TRAJECTORY_OPTIMIZATION_HPP___
+#define MODERN_ROBOTICS__TRAJECTORY_OPTIMIZATION_HPP___
+
+#include <vector>
+#include <armadillo>
+
+namespace mr
+{
+/// \defgroup trajectory_optimization Trajectory Optimization
+
+/// \ingroup trajectory_optimization
+/// \brief A finite-horizon optimal control problem for an open chain
+/// \details The state x = [theta; dtheta] advances by the explicit Euler step
+///          of EulerStep with the accelerations of ForwardDynamics. The cost is
+///          the sum over the knots k < N of
+///          1/2 e_k^T Q e_k + 1/2 tau_k^T R tau_k, plus 1/2 e_N^T Qf e_N, where
+///          e_k = x_k - [thetad_k; dthetad_k].
+struct ILQRProblem
+{
+  arma::vec thetalist; /// n-vector of initial joint variables
+  arma::vec dthetalist; /// n-vector of initial joint velocities
+  arma::vec3 g; /// Gravity vector g
+  std::vector<arma::mat44> Mlist; /// Link frames i relative to i-1 at the home position
+  std::vector<arma::mat66> Glist; /// Spatial inertia matrices Gi of the links
+  std::vector<arma::vec6> Slist; /// Screw axes Si of the joints in a space frame
+  std::vector<arma::vec> thetamatd; /// The desired joint variables at the N + 1 knots
+  std::vector<arma::vec> dthetamatd; /// The desired joint velocities at the N + 1 knots
+  arma::mat Q; /// The 2n x 2n weight of the state error at knots 0 to N - 1
+  arma::mat R; /// The n x n weight of the joint torques
+  arma::mat Qf; /// The 2n x 2n weight of the state error at knot N
+  double dt; /// The timestep between knots
+};
+
+/// \ingroup trajectory_optimization
+/// \brief Settings of ILQR
+struct ILQROptions
+{
+  /// The maximum number of iterations
+  size_t max_iterations = 100;
+  /// The relative cost decrease below which the solver has converged
+  double tolerance = 1e-6;
+  /// The initial regularization added to the diagonal of Quu
+  double regularization = 1e-6;
+  /// The regularization above which the solver gives up
+  double max_regularization = 1e10;
+  /// The number of line search step sizes 1, 1/2, 1/4, ... tried per iteration
+  size_t line_search_steps = 8;
+  /// The number of worker threads, 0 to use one per hardware thread
+  size_t num_threads = 0;
+};
+
+/// \ingroup trajectory_optimization
+/// \brief A locally optimal torque trajectory and its feedback gains
+struct ILQRResult
+{
+  std::vector<arma::vec> taumat; /// The N nominal joint torques
+  std::vector<arma::mat> Kmat; /// The N n x 2n feedback gains on the state error
+  std::vector<arma::vec> thetamat; /// The joint variables of the nominal rollout, N + 1 of them
+  std::vector<arma::vec> dthetamat; /// The joint velocities of the nominal rollout, N + 1 of them
+  double cost; /// The cost of the nominal rollout
+  size_t iterations; /// The number of iterations run
+  bool converged; /// Whether the cost decrease fell below the tolerance
+};
+
+/// \ingroup trajectory_optimization
+/// \brief Optimizes a torque trajectory with the iterative linear quadratic regulator
+/// \param problem The optimal control problem
+/// \param taumat0 The N initial joint torques, or empty to start from the
+///                gravity torques at the desired joint variables
+/// \param options The solver settings
+/// \return The optimized torques, feedback gains and nominal rollout
+/// \details Every iteration linearizes the Euler step at all knots in
+///          parallel with DynamicsWorkspace::ForwardDynamicsDerivatives, which
+///          works from one Cholesky factor of the mass matrix per knot and
+///          never forms M^-1 explicitly. The backward pass uses
+///          Levenberg-Marquardt regularization of Quu, and the line search
+///          rolls out all step sizes in parallel and keeps the largest one with
+///          sufficient decrease. Each worker
+///          thread keeps its DynamicsWorkspace across iterations. Throws
+///          std::invalid_argument if the problem is inconsistent.
+const ILQRResult ILQR(
+  const ILQRProblem & problem,
+  const std::vector<arma::vec> & taumat0 = {},
+  const ILQROptions & options = ILQROptions()
+);
+
+/// \ingroup trajectory_optimization
+/// \brief Computes the feedback torques of an ILQR solution
+/// \param result The ILQR solution
+/// \param i The knot, 0 <= i < N
+/// \param thetalist n-vector of the measured joint variables
+/// \param dthetalist n-vector of the measured joint velocities
+/// \return taumat[i] + Kmat[i] [thetalist - thetamat[i]; dthetalist - dthetamat[i]]
+const arma::vec ILQRTorque(
+  const ILQRResult & result,
+  const size_t i,
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist
+);
+}
+
+#endif /// MODERN_ROBOTICS__TRAJECTORY_OPTIMIZATION_HPP___
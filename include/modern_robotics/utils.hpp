@@ -4,6 +4,9 @@
 #include <armadillo>
 #include <cmath>
 #include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
 
 namespace mr
 {
@@ -21,6 +24,85 @@ constexpr bool NearZero(const double z)
 /// \param vec The vector to normalize
 /// \return The normalized vector
 const arma::vec Normalize(const arma::vec & vec);
+
+/// \brief Checks two matrices for exact equality
+/// \param a A matrix or vector
+/// \param b A matrix or vector
+/// \return true if a and b have the same shape and equal entries
+/// \details Used to detect unchanged inputs, so no tolerance is applied.
+bool Identical(const arma::mat & a, const arma::mat & b);
+
+/// \brief Checks two lists of matrices for exact equality
+/// \param a A list of matrices or vectors
+/// \param b A list of matrices or vectors
+/// \return true if a and b have the same length and identical entries
+template<typename T>
+bool Identical(const std::vector<T> & a, const std::vector<T> & b)
+{
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (!Identical(a.at(i), b.at(i))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// \brief Computes the Cholesky factor of a symmetric positive definite matrix in place
+/// \param A The matrix to factor; only its lower triangle is read, and it is
+///          overwritten by the lower triangular factor L with A = L L^T
+/// \return true on success, false if A is not positive definite
+/// \details Works on the storage of A directly, so fixed-size matrices are
+///          factored without any heap allocation.
+bool CholeskyDecompose(arma::mat & A);
+
+/// \brief Solves L L^T x = b in place
+/// \param L The lower triangular factor computed by CholeskyDecompose
+/// \param b The right-hand side, overwritten by the solution x
+void CholeskySolve(const arma::mat & L, arma::vec & b);
+
+/// \brief Runs a loop body for every index in [0, n) on a pool of threads
+/// \param n The number of iterations
+/// \param f The loop body, called once per index from any of the workers
+/// \param num_threads The number of worker threads, 0 to use one per hardware thread
+/// \details Indices are handed out in chunks from a shared counter, so uneven
+///          iterations balance across workers. The first exception thrown by f
+///          is rethrown on the calling thread once all workers have joined.
+void ParallelFor(
+  const size_t n,
+  const std::function<void(const size_t)> & f,
+  const size_t num_threads = 0
+);
+
+/// \brief Read-only memory mapping of a whole file, unmapped on destruction
+/// \details Backs the memory-mapped views of precomputed tables. An empty
+///          file is not mapped and has a null data pointer.
+class MappedFile
+{
+public:
+  /// \brief Maps a file
+  /// \param filename The path of the file
+  /// \details Throws std::runtime_error if the file cannot be opened or mapped.
+  explicit MappedFile(const std::string & filename);
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile & operator=(const MappedFile &) = delete;
+  MappedFile(MappedFile && other) noexcept;
+  MappedFile & operator=(MappedFile && other) noexcept;
+  ~MappedFile();
+
+  /// \brief The first byte of the file
+  const char * data() const;
+
+  /// \brief The size of the file in bytes
+  size_t size() const;
+
+private:
+  void * data_ = nullptr;
+  size_t bytes_ = 0;
+};
 } // namespace modern_robotics
 
 #endif /// MODERN_ROBOTICS__UTILS_HPP___
@@ -1,12 +1,35 @@
 #ifndef MODERN_ROBOTICS__VELOCITY_KINEMATICS_AND_STATICS_HPP___
 #define MODERN_ROBOTICS__VELOCITY_KINEMATICS_AND_STATICS_HPP___
 
+#include <cstdint>
+#include <tuple>
+#include <vector>
 #include <armadillo>
 
+#include "modern_robotics/forward_kinematics.hpp"
+
 namespace mr
 {
 /// \defgroup velocity_kinematics_and_statics Chapter 5: Velocity Kinematics and Statics
 
+/// \ingroup velocity_kinematics_and_statics
+/// \brief The rows of a Jacobian a manipulability measure is computed from
+enum class ManipulabilityPart : uint8_t
+{
+  Twist, /// all six rows, A = J J^T is 6x6
+  Angular, /// the angular velocity rows, A = Jw Jw^T is 3x3
+  Linear /// the linear velocity rows, A = Jv Jv^T is 3x3
+};
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Manipulability measures of a Jacobian at one configuration
+struct ManipulabilityMeasures
+{
+  double manipulability; /// Yoshikawa measure sqrt(det(A)), the ellipsoid volume
+  double condition_number; /// sqrt(lambda_max / lambda_min) of A, inf at a singularity
+  double min_singular_value; /// sqrt(lambda_min) of A, the distance to a singularity
+};
+
 /// \ingroup velocity_kinematics_and_statics
 /// \brief Computes the body Jacobian for an open chain robot
 /// \param Blist The joint screw axes in the end-effector frame when the
@@ -30,6 +53,449 @@ const arma::mat JacobianSpace(
   const std::vector<arma::vec6> & Slist,
   const arma::vec & thetalist
 );
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes the body Jacobian for a chain of classified joints
+/// \param Blist The classified joint screw axes in the end-effector frame
+/// \param thetalist A list of joint coordinates
+/// \return The body Jacobian corresponding to the inputs (6xn real numbers)
+const arma::mat JacobianBody(
+  const std::vector<Joint> & Blist,
+  const arma::vec & thetalist
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes the space Jacobian for a chain of classified joints
+/// \param Slist The classified joint screw axes in the space frame
+/// \param thetalist A list of joint coordinates
+/// \return The space Jacobian corresponding to the inputs (6xn real numbers)
+const arma::mat JacobianSpace(
+  const std::vector<Joint> & Slist,
+  const arma::vec & thetalist
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes the manipulability measures of a Jacobian
+/// \param J A 6xn space or body Jacobian
+/// \param part The rows of J the manipulability ellipsoid is built from
+/// \return The manipulability, condition number and minimum singular value
+/// \details The measures come from the eigenvalues of A = J J^T rather than
+///          an SVD of J. The angular and linear parts use the closed-form
+///          eigenvalues of a 3x3 symmetric matrix; the full twist part uses a
+///          symmetric eigensolver on the 6x6 A.
+const ManipulabilityMeasures Manipulability(
+  const arma::mat & J,
+  const ManipulabilityPart part = ManipulabilityPart::Twist
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes the gradient of the manipulability with respect to the joints
+/// \param Jb A 6xn body Jacobian
+/// \return The gradient of the Yoshikawa measure w = sqrt(det(Jb Jb^T)), zero
+///         at a singularity
+/// \details Uses dJbi/dthetaj = [ad_Jbi] Jbj for j > i, so the gradient
+///          dw/dthetaj = w * sum_{i<j} Xi^T [ad_Jbi] Jbj with X = (Jb Jb^T)^-1 Jb
+///          needs one Cholesky factorization and no finite differences. The
+///          measure is the same for the space Jacobian.
+const arma::vec ManipulabilityGradient(const arma::mat & Jb);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes the gradient of a joint-centering objective
+/// \param thetalist A list of joint coordinates
+/// \param lower The lower joint limits
+/// \param upper The upper joint limits
+/// \return The gradient of H = -1/(2n) sum ((thetai - mi) / (upperi - loweri))^2,
+///         with mi the middle of the joint range; following it moves every
+///         joint towards the middle of its range
+const arma::vec JointCenteringGradient(
+  const arma::vec & thetalist,
+  const arma::vec & lower,
+  const arma::vec & upper
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes joint rates that achieve a twist and pursue a secondary
+///        joint motion in the null space of the Jacobian
+/// \param J A 6xn space or body Jacobian
+/// \param V The desired twist, in the frame of J
+/// \param z The secondary joint motion, typically a gain times the gradient
+///          of an objective such as ManipulabilityGradient
+/// \param damping The damping lambda^2 of the least-squares solve, 0 for the
+///                pseudoinverse of a full-rank J
+/// \return dtheta = J# V + (I - J# J) z with J# = J^T (J J^T + damping I)^-1
+/// \details Both terms come from one Cholesky factorization of the 6x6 matrix
+///          J J^T + damping I, using dtheta = z + J# (V - J z), so the null
+///          space projector is never formed and no SVD is needed. Throws
+///          std::invalid_argument if the sizes do not match and
+///          std::runtime_error if J J^T + damping I is singular.
+const arma::vec NullSpaceResolvedRate(
+  const arma::mat & J,
+  const arma::vec6 & V,
+  const arma::vec & z,
+  const double damping = 0.0
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes null-space resolved joint rates into preallocated storage
+/// \param J A 6xn space or body Jacobian
+/// \param V The desired twist, in the frame of J
+/// \param z The secondary joint motion
+/// \param damping The damping lambda^2 of the least-squares solve
+/// \param A Storage for the Cholesky factor of J J^T + damping I
+/// \param dtheta The joint rates, resized to n if needed
+/// \return false if J J^T + damping I is singular, leaving dtheta unspecified
+/// \details Performs no heap allocation once dtheta has n entries, for use in
+///          control loops.
+bool NullSpaceResolvedRate(
+  const arma::mat & J,
+  const arma::vec6 & V,
+  const arma::vec & z,
+  const double damping,
+  arma::mat66 & A,
+  arma::vec & dtheta
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes null-space resolved joint rates with a factorization at hand
+/// \param J A 6xn space or body Jacobian
+/// \param V The desired twist, in the frame of J
+/// \param z The secondary joint motion
+/// \param L The lower Cholesky factor of J J^T + damping I, as computed by
+///          CholeskyDecompose
+/// \param dtheta The joint rates, resized to n if needed
+/// \details For callers that already factored J J^T + damping I, e.g. to
+///          measure the manipulability. Performs no heap allocation once
+///          dtheta has n entries.
+void NullSpaceResolvedRate(
+  const arma::mat & J,
+  const arma::vec6 & V,
+  const arma::vec & z,
+  const arma::mat & L,
+  arma::vec & dtheta
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes the body forward kinematics and the body Jacobian together
+/// \param M The home configuration of the end-effector
+/// \param Blist The joint screw axes in the end-effector frame when the
+///              manipulator is at the home position, in the format of a
+///              matrix with axes as the columns
+/// \param thetalist A list of joint coordinates
+/// \return T: The end-effector configuration, equal to FKinBody(M, Blist, thetalist)
+/// \return Jb: The body Jacobian, equal to JacobianBody(Blist, thetalist)
+/// \details Both results come from one sweep of n joint exponentials instead
+///          of the 2n exponentials spent by calling the two functions.
+const std::tuple<const arma::mat44, const arma::mat> FKinAndJacobianBody(
+  const arma::mat44 & M,
+  const std::vector<arma::vec6> & Blist,
+  const arma::vec & thetalist
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes the body forward kinematics and the body Jacobian together
+///        for a chain of classified joints
+/// \param M The home configuration of the end-effector
+/// \param Blist The classified joint screw axes in the end-effector frame
+/// \param thetalist A list of joint coordinates
+/// \return T: The end-effector configuration, equal to FKinBody(M, Blist, thetalist)
+/// \return Jb: The body Jacobian, equal to JacobianBody(Blist, thetalist)
+const std::tuple<const arma::mat44, const arma::mat> FKinAndJacobianBody(
+  const arma::mat44 & M,
+  const std::vector<Joint> & Blist,
+  const arma::vec & thetalist
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes the body forward kinematics and the body Jacobian together
+///        into caller-owned storage
+/// \param M The home configuration of the end-effector
+/// \param Blist The classified joint screw axes in the end-effector frame
+/// \param thetalist A list of joint coordinates
+/// \param Tsb Output: the end-effector configuration
+/// \param Jb Output: the body Jacobian
+/// \details Resizes Jb to 6 x n if needed and performs no heap allocation when
+///          it is already 6 x n, so it can run inside real-time loops with
+///          preallocated buffers. Throws std::invalid_argument unless thetalist
+///          has one entry per joint.
+void FKinAndJacobianBody(
+  const arma::mat44 & M,
+  const std::vector<Joint> & Blist,
+  const arma::vec & thetalist,
+  arma::mat44 & Tsb,
+  arma::mat & Jb
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes the space forward kinematics and the space Jacobian together
+/// \param M The home configuration of the end-effector
+/// \param Slist The joint screw axes in the space frame when the
+///              manipulator is at the home position, in the format of a
+///              matrix with axes as the columns
+/// \param thetalist A list of joint coordinates
+/// \return T: The end-effector configuration, equal to FKinSpace(M, Slist, thetalist)
+/// \return Js: The space Jacobian, equal to JacobianSpace(Slist, thetalist)
+/// \details Both results come from one sweep of n joint exponentials instead
+///          of the 2n exponentials spent by calling the two functions.
+const std::tuple<const arma::mat44, const arma::mat> FKinAndJacobianSpace(
+  const arma::mat44 & M,
+  const std::vector<arma::vec6> & Slist,
+  const arma::vec & thetalist
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes the space forward kinematics and the space Jacobian together
+///        for a chain of classified joints
+/// \param M The home configuration of the end-effector
+/// \param Slist The classified joint screw axes in the space frame
+/// \param thetalist A list of joint coordinates
+/// \return T: The end-effector configuration, equal to FKinSpace(M, Slist, thetalist)
+/// \return Js: The space Jacobian, equal to JacobianSpace(Slist, thetalist)
+const std::tuple<const arma::mat44, const arma::mat> FKinAndJacobianSpace(
+  const arma::mat44 & M,
+  const std::vector<Joint> & Slist,
+  const arma::vec & thetalist
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes the space forward kinematics and the space Jacobian together
+///        into caller-owned storage
+/// \param M The home configuration of the end-effector
+/// \param Slist The classified joint screw axes in the space frame
+/// \param thetalist A list of joint coordinates
+/// \param Tsb Output: the end-effector configuration
+/// \param Js Output: the space Jacobian
+/// \details Resizes Js to 6 x n if needed and performs no heap allocation when
+///          it is already 6 x n. Throws std::invalid_argument unless thetalist
+///          has one entry per joint.
+void FKinAndJacobianSpace(
+  const arma::mat44 & M,
+  const std::vector<Joint> & Slist,
+  const arma::vec & thetalist,
+  arma::mat44 & Tsb,
+  arma::mat & Js
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes the body twist Jb(thetalist) * dthetalist without forming Jb
+/// \param Blist The joint screw axes in the end-effector frame when the
+///              manipulator is at the home position, in the format of a
+///              matrix with axes as the columns
+/// \param thetalist A list of joint coordinates
+/// \param dthetalist A list of joint rates
+/// \return The end-effector twist Vb expressed in the end-effector frame
+/// \details Accumulates [AdT]Bi * dthetai along the chain in O(n), without
+///          allocating the 6xn Jacobian.
+const arma::vec6 JacobianBodyProduct(
+  const std::vector<arma::vec6> & Blist,
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes Jb(thetalist) * dthetalist for a chain of classified joints
+/// \param Blist The classified joint screw axes in the end-effector frame
+/// \param thetalist A list of joint coordinates
+/// \param dthetalist A list of joint rates
+/// \return The end-effector twist Vb expressed in the end-effector frame
+const arma::vec6 JacobianBodyProduct(
+  const std::vector<Joint> & Blist,
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes the joint torques Jb(thetalist)^T * Fb without forming Jb
+/// \param Blist The joint screw axes in the end-effector frame when the
+///              manipulator is at the home position, in the format of a
+///              matrix with axes as the columns
+/// \param thetalist A list of joint coordinates
+/// \param Fb A wrench expressed in the end-effector frame
+/// \return The joint forces/torques that balance Fb
+const arma::vec JacobianBodyTransposeProduct(
+  const std::vector<arma::vec6> & Blist,
+  const arma::vec & thetalist,
+  const arma::vec6 & Fb
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes Jb(thetalist)^T * Fb for a chain of classified joints
+/// \param Blist The classified joint screw axes in the end-effector frame
+/// \param thetalist A list of joint coordinates
+/// \param Fb A wrench expressed in the end-effector frame
+/// \return The joint forces/torques that balance Fb
+const arma::vec JacobianBodyTransposeProduct(
+  const std::vector<Joint> & Blist,
+  const arma::vec & thetalist,
+  const arma::vec6 & Fb
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes the spatial twist Js(thetalist) * dthetalist without forming Js
+/// \param Slist The joint screw axes in the space frame when the
+///              manipulator is at the home position, in the format of a
+///              matrix with axes as the columns
+/// \param thetalist A list of joint coordinates
+/// \param dthetalist A list of joint rates
+/// \return The end-effector twist Vs expressed in the space frame
+/// \details Accumulates [AdT]Si * dthetai along the chain in O(n), without
+///          allocating the 6xn Jacobian.
+const arma::vec6 JacobianSpaceProduct(
+  const std::vector<arma::vec6> & Slist,
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes Js(thetalist) * dthetalist for a chain of classified joints
+/// \param Slist The classified joint screw axes in the space frame
+/// \param thetalist A list of joint coordinates
+/// \param dthetalist A list of joint rates
+/// \return The end-effector twist Vs expressed in the space frame
+const arma::vec6 JacobianSpaceProduct(
+  const std::vector<Joint> & Slist,
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes the joint torques Js(thetalist)^T * Fs without forming Js
+/// \param Slist The joint screw axes in the space frame when the
+///              manipulator is at the home position, in the format of a
+///              matrix with axes as the columns
+/// \param thetalist A list of joint coordinates
+/// \param Fs A wrench expressed in the space frame
+/// \return The joint forces/torques that balance Fs
+const arma::vec JacobianSpaceTransposeProduct(
+  const std::vector<arma::vec6> & Slist,
+  const arma::vec & thetalist,
+  const arma::vec6 & Fs
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes Js(thetalist)^T * Fs for a chain of classified joints
+/// \param Slist The classified joint screw axes in the space frame
+/// \param thetalist A list of joint coordinates
+/// \param Fs A wrench expressed in the space frame
+/// \return The joint forces/torques that balance Fs
+const arma::vec JacobianSpaceTransposeProduct(
+  const std::vector<Joint> & Slist,
+  const arma::vec & thetalist,
+  const arma::vec6 & Fs
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes the time derivative of the body Jacobian
+/// \param Blist The joint screw axes in the end-effector frame when the
+///              manipulator is at the home position, in the format of a
+///              matrix with axes as the columns
+/// \param thetalist A list of joint coordinates
+/// \param dthetalist A list of joint rates
+/// \return The 6xn matrix dJb/dt at (thetalist, dthetalist)
+/// \details Column i is [ad_Jbi] (sum_{k>i} Jbk * dthetak), the Lie bracket of
+///          column i with the twist generated by the joints distal to it.
+const arma::mat JacobianBodyDot(
+  const std::vector<arma::vec6> & Blist,
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes the time derivative of the body Jacobian for a chain of
+///        classified joints
+/// \param Blist The classified joint screw axes in the end-effector frame
+/// \param thetalist A list of joint coordinates
+/// \param dthetalist A list of joint rates
+/// \return The 6xn matrix dJb/dt at (thetalist, dthetalist)
+const arma::mat JacobianBodyDot(
+  const std::vector<Joint> & Blist,
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes dJb/dt * dthetalist without forming either matrix
+/// \param Blist The joint screw axes in the end-effector frame when the
+///              manipulator is at the home position, in the format of a
+///              matrix with axes as the columns
+/// \param thetalist A list of joint coordinates
+/// \param dthetalist A list of joint rates
+/// \return The velocity-product term of the end-effector acceleration, in
+///         the end-effector frame
+const arma::vec6 JacobianBodyDotProduct(
+  const std::vector<arma::vec6> & Blist,
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes dJb/dt * dthetalist for a chain of classified joints
+/// \param Blist The classified joint screw axes in the end-effector frame
+/// \param thetalist A list of joint coordinates
+/// \param dthetalist A list of joint rates
+/// \return The velocity-product term of the end-effector acceleration, in
+///         the end-effector frame
+const arma::vec6 JacobianBodyDotProduct(
+  const std::vector<Joint> & Blist,
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes the time derivative of the space Jacobian
+/// \param Slist The joint screw axes in the space frame when the
+///              manipulator is at the home position, in the format of a
+///              matrix with axes as the columns
+/// \param thetalist A list of joint coordinates
+/// \param dthetalist A list of joint rates
+/// \return The 6xn matrix dJs/dt at (thetalist, dthetalist)
+/// \details Column i is [ad_V] Jsi with V = sum_{k<i} Jsk * dthetak, the twist
+///          of the link that carries joint i.
+const arma::mat JacobianSpaceDot(
+  const std::vector<arma::vec6> & Slist,
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes the time derivative of the space Jacobian for a chain of
+///        classified joints
+/// \param Slist The classified joint screw axes in the space frame
+/// \param thetalist A list of joint coordinates
+/// \param dthetalist A list of joint rates
+/// \return The 6xn matrix dJs/dt at (thetalist, dthetalist)
+const arma::mat JacobianSpaceDot(
+  const std::vector<Joint> & Slist,
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes dJs/dt * dthetalist without forming either matrix
+/// \param Slist The joint screw axes in the space frame when the
+///              manipulator is at the home position, in the format of a
+///              matrix with axes as the columns
+/// \param thetalist A list of joint coordinates
+/// \param dthetalist A list of joint rates
+/// \return The velocity-product term of the end-effector acceleration, in
+///         the space frame
+const arma::vec6 JacobianSpaceDotProduct(
+  const std::vector<arma::vec6> & Slist,
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist
+);
+
+/// \ingroup velocity_kinematics_and_statics
+/// \brief Computes dJs/dt * dthetalist for a chain of classified joints
+/// \param Slist The classified joint screw axes in the space frame
+/// \param thetalist A list of joint coordinates
+/// \param dthetalist A list of joint rates
+/// \return The velocity-product term of the end-effector acceleration, in
+///         the space frame
+const arma::vec6 JacobianSpaceDotProduct(
+  const std::vector<Joint> & Slist,
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist
+);
 }
 
 #endif
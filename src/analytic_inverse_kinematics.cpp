@@ -0,0 +1,439 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "modern_robotics/utils.hpp"
+#include "modern_robotics/rigid_body_motions.hpp"
+#include "modern_robotics/analytic_inverse_kinematics.hpp"
+
+namespace mr
+{
+namespace
+{
+/// \brief Largest end-effector mismatch accepted when verifying a solution
+constexpr double verify_tolerance = 1e-6;
+
+/// \brief Up to two solutions of a subproblem
+struct Angles
+{
+  std::array<double, 2> value{};
+  size_t count = 0;
+
+  void push(const double theta)
+  {
+    value.at(count++) = theta;
+  }
+};
+
+/// \brief Up to two solution pairs of subproblem 2
+struct AnglePairs
+{
+  std::array<std::array<double, 2>, 2> value{};
+  size_t count = 0;
+
+  void push(const double theta1, const double theta2)
+  {
+    value.at(count++) = {theta1, theta2};
+  }
+};
+
+double Wrap(const double theta)
+{
+  return std::remainder(theta, 2.0 * arma::datum::pi);
+}
+
+/// \brief Applies a homogeneous transformation to a point
+const arma::vec3 Apply(const arma::mat44 & T, const arma::vec3 & p)
+{
+  return arma::vec3{
+    T.at(0, 0) * p.at(0) + T.at(0, 1) * p.at(1) + T.at(0, 2) * p.at(2) + T.at(0, 3),
+    T.at(1, 0) * p.at(0) + T.at(1, 1) * p.at(1) + T.at(1, 2) * p.at(2) + T.at(1, 3),
+    T.at(2, 0) * p.at(0) + T.at(2, 1) * p.at(1) + T.at(2, 2) * p.at(2) + T.at(2, 3)
+  };
+}
+
+/// \brief A unit vector perpendicular to w
+const arma::vec3 Perpendicular(const arma::vec3 & w)
+{
+  const arma::uword i = arma::abs(w).index_min();
+  arma::vec3 e{arma::fill::zeros};
+  e.at(i) = 1.0;
+  const arma::vec3 n = arma::cross(w, e);
+  return n / arma::norm(n);
+}
+
+bool Parallel(const arma::vec3 & wa, const arma::vec3 & wb)
+{
+  return NearZero(arma::norm(arma::cross(wa, wb)));
+}
+
+bool OnAxis(const arma::vec3 & w, const arma::vec3 & q, const arma::vec3 & p)
+{
+  return NearZero(arma::norm(arma::cross(p - q, w)));
+}
+
+/// \brief Finds the intersection of the lines qa + t wa and qb + s wb
+/// \return false if the lines are parallel or skew
+bool Intersection(
+  const arma::vec3 & wa, const arma::vec3 & qa,
+  const arma::vec3 & wb, const arma::vec3 & qb,
+  arma::vec3 & point)
+{
+  const arma::vec3 n = arma::cross(wa, wb);
+  const double nn = arma::dot(n, n);
+  const arma::vec3 d = qb - qa;
+
+  if (NearZero(nn) || !NearZero(arma::dot(d, n) / std::sqrt(nn))) {
+    return false;
+  }
+
+  point = qa + arma::dot(arma::cross(d, wb), n) / nn * wa;
+  return true;
+}
+
+/// \brief Paden-Kahan subproblem 1: the rotation about the axis (w, r) that
+///        takes p to q
+double Subproblem1(
+  const arma::vec3 & w, const arma::vec3 & r,
+  const arma::vec3 & p, const arma::vec3 & q)
+{
+  const arma::vec3 u = p - r;
+  const arma::vec3 v = q - r;
+  const arma::vec3 up = u - arma::dot(w, u) * w;
+  const arma::vec3 vp = v - arma::dot(w, v) * w;
+
+  return std::atan2(arma::dot(w, arma::cross(up, vp)), arma::dot(up, vp));
+}
+
+/// \brief Paden-Kahan subproblem 2: rotations about the axes (w1, r) and
+///        (w2, r) with e^[w1]theta1 e^[w2]theta2 p = q
+AnglePairs Subproblem2(
+  const arma::vec3 & w1, const arma::vec3 & w2, const arma::vec3 & r,
+  const arma::vec3 & p, const arma::vec3 & q)
+{
+  AnglePairs solutions;
+  const arma::vec3 u = p - r;
+  const arma::vec3 v = q - r;
+  const double a = arma::dot(w1, w2);
+  const double den = a * a - 1.0;
+
+  if (NearZero(den)) {
+    return solutions;
+  }
+
+  const double alpha = (a * arma::dot(w2, u) - arma::dot(w1, v)) / den;
+  const double beta = (a * arma::dot(w1, v) - arma::dot(w2, u)) / den;
+  const arma::vec3 n = arma::cross(w1, w2);
+  const double gamma2 = (arma::dot(u, u) - alpha * alpha - beta * beta - 2.0 * alpha * beta * a) /
+    arma::dot(n, n);
+
+  if (gamma2 < -tolerance) {
+    return solutions;
+  }
+
+  const double gamma = std::sqrt(std::max(0.0, gamma2));
+  for (const double sign : {1.0, -1.0}) {
+    const arma::vec3 c = r + alpha * w1 + beta * w2 + sign * gamma * n;
+    solutions.push(Subproblem1(w1, r, c, q), Subproblem1(w2, r, p, c));
+    if (NearZero(gamma)) {
+      break;
+    }
+  }
+
+  return solutions;
+}
+
+/// \brief Paden-Kahan subproblem 3: the rotations about the axis (w, r) that
+///        bring p to a distance delta from q
+Angles Subproblem3(
+  const arma::vec3 & w, const arma::vec3 & r,
+  const arma::vec3 & p, const arma::vec3 & q, const double delta)
+{
+  Angles solutions;
+  const arma::vec3 u = p - r;
+  const arma::vec3 v = q - r;
+  const arma::vec3 up = u - arma::dot(w, u) * w;
+  const arma::vec3 vp = v - arma::dot(w, v) * w;
+  const double nu = arma::norm(up);
+  const double nv = arma::norm(vp);
+  const double h = arma::dot(w, p - q);
+
+  if (NearZero(nu) || NearZero(nv)) {
+    return solutions;
+  }
+
+  const double c = (nu * nu + nv * nv - (delta * delta - h * h)) / (2.0 * nu * nv);
+  if (std::fabs(c) > 1.0 + tolerance) {
+    return solutions;
+  }
+
+  const double theta0 = std::atan2(arma::dot(w, arma::cross(up, vp)), arma::dot(up, vp));
+  const double phi = std::acos(std::clamp(c, -1.0, 1.0));
+  solutions.push(theta0 + phi);
+  if (!NearZero(phi)) {
+    solutions.push(theta0 - phi);
+  }
+
+  return solutions;
+}
+
+/// \brief Paden-Kahan subproblem 4: the rotations about the axis (w, r) that
+///        move p onto the plane h . x = d
+Angles Subproblem4(
+  const arma::vec3 & w, const arma::vec3 & r,
+  const arma::vec3 & p, const arma::vec3 & h, const double d)
+{
+  Angles solutions;
+  const arma::vec3 u = p - r;
+  const arma::vec3 upar = arma::dot(w, u) * w;
+  const arma::vec3 up = u - upar;
+
+  // h . (r + upar + cos(theta) up + sin(theta) w x up) = d
+  const double A = arma::dot(h, up);
+  const double B = arma::dot(h, arma::cross(w, up));
+  const double C = d - arma::dot(h, r) - arma::dot(h, upar);
+  const double rho = std::sqrt(A * A + B * B);
+
+  if (NearZero(rho) || std::fabs(C / rho) > 1.0 + tolerance) {
+    return solutions;
+  }
+
+  const double alpha = std::atan2(B, A);
+  const double phi = std::acos(std::clamp(C / rho, -1.0, 1.0));
+  solutions.push(alpha + phi);
+  if (!NearZero(phi)) {
+    solutions.push(alpha - phi);
+  }
+
+  return solutions;
+}
+}
+
+AnalyticIK::AnalyticIK(
+  const std::vector<arma::vec6> & list,
+  const arma::mat44 & M,
+  const IKFrame frame
+)
+: M_(M), Minv_(TransInv(M))
+{
+  if (frame == IKFrame::Body) {
+    for (const arma::vec6 & B : list) {
+      Slist_.push_back(AdjointMap(M, B));
+    }
+  } else {
+    Slist_ = list;
+  }
+  joints_ = ClassifyJoints(Slist_);
+
+  if (joints_.size() != 6) {
+    return;
+  }
+
+  for (const Joint & joint : joints_) {
+    const arma::vec3 w = joint.S.subvec(0, 2);
+    const arma::vec3 v = joint.S.subvec(3, 5);
+    if (joint.type != JointType::Revolute || !NearZero(arma::dot(w, v))) {
+      return;
+    }
+
+    // v = -w x q, so w x v is the point on the axis closest to the origin
+    w_.push_back(w);
+    q_.push_back(arma::cross(w, v));
+  }
+
+  if (Intersection(w_.at(0), q_.at(0), w_.at(1), q_.at(1), shoulder_) &&
+    Parallel(w_.at(1), w_.at(2)) && !OnAxis(w_.at(1), q_.at(1), q_.at(2)) &&
+    Intersection(w_.at(3), q_.at(3), w_.at(4), q_.at(4), wrist_) &&
+    OnAxis(w_.at(5), q_.at(5), wrist_) && !Parallel(w_.at(4), w_.at(5)) &&
+    !OnAxis(w_.at(2), q_.at(2), wrist_))
+  {
+    geometry_ = ArmGeometry::SphericalWrist;
+  } else if (Parallel(w_.at(1), w_.at(2)) && Parallel(w_.at(2), w_.at(3)) &&
+    Intersection(w_.at(4), q_.at(4), w_.at(5), q_.at(5), wrist_) &&
+    !Parallel(w_.at(0), w_.at(1)) && !Parallel(w_.at(4), w_.at(1)))
+  {
+    geometry_ = ArmGeometry::OffsetWrist;
+  }
+}
+
+ArmGeometry AnalyticIK::geometry() const
+{
+  return geometry_;
+}
+
+const std::vector<arma::vec> AnalyticIK::SolveAll(const arma::mat44 & T) const
+{
+  std::vector<arma::vec> solutions;
+  if (geometry_ == ArmGeometry::General) {
+    return solutions;
+  }
+
+  const arma::mat44 g = T * Minv_;
+  const auto exp = [&](const size_t i, const double theta) {
+      return JointExp6(joints_.at(i), theta);
+    };
+  const auto add = [&](const arma::vec & candidate) {
+      arma::vec theta{candidate};
+      for (size_t i = 0; i < theta.n_elem; ++i) {
+        theta.at(i) = Wrap(theta.at(i));
+      }
+
+      const arma::mat44 Tsol = FKinSpace(M_, joints_, theta);
+      if (arma::abs(Tsol - T).max() > verify_tolerance) {
+        return;
+      }
+      for (const arma::vec & other : solutions) {
+        if (arma::abs(other - theta).max() < verify_tolerance) {
+          return;
+        }
+      }
+      solutions.push_back(theta);
+    };
+
+  if (geometry_ == ArmGeometry::SphericalWrist) {
+    // The wrist center is fixed by joints 4 to 6 and axes 1 and 2 keep the
+    // distance to the shoulder, which leaves theta3 alone
+    const arma::vec3 gw = Apply(g, wrist_);
+    const Angles theta3 = Subproblem3(
+      w_.at(2), q_.at(2), wrist_, shoulder_, arma::norm(gw - shoulder_));
+
+    for (size_t i3 = 0; i3 < theta3.count; ++i3) {
+      const double t3 = theta3.value.at(i3);
+      const arma::mat44 e3 = exp(2, t3);
+      const AnglePairs theta12 = Subproblem2(
+        w_.at(0), w_.at(1), shoulder_, Apply(e3, wrist_), gw);
+
+      for (size_t i12 = 0; i12 < theta12.count; ++i12) {
+        const auto & [t1, t2] = theta12.value.at(i12);
+        const arma::mat44 g456 = TransInv(exp(0, t1) * exp(1, t2) * e3) * g;
+
+        // A point on axis 6 is only moved by joints 4 and 5
+        const arma::vec3 p6 = wrist_ + w_.at(5);
+        const AnglePairs theta45 = Subproblem2(
+          w_.at(3), w_.at(4), wrist_, p6, Apply(g456, p6));
+
+        for (size_t i45 = 0; i45 < theta45.count; ++i45) {
+          const auto & [t4, t5] = theta45.value.at(i45);
+          const arma::mat44 g6 = TransInv(exp(3, t4) * exp(4, t5)) * g456;
+          const arma::vec3 p = wrist_ + Perpendicular(w_.at(5));
+          const double t6 = Subproblem1(w_.at(5), wrist_, p, Apply(g6, p));
+
+          add(arma::vec{t1, t2, t3, t4, t5, t6});
+        }
+      }
+    }
+  } else {
+    // Joints 2 to 4 rotate about parallel axes along h: they keep the
+    // component along h of every point and leave the direction h itself fixed
+    const arma::vec3 & h = w_.at(1);
+    const arma::mat33 Rg = g.submat(0, 0, 2, 2);
+    const arma::vec3 zero{arma::fill::zeros};
+
+    // h . e^-[S1]theta1 g p56 = h . p56
+    const Angles theta1 = Subproblem4(
+      w_.at(0), q_.at(0), Apply(g, wrist_), h, arma::dot(h, wrist_));
+
+    for (size_t i1 = 0; i1 < theta1.count; ++i1) {
+      const double t1 = -theta1.value.at(i1);
+      const arma::mat44 e1 = exp(0, t1);
+      const arma::mat33 R1 = e1.submat(0, 0, 2, 2);
+
+      // h^T R5 w6 = h^T R1^T Rg w6
+      const Angles theta5 = Subproblem4(
+        w_.at(4), zero, w_.at(5), h, arma::dot(h, R1.t() * Rg * w_.at(5)));
+
+      for (size_t i5 = 0; i5 < theta5.count; ++i5) {
+        const double t5 = theta5.value.at(i5);
+        const arma::mat44 e5 = exp(4, t5);
+        const arma::mat33 R5 = e5.submat(0, 0, 2, 2);
+
+        // R6^T R5^T h = Rg^T R1 h; at a wrist singularity any theta6 works
+        const double t6 = -Subproblem1(w_.at(5), zero, R5.t() * h, Rg.t() * R1 * h);
+        const arma::mat44 g234 = TransInv(e1) * g * TransInv(e5 * exp(5, t6));
+
+        // A point on axis 4 is only moved by joints 2 and 3
+        const arma::vec3 & p4 = q_.at(3);
+        const arma::vec3 gp4 = Apply(g234, p4);
+        const Angles theta3 = Subproblem3(
+          w_.at(2), q_.at(2), p4, q_.at(1), arma::norm(gp4 - q_.at(1)));
+
+        for (size_t i3 = 0; i3 < theta3.count; ++i3) {
+          const double t3 = theta3.value.at(i3);
+          const arma::mat44 e3 = exp(2, t3);
+          const double t2 = Subproblem1(w_.at(1), q_.at(1), Apply(e3, p4), gp4);
+
+          const arma::mat44 g4 = TransInv(exp(1, t2) * e3) * g234;
+          const arma::vec3 p = p4 + Perpendicular(w_.at(3));
+          const double t4 = Subproblem1(w_.at(3), p4, p, Apply(g4, p));
+
+          add(arma::vec{t1, t2, t3, t4, t5, t6});
+        }
+      }
+    }
+  }
+
+  return solutions;
+}
+
+const IKResult AnalyticIK::Solve(
+  const arma::mat44 & T,
+  const arma::vec & thetalist0,
+  const IKOptions & options
+) const
+{
+  const auto start = std::chrono::steady_clock::now();
+  if (thetalist0.n_elem != joints_.size()) {
+    throw std::invalid_argument("AnalyticIK::Solve: thetalist0 must have one entry per joint");
+  }
+  CheckJointLimits(options, joints_.size());
+  const std::vector<arma::vec> solutions = SolveAll(T);
+
+  if (solutions.empty()) {
+    return IKinSpaceDLS(Slist_, M_, T, thetalist0, options);
+  }
+
+  // Shift every solution by multiples of 2 pi towards the guess
+  arma::vec best;
+  double best_distance = std::numeric_limits<double>::infinity();
+  for (const arma::vec & solution : solutions) {
+    arma::vec theta{solution - thetalist0};
+    for (size_t i = 0; i < theta.n_elem; ++i) {
+      theta.at(i) = Wrap(theta.at(i));
+    }
+    const double distance = arma::norm(theta);
+
+    bool feasible = true;
+    if (!options.lower.is_empty()) {
+      for (size_t i = 0; i < theta.n_elem; ++i) {
+        const double angle = thetalist0.at(i) + theta.at(i);
+        feasible = feasible && angle >= options.lower.at(i) && angle <= options.upper.at(i);
+      }
+    }
+
+    if (feasible && distance < best_distance) {
+      best_distance = distance;
+      best = thetalist0 + theta;
+    }
+  }
+
+  if (best.is_empty()) {
+    return IKinSpaceDLS(Slist_, M_, T, thetalist0, options);
+  }
+
+  const arma::mat44 Tsb = FKinSpace(M_, joints_, best);
+  const arma::vec6 Vs = AdjointMap(Tsb, se3ToVec(MatrixLog6(TransInv(Tsb) * T)));
+  const double angular_error = arma::norm(Vs.subvec(0, 2));
+  const double linear_error = arma::norm(Vs.subvec(3, 5));
+  const bool success = angular_error <= options.eomg && linear_error <= options.ev;
+  const double wall_time = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start).count();
+
+  IKResult result{best, success, 0, angular_error, linear_error, wall_time,
+    success ? IKTermination::Converged : IKTermination::MaxIterations, {}};
+  JointLimitStatuses(best, options, result.limits);
+  return result;
+}
+}
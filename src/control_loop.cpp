@@ -0,0 +1,372 @@
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <future>
+#include <stdexcept>
+#include <utility>
+
+#include "modern_robotics/control_loop.hpp"
+
+namespace mr
+{
+namespace
+{
+constexpr int64_t kNanoseconds = 1000000000;
+
+/// The layout of the statistics in their SeqLock
+enum Stat : size_t
+{
+  kCycles,
+  kOverruns,
+  kLatencySum,
+  kLatencyMax,
+  kPeriodSum,
+  kPeriodSquares,
+  kPeriodMin,
+  kPeriodMax,
+  kComputeSum,
+  kComputeMax,
+  kStats
+};
+
+int64_t Now()
+{
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * kNanoseconds + now.tv_nsec;
+}
+
+void SleepUntil(const int64_t deadline)
+{
+  timespec t;
+  t.tv_sec = deadline / kNanoseconds;
+  t.tv_nsec = deadline % kNanoseconds;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, nullptr) == EINTR) {
+  }
+}
+
+/// \brief Applies the scheduling settings to the calling thread
+/// \return Whether all requested settings were applied
+bool Schedule(const ControlLoopOptions & options)
+{
+  bool scheduled = true;
+  if (options.cpu >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(options.cpu, &cpus);
+    scheduled = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+  }
+  if (options.priority > 0) {
+    sched_param param{};
+    param.sched_priority = options.priority;
+    scheduled = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0 && scheduled;
+  }
+  return scheduled;
+}
+}
+
+SeqLock::SeqLock(const size_t size)
+: size_(size),
+  data_(new std::atomic<double>[size])
+{
+  for (size_t i = 0; i < size_; ++i) {
+    data_[i].store(0.0, std::memory_order_relaxed);
+  }
+}
+
+size_t SeqLock::size() const
+{
+  return size_;
+}
+
+void SeqLock::Write(const arma::vec & data)
+{
+  if (data.n_elem != size_) {
+    throw std::invalid_argument("SeqLock::Write: data must have size() entries");
+  }
+
+  const uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+  sequence_.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for (size_t i = 0; i < size_; ++i) {
+    data_[i].store(data.at(i), std::memory_order_relaxed);
+  }
+  sequence_.store(sequence + 2, std::memory_order_release);
+}
+
+bool SeqLock::TryRead(arma::vec & data) const
+{
+  if (data.n_elem != size_) {
+    data.set_size(size_);
+  }
+
+  const uint64_t before = sequence_.load(std::memory_order_acquire);
+  if (before % 2 != 0) {
+    return false;
+  }
+  for (size_t i = 0; i < size_; ++i) {
+    data.at(i) = data_[i].load(std::memory_order_relaxed);
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return sequence_.load(std::memory_order_relaxed) == before;
+}
+
+void SeqLock::Read(arma::vec & data) const
+{
+  while (!TryRead(data)) {
+    std::this_thread::yield();
+  }
+}
+
+SimulatedRobot::SimulatedRobot(
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist,
+  const arma::vec3 & g,
+  const std::vector<arma::mat44> & Mlist,
+  const std::vector<arma::mat66> & Glist,
+  const std::vector<arma::vec6> & Slist,
+  const double dt,
+  const size_t intRes
+)
+: dynamics_(Mlist, Glist, Slist),
+  g_(g),
+  dt_(dt),
+  intRes_(intRes),
+  Ftip_(arma::fill::zeros),
+  thetalist_(thetalist),
+  dthetalist_(dthetalist),
+  ddthetalist_(Slist.size(), arma::fill::zeros)
+{
+  if (thetalist.n_elem != Slist.size() || dthetalist.n_elem != Slist.size()) {
+    throw std::invalid_argument(
+            "SimulatedRobot: joint vectors must have one entry per joint");
+  }
+  if (!(dt > 0.0) || intRes == 0) {
+    throw std::invalid_argument("SimulatedRobot: dt and intRes must be positive");
+  }
+}
+
+void SimulatedRobot::Read(arma::vec & thetalist, arma::vec & dthetalist)
+{
+  thetalist = thetalist_;
+  dthetalist = dthetalist_;
+}
+
+void SimulatedRobot::Write(const arma::vec & taulist)
+{
+  const double h = dt_ / static_cast<double>(intRes_);
+  for (size_t k = 0; k < intRes_; ++k) {
+    dynamics_.ForwardDynamics(thetalist_, dthetalist_, taulist, g_, Ftip_, ddthetalist_);
+    thetalist_ += h * dthetalist_;
+    dthetalist_ += h * ddthetalist_;
+  }
+}
+
+ControlLoop::ControlLoop(
+  RobotInterface & robot,
+  const ControlLaw & law,
+  const ControlSetpoint & setpoint,
+  const ControlLoopOptions & options
+)
+: robot_(robot),
+  law_(law),
+  options_(options),
+  n_(setpoint.thetalistd.n_elem),
+  setpoint_(setpoint),
+  state_(2 + 3 * setpoint.thetalistd.n_elem),
+  stats_(kStats)
+{
+  if (!(options.period > 0.0)) {
+    throw std::invalid_argument("ControlLoop: period must be positive");
+  }
+  if (setpoint.dthetalistd.n_elem != n_ || setpoint.ddthetalistd.n_elem != n_) {
+    throw std::invalid_argument("ControlLoop: setpoint vectors must have the same length");
+  }
+}
+
+ControlLoop::~ControlLoop()
+{
+  try {
+    Stop();
+  } catch (...) {
+  }
+}
+
+void ControlLoop::Start()
+{
+  if (running_.load()) {
+    throw std::runtime_error("ControlLoop::Start: the loop is already running");
+  }
+  // A loop that ended on an error has not been joined yet
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+
+  std::promise<bool> ready;
+  std::future<bool> scheduled = ready.get_future();
+  stop_.store(false);
+  error_ = nullptr;
+  running_.store(true);
+  thread_ = std::thread(
+    [this, ready = std::move(ready)]() mutable {
+      ready.set_value(Schedule(options_));
+      Run();
+    });
+  scheduled_.store(scheduled.get());
+}
+
+void ControlLoop::Stop()
+{
+  stop_.store(true);
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  if (error_) {
+    std::exception_ptr error = error_;
+    error_ = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+bool ControlLoop::running() const
+{
+  return running_.load();
+}
+
+bool ControlLoop::scheduled() const
+{
+  return scheduled_.load();
+}
+
+void ControlLoop::SetSetpoint(const ControlSetpoint & setpoint)
+{
+  if (setpoint.thetalistd.n_elem != n_ || setpoint.dthetalistd.n_elem != n_ ||
+    setpoint.ddthetalistd.n_elem != n_)
+  {
+    throw std::invalid_argument(
+            "ControlLoop::SetSetpoint: setpoint vectors must have the initial length");
+  }
+  setpoint_.Write(setpoint);
+}
+
+void ControlLoop::State(ControlLoopState & state) const
+{
+  arma::vec data;
+  state_.Read(data);
+
+  const size_t n = n_;
+  state.cycle = static_cast<uint64_t>(data.at(0));
+  state.time = data.at(1);
+  state.thetalist.set_size(n);
+  state.dthetalist.set_size(n);
+  state.taulist.set_size(n);
+  for (size_t i = 0; i < n; ++i) {
+    state.thetalist.at(i) = data.at(2 + i);
+    state.dthetalist.at(i) = data.at(2 + n + i);
+    state.taulist.at(i) = data.at(2 + 2 * n + i);
+  }
+}
+
+const ControlLoopStats ControlLoop::stats() const
+{
+  arma::vec data;
+  stats_.Read(data);
+
+  ControlLoopStats stats;
+  stats.cycles = static_cast<uint64_t>(data.at(kCycles));
+  stats.overruns = static_cast<uint64_t>(data.at(kOverruns));
+  if (stats.cycles > 0) {
+    const double cycles = static_cast<double>(stats.cycles);
+    stats.latency_mean = data.at(kLatencySum) / cycles;
+    stats.latency_max = data.at(kLatencyMax);
+    stats.compute_mean = data.at(kComputeSum) / cycles;
+    stats.compute_max = data.at(kComputeMax);
+  }
+  if (stats.cycles > 1) {
+    const double periods = static_cast<double>(stats.cycles - 1);
+    stats.period_mean = data.at(kPeriodSum) / periods;
+    stats.period_stddev = std::sqrt(
+      std::max(0.0, data.at(kPeriodSquares) / periods - stats.period_mean * stats.period_mean));
+    stats.period_min = data.at(kPeriodMin);
+    stats.period_max = data.at(kPeriodMax);
+  }
+  return stats;
+}
+
+void ControlLoop::Run()
+{
+  const size_t n = n_;
+  const int64_t period = std::max<int64_t>(
+    1, std::llround(options_.period * static_cast<double>(kNanoseconds)));
+
+  ControlLoopState state;
+  state.thetalist.zeros(n);
+  state.dthetalist.zeros(n);
+  arma::vec taulist(n, arma::fill::zeros);
+  arma::vec published(state_.size(), arma::fill::zeros);
+  arma::vec stats(kStats, arma::fill::zeros);
+  stats.at(kPeriodMin) = arma::datum::inf;
+
+  const int64_t start = Now();
+  int64_t deadline = start;
+  int64_t previous = 0;
+  uint64_t cycle = 0;
+
+  try {
+    while (!stop_.load(std::memory_order_relaxed)) {
+      deadline += period;
+      SleepUntil(deadline);
+      const int64_t wake = Now();
+
+      robot_.Read(state.thetalist, state.dthetalist);
+      setpoint_.Update();
+      state.cycle = cycle;
+      state.time = static_cast<double>(deadline - start) / kNanoseconds;
+      law_(state, setpoint_.front(), taulist);
+      robot_.Write(taulist);
+      const int64_t done = Now();
+
+      const double latency = static_cast<double>(wake - deadline) / kNanoseconds;
+      const double compute = static_cast<double>(done - wake) / kNanoseconds;
+
+      // Skip the deadlines this cycle overran instead of running them late
+      if (done > deadline + period) {
+        stats.at(kOverruns) += 1.0;
+        deadline += (done - deadline) / period * period;
+      }
+
+      stats.at(kCycles) += 1.0;
+      stats.at(kLatencySum) += latency;
+      stats.at(kLatencyMax) = std::max(stats.at(kLatencyMax), latency);
+      stats.at(kComputeSum) += compute;
+      stats.at(kComputeMax) = std::max(stats.at(kComputeMax), compute);
+      if (cycle > 0) {
+        const double elapsed = static_cast<double>(wake - previous) / kNanoseconds;
+        stats.at(kPeriodSum) += elapsed;
+        stats.at(kPeriodSquares) += elapsed * elapsed;
+        stats.at(kPeriodMin) = std::min(stats.at(kPeriodMin), elapsed);
+        stats.at(kPeriodMax) = std::max(stats.at(kPeriodMax), elapsed);
+      }
+      previous = wake;
+
+      published.at(0) = static_cast<double>(cycle);
+      published.at(1) = state.time;
+      for (size_t i = 0; i < n; ++i) {
+        published.at(2 + i) = state.thetalist.at(i);
+        published.at(2 + n + i) = state.dthetalist.at(i);
+        published.at(2 + 2 * n + i) = taulist.at(i);
+      }
+      state_.Write(published);
+      stats_.Write(stats);
+      ++cycle;
+    }
+  } catch (...) {
+    error_ = std::current_exception();
+  }
+  running_.store(false);
+}
+}
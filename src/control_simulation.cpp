@@ -0,0 +1,214 @@
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+
+#include "modern_robotics/dynamics_of_open_chains.hpp"
+#include "modern_robotics/control_simulation.hpp"
+
+namespace mr
+{
+namespace
+{
+/// \brief The plant state and the storage of one integration step
+struct Plant
+{
+  Plant(
+    const arma::vec & thetalist,
+    const arma::vec & dthetalist,
+    const std::vector<arma::mat44> & Mlist,
+    const std::vector<arma::mat66> & Glist,
+    const std::vector<arma::vec6> & Slist,
+    const ActuatorModel & actuators,
+    DynamicsCache * cache)
+  : own(cache ? nullptr : std::make_unique<DynamicsCache>(Mlist, Glist, Slist)),
+    dynamics(cache ? *cache : *own),
+    theta(thetalist),
+    dtheta(dthetalist)
+  {
+    if (own) {
+      own->SetActuators(actuators);
+    }
+    const size_t n = Slist.size();
+    for (arma::vec * v : {&a1, &a2, &a3, &a4, &theta2, &theta3, &theta4, &dtheta2, &dtheta3,
+        &dtheta4})
+    {
+      v->zeros(n);
+    }
+  }
+
+  /// \brief Advances the state by h with the torques and tip force held
+  void Step(
+    const Integrator integrator,
+    const double h,
+    const arma::vec & taulist,
+    const arma::vec3 & g,
+    const arma::vec6 & Ftip)
+  {
+    dynamics.ForwardDynamics(theta, dtheta, taulist, g, Ftip, a1);
+    switch (integrator) {
+      case Integrator::Euler:
+        theta += h * dtheta;
+        dtheta += h * a1;
+        break;
+      case Integrator::SemiImplicitEuler:
+        dtheta += h * a1;
+        theta += h * dtheta;
+        break;
+      case Integrator::RK4:
+        theta2 = theta + (0.5 * h) * dtheta;
+        dtheta2 = dtheta + (0.5 * h) * a1;
+        dynamics.ForwardDynamics(theta2, dtheta2, taulist, g, Ftip, a2);
+        theta3 = theta + (0.5 * h) * dtheta2;
+        dtheta3 = dtheta + (0.5 * h) * a2;
+        dynamics.ForwardDynamics(theta3, dtheta3, taulist, g, Ftip, a3);
+        theta4 = theta + h * dtheta3;
+        dtheta4 = dtheta + h * a3;
+        dynamics.ForwardDynamics(theta4, dtheta4, taulist, g, Ftip, a4);
+        theta += (h / 6.0) * (dtheta + 2.0 * dtheta2 + 2.0 * dtheta3 + dtheta4);
+        dtheta += (h / 6.0) * (a1 + 2.0 * a2 + 2.0 * a3 + a4);
+        break;
+    }
+  }
+
+  std::unique_ptr<DynamicsCache> own;
+  DynamicsCache & dynamics;
+  arma::vec theta;
+  arma::vec dtheta;
+  arma::vec a1; /// The accelerations at the stages of the step
+  arma::vec a2;
+  arma::vec a3;
+  arma::vec a4;
+  arma::vec theta2;
+  arma::vec theta3;
+  arma::vec theta4;
+  arma::vec dtheta2;
+  arma::vec dtheta3;
+  arma::vec dtheta4;
+};
+
+/// \brief Fixed-capacity queue of commands waiting for the actuator delay
+class DelayLine
+{
+public:
+  DelayLine(const size_t capacity, const size_t n)
+  : times_(capacity, 0.0),
+    commands_(capacity, arma::vec(n, arma::fill::zeros))
+  {
+  }
+
+  /// \brief Queues a command that takes effect at time t, applying the oldest
+  ///        one early if the queue is full
+  void Push(const double t, const arma::vec & taulist, arma::vec & applied)
+  {
+    if (size_ == times_.size()) {
+      Pop(applied);
+    }
+    const size_t tail = (head_ + size_) % times_.size();
+    times_.at(tail) = t;
+    commands_.at(tail) = taulist;
+    ++size_;
+  }
+
+  /// \brief Applies every command due by time t
+  void Apply(const double t, arma::vec & applied)
+  {
+    while (size_ > 0 && times_.at(head_) <= t) {
+      Pop(applied);
+    }
+  }
+
+private:
+  void Pop(arma::vec & applied)
+  {
+    applied = commands_.at(head_);
+    head_ = (head_ + 1) % times_.size();
+    --size_;
+  }
+
+  std::vector<double> times_;
+  std::vector<arma::vec> commands_;
+  size_t head_ = 0;
+  size_t size_ = 0;
+};
+}
+
+const SimulationResult SimulateClosedLoop(
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist,
+  const arma::vec3 & g,
+  const std::vector<arma::mat44> & Mlist,
+  const std::vector<arma::mat66> & Glist,
+  const std::vector<arma::vec6> & Slist,
+  const ControllerFunction & controller,
+  const size_t steps,
+  const SimulationOptions & options,
+  const SimulationObserver & observer
+)
+{
+  const size_t n = Slist.size();
+  const double Tc = options.controller_dt;
+  const double h = options.plant_dt;
+  const double delay = options.actuator_delay;
+
+  if (thetalist.n_elem != n || dthetalist.n_elem != n) {
+    throw std::invalid_argument(
+            "SimulateClosedLoop: initial state must have one entry per joint");
+  }
+  if (!options.initial_torque.is_empty() && options.initial_torque.n_elem != n) {
+    throw std::invalid_argument(
+            "SimulateClosedLoop: initial_torque must have one entry per joint");
+  }
+  if (!controller) {
+    throw std::invalid_argument("SimulateClosedLoop: controller must not be empty");
+  }
+  if (options.cache && options.cache->size() != n) {
+    throw std::invalid_argument("SimulateClosedLoop: cache must be of a chain of n joints");
+  }
+  if (!(Tc > 0.0) || !(h > 0.0) || !(delay >= 0.0)) {
+    throw std::invalid_argument(
+            "SimulateClosedLoop: rates must be positive and the delay non-negative");
+  }
+
+  // Times within a billionth of a plant step count as equal, so that rates
+  // and delays that are multiples of each other line up despite rounding
+  const double eps = 1e-9 * h;
+  const double duration = static_cast<double>(steps) * Tc;
+  const size_t K = steps == 0 ? 0 : static_cast<size_t>(std::ceil(duration / h - 1e-9));
+
+  Plant plant(
+    thetalist, dthetalist, Mlist, Glist, Slist, options.actuators, options.cache);
+  DelayLine delayed(static_cast<size_t>(std::ceil((delay + h) / Tc)) + 2, n);
+  arma::vec command(n, arma::fill::zeros);
+  arma::vec applied(n, arma::fill::zeros);
+  if (!options.initial_torque.is_empty()) {
+    applied = options.initial_torque;
+  }
+  arma::vec6 Ftip{arma::fill::zeros};
+
+  size_t i = 0;
+  for (size_t k = 0; k < K; ++k) {
+    const double t = static_cast<double>(k) * h;
+
+    while (i < steps && static_cast<double>(i) * Tc <= t + eps) {
+      controller(i, t, plant.theta, plant.dtheta, command);
+      if (command.n_elem != n) {
+        throw std::invalid_argument(
+                "SimulateClosedLoop: controller must command one torque per joint");
+      }
+      if (observer) {
+        observer(i, t, plant.theta, plant.dtheta, command);
+      }
+      delayed.Push(t + delay, command, applied);
+      ++i;
+    }
+    delayed.Apply(t + eps, applied);
+
+    if (options.Ftip) {
+      Ftip = options.Ftip(t);
+    }
+    plant.Step(options.integrator, h, applied, g, Ftip);
+  }
+
+  return {plant.theta, plant.dtheta, K};
+}
+}
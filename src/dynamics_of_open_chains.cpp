@@ -1,10 +1,205 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
 #include <armadillo>
 
+#include "modern_robotics/utils.hpp"
+#include "modern_robotics/latency_histogram.hpp"
 #include "modern_robotics/rigid_body_motions.hpp"
 #include "modern_robotics/dynamics_of_open_chains.hpp"
 
 namespace mr
 {
+namespace
+{
+/// \brief Computes [Ad_T] V from the rotation and position of T
+void AdjointApply(const arma::mat44 & T, const arma::vec6 & V, arma::vec6 & out)
+{
+  double w[3];
+  for (size_t r = 0; r < 3; ++r) {
+    w[r] = T.at(r, 0) * V.at(0) + T.at(r, 1) * V.at(1) + T.at(r, 2) * V.at(2);
+    out.at(r + 3) = T.at(r, 0) * V.at(3) + T.at(r, 1) * V.at(4) + T.at(r, 2) * V.at(5);
+  }
+
+  // v' = p x (R w) + R v
+  const double px = T.at(0, 3);
+  const double py = T.at(1, 3);
+  const double pz = T.at(2, 3);
+  out.at(0) = w[0];
+  out.at(1) = w[1];
+  out.at(2) = w[2];
+  out.at(3) += py * w[2] - pz * w[1];
+  out.at(4) += pz * w[0] - px * w[2];
+  out.at(5) += px * w[1] - py * w[0];
+}
+
+/// \brief Computes [Ad_T]^T F from the rotation and position of T
+void AdjointTransposeApply(const arma::mat44 & T, const arma::vec6 & F, arma::vec6 & out)
+{
+  // m' = R^T (m - p x f), f' = R^T f
+  const double px = T.at(0, 3);
+  const double py = T.at(1, 3);
+  const double pz = T.at(2, 3);
+  const double m[3] = {
+    F.at(0) - (py * F.at(5) - pz * F.at(4)),
+    F.at(1) - (pz * F.at(3) - px * F.at(5)),
+    F.at(2) - (px * F.at(4) - py * F.at(3))
+  };
+
+  for (size_t c = 0; c < 3; ++c) {
+    out.at(c) = T.at(0, c) * m[0] + T.at(1, c) * m[1] + T.at(2, c) * m[2];
+    out.at(c + 3) = T.at(0, c) * F.at(3) + T.at(1, c) * F.at(4) + T.at(2, c) * F.at(5);
+  }
+}
+
+/// \brief Writes [Ad_T] = [R 0; [p]R R] into preallocated storage
+void AdjointMatrix(const arma::mat44 & T, arma::mat66 & Ad)
+{
+  Ad.zeros();
+  for (size_t r = 0; r < 3; ++r) {
+    for (size_t c = 0; c < 3; ++c) {
+      Ad.at(r, c) = T.at(r, c);
+      Ad.at(r + 3, c + 3) = T.at(r, c);
+    }
+  }
+
+  const double px = T.at(0, 3);
+  const double py = T.at(1, 3);
+  const double pz = T.at(2, 3);
+  for (size_t c = 0; c < 3; ++c) {
+    Ad.at(3, c) = py * T.at(2, c) - pz * T.at(1, c);
+    Ad.at(4, c) = pz * T.at(0, c) - px * T.at(2, c);
+    Ad.at(5, c) = px * T.at(1, c) - py * T.at(0, c);
+  }
+}
+
+/// \brief Computes G + [Ad]^T I [Ad] with explicit loops, through the scratch
+///        storage IAd, since Armadillo keeps the 6x6 temporaries of the matrix
+///        expression on the heap
+void AddCongruence(
+  const arma::mat66 & G,
+  const arma::mat66 & Ad,
+  const arma::mat66 & I,
+  arma::mat66 & IAd,
+  arma::mat66 & out)
+{
+  for (size_t c = 0; c < 6; ++c) {
+    for (size_t r = 0; r < 6; ++r) {
+      double sum = 0.0;
+      for (size_t k = 0; k < 6; ++k) {
+        sum += I.at(r, k) * Ad.at(k, c);
+      }
+      IAd.at(r, c) = sum;
+    }
+  }
+  for (size_t c = 0; c < 6; ++c) {
+    for (size_t r = 0; r < 6; ++r) {
+      double sum = G.at(r, c);
+      for (size_t k = 0; k < 6; ++k) {
+        sum += Ad.at(k, r) * IAd.at(k, c);
+      }
+      out.at(r, c) = sum;
+    }
+  }
+}
+
+/// \brief Computes [ad_V] W
+void adApply(const arma::vec6 & V, const arma::vec6 & W, arma::vec6 & out)
+{
+  // [w x w2; w x v2 + v x w2]
+  out.at(0) = V.at(1) * W.at(2) - V.at(2) * W.at(1);
+  out.at(1) = V.at(2) * W.at(0) - V.at(0) * W.at(2);
+  out.at(2) = V.at(0) * W.at(1) - V.at(1) * W.at(0);
+  out.at(3) = V.at(1) * W.at(5) - V.at(2) * W.at(4) + V.at(4) * W.at(2) - V.at(5) * W.at(1);
+  out.at(4) = V.at(2) * W.at(3) - V.at(0) * W.at(5) + V.at(5) * W.at(0) - V.at(3) * W.at(2);
+  out.at(5) = V.at(0) * W.at(4) - V.at(1) * W.at(3) + V.at(3) * W.at(1) - V.at(4) * W.at(0);
+}
+
+/// \brief Computes [ad_V]^T F
+void adTransposeApply(const arma::vec6 & V, const arma::vec6 & F, arma::vec6 & out)
+{
+  // [-w x m - v x f; -w x f]
+  out.at(0) = -(V.at(1) * F.at(2) - V.at(2) * F.at(1)) - (V.at(4) * F.at(5) - V.at(5) * F.at(4));
+  out.at(1) = -(V.at(2) * F.at(0) - V.at(0) * F.at(2)) - (V.at(5) * F.at(3) - V.at(3) * F.at(5));
+  out.at(2) = -(V.at(0) * F.at(1) - V.at(1) * F.at(0)) - (V.at(3) * F.at(4) - V.at(4) * F.at(3));
+  out.at(3) = -(V.at(1) * F.at(5) - V.at(2) * F.at(4));
+  out.at(4) = -(V.at(2) * F.at(3) - V.at(0) * F.at(5));
+  out.at(5) = -(V.at(0) * F.at(4) - V.at(1) * F.at(3));
+}
+
+/// \brief Checks an actuator model against n joints and fills in its empty lists
+const ActuatorModel Complete(const ActuatorModel & actuators, const size_t n)
+{
+  ActuatorModel complete = actuators;
+  const std::pair<arma::vec *, double> lists[] = {
+    {&complete.gear_ratio, 1.0}, {&complete.rotor_inertia, 0.0}, {&complete.coulomb, 0.0},
+    {&complete.viscous, 0.0}, {&complete.stribeck_velocity, 0.0}
+  };
+  for (const std::pair<arma::vec *, double> & list : lists) {
+    if (list.first->is_empty()) {
+      list.first->set_size(n);
+      list.first->fill(list.second);
+    } else if (list.first->n_elem != n) {
+      throw std::invalid_argument(
+              "ActuatorModel: lists must be empty or have one entry per joint");
+    }
+  }
+  if (complete.static_friction.is_empty()) {
+    complete.static_friction = complete.coulomb;
+  } else if (complete.static_friction.n_elem != n) {
+    throw std::invalid_argument(
+            "ActuatorModel: lists must be empty or have one entry per joint");
+  }
+
+  bool valid = complete.smoothing >= 0.0;
+  for (size_t i = 0; i < n; ++i) {
+    valid = valid && complete.stribeck_velocity.at(i) >= 0.0;
+  }
+  if (!valid) {
+    throw std::invalid_argument(
+            "ActuatorModel: smoothing and Stribeck velocities must not be negative");
+  }
+  return complete;
+}
+
+/// \brief The friction of joint i of a complete actuator model at the rate v
+double Friction(const ActuatorModel & actuators, const size_t i, const double v)
+{
+  const double sign = actuators.smoothing > 0.0 ?
+    std::tanh(v / actuators.smoothing) : static_cast<double>((v > 0.0) - (v < 0.0));
+  double F = actuators.coulomb.at(i);
+  const double vs = actuators.stribeck_velocity.at(i);
+  if (vs > 0.0) {
+    const double r = v / vs;
+    F += (actuators.static_friction.at(i) - actuators.coulomb.at(i)) * std::exp(-r * r);
+  }
+  return F * sign + actuators.viscous.at(i) * v;
+}
+
+/// \brief The apparent rotor inertias G^2 I_rotor of a complete actuator model
+const arma::vec Armature(const ActuatorModel & actuators)
+{
+  const size_t n = actuators.gear_ratio.n_elem;
+  arma::vec armature(n, arma::fill::zeros);
+  for (size_t i = 0; i < n; ++i) {
+    const double G = actuators.gear_ratio.at(i);
+    armature.at(i) = G * G * actuators.rotor_inertia.at(i);
+  }
+  return armature;
+}
+
+/// \brief Whether x equals the key, entry for entry, storing it in the key if not
+bool Matches(arma::vec & key, const arma::vec & x)
+{
+  const bool same = Identical(key, x);
+  if (!same) {
+    key = x;
+  }
+  return same;
+}
+}
+
 const arma::mat66 ad(const arma::vec6 & V)
 {
   const arma::mat33 omgmat = VecToso3(V.subvec(0, 2));
@@ -18,6 +213,13 @@ const arma::mat66 ad(const arma::vec6 & V)
   return adV;
 }
 
+const arma::vec6 adMap(const arma::vec6 & V, const arma::vec6 & W)
+{
+  arma::vec6 adVW;
+  adApply(V, W, adVW);
+  return adVW;
+}
+
 const arma::vec InverseDynamics(
   const arma::vec & thetalist,
   const arma::vec & dthetalist,
@@ -203,6 +405,7 @@ const arma::vec ForwardDynamics(
   const std::vector<arma::vec6> & Slist
 )
 {
+  MR_LATENCY_SCOPE("ForwardDynamics");
   const arma::mat Mmat = MassMatrix(thetalist, Mlist, Glist, Slist);
   const arma::vec c = VelQuandraticForces(thetalist, dthetalist, Mlist, Glist, Slist);
   const arma::vec grav = GravityForces(thetalist, g, Mlist, Glist, Slist);
@@ -214,6 +417,79 @@ const arma::vec ForwardDynamics(
   return Minv * rhs;
 }
 
+const arma::vec ApparentRotorInertias(const ActuatorModel & actuators, const size_t n)
+{
+  return Armature(Complete(actuators, n));
+}
+
+const arma::vec FrictionForces(const arma::vec & dthetalist, const ActuatorModel & actuators)
+{
+  const size_t n = dthetalist.n_elem;
+  const ActuatorModel complete = Complete(actuators, n);
+  arma::vec taulist(n, arma::fill::zeros);
+  for (size_t i = 0; i < n; ++i) {
+    taulist.at(i) = Friction(complete, i, dthetalist.at(i));
+  }
+  return taulist;
+}
+
+const arma::vec InverseDynamics(
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist,
+  const arma::vec & ddthetalist,
+  const arma::vec & g,
+  const arma::vec6 & Ftip,
+  const std::vector<arma::mat44> & Mlist,
+  const std::vector<arma::mat66> & Glist,
+  const std::vector<arma::vec6> & Slist,
+  const ActuatorModel & actuators
+)
+{
+  const arma::vec taulist = InverseDynamics(
+    thetalist, dthetalist, ddthetalist, g, Ftip, Mlist, Glist, Slist);
+  const arma::vec armature = ApparentRotorInertias(actuators, thetalist.n_elem);
+  const arma::vec friction = FrictionForces(dthetalist, actuators);
+
+  return taulist + armature % ddthetalist + friction;
+}
+
+const arma::mat MassMatrix(
+  const arma::vec & thetalist,
+  const std::vector<arma::mat44> & Mlist,
+  const std::vector<arma::mat66> & Glist,
+  const std::vector<arma::vec6> & Slist,
+  const ActuatorModel & actuators
+)
+{
+  const arma::mat M = MassMatrix(thetalist, Mlist, Glist, Slist);
+  const arma::vec armature = ApparentRotorInertias(actuators, thetalist.n_elem);
+
+  return M + arma::diagmat(armature);
+}
+
+const arma::vec ForwardDynamics(
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist,
+  const arma::vec & taulist,
+  const arma::vec3 & g,
+  const arma::vec6 & Ftip,
+  const std::vector<arma::mat44> & Mlist,
+  const std::vector<arma::mat66> & Glist,
+  const std::vector<arma::vec6> & Slist,
+  const ActuatorModel & actuators
+)
+{
+  const arma::mat Mmat = MassMatrix(thetalist, Mlist, Glist, Slist, actuators);
+  const arma::vec zeros(thetalist.n_elem, arma::fill::zeros);
+  const arma::vec bias = InverseDynamics(
+    thetalist, dthetalist, zeros, g, Ftip, Mlist, Glist, Slist, actuators);
+
+  const arma::mat Minv = Mmat.i();
+  const arma::vec rhs = taulist - bias;
+
+  return Minv * rhs;
+}
+
 const std::tuple<const arma::vec, const arma::vec> EulerStep(
   const arma::vec & thetalist,
   const arma::vec & dthetalist,
@@ -338,4 +614,442 @@ ForwardDynamicsTrajectory(
 
   return {thetamat, dthetamat};
 }
+
+DynamicsWorkspace::DynamicsWorkspace(
+  const std::vector<arma::mat44> & Mlist,
+  const std::vector<arma::mat66> & Glist,
+  const std::vector<arma::vec6> & Slist
+)
+: Glist_(Glist)
+{
+  const size_t n = Slist.size();
+  if (Glist.size() != n || Mlist.size() != n + 1) {
+    throw std::invalid_argument(
+            "DynamicsWorkspace: expected n screw axes, n inertias and n + 1 link frames");
+  }
+
+  arma::mat44 Mi{arma::fill::eye};
+  joints_.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    Mi = Mi * Mlist.at(i);
+    joints_.push_back(ClassifyJoint(Adjoint(TransInv(Mi)) * Slist.at(i)));
+  }
+  for (const arma::mat44 & M : Mlist) {
+    Minv_.push_back(TransInv(M));
+  }
+
+  T_.assign(n + 1, arma::mat44{arma::fill::eye});
+  T_.at(n) = Minv_.at(n);
+  V_.assign(n + 1, arma::vec6{arma::fill::zeros});
+  Vd_.assign(n + 1, arma::vec6{arma::fill::zeros});
+  Ic_.assign(n, arma::mat66{arma::fill::zeros});
+  M_.zeros(n, n);
+  bias_.zeros(n);
+  zeros_.zeros(n);
+  theta_.zeros(n);
+  dtheta_.zeros(n);
+  tauplus_.zeros(n);
+  tauminus_.zeros(n);
+}
+
+size_t DynamicsWorkspace::size() const
+{
+  return joints_.size();
+}
+
+void DynamicsWorkspace::SetActuators(const ActuatorModel & actuators)
+{
+  actuators_ = Complete(actuators, joints_.size());
+  armature_ = Armature(actuators_);
+  actuated_ = true;
+}
+
+void DynamicsWorkspace::InverseDynamics(
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist,
+  const arma::vec & ddthetalist,
+  const arma::vec3 & g,
+  const arma::vec6 & Ftip,
+  arma::vec & taulist
+)
+{
+  Transforms(thetalist);
+  Recursion(dthetalist, ddthetalist, g, Ftip, taulist);
+  if (actuated_) {
+    AddActuatorForces(dthetalist, &ddthetalist, taulist);
+  }
+}
+
+void DynamicsWorkspace::MassMatrix(const arma::vec & thetalist, arma::mat & M)
+{
+  const size_t n = joints_.size();
+  if (M.n_rows != n || M.n_cols != n) {
+    M.set_size(n, n);
+  }
+  Transforms(thetalist);
+
+  // Composite rigid body algorithm: Ic_i = G_i + [Ad_T(i+1)]^T Ic_(i+1) [Ad_T(i+1)]
+  Ic_.at(n - 1) = Glist_.at(n - 1);
+  for (size_t j = 1; j < n; ++j) {
+    const size_t i = n - 1 - j;
+    AdjointMatrix(T_.at(i + 1), Ad_);
+    AddCongruence(Glist_.at(i), Ad_, Ic_.at(i + 1), IAd_, Ic_.at(i));
+  }
+
+  arma::vec6 F;
+  arma::vec6 Fnext;
+  for (size_t i = 0; i < n; ++i) {
+    F = Ic_.at(i) * joints_.at(i).S;
+    M.at(i, i) = arma::dot(joints_.at(i).S, F);
+
+    // Carry the composite wrench towards the base
+    for (size_t j = i; j > 0; --j) {
+      AdjointTransposeApply(T_.at(j), F, Fnext);
+      F = Fnext;
+      M.at(j - 1, i) = arma::dot(joints_.at(j - 1).S, F);
+      M.at(i, j - 1) = M.at(j - 1, i);
+    }
+  }
+
+  if (actuated_) {
+    for (size_t i = 0; i < n; ++i) {
+      M.at(i, i) += armature_.at(i);
+    }
+  }
+}
+
+void DynamicsWorkspace::ForwardDynamics(
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist,
+  const arma::vec & taulist,
+  const arma::vec3 & g,
+  const arma::vec6 & Ftip,
+  arma::vec & ddthetalist
+)
+{
+  MR_LATENCY_SCOPE("DynamicsWorkspace::ForwardDynamics");
+  const size_t n = joints_.size();
+  if (ddthetalist.n_elem != n) {
+    ddthetalist.set_size(n);
+  }
+
+  MassMatrix(thetalist, M_);
+  if (!CholeskyDecompose(M_)) {
+    throw std::runtime_error("DynamicsWorkspace::ForwardDynamics: singular mass matrix");
+  }
+
+  // The transforms of MassMatrix are reused for the bias c + g + J^T Ftip
+  Recursion(dthetalist, zeros_, g, Ftip, bias_);
+  if (actuated_) {
+    AddActuatorForces(dthetalist, nullptr, bias_);
+  }
+  for (size_t i = 0; i < n; ++i) {
+    ddthetalist.at(i) = taulist.at(i) - bias_.at(i);
+  }
+  CholeskySolve(M_, ddthetalist);
+}
+
+void DynamicsWorkspace::ForwardDynamicsDerivatives(
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist,
+  const arma::vec & taulist,
+  const arma::vec3 & g,
+  const arma::vec6 & Ftip,
+  arma::vec & ddthetalist,
+  arma::mat & dtheta,
+  arma::mat & ddtheta,
+  arma::mat & dtau
+)
+{
+  const size_t n = joints_.size();
+  for (arma::mat * D : {&dtheta, &ddtheta, &dtau}) {
+    if (D->n_rows != n || D->n_cols != n) {
+      D->set_size(n, n);
+    }
+  }
+
+  // Leaves the Cholesky factor of the mass matrix in M_
+  ForwardDynamics(thetalist, dthetalist, taulist, g, Ftip, ddthetalist);
+
+  theta_ = thetalist;
+  dtheta_ = dthetalist;
+  for (size_t j = 0; j < 2 * n; ++j) {
+    arma::vec & q = j < n ? theta_ : dtheta_;
+    arma::mat & D = j < n ? dtheta : ddtheta;
+    const size_t k = j % n;
+    const double q0 = q.at(k);
+    const double h = 1e-6 * std::max(1.0, std::abs(q0));
+
+    q.at(k) = q0 + h;
+    InverseDynamics(theta_, dtheta_, ddthetalist, g, Ftip, tauplus_);
+    q.at(k) = q0 - h;
+    InverseDynamics(theta_, dtheta_, ddthetalist, g, Ftip, tauminus_);
+    q.at(k) = q0;
+
+    for (size_t i = 0; i < n; ++i) {
+      tauplus_.at(i) = (tauminus_.at(i) - tauplus_.at(i)) / (2.0 * h);
+    }
+    CholeskySolve(M_, tauplus_);
+    for (size_t i = 0; i < n; ++i) {
+      D.at(i, k) = tauplus_.at(i);
+    }
+  }
+
+  for (size_t k = 0; k < n; ++k) {
+    tauplus_.zeros();
+    tauplus_.at(k) = 1.0;
+    CholeskySolve(M_, tauplus_);
+    for (size_t i = 0; i < n; ++i) {
+      dtau.at(i, k) = tauplus_.at(i);
+    }
+  }
+}
+
+void DynamicsWorkspace::Transforms(const arma::vec & thetalist)
+{
+  for (size_t i = 0; i < joints_.size(); ++i) {
+    T_.at(i) = JointExp6(joints_.at(i), -thetalist.at(i)) * Minv_.at(i);
+  }
+}
+
+void DynamicsWorkspace::AddActuatorForces(
+  const arma::vec & dthetalist,
+  const arma::vec * ddthetalist,
+  arma::vec & taulist
+) const
+{
+  for (size_t i = 0; i < joints_.size(); ++i) {
+    double tau = Friction(actuators_, i, dthetalist.at(i));
+    if (ddthetalist) {
+      tau += armature_.at(i) * ddthetalist->at(i);
+    }
+    taulist.at(i) += tau;
+  }
+}
+
+void DynamicsWorkspace::Recursion(
+  const arma::vec & dthetalist,
+  const arma::vec & ddthetalist,
+  const arma::vec3 & g,
+  const arma::vec6 & Ftip,
+  arma::vec & taulist
+)
+{
+  const size_t n = joints_.size();
+  if (taulist.n_elem != n) {
+    taulist.set_size(n);
+  }
+
+  // V_ and Vd_ hold the base at index 0 and link i at index i + 1
+  V_.at(0).zeros();
+  Vd_.at(0).zeros();
+  Vd_.at(0).at(3) = -g.at(0);
+  Vd_.at(0).at(4) = -g.at(1);
+  Vd_.at(0).at(5) = -g.at(2);
+
+  arma::vec6 adVA;
+  for (size_t i = 0; i < n; ++i) {
+    const arma::vec6 & A = joints_.at(i).S;
+    const double dtheta = dthetalist.at(i);
+
+    arma::vec6 & V = V_.at(i + 1);
+    arma::vec6 & Vd = Vd_.at(i + 1);
+    AdjointApply(T_.at(i), V_.at(i), V);
+    V += A * dtheta;
+
+    AdjointApply(T_.at(i), Vd_.at(i), Vd);
+    adApply(V, A, adVA);
+    Vd += A * ddthetalist.at(i) + adVA * dtheta;
+  }
+
+  // T_[n] is the fixed end-effector frame M_{n+1,n}
+  arma::vec6 F = Ftip;
+  arma::vec6 Fnext;
+  arma::vec6 GV;
+  arma::vec6 adVGV;
+  for (size_t j = 0; j < n; ++j) {
+    const size_t i = n - 1 - j;
+    const arma::mat66 & G = Glist_.at(i);
+    const arma::vec6 & V = V_.at(i + 1);
+
+    AdjointTransposeApply(T_.at(i + 1), F, Fnext);
+    GV = G * V;
+    adTransposeApply(V, GV, adVGV);
+    F = Fnext + G * Vd_.at(i + 1) - adVGV;
+
+    taulist.at(i) = arma::dot(F, joints_.at(i).S);
+  }
+}
+
+DynamicsCache::DynamicsCache(
+  const std::vector<arma::mat44> & Mlist,
+  const std::vector<arma::mat66> & Glist,
+  const std::vector<arma::vec6> & Slist
+)
+: dynamics_(Mlist, Glist, Slist)
+{
+  const size_t n = Slist.size();
+  for (arma::vec * v : {&thetaM_, &thetaL_, &thetab_, &dthetab_, &bias_, &zeros_, &tip_}) {
+    v->zeros(n);
+  }
+  gb_.zeros();
+  M_.zeros(n, n);
+  L_.zeros(n, n);
+}
+
+size_t DynamicsCache::size() const
+{
+  return dynamics_.size();
+}
+
+void DynamicsCache::SetActuators(const ActuatorModel & actuators)
+{
+  dynamics_.SetActuators(actuators);
+  Invalidate();
+}
+
+const arma::mat & DynamicsCache::MassMatrix(const arma::vec & thetalist)
+{
+  validM_ = Matches(thetaM_, thetalist) && validM_;
+  if (validM_) {
+    ++hits_;
+    return M_;
+  }
+  ++misses_;
+  dynamics_.MassMatrix(thetalist, M_);
+  validM_ = true;
+  return M_;
+}
+
+const arma::mat & DynamicsCache::CholeskyFactor(const arma::vec & thetalist)
+{
+  validL_ = Matches(thetaL_, thetalist) && validL_;
+  if (validL_) {
+    ++hits_;
+    return L_;
+  }
+  ++misses_;
+  L_ = MassMatrix(thetalist);
+  if (!CholeskyDecompose(L_)) {
+    throw std::runtime_error("DynamicsCache::CholeskyFactor: singular mass matrix");
+  }
+  validL_ = true;
+  return L_;
+}
+
+const arma::vec & DynamicsCache::Bias(
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist,
+  const arma::vec3 & g
+)
+{
+  if (BiasMatches(thetalist, dthetalist, g)) {
+    ++hits_;
+    return bias_;
+  }
+  ++misses_;
+  const arma::vec6 Ftip{arma::fill::zeros};
+  dynamics_.InverseDynamics(thetalist, dthetalist, zeros_, g, Ftip, bias_);
+  validb_ = true;
+  return bias_;
+}
+
+void DynamicsCache::InverseDynamics(
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist,
+  const arma::vec & ddthetalist,
+  const arma::vec3 & g,
+  arma::vec & taulist
+)
+{
+  const size_t n = size();
+  if (taulist.n_elem != n) {
+    taulist.set_size(n);
+  }
+
+  const arma::mat & M = MassMatrix(thetalist);
+  const arma::vec & bias = Bias(thetalist, dthetalist, g);
+  for (size_t i = 0; i < n; ++i) {
+    double tau = bias.at(i);
+    for (size_t j = 0; j < n; ++j) {
+      tau += M.at(i, j) * ddthetalist.at(j);
+    }
+    taulist.at(i) = tau;
+  }
+}
+
+void DynamicsCache::ForwardDynamics(
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist,
+  const arma::vec & taulist,
+  const arma::vec3 & g,
+  const arma::vec6 & Ftip,
+  arma::vec & ddthetalist
+)
+{
+  const size_t n = size();
+  if (ddthetalist.n_elem != n) {
+    ddthetalist.set_size(n);
+  }
+
+  const arma::mat & L = CholeskyFactor(thetalist);
+  bool tip = false;
+  for (size_t i = 0; i < 6; ++i) {
+    tip = tip || Ftip.at(i) != 0.0;
+  }
+
+  if (!tip) {
+    const arma::vec & bias = Bias(thetalist, dthetalist, g);
+    for (size_t i = 0; i < n; ++i) {
+      ddthetalist.at(i) = taulist.at(i) - bias.at(i);
+    }
+  } else if (BiasMatches(thetalist, dthetalist, g)) {
+    // The cached c + g plus a pass for J^T Ftip alone
+    ++hits_;
+    const arma::vec3 g0{arma::fill::zeros};
+    dynamics_.InverseDynamics(thetalist, zeros_, zeros_, g0, Ftip, tip_);
+    for (size_t i = 0; i < n; ++i) {
+      ddthetalist.at(i) = taulist.at(i) - bias_.at(i) - tip_.at(i);
+    }
+  } else {
+    // One pass for c + g + J^T Ftip, which is not worth caching
+    ++misses_;
+    dynamics_.InverseDynamics(thetalist, dthetalist, zeros_, g, Ftip, tip_);
+    for (size_t i = 0; i < n; ++i) {
+      ddthetalist.at(i) = taulist.at(i) - tip_.at(i);
+    }
+  }
+  CholeskySolve(L, ddthetalist);
+}
+
+void DynamicsCache::Invalidate()
+{
+  validM_ = false;
+  validL_ = false;
+  validb_ = false;
+}
+
+size_t DynamicsCache::hits() const
+{
+  return hits_;
+}
+
+size_t DynamicsCache::misses() const
+{
+  return misses_;
+}
+
+bool DynamicsCache::BiasMatches(
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist,
+  const arma::vec3 & g
+)
+{
+  const bool theta = Matches(thetab_, thetalist);
+  const bool dtheta = Matches(dthetab_, dthetalist);
+  const bool gravity = Identical(gb_, g);
+  gb_ = g;
+  validb_ = theta && dtheta && gravity && validb_;
+  return validb_;
+}
 }
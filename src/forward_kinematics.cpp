@@ -1,23 +1,134 @@
+#include <cmath>
+
 #include "modern_robotics/rigid_body_motions.hpp"
 #include "modern_robotics/forward_kinematics.hpp"
 
 namespace mr
 {
+const Joint ClassifyJoint(const arma::vec6 & S)
+{
+  const double wx = S.at(0);
+  const double wy = S.at(1);
+  const double wz = S.at(2);
+  const double wnorm = std::sqrt(wx * wx + wy * wy + wz * wz);
+
+  if (NearZero(wnorm)) {
+    return {S, JointType::Prismatic, -1};
+  } else if (!NearZero(wnorm - 1.0)) {
+    return {S, JointType::General, -1};
+  }
+
+  int axis = -1;
+  if (NearZero(wy) && NearZero(wz)) {
+    axis = 0;
+  } else if (NearZero(wx) && NearZero(wz)) {
+    axis = 1;
+  } else if (NearZero(wx) && NearZero(wy)) {
+    axis = 2;
+  }
+
+  return {S, JointType::Revolute, axis};
+}
+
+const std::vector<Joint> ClassifyJoints(const std::vector<arma::vec6> & Slist)
+{
+  std::vector<Joint> joints;
+  joints.reserve(Slist.size());
+
+  for (const arma::vec6 & S : Slist) {
+    joints.push_back(ClassifyJoint(S));
+  }
+
+  return joints;
+}
+
+const arma::mat44 JointExp6(const Joint & joint, const double theta)
+{
+  const arma::vec6 & S = joint.S;
+  arma::mat44 T{arma::fill::eye};
+
+  if (joint.type == JointType::General) {
+    return MatrixExp6(VecTose3(S * theta));
+  } else if (joint.type == JointType::Prismatic) {
+    T.at(0, 3) = S.at(3) * theta;
+    T.at(1, 3) = S.at(4) * theta;
+    T.at(2, 3) = S.at(5) * theta;
+    return T;
+  }
+
+  const double wx = S.at(0);
+  const double wy = S.at(1);
+  const double wz = S.at(2);
+  const double vx = S.at(3);
+  const double vy = S.at(4);
+  const double vz = S.at(5);
+  const double s = std::sin(theta);
+  const double c = std::cos(theta);
+  const double vers = 1.0 - c;
+
+  if (joint.axis < 0) {
+    // R = I + sin(theta) [w] + (1 - cos(theta)) [w]^2 with |w| = 1
+    T.at(0, 0) = c + vers * wx * wx;
+    T.at(0, 1) = vers * wx * wy - s * wz;
+    T.at(0, 2) = vers * wx * wz + s * wy;
+    T.at(1, 0) = vers * wx * wy + s * wz;
+    T.at(1, 1) = c + vers * wy * wy;
+    T.at(1, 2) = vers * wy * wz - s * wx;
+    T.at(2, 0) = vers * wx * wz - s * wy;
+    T.at(2, 1) = vers * wy * wz + s * wx;
+    T.at(2, 2) = c + vers * wz * wz;
+  } else {
+    const int i = joint.axis;
+    const int j = (i + 1) % 3;
+    const int k = (i + 2) % 3;
+    const double ws = S.at(i) * s;
+
+    T.at(j, j) = c;
+    T.at(k, k) = c;
+    T.at(k, j) = ws;
+    T.at(j, k) = -ws;
+  }
+
+  // p = (I theta + (1 - cos(theta)) [w] + (theta - sin(theta)) [w]^2) v
+  //   = sin(theta) v + (1 - cos(theta)) (w x v) + (theta - sin(theta)) (w . v) w
+  const double wdotv = wx * vx + wy * vy + wz * vz;
+  const double a = (theta - s) * wdotv;
+  T.at(0, 3) = s * vx + vers * (wy * vz - wz * vy) + a * wx;
+  T.at(1, 3) = s * vy + vers * (wz * vx - wx * vz) + a * wy;
+  T.at(2, 3) = s * vz + vers * (wx * vy - wy * vx) + a * wz;
+
+  return T;
+}
+
 const arma::mat44 FKinBody(
   const arma::mat44 & M,
   const std::vector<arma::vec6> & Blist,
   const arma::vec & thetalist
 )
+{
+  return FKinBody(M, ClassifyJoints(Blist), thetalist);
+}
+
+const arma::mat44 FKinSpace(
+  const arma::mat44 & M,
+  const std::vector<arma::vec6> & Slist,
+  const arma::vec & thetalist
+)
+{
+  return FKinSpace(M, ClassifyJoints(Slist), thetalist);
+}
+
+const arma::mat44 FKinBody(
+  const arma::mat44 & M,
+  const std::vector<Joint> & Blist,
+  const arma::vec & thetalist
+)
 {
   arma::mat44 T(M);
   const size_t n = thetalist.size();
 
   for (size_t i = 0; i < n; ++i) {
-    const arma::vec6 B = Blist.at(i);
-    const double theta = thetalist.at(i);
-
-    const arma::mat44 se3mat = VecTose3(B * theta);
-    const arma::mat44 Tij = MatrixExp6(se3mat);
+    const arma::mat44 Tij = JointExp6(Blist.at(i), thetalist.at(i));
     T = T * Tij;
   }
 
@@ -26,7 +137,7 @@ const arma::mat44 FKinBody(
 
 const arma::mat44 FKinSpace(
   const arma::mat44 & M,
-  const std::vector<arma::vec6> & Slist,
+  const std::vector<Joint> & Slist,
   const arma::vec & thetalist
 )
 {
@@ -35,11 +146,7 @@ const arma::mat44 FKinSpace(
 
   for (size_t j = 0; j < n; ++j) {
     const size_t i = n - 1 - j;
-    const arma::vec6 S = Slist.at(i);
-    const double theta = thetalist.at(i);
-
-    const arma::mat44 se3mat = VecTose3(S * theta);
-    const arma::mat44 Tij = MatrixExp6(se3mat);
+    const arma::mat44 Tij = JointExp6(Slist.at(i), thetalist.at(i));
     T = Tij * T;
   }
 
@@ -0,0 +1,330 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+#include "modern_robotics/utils.hpp"
+#include "modern_robotics/dynamics_of_open_chains.hpp"
+#include "modern_robotics/robot_control.hpp"
+#include "modern_robotics/gain_tuning.hpp"
+
+namespace mr
+{
+namespace
+{
+void CheckProblem(const GainTuningProblem & problem)
+{
+  const size_t n = problem.Slist.size();
+  const size_t N = problem.thetamatd.size();
+
+  if (problem.thetalist.n_elem != n || problem.dthetalist.n_elem != n) {
+    throw std::invalid_argument("GainSweep: initial state must have one entry per joint");
+  }
+  if (problem.dthetamatd.size() != N || problem.ddthetamatd.size() != N ||
+    problem.Ftipmat.size() != N)
+  {
+    throw std::invalid_argument("GainSweep: reference trajectories must have equal lengths");
+  }
+  if (problem.Mlist.size() != n + 1 || problem.Glist.size() != n) {
+    throw std::invalid_argument(
+            "GainSweep: Mlist must have n + 1 frames and Glist n inertias for n joints");
+  }
+  if (problem.Mtildelist.size() != n + 1 || problem.Gtildelist.size() != n) {
+    throw std::invalid_argument(
+            "GainSweep: Mtildelist must have n + 1 frames and Gtildelist n inertias for n joints");
+  }
+  for (size_t i = 0; i < N; ++i) {
+    if (problem.thetamatd.at(i).n_elem != n || problem.dthetamatd.at(i).n_elem != n ||
+      problem.ddthetamatd.at(i).n_elem != n)
+    {
+      throw std::invalid_argument(
+              "GainSweep: every reference step must have one entry per joint");
+    }
+  }
+  if (problem.intRes < 1) {
+    throw std::invalid_argument("GainSweep: intRes must be at least 1");
+  }
+}
+
+/// \brief The controller and plant one worker simulates with
+struct SimulationWorkspace
+{
+  explicit SimulationWorkspace(const GainTuningProblem & problem)
+  : controller(
+      problem.gtilde, problem.Mtildelist, problem.Gtildelist, problem.Slist, 0.0, 0.0, 0.0),
+    plant(problem.Mlist, problem.Glist, problem.Slist),
+    theta(problem.thetalist),
+    dtheta(problem.dthetalist),
+    ddtheta(problem.Slist.size(), arma::fill::zeros),
+    eint(problem.Slist.size(), arma::fill::zeros)
+  {
+  }
+
+  ComputedTorqueController controller;
+  DynamicsWorkspace plant;
+  arma::vec theta;
+  arma::vec dtheta;
+  arma::vec ddtheta;
+  arma::vec eint;
+};
+
+void Simulate(const GainTuningProblem & problem, SimulationWorkspace & ws, GainScore & score)
+{
+  constexpr double inf = std::numeric_limits<double>::infinity();
+  const size_t n = problem.Slist.size();
+  const size_t N = problem.thetamatd.size();
+  const double h = problem.dt / static_cast<double>(problem.intRes);
+
+  ws.controller.SetGains(score.gains.kp, score.gains.ki, score.gains.kd);
+  ws.theta = problem.thetalist;
+  ws.dtheta = problem.dthetalist;
+  ws.eint.zeros();
+
+  double error2 = 0.0;
+  double effort2 = 0.0;
+
+  try {
+    for (size_t i = 0; i < N; ++i) {
+      const arma::vec & thetalistd = problem.thetamatd.at(i);
+
+      ws.controller.SetIntegralError(ws.eint);
+      const arma::vec & taulist = ws.controller.Step(
+        ws.theta, ws.dtheta, thetalistd, problem.dthetamatd.at(i), problem.ddthetamatd.at(i));
+
+      for (size_t j = 0; j < problem.intRes; ++j) {
+        ws.plant.ForwardDynamics(
+          ws.theta, ws.dtheta, taulist, problem.g, problem.Ftipmat.at(i), ws.ddtheta);
+        ws.theta += h * ws.dtheta;
+        ws.dtheta += h * ws.ddtheta;
+      }
+
+      for (size_t k = 0; k < n; ++k) {
+        const double e = thetalistd.at(k) - ws.theta.at(k);
+        ws.eint.at(k) += e;
+        error2 += e * e;
+        effort2 += taulist.at(k) * taulist.at(k);
+      }
+
+      if (!std::isfinite(error2) || !std::isfinite(effort2)) {
+        break;
+      }
+    }
+  } catch (const std::runtime_error &) {
+    error2 = inf;
+  }
+
+  const double samples = static_cast<double>(std::max<size_t>(1, N * n));
+  const bool stable = std::isfinite(error2) && std::isfinite(effort2);
+  score.tracking_error = stable ? std::sqrt(error2 / samples) : inf;
+  score.effort = stable ? std::sqrt(effort2 / samples) : inf;
+}
+
+/// \brief Scores candidates [first, scores.size()) in parallel
+void Evaluate(
+  const GainTuningProblem & problem,
+  std::vector<GainScore> & scores,
+  const size_t first,
+  const size_t num_threads)
+{
+  const size_t K = scores.size() - first;
+  const size_t hardware = std::max<size_t>(1, std::thread::hardware_concurrency());
+  const size_t workers = std::max<size_t>(
+    1, std::min(K, num_threads == 0 ? hardware : num_threads));
+  std::atomic<size_t> next{first};
+
+  ParallelFor(
+    workers,
+    [&](const size_t) {
+      SimulationWorkspace ws(problem);
+      for (size_t k = next++; k < scores.size(); k = next++) {
+        Simulate(problem, ws, scores.at(k));
+      }
+    },
+    workers
+  );
+}
+
+const std::vector<size_t> ParetoFront(const std::vector<GainScore> & scores)
+{
+  std::vector<size_t> order(scores.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(
+    order.begin(), order.end(), [&](const size_t a, const size_t b) {
+      if (scores.at(a).tracking_error != scores.at(b).tracking_error) {
+        return scores.at(a).tracking_error < scores.at(b).tracking_error;
+      }
+      return scores.at(a).effort < scores.at(b).effort;
+    });
+
+  // Sorted by tracking error, a candidate is on the front iff it needs less
+  // effort than every candidate before it
+  std::vector<size_t> front;
+  double best_effort = std::numeric_limits<double>::infinity();
+  for (const size_t k : order) {
+    if (std::isfinite(scores.at(k).tracking_error) && scores.at(k).effort < best_effort) {
+      front.push_back(k);
+      best_effort = scores.at(k).effort;
+    }
+  }
+
+  return front;
+}
+}
+
+const std::vector<ControlGains> GainGrid(
+  const size_t n,
+  const std::vector<double> & kp,
+  const std::vector<double> & ki,
+  const std::vector<double> & kd
+)
+{
+  std::vector<ControlGains> grid;
+  grid.reserve(kp.size() * ki.size() * kd.size());
+
+  for (const double d : kd) {
+    for (const double i : ki) {
+      for (const double p : kp) {
+        ControlGains gains{arma::vec(n, arma::fill::zeros), arma::vec(n, arma::fill::zeros),
+          arma::vec(n, arma::fill::zeros)};
+        gains.kp.fill(p);
+        gains.ki.fill(i);
+        gains.kd.fill(d);
+        grid.push_back(gains);
+      }
+    }
+  }
+
+  return grid;
+}
+
+const GainTuningResult GainSweep(
+  const GainTuningProblem & problem,
+  const std::vector<ControlGains> & candidates,
+  const size_t num_threads
+)
+{
+  CheckProblem(problem);
+
+  GainTuningResult result;
+  result.candidates.reserve(candidates.size());
+  for (const ControlGains & gains : candidates) {
+    result.candidates.push_back({gains, 0.0, 0.0});
+  }
+
+  Evaluate(problem, result.candidates, 0, num_threads);
+  result.pareto = ParetoFront(result.candidates);
+
+  return result;
+}
+
+const GainTuningResult GainSearch(
+  const GainTuningProblem & problem,
+  const GainSearchOptions & options
+)
+{
+  CheckProblem(problem);
+
+  const size_t n = problem.Slist.size();
+  const ControlGains & initial = options.initial;
+  if (initial.kp.n_elem != n || initial.ki.n_elem != n || initial.kd.n_elem != n) {
+    throw std::invalid_argument("GainSearch: initial gains must have one entry per joint");
+  }
+  if (options.population < 2) {
+    throw std::invalid_argument("GainSearch: population must be at least 2");
+  }
+
+  // The search space is the logarithm of [kp; ki; kd]
+  const size_t d = 3 * n;
+  arma::vec mean{d, arma::fill::zeros};
+  for (size_t i = 0; i < n; ++i) {
+    if (initial.kp.at(i) <= 0.0 || initial.ki.at(i) <= 0.0 || initial.kd.at(i) <= 0.0) {
+      throw std::invalid_argument("GainSearch: initial gains must be positive");
+    }
+    mean.at(i) = std::log(initial.kp.at(i));
+    mean.at(n + i) = std::log(initial.ki.at(i));
+    mean.at(2 * n + i) = std::log(initial.kd.at(i));
+  }
+
+  // Strategy parameters of the separable CMA-ES without the rank-one update
+  const size_t lambda = options.population;
+  const size_t mu = lambda / 2;
+  arma::vec weights{mu, arma::fill::zeros};
+  for (size_t i = 0; i < mu; ++i) {
+    weights.at(i) = std::log(static_cast<double>(mu) + 0.5) - std::log(static_cast<double>(i + 1));
+  }
+  weights /= arma::accu(weights);
+  const double mueff = 1.0 / arma::dot(weights, weights);
+  const double D = static_cast<double>(d);
+  const double csigma = (mueff + 2.0) / (D + mueff + 5.0);
+  const double dsigma = 1.0 + 2.0 * std::max(0.0, std::sqrt((mueff - 1.0) / (D + 1.0)) - 1.0) +
+    csigma;
+  const double cmu = std::min(
+    1.0, (D + 2.0) / 3.0 * 2.0 * (mueff - 2.0 + 1.0 / mueff) / ((D + 2.0) * (D + 2.0) + mueff));
+  const double chiN = std::sqrt(D) * (1.0 - 1.0 / (4.0 * D) + 1.0 / (21.0 * D * D));
+
+  double sigma = options.sigma;
+  arma::vec C{d, arma::fill::ones};
+  arma::vec psigma{d, arma::fill::zeros};
+  std::vector<arma::vec> steps(lambda, arma::vec(d, arma::fill::zeros));
+  std::vector<double> fitness(lambda, 0.0);
+  std::vector<size_t> ranking(lambda);
+
+  std::mt19937_64 generator(options.random_seed);
+  std::normal_distribution<double> normal(0.0, 1.0);
+
+  GainTuningResult result;
+  result.candidates.reserve(lambda * options.generations);
+
+  for (size_t generation = 0; generation < options.generations; ++generation) {
+    const size_t first = result.candidates.size();
+
+    for (size_t k = 0; k < lambda; ++k) {
+      ControlGains gains{arma::vec(n, arma::fill::zeros), arma::vec(n, arma::fill::zeros),
+        arma::vec(n, arma::fill::zeros)};
+      for (size_t i = 0; i < d; ++i) {
+        steps.at(k).at(i) = std::sqrt(C.at(i)) * normal(generator);
+        const double gain = std::exp(mean.at(i) + sigma * steps.at(k).at(i));
+        arma::vec & part = i < n ? gains.kp : (i < 2 * n ? gains.ki : gains.kd);
+        part.at(i % n) = gain;
+      }
+      result.candidates.push_back({gains, 0.0, 0.0});
+    }
+
+    Evaluate(problem, result.candidates, first, options.num_threads);
+
+    for (size_t k = 0; k < lambda; ++k) {
+      const GainScore & score = result.candidates.at(first + k);
+      fitness.at(k) = score.tracking_error + options.effort_weight * score.effort;
+    }
+    std::iota(ranking.begin(), ranking.end(), 0);
+    std::stable_sort(
+      ranking.begin(), ranking.end(), [&](const size_t a, const size_t b) {
+        return fitness.at(a) < fitness.at(b);
+      });
+
+    // Recombine the best mu steps, then adapt the step size and the variances
+    arma::vec yw{d, arma::fill::zeros};
+    arma::vec rankmu{d, arma::fill::zeros};
+    for (size_t i = 0; i < mu; ++i) {
+      const arma::vec & y = steps.at(ranking.at(i));
+      yw += weights.at(i) * y;
+      rankmu += weights.at(i) * (y % y);
+    }
+    mean += sigma * yw;
+
+    for (size_t i = 0; i < d; ++i) {
+      psigma.at(i) = (1.0 - csigma) * psigma.at(i) +
+        std::sqrt(csigma * (2.0 - csigma) * mueff) * yw.at(i) / std::sqrt(C.at(i));
+    }
+    C = (1.0 - cmu) * C + cmu * rankmu;
+    sigma *= std::exp((csigma / dsigma) * (arma::norm(psigma) / chiN - 1.0));
+  }
+
+  result.pareto = ParetoFront(result.candidates);
+  return result;
+}
+}
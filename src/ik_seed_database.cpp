@@ -0,0 +1,334 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <utility>
+
+#include "modern_robotics/utils.hpp"
+#include "modern_robotics/forward_kinematics.hpp"
+#include "modern_robotics/ik_seed_database.hpp"
+
+namespace mr
+{
+namespace
+{
+constexpr char kMagic[8] = {'M', 'R', 'I', 'K', 'S', 'E', 'D', '\0'};
+constexpr uint32_t kVersion = 1;
+
+/// \brief Fixed-size file header, followed by the records
+struct SeedFileHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t num_joints;
+  uint64_t count;
+  double orientation_weight;
+};
+
+static_assert(sizeof(SeedFileHeader) == 32, "seed file header must stay 8-byte aligned");
+
+/// \brief The position and orientation part of a record
+constexpr size_t kPose = 7;
+
+/// \brief Writes the position and unit quaternion (w, x, y, z) of T
+void Pose(const arma::mat44 & T, double * pose)
+{
+  const double trace = T.at(0, 0) + T.at(1, 1) + T.at(2, 2);
+  double w, x, y, z;
+
+  // Shepperd's method: divide by the largest of the four candidates
+  if (trace > 0.0) {
+    const double s = 2.0 * std::sqrt(1.0 + trace);
+    w = 0.25 * s;
+    x = (T.at(2, 1) - T.at(1, 2)) / s;
+    y = (T.at(0, 2) - T.at(2, 0)) / s;
+    z = (T.at(1, 0) - T.at(0, 1)) / s;
+  } else if (T.at(0, 0) > T.at(1, 1) && T.at(0, 0) > T.at(2, 2)) {
+    const double s = 2.0 * std::sqrt(1.0 + T.at(0, 0) - T.at(1, 1) - T.at(2, 2));
+    w = (T.at(2, 1) - T.at(1, 2)) / s;
+    x = 0.25 * s;
+    y = (T.at(0, 1) + T.at(1, 0)) / s;
+    z = (T.at(0, 2) + T.at(2, 0)) / s;
+  } else if (T.at(1, 1) > T.at(2, 2)) {
+    const double s = 2.0 * std::sqrt(1.0 + T.at(1, 1) - T.at(0, 0) - T.at(2, 2));
+    w = (T.at(0, 2) - T.at(2, 0)) / s;
+    x = (T.at(0, 1) + T.at(1, 0)) / s;
+    y = 0.25 * s;
+    z = (T.at(1, 2) + T.at(2, 1)) / s;
+  } else {
+    const double s = 2.0 * std::sqrt(1.0 + T.at(2, 2) - T.at(0, 0) - T.at(1, 1));
+    w = (T.at(1, 0) - T.at(0, 1)) / s;
+    x = (T.at(0, 2) + T.at(2, 0)) / s;
+    y = (T.at(1, 2) + T.at(2, 1)) / s;
+    z = 0.25 * s;
+  }
+
+  const double norm = std::sqrt(w * w + x * x + y * y + z * z);
+  pose[0] = T.at(0, 3);
+  pose[1] = T.at(1, 3);
+  pose[2] = T.at(2, 3);
+  pose[3] = w / norm;
+  pose[4] = x / norm;
+  pose[5] = y / norm;
+  pose[6] = z / norm;
+}
+
+/// \brief The squared pose distance between a query and a record
+double Distance2(const double * query, const double * record, const double weight)
+{
+  double d2 = 0.0;
+  for (size_t i = 0; i < 3; ++i) {
+    d2 += (query[i] - record[i]) * (query[i] - record[i]);
+  }
+
+  double dot = 0.0;
+  for (size_t i = 3; i < kPose; ++i) {
+    dot += query[i] * record[i];
+  }
+  // q and -q are the same rotation
+  const double angle = 2.0 * std::acos(std::min(1.0, std::abs(dot)));
+
+  return d2 + weight * weight * angle * angle;
+}
+
+/// \brief Records of an implicit kd-tree, stored in place or memory-mapped
+struct KdTree
+{
+  const double * records;
+  size_t size;
+  size_t stride;
+  double weight;
+
+  void Search(
+    const double * query, const size_t lo, const size_t hi, const size_t depth,
+    size_t & best, double & best_d2) const
+  {
+    if (lo >= hi) {
+      return;
+    }
+
+    const size_t mid = lo + (hi - lo) / 2;
+    const double * node = records + mid * stride;
+    const double d2 = Distance2(query, node, weight);
+    if (d2 < best_d2) {
+      best_d2 = d2;
+      best = mid;
+    }
+
+    // The position distance to the split plane bounds the far side from below
+    const size_t axis = depth % 3;
+    const double diff = query[axis] - node[axis];
+    const bool left = diff < 0.0;
+    Search(query, left ? lo : mid + 1, left ? mid : hi, depth + 1, best, best_d2);
+    if (diff * diff < best_d2) {
+      Search(query, left ? mid + 1 : lo, left ? hi : mid, depth + 1, best, best_d2);
+    }
+  }
+
+  const arma::vec Nearest(const arma::mat44 & T) const
+  {
+    if (size == 0) {
+      throw std::runtime_error("NearestIKSeed: the seed database is empty");
+    }
+
+    double query[kPose];
+    Pose(T, query);
+
+    size_t best = 0;
+    double best_d2 = std::numeric_limits<double>::infinity();
+    Search(query, 0, size, 0, best, best_d2);
+
+    const double * joints = records + best * stride + kPose;
+    arma::vec thetalist{stride - kPose, arma::fill::zeros};
+    for (size_t i = 0; i < thetalist.n_elem; ++i) {
+      thetalist.at(i) = joints[i];
+    }
+    return thetalist;
+  }
+};
+
+/// \brief Orders the indices [lo, hi) as a balanced kd-tree over the positions
+void BuildKdTree(
+  const std::vector<double> & records, const size_t stride, std::vector<size_t> & order,
+  const size_t lo, const size_t hi, const size_t depth)
+{
+  if (hi - lo <= 1) {
+    return;
+  }
+
+  const size_t mid = lo + (hi - lo) / 2;
+  const size_t axis = depth % 3;
+  std::nth_element(
+    order.begin() + lo, order.begin() + mid, order.begin() + hi,
+    [&](const size_t a, const size_t b) {
+      return records[a * stride + axis] < records[b * stride + axis];
+    });
+
+  BuildKdTree(records, stride, order, lo, mid, depth + 1);
+  BuildKdTree(records, stride, order, mid + 1, hi, depth + 1);
+}
+}
+
+const IKSeedDatabase BuildIKSeedDatabase(
+  const std::vector<arma::vec6> & list,
+  const arma::mat44 & M,
+  const IKFrame frame,
+  const IKSeedDatabaseOptions & options
+)
+{
+  const size_t n = list.size();
+  if (options.lower.n_elem != n || options.upper.n_elem != n) {
+    throw std::invalid_argument("BuildIKSeedDatabase: bounds must have one entry per joint");
+  }
+
+  const std::vector<Joint> joints = ClassifyJoints(list);
+  const size_t stride = kPose + n;
+  const size_t count = options.num_samples;
+
+  // Draw every sample up front so the database does not depend on threading
+  std::vector<double> samples(stride * count, 0.0);
+  std::mt19937_64 generator(options.random_seed);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  for (size_t k = 0; k < count; ++k) {
+    for (size_t i = 0; i < n; ++i) {
+      samples[k * stride + kPose + i] = options.lower.at(i) +
+        uniform(generator) * (options.upper.at(i) - options.lower.at(i));
+    }
+  }
+
+  ParallelFor(
+    count,
+    [&](const size_t k) {
+      double * record = samples.data() + k * stride;
+      arma::vec thetalist{n, arma::fill::zeros};
+      for (size_t i = 0; i < n; ++i) {
+        thetalist.at(i) = record[kPose + i];
+      }
+      const arma::mat44 T = frame == IKFrame::Body ?
+        FKinBody(M, joints, thetalist) : FKinSpace(M, joints, thetalist);
+      Pose(T, record);
+    },
+    options.num_threads
+  );
+
+  std::vector<size_t> order(count);
+  std::iota(order.begin(), order.end(), 0);
+  BuildKdTree(samples, stride, order, 0, count, 0);
+
+  IKSeedDatabase database{n, options.orientation_weight, {}};
+  database.records.resize(samples.size());
+  for (size_t k = 0; k < count; ++k) {
+    std::copy_n(
+      samples.begin() + order[k] * stride, stride, database.records.begin() + k * stride);
+  }
+
+  return database;
+}
+
+const arma::vec NearestIKSeed(const IKSeedDatabase & database, const arma::mat44 & T)
+{
+  const size_t stride = kPose + database.num_joints;
+  const KdTree tree{
+    database.records.data(), database.records.size() / stride, stride,
+    database.orientation_weight};
+  return tree.Nearest(T);
+}
+
+void SaveIKSeedDatabase(const IKSeedDatabase & database, const std::string & filename)
+{
+  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    throw std::runtime_error("SaveIKSeedDatabase: cannot open " + filename);
+  }
+
+  SeedFileHeader header{};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.num_joints = static_cast<uint32_t>(database.num_joints);
+  header.count = database.records.size() / (kPose + database.num_joints);
+  header.orientation_weight = database.orientation_weight;
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  file.write(
+    reinterpret_cast<const char *>(database.records.data()),
+    static_cast<std::streamsize>(database.records.size() * sizeof(double)));
+
+  if (!file) {
+    throw std::runtime_error("SaveIKSeedDatabase: failed to write " + filename);
+  }
+}
+
+IKSeedDatabaseView::IKSeedDatabaseView(const std::string & filename)
+: file_(filename)
+{
+  if (file_.size() < sizeof(SeedFileHeader)) {
+    throw std::runtime_error("IKSeedDatabaseView: not a seed database file " + filename);
+  }
+
+  const char * bytes = file_.data();
+  const SeedFileHeader * header = reinterpret_cast<const SeedFileHeader *>(bytes);
+
+  if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || header->version != kVersion ||
+    header->num_joints == 0)
+  {
+    throw std::runtime_error("IKSeedDatabaseView: not a seed database file " + filename);
+  }
+
+  num_joints_ = header->num_joints;
+  orientation_weight_ = header->orientation_weight;
+  size_ = header->count;
+  const size_t record = (kPose + num_joints_) * sizeof(double);
+  if (size_ > (file_.size() - sizeof(SeedFileHeader)) / record) {
+    throw std::runtime_error("IKSeedDatabaseView: truncated seed database file " + filename);
+  }
+  records_ = reinterpret_cast<const double *>(bytes + sizeof(SeedFileHeader));
+}
+
+IKSeedDatabaseView::IKSeedDatabaseView(IKSeedDatabaseView && other) noexcept
+: file_(std::move(other.file_)),
+  num_joints_(std::exchange(other.num_joints_, 0)),
+  orientation_weight_(other.orientation_weight_),
+  records_(std::exchange(other.records_, nullptr)),
+  size_(std::exchange(other.size_, 0))
+{
+}
+
+IKSeedDatabaseView & IKSeedDatabaseView::operator=(IKSeedDatabaseView && other) noexcept
+{
+  if (this != &other) {
+    file_ = std::move(other.file_);
+    num_joints_ = std::exchange(other.num_joints_, 0);
+    orientation_weight_ = other.orientation_weight_;
+    records_ = std::exchange(other.records_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+  }
+  return *this;
+}
+
+IKSeedDatabaseView::~IKSeedDatabaseView() = default;
+
+size_t IKSeedDatabaseView::num_joints() const
+{
+  return num_joints_;
+}
+
+double IKSeedDatabaseView::orientation_weight() const
+{
+  return orientation_weight_;
+}
+
+size_t IKSeedDatabaseView::size() const
+{
+  return size_;
+}
+
+const arma::vec IKSeedDatabaseView::Nearest(const arma::mat44 & T) const
+{
+  const KdTree tree{records_, size_, kPose + num_joints_, orientation_weight_};
+  return tree.Nearest(T);
+}
+}
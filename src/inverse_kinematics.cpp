@@ -1,5 +1,15 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <thread>
 #include <armadillo>
 
+#include "modern_robotics/utils.hpp"
+#include "modern_robotics/latency_histogram.hpp"
 #include "modern_robotics/rigid_body_motions.hpp"
 #include "modern_robotics/forward_kinematics.hpp"
 #include "modern_robotics/velocity_kinematics_and_statics.hpp"
@@ -7,6 +17,436 @@
 
 namespace mr
 {
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+double Elapsed(const Clock::time_point & start)
+{
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/// \brief Converts a time budget in seconds into an absolute deadline
+Clock::time_point Deadline(const Clock::time_point & start, const double budget)
+{
+  const double remaining = std::chrono::duration<double>(Clock::time_point::max() - start).count();
+  if (!(budget < remaining)) {
+    return Clock::time_point::max();
+  }
+  return start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(budget));
+}
+
+bool Converged(const arma::vec6 & V, const IKOptions & options)
+{
+  return arma::norm(V.subvec(0, 2)) <= options.eomg && arma::norm(V.subvec(3, 5)) <= options.ev;
+}
+
+double MaxAbs(const arma::vec & x)
+{
+  double largest = 0.0;
+  for (size_t i = 0; i < x.n_elem; ++i) {
+    largest = std::max(largest, std::fabs(x.at(i)));
+  }
+  return largest;
+}
+
+/// \brief Scales a step down so that no joint moves by more than max_step
+void LimitStep(arma::vec & dtheta, const double max_step)
+{
+  const double largest = MaxAbs(dtheta);
+  if (largest > max_step) {
+    dtheta *= max_step / largest;
+  }
+}
+
+/// \brief Checks the stopping criteria shared by all iterative solvers
+/// \return true if the solver should stop, with result.termination set
+bool Terminate(
+  IKResult & result,
+  const arma::vec6 & V,
+  const IKOptions & options,
+  const Clock::time_point & deadline,
+  const std::atomic<bool> * cancel = nullptr)
+{
+  if (Converged(V, options)) {
+    result.termination = IKTermination::Converged;
+  } else if (result.iterations >= options.max_iterations) {
+    result.termination = IKTermination::MaxIterations;
+  } else if (Clock::now() >= deadline) {
+    result.termination = IKTermination::Timeout;
+  } else if (cancel != nullptr && cancel->load(std::memory_order_relaxed)) {
+    result.termination = IKTermination::Cancelled;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool HasLimits(const IKOptions & options)
+{
+  return !options.lower.is_empty() || !options.upper.is_empty();
+}
+
+/// \brief Clamps every joint into its limits
+void Project(arma::vec & thetalist, const IKOptions & options)
+{
+  if (HasLimits(options)) {
+    for (size_t i = 0; i < thetalist.n_elem; ++i) {
+      thetalist.at(i) = std::clamp(thetalist.at(i), options.lower.at(i), options.upper.at(i));
+    }
+  }
+}
+
+void Start(IKResult & result, const arma::vec & thetalist0, const IKOptions & options)
+{
+  result.thetalist = thetalist0;
+  Project(result.thetalist, options);
+  result.success = false;
+  result.iterations = 0;
+  result.termination = IKTermination::MaxIterations;
+}
+
+void Finish(
+  IKResult & result,
+  const arma::vec6 & V,
+  const IKOptions & options,
+  const Clock::time_point & start)
+{
+  result.success = Converged(V, options);
+  result.angular_error = arma::norm(V.subvec(0, 2));
+  result.linear_error = arma::norm(V.subvec(3, 5));
+  result.wall_time = Elapsed(start);
+  JointLimitStatuses(result.thetalist, options, result.limits);
+}
+
+/// \brief Buffers of the damped least-squares iteration, sized once per robot
+struct SolverWorkspace
+{
+  explicit SolverWorkspace(const size_t n)
+  : J(6, n, arma::fill::zeros),
+    Jtrial(6, n, arma::fill::zeros),
+    trial(n, arma::fill::zeros),
+    dtheta(n, arma::fill::zeros),
+    z(n, arma::fill::zeros),
+    free(n, 1)
+  {
+  }
+
+  arma::mat J;
+  arma::mat Jtrial;
+  arma::vec trial;
+  arma::vec dtheta;
+  arma::vec z;
+  std::vector<char> free;
+  arma::mat66 A;
+  arma::vec6 V;
+  arma::vec6 Vtrial;
+  arma::vec6 b;
+  arma::vec6 r;
+};
+
+/// \brief A = J_F J_F^T + damping I over the free columns F of J
+void DampedGram(
+  const arma::mat & J,
+  const std::vector<char> & free,
+  const double damping,
+  arma::mat66 & A)
+{
+  for (size_t r = 0; r < 6; ++r) {
+    for (size_t c = 0; c <= r; ++c) {
+      double sum = 0.0;
+      for (size_t k = 0; k < J.n_cols; ++k) {
+        if (free.at(k)) {
+          sum += J.at(r, k) * J.at(c, k);
+        }
+      }
+      A.at(r, c) = sum;
+      A.at(c, r) = sum;
+    }
+    A.at(r, r) += damping;
+  }
+}
+
+/// \brief r = V - J dtheta
+void Residual(const arma::mat & J, const arma::vec6 & V, const arma::vec & dtheta, arma::vec6 & r)
+{
+  r = V;
+  for (size_t k = 0; k < J.n_cols; ++k) {
+    for (size_t i = 0; i < 6; ++i) {
+      r.at(i) -= J.at(i, k) * dtheta.at(k);
+    }
+  }
+}
+
+/// \brief Computes the damped least-squares step inside the joint limits
+/// \return false if the damped normal equations could not be factored
+/// \details Without limits this is dtheta = z + J^T (J J^T + damping I)^-1 (V - J z),
+///          which moves along the secondary motion z only in the null space
+///          of J; z is zero without a secondary objective. With limits, joints
+///          whose step would leave the box are pinned to the limit and the
+///          step is re-solved for the free joints against the remaining
+///          error, until no free joint leaves the box. Every round pins at
+///          least one joint, so there are at most n + 1 rounds.
+bool DampedStep(
+  SolverWorkspace & ws,
+  const arma::vec & thetalist,
+  const double damping,
+  const bool secondary,
+  const IKOptions & options)
+{
+  const bool limited = HasLimits(options);
+  std::fill(ws.free.begin(), ws.free.end(), 1);
+  ws.dtheta.zeros();
+
+  for (;;) {
+    // b = V - J_P dtheta_P - J_F z_F for the pinned joints P and free joints F
+    for (size_t k = 0; k < ws.free.size(); ++k) {
+      if (ws.free.at(k)) {
+        ws.dtheta.at(k) = secondary ? ws.z.at(k) : 0.0;
+      }
+    }
+    Residual(ws.J, ws.V, ws.dtheta, ws.b);
+
+    DampedGram(ws.J, ws.free, damping, ws.A);
+    if (!CholeskyDecompose(ws.A)) {
+      return false;
+    }
+    CholeskySolve(ws.A, ws.b);
+
+    bool pinned = false;
+    for (size_t k = 0; k < ws.free.size(); ++k) {
+      if (!ws.free.at(k)) {
+        continue;
+      }
+
+      double step = secondary ? ws.z.at(k) : 0.0;
+      for (size_t i = 0; i < 6; ++i) {
+        step += ws.J.at(i, k) * ws.b.at(i);
+      }
+      ws.dtheta.at(k) = step;
+
+      if (limited) {
+        const double next = thetalist.at(k) + step;
+        if (next < options.lower.at(k) || next > options.upper.at(k)) {
+          const double bound =
+            next < options.lower.at(k) ? options.lower.at(k) : options.upper.at(k);
+          ws.dtheta.at(k) = bound - thetalist.at(k);
+          ws.free.at(k) = 0;
+          pinned = true;
+        }
+      }
+    }
+
+    if (!pinned) {
+      return true;
+    }
+  }
+}
+
+/// \brief Newton-Raphson iteration shared by the body and space solvers
+/// \param linearize Computes the error twist V and Jacobian J at a thetalist
+template<typename Linearize>
+const IKResult NewtonRaphson(
+  const Linearize & linearize,
+  const arma::vec & thetalist0,
+  const IKOptions & options
+)
+{
+  MR_LATENCY_SCOPE("IKinNewtonRaphson");
+  const Clock::time_point start = Clock::now();
+  const Clock::time_point deadline = Deadline(start, options.time_budget);
+  IKResult result{};
+  Start(result, thetalist0, options);
+
+  arma::mat J{6, thetalist0.n_elem, arma::fill::zeros};
+  arma::vec6 V;
+  linearize(result.thetalist, J, V);
+
+  while (!Terminate(result, V, options, deadline)) {
+    arma::vec dtheta = arma::pinv(J) * V;
+    LimitStep(dtheta, options.max_step);
+    result.thetalist += dtheta;
+    Project(result.thetalist, options);
+    linearize(result.thetalist, J, V);
+    ++result.iterations;
+  }
+
+  Finish(result, V, options, start);
+  return result;
+}
+
+/// \brief Levenberg-Marquardt iteration shared by the body and space solvers
+/// \param linearize Computes the error twist V and Jacobian J at a thetalist
+/// \details Damping follows Nielsen's gain-ratio update, starting from
+///          1e-3 times the largest diagonal entry of J J^T. Runs entirely in
+///          the workspace and the result, so it does not allocate once both
+///          are sized for the robot.
+template<typename Linearize>
+void DampedLeastSquares(
+  const Linearize & linearize,
+  const arma::vec & thetalist0,
+  const IKOptions & options,
+  const Clock::time_point & start,
+  const Clock::time_point & deadline,
+  const std::atomic<bool> * cancel,
+  SolverWorkspace & ws,
+  IKResult & result
+)
+{
+  MR_LATENCY_SCOPE("IKinDampedLeastSquares");
+  constexpr double min_damping = 1e-6;
+  constexpr double max_damping = 1e10;
+
+  Start(result, thetalist0, options);
+  linearize(result.thetalist, ws.J, ws.V);
+
+  std::fill(ws.free.begin(), ws.free.end(), 1);
+  DampedGram(ws.J, ws.free, 0.0, ws.A);
+  double largest = 0.0;
+  for (size_t i = 0; i < 6; ++i) {
+    largest = std::max(largest, ws.A.at(i, i));
+  }
+  double damping = std::max(min_damping, 1e-3 * largest);
+  double nu = 2.0;
+  double cost = arma::dot(ws.V, ws.V);
+
+  const bool secondary = static_cast<bool>(options.null_space);
+  if (secondary) {
+    options.null_space(result.thetalist, ws.z);
+  }
+
+  while (!Terminate(result, ws.V, options, deadline, cancel)) {
+    if (damping >= max_damping) {
+      result.termination = IKTermination::Stalled;
+      break;
+    }
+    ++result.iterations;
+
+    if (!DampedStep(ws, result.thetalist, damping, secondary, options)) {
+      damping = std::min(max_damping, damping * nu);
+      nu *= 2.0;
+      continue;
+    }
+    LimitStep(ws.dtheta, options.max_step);
+
+    // The linear model predicts the error twist V - J dtheta after the step
+    Residual(ws.J, ws.V, ws.dtheta, ws.r);
+    double predicted = cost - arma::dot(ws.r, ws.r);
+
+    // Far from the target, a damped null space leaks the secondary motion
+    // into the task; drop it for this step if it would undo the primary one
+    if (secondary && predicted <= 0.0) {
+      DampedStep(ws, result.thetalist, damping, false, options);
+      LimitStep(ws.dtheta, options.max_step);
+      Residual(ws.J, ws.V, ws.dtheta, ws.r);
+      predicted = cost - arma::dot(ws.r, ws.r);
+    }
+
+    ws.trial = result.thetalist + ws.dtheta;
+    linearize(ws.trial, ws.Jtrial, ws.Vtrial);
+
+    const double trial_cost = arma::dot(ws.Vtrial, ws.Vtrial);
+    const double rho = predicted > 0.0 ? (cost - trial_cost) / predicted : -1.0;
+
+    if (rho > 0.0) {
+      std::swap(result.thetalist, ws.trial);
+      std::swap(ws.J, ws.Jtrial);
+      ws.V = ws.Vtrial;
+      cost = trial_cost;
+      if (secondary) {
+        options.null_space(result.thetalist, ws.z);
+      }
+
+      const double r = 2.0 * rho - 1.0;
+      damping = std::max(min_damping, damping * std::max(1.0 / 3.0, 1.0 - r * r * r));
+      nu = 2.0;
+    } else {
+      damping = std::min(max_damping, damping * nu);
+      nu *= 2.0;
+    }
+  }
+
+  Finish(result, ws.V, options, start);
+}
+
+/// \brief Error twist and Jacobian of a body-frame solve
+struct BodyLinearization
+{
+  const std::vector<Joint> & joints;
+  const arma::mat44 & M;
+  const arma::mat44 & T;
+
+  void operator()(const arma::vec & thetalist, arma::mat & Jb, arma::vec6 & Vb) const
+  {
+    arma::mat44 Tsb;
+    FKinAndJacobianBody(M, joints, thetalist, Tsb, Jb);
+    Vb = se3ToVec(MatrixLog6(TransInv(Tsb) * T));
+  }
+};
+
+/// \brief Error twist and Jacobian of a space-frame solve
+struct SpaceLinearization
+{
+  const std::vector<Joint> & joints;
+  const arma::mat44 & M;
+  const arma::mat44 & T;
+
+  void operator()(const arma::vec & thetalist, arma::mat & Js, arma::vec6 & Vs) const
+  {
+    arma::mat44 Tsb;
+    FKinAndJacobianSpace(M, joints, thetalist, Tsb, Js);
+    Vs = AdjointMap(Tsb, se3ToVec(MatrixLog6(TransInv(Tsb) * T)));
+  }
+};
+
+/// \brief Runs a damped least-squares solve with a workspace of its own
+template<typename Linearize>
+const IKResult DampedLeastSquares(
+  const Linearize & linearize,
+  const arma::vec & thetalist0,
+  const IKOptions & options
+)
+{
+  const Clock::time_point start = Clock::now();
+  SolverWorkspace ws(thetalist0.n_elem);
+  IKResult result{};
+
+  DampedLeastSquares(
+    linearize, thetalist0, options, start, Deadline(start, options.time_budget), nullptr, ws,
+    result);
+  return result;
+}
+}
+
+void CheckJointLimits(const IKOptions & options, const size_t n)
+{
+  if (HasLimits(options) && (options.lower.n_elem != n || options.upper.n_elem != n)) {
+    throw std::invalid_argument("IKOptions: joint limits must have one entry per joint");
+  }
+}
+
+void JointLimitStatuses(
+  const arma::vec & thetalist,
+  const IKOptions & options,
+  std::vector<JointLimitStatus> & limits
+)
+{
+  constexpr double tolerance = 1e-9;
+  const size_t n = thetalist.n_elem;
+  limits.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    JointLimitStatus status = JointLimitStatus::Free;
+    if (HasLimits(options)) {
+      if (thetalist.at(i) <= options.lower.at(i) + tolerance) {
+        status = JointLimitStatus::AtLower;
+      } else if (thetalist.at(i) >= options.upper.at(i) - tolerance) {
+        status = JointLimitStatus::AtUpper;
+      }
+    }
+    limits.at(i) = status;
+  }
+}
+
 const std::pair<const arma::vec, bool> IKinBody(
   const std::vector<arma::vec6> & Blist,
   const arma::mat44 & M,
@@ -16,55 +456,402 @@ const std::pair<const arma::vec, bool> IKinBody(
   const double ev
 )
 {
-  constexpr int max_iter = 20;
-  arma::vec thetalist{thetalist0};
-  int i = 0;
-  bool err = true;
+  IKOptions options;
+  options.max_iterations = 20;
+  options.eomg = emog;
+  options.ev = ev;
 
-  do {
-    const arma::mat44 Tsb = FKinBody(M, Blist, thetalist);
-    const arma::mat44 Tsbinv = TransInv(Tsb);
-    const arma::vec6 Vb = se3ToVec(MatrixLog6(Tsbinv * T));
+  const IKResult result = IKinBody(Blist, M, T, thetalist0, options);
+  return {result.thetalist, result.success};
+}
 
-    const arma::mat Jb = JacobianBody(Blist, thetalist);
-    const arma::vec dtheta = arma::pinv(Jb) * Vb;
-    thetalist += dtheta;
+const std::pair<const arma::vec, bool> IKinSpace(
+  const std::vector<arma::vec6> & Slist,
+  const arma::mat44 & M,
+  const arma::mat44 & T,
+  const arma::vec & thetalist0,
+  const double emog,
+  const double ev
+)
+{
+  IKOptions options;
+  options.max_iterations = 20;
+  options.eomg = emog;
+  options.ev = ev;
 
-    err = arma::norm(Vb.subvec(0, 2)) > emog || arma::norm(Vb.subvec(3, 5)) > ev;
-    ++i;
-  } while (err && i < max_iter);
+  const IKResult result = IKinSpace(Slist, M, T, thetalist0, options);
+  return {result.thetalist, result.success};
+}
 
-  return {thetalist, !err};
+const IKResult IKinBody(
+  const std::vector<arma::vec6> & Blist,
+  const arma::mat44 & M,
+  const arma::mat44 & T,
+  const arma::vec & thetalist0,
+  const IKOptions & options
+)
+{
+  CheckJointLimits(options, Blist.size());
+  const std::vector<Joint> joints = ClassifyJoints(Blist);
+  return NewtonRaphson(BodyLinearization{joints, M, T}, thetalist0, options);
 }
 
-const std::pair<const arma::vec, bool> IKinSpace(
+const IKResult IKinSpace(
   const std::vector<arma::vec6> & Slist,
   const arma::mat44 & M,
   const arma::mat44 & T,
   const arma::vec & thetalist0,
+  const IKOptions & options
+)
+{
+  CheckJointLimits(options, Slist.size());
+  const std::vector<Joint> joints = ClassifyJoints(Slist);
+  return NewtonRaphson(SpaceLinearization{joints, M, T}, thetalist0, options);
+}
+
+const IKResult IKinBodyDLS(
+  const std::vector<arma::vec6> & Blist,
+  const arma::mat44 & M,
+  const arma::mat44 & T,
+  const arma::vec & thetalist0,
   const double emog,
   const double ev
 )
 {
-  constexpr int max_iter = 20;
-  arma::vec thetalist{thetalist0};
-  int i = 0;
-  bool err = true;
+  IKOptions options;
+  options.max_iterations = 50;
+  options.eomg = emog;
+  options.ev = ev;
+
+  return IKinBodyDLS(Blist, M, T, thetalist0, options);
+}
+
+const IKResult IKinSpaceDLS(
+  const std::vector<arma::vec6> & Slist,
+  const arma::mat44 & M,
+  const arma::mat44 & T,
+  const arma::vec & thetalist0,
+  const double emog,
+  const double ev
+)
+{
+  IKOptions options;
+  options.max_iterations = 50;
+  options.eomg = emog;
+  options.ev = ev;
+
+  return IKinSpaceDLS(Slist, M, T, thetalist0, options);
+}
+
+const IKResult IKinBodyDLS(
+  const std::vector<arma::vec6> & Blist,
+  const arma::mat44 & M,
+  const arma::mat44 & T,
+  const arma::vec & thetalist0,
+  const IKOptions & options
+)
+{
+  CheckJointLimits(options, Blist.size());
+  const std::vector<Joint> joints = ClassifyJoints(Blist);
+  return DampedLeastSquares(BodyLinearization{joints, M, T}, thetalist0, options);
+}
+
+const IKResult IKinSpaceDLS(
+  const std::vector<arma::vec6> & Slist,
+  const arma::mat44 & M,
+  const arma::mat44 & T,
+  const arma::vec & thetalist0,
+  const IKOptions & options
+)
+{
+  CheckJointLimits(options, Slist.size());
+  const std::vector<Joint> joints = ClassifyJoints(Slist);
+  return DampedLeastSquares(SpaceLinearization{joints, M, T}, thetalist0, options);
+}
+
+struct RealTimeIK::Workspace
+{
+  Workspace(
+    const std::vector<arma::vec6> & list,
+    const arma::mat44 & M,
+    const IKFrame frame,
+    const IKOptions & options)
+  : joints(ClassifyJoints(list)), M(M), frame(frame), options(options), solver(list.size())
+  {
+  }
+
+  const std::vector<Joint> joints;
+  const arma::mat44 M;
+  const IKFrame frame;
+  const IKOptions options;
+  SolverWorkspace solver;
+};
+
+RealTimeIK::RealTimeIK(
+  const std::vector<arma::vec6> & list,
+  const arma::mat44 & M,
+  const IKFrame frame,
+  const IKOptions & options
+)
+: workspace_(std::make_unique<Workspace>(list, M, frame, options)),
+  result_{arma::vec(list.size(), arma::fill::zeros), false, 0, 0.0, 0.0, 0.0,
+    IKTermination::MaxIterations,
+    std::vector<JointLimitStatus>(list.size(), JointLimitStatus::Free)}
+{
+  CheckJointLimits(options, list.size());
+}
+
+RealTimeIK::RealTimeIK(RealTimeIK && other) noexcept = default;
+RealTimeIK & RealTimeIK::operator=(RealTimeIK && other) noexcept = default;
+RealTimeIK::~RealTimeIK() = default;
+
+const IKResult & RealTimeIK::Solve(const arma::mat44 & T, const arma::vec & thetalist0)
+{
+  const Clock::time_point start = Clock::now();
+  return Solve(T, thetalist0, Deadline(start, workspace_->options.time_budget));
+}
+
+const IKResult & RealTimeIK::Solve(
+  const arma::mat44 & T,
+  const arma::vec & thetalist0,
+  const Clock::time_point deadline
+)
+{
+  return Iterate(T, thetalist0, deadline, nullptr);
+}
+
+const IKResult & RealTimeIK::Solve(
+  const arma::mat44 & T,
+  const arma::vec & thetalist0,
+  const Clock::time_point deadline,
+  const std::atomic<bool> & cancel
+)
+{
+  return Iterate(T, thetalist0, deadline, &cancel);
+}
+
+const IKResult & RealTimeIK::Iterate(
+  const arma::mat44 & T,
+  const arma::vec & thetalist0,
+  const Clock::time_point deadline,
+  const std::atomic<bool> * cancel
+)
+{
+  const Clock::time_point start = Clock::now();
+  Workspace & ws = *workspace_;
+
+  if (thetalist0.n_elem != ws.joints.size()) {
+    throw std::invalid_argument("RealTimeIK::Solve: thetalist0 must have one entry per joint");
+  }
+
+  if (ws.frame == IKFrame::Body) {
+    DampedLeastSquares(
+      BodyLinearization{ws.joints, ws.M, T}, thetalist0, ws.options, start, deadline, cancel,
+      ws.solver, result_);
+  } else {
+    DampedLeastSquares(
+      SpaceLinearization{ws.joints, ws.M, T}, thetalist0, ws.options, start, deadline, cancel,
+      ws.solver, result_);
+  }
+
+  return result_;
+}
+
+const IKOptions & RealTimeIK::options() const
+{
+  return workspace_->options;
+}
+
+const PathIKResult IKinPath(
+  const std::vector<arma::vec6> & list,
+  const arma::mat44 & M,
+  const IKFrame frame,
+  const std::vector<arma::mat44> & traj,
+  const arma::vec & thetalist0,
+  const PathIKOptions & options
+)
+{
+  const size_t N = traj.size();
+  const size_t length = options.segment_length == 0 ? std::max<size_t>(1, N) :
+    options.segment_length;
+  const size_t segments = (N + length - 1) / length;
+
+  PathIKResult result{std::vector<arma::vec>(N), {}, {}, false};
+  std::vector<char> converged(N, 0);
+
+  // The head of every segment is solved serially from the previous head, so
+  // that each segment starts near the branch the path is on
+  RealTimeIK solver(list, M, frame, options.ik);
+  for (size_t k = 0; k < segments; ++k) {
+    const size_t head = k * length;
+    const arma::vec & seed = k == 0 ? thetalist0 : result.thetamat.at(head - length);
+    const IKResult & solve = solver.Solve(traj.at(head), seed);
+    result.thetamat.at(head) = solve.thetalist;
+    converged.at(head) = solve.success;
+  }
+
+  // Every segment is then warm-started along its own poses
+  ParallelFor(
+    segments,
+    [&](const size_t k) {
+      RealTimeIK worker(list, M, frame, options.ik);
+      const size_t begin = k * length;
+      const size_t end = std::min(N, begin + length);
+
+      for (size_t i = begin + 1; i < end; ++i) {
+        const IKResult & solve = worker.Solve(traj.at(i), result.thetamat.at(i - 1));
+        result.thetamat.at(i) = solve.thetalist;
+        converged.at(i) = solve.success;
+      }
+    },
+    options.num_threads);
+
+  // Re-solve the head of each segment from the end of the previous one until
+  // the parallel solution is continuous with it again
+  for (size_t k = 1; k < segments; ++k) {
+    const size_t begin = k * length;
+    const size_t end = std::min(N, begin + length);
+
+    for (size_t i = begin; i < end; ++i) {
+      const arma::vec & previous = result.thetamat.at(i - 1);
+      if (converged.at(i) && MaxAbs(result.thetamat.at(i) - previous) <= options.max_joint_step) {
+        break;
+      }
+
+      const IKResult & solve = solver.Solve(traj.at(i), previous);
+      result.thetamat.at(i) = solve.thetalist;
+      converged.at(i) = solve.success;
+    }
+  }
+
+  for (size_t i = 0; i < N; ++i) {
+    if (!converged.at(i)) {
+      result.failures.push_back(i);
+    }
+    if (i > 0 &&
+      MaxAbs(result.thetamat.at(i) - result.thetamat.at(i - 1)) > options.max_joint_step)
+    {
+      result.discontinuities.push_back(i);
+    }
+  }
+  result.success = result.failures.empty() && result.discontinuities.empty();
+
+  return result;
+}
+
+const MultiStartIKResult IKinMultiStart(
+  const std::vector<arma::vec6> & list,
+  const arma::mat44 & M,
+  const IKFrame frame,
+  const arma::mat44 & T,
+  const MultiStartIKOptions & options
+)
+{
+  const size_t n = list.size();
+  std::vector<arma::vec> seeds = options.seeds;
+
+  if (seeds.empty()) {
+    arma::vec lower = options.lower.is_empty() ? options.ik.lower : options.lower;
+    arma::vec upper = options.upper.is_empty() ? options.ik.upper : options.upper;
+    if (lower.is_empty()) {
+      lower.set_size(n);
+      lower.fill(-arma::datum::pi);
+    }
+    if (upper.is_empty()) {
+      upper.set_size(n);
+      upper.fill(arma::datum::pi);
+    }
+    if (lower.n_elem != n || upper.n_elem != n) {
+      throw std::invalid_argument("IKinMultiStart: joint limits must have one entry per joint");
+    }
+
+    std::mt19937_64 generator(options.random_seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    seeds.reserve(options.num_seeds);
+    for (size_t k = 0; k < options.num_seeds; ++k) {
+      arma::vec seed{n, arma::fill::zeros};
+      for (size_t i = 0; i < n; ++i) {
+        seed.at(i) = lower.at(i) + uniform(generator) * (upper.at(i) - lower.at(i));
+      }
+      seeds.push_back(seed);
+    }
+  }
+
+  for (const arma::vec & seed : seeds) {
+    if (seed.n_elem != n) {
+      throw std::invalid_argument("IKinMultiStart: seeds must have one entry per joint");
+    }
+  }
+
+  const size_t K = seeds.size();
+  const size_t hardware = std::max<size_t>(1, std::thread::hardware_concurrency());
+  const size_t workers = std::max<size_t>(
+    1, std::min(K, options.num_threads == 0 ? hardware : options.num_threads));
+
+  std::vector<IKResult> solves(K);
+  std::vector<char> solved(K, 0);
+  std::atomic<size_t> next{0};
+  std::atomic<bool> done{false};
+  std::mutex first_mutex;
+  size_t first = K;
+
+  ParallelFor(
+    workers,
+    [&](const size_t) {
+      RealTimeIK solver(list, M, frame, options.ik);
+      while (!done.load(std::memory_order_relaxed)) {
+        const size_t k = next.fetch_add(1);
+        if (k >= K) {
+          return;
+        }
+
+        solves.at(k) = solver.Solve(
+          T, seeds.at(k), Deadline(Clock::now(), options.ik.time_budget), done);
+        solved.at(k) = solves.at(k).termination != IKTermination::Cancelled;
+        if (solves.at(k).success) {
+          const std::lock_guard<std::mutex> lock(first_mutex);
+          if (first == K) {
+            first = k;
+          }
+          if (!options.collect_all) {
+            done.store(true, std::memory_order_relaxed);
+          }
+        }
+      }
+    },
+    workers);
 
-  do {
-    const arma::mat44 Tsb = FKinSpace(M, Slist, thetalist);
-    const arma::mat44 Tsbinv = TransInv(Tsb);
-    const arma::mat66 AdTsb = Adjoint(Tsb);
-    const arma::vec6 Vs = AdTsb * se3ToVec(MatrixLog6(Tsbinv * T));
+  MultiStartIKResult result{IKResult{}, {}, 0};
+  double best_error = std::numeric_limits<double>::infinity();
+  for (size_t k = 0; k < K; ++k) {
+    if (!solved.at(k)) {
+      continue;
+    }
+    ++result.attempts;
 
-    const arma::mat Js = JacobianSpace(Slist, thetalist);
-    const arma::vec dtheta = arma::pinv(Js) * Vs;
-    thetalist += dtheta;
+    const IKResult & solve = solves.at(k);
+    const double error = solve.angular_error * solve.angular_error +
+      solve.linear_error * solve.linear_error;
+    if (first == K && error < best_error) {
+      best_error = error;
+      result.best = solve;
+    }
 
-    err = arma::norm(Vs.subvec(0, 2)) > emog || arma::norm(Vs.subvec(3, 5)) > ev;
-    ++i;
-  } while (err && i < max_iter);
+    if (solve.success) {
+      const bool duplicate = std::any_of(
+        result.solutions.begin(), result.solutions.end(),
+        [&](const arma::vec & other) {
+          return MaxAbs(other - solve.thetalist) <= options.distinct_tolerance;
+        });
+      if (!duplicate) {
+        result.solutions.push_back(solve.thetalist);
+      }
+    }
+  }
+  if (first != K) {
+    result.best = solves.at(first);
+  }
 
-  return {thetalist, !err};
+  return result;
 }
 }
@@ -0,0 +1,288 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <mutex>
+
+#include "modern_robotics/latency_histogram.hpp"
+
+namespace mr
+{
+namespace
+{
+/// \brief The histograms registered by name, never destroyed so that sites
+///        recording during static destruction stay valid
+struct Registry
+{
+  std::mutex mutex;
+  std::vector<std::unique_ptr<LatencyHistogram>> histograms;
+};
+
+Registry & GetRegistry()
+{
+  static Registry * registry = new Registry();
+  return *registry;
+}
+
+double Seconds(const uint64_t nanoseconds)
+{
+  return static_cast<double>(nanoseconds) * 1e-9;
+}
+
+/// \brief Formats a number for JSON, which has no infinities or NaN
+const std::string Number(const double x)
+{
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "%.9g", std::isfinite(x) ? x : 0.0);
+  return buffer;
+}
+
+/// \brief Quotes a string for JSON
+const std::string Quote(const std::string & s)
+{
+  std::string quoted = "\"";
+  for (const char c : s) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+      quoted += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buffer[8];
+      std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+      quoted += buffer;
+    } else {
+      quoted += c;
+    }
+  }
+  return quoted + "\"";
+}
+}
+
+LatencyHistogram::LatencyHistogram(const std::string & name)
+: name_(name),
+  min_(std::numeric_limits<uint64_t>::max())
+{
+  for (std::atomic<uint64_t> & count : counts_) {
+    count.store(0, std::memory_order_relaxed);
+  }
+}
+
+const std::string & LatencyHistogram::name() const
+{
+  return name_;
+}
+
+size_t LatencyHistogram::Index(const uint64_t nanoseconds)
+{
+  const uint64_t value = std::min(nanoseconds, (uint64_t{1} << kMaxBits) - 1);
+  if (value < 2 * kHalf) {
+    return value;
+  }
+  const unsigned magnitude = 63 - __builtin_clzll(value);
+  const unsigned shift = magnitude - kSubBits + 1;
+  return shift * kHalf + (value >> shift);
+}
+
+uint64_t LatencyHistogram::Upper(const size_t index)
+{
+  if (index < 2 * kHalf) {
+    return index;
+  }
+  const size_t shift = index / kHalf - 1;
+  const uint64_t sub = index - shift * kHalf;
+  return ((sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(const uint64_t nanoseconds)
+{
+  counts_[Index(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+  uint64_t min = min_.load(std::memory_order_relaxed);
+  while (nanoseconds < min &&
+    !min_.compare_exchange_weak(min, nanoseconds, std::memory_order_relaxed))
+  {
+  }
+  uint64_t max = max_.load(std::memory_order_relaxed);
+  while (nanoseconds > max &&
+    !max_.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed))
+  {
+  }
+
+  count_.fetch_add(1, std::memory_order_release);
+}
+
+void LatencyHistogram::Record(const std::chrono::steady_clock::duration duration)
+{
+  const int64_t nanoseconds =
+    std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+  Record(static_cast<uint64_t>(std::max<int64_t>(0, nanoseconds)));
+}
+
+uint64_t LatencyHistogram::count() const
+{
+  return count_.load(std::memory_order_acquire);
+}
+
+double LatencyHistogram::Percentile(const double q) const
+{
+  uint64_t total = 0;
+  for (const std::atomic<uint64_t> & count : counts_) {
+    total += count.load(std::memory_order_relaxed);
+  }
+  if (total == 0) {
+    return 0.0;
+  }
+
+  const double clamped = std::min(1.0, std::max(0.0, q));
+  const uint64_t rank = std::max<uint64_t>(
+    1, static_cast<uint64_t>(std::ceil(clamped * static_cast<double>(total))));
+  uint64_t seen = 0;
+  size_t index = 0;
+  for (; index + 1 < kBuckets; ++index) {
+    seen += counts_[index].load(std::memory_order_relaxed);
+    if (seen >= rank) {
+      break;
+    }
+  }
+  return Seconds(std::min(Upper(index), max_.load(std::memory_order_relaxed)));
+}
+
+const LatencySnapshot LatencyHistogram::Snapshot() const
+{
+  LatencySnapshot snapshot;
+  snapshot.name = name_;
+
+  // Work from one copy of the buckets, so the percentiles agree with each other
+  std::vector<uint64_t> counts(kBuckets);
+  for (size_t i = 0; i < kBuckets; ++i) {
+    counts[i] = counts_[i].load(std::memory_order_relaxed);
+    snapshot.count += counts[i];
+  }
+  if (snapshot.count == 0) {
+    return snapshot;
+  }
+
+  const uint64_t max = max_.load(std::memory_order_relaxed);
+  snapshot.min = Seconds(min_.load(std::memory_order_relaxed));
+  snapshot.max = Seconds(max);
+  snapshot.mean = Seconds(sum_.load(std::memory_order_relaxed)) /
+    static_cast<double>(snapshot.count);
+
+  const std::pair<double, double *> percentiles[] = {
+    {0.5, &snapshot.p50}, {0.9, &snapshot.p90}, {0.99, &snapshot.p99}, {0.999, &snapshot.p999}
+  };
+  uint64_t seen = 0;
+  size_t next = 0;
+  for (size_t i = 0; i < kBuckets; ++i) {
+    if (counts[i] == 0) {
+      continue;
+    }
+    seen += counts[i];
+    const double upper = Seconds(std::min(Upper(i), max));
+    snapshot.buckets.emplace_back(upper, counts[i]);
+    while (next < 4 &&
+      seen >= std::ceil(percentiles[next].first * static_cast<double>(snapshot.count)))
+    {
+      *percentiles[next].second = upper;
+      ++next;
+    }
+  }
+  return snapshot;
+}
+
+void LatencyHistogram::Reset()
+{
+  count_.store(0, std::memory_order_relaxed);
+  sum_.store(0, std::memory_order_relaxed);
+  min_.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+  max_.store(0, std::memory_order_relaxed);
+  for (std::atomic<uint64_t> & count : counts_) {
+    count.store(0, std::memory_order_relaxed);
+  }
+}
+
+LatencyHistogram & RegisterLatencyHistogram(const std::string & name)
+{
+  Registry & registry = GetRegistry();
+  const std::lock_guard<std::mutex> lock(registry.mutex);
+  for (const std::unique_ptr<LatencyHistogram> & histogram : registry.histograms) {
+    if (histogram->name() == name) {
+      return *histogram;
+    }
+  }
+  registry.histograms.push_back(std::make_unique<LatencyHistogram>(name));
+  return *registry.histograms.back();
+}
+
+const std::vector<LatencySnapshot> LatencySnapshots()
+{
+  Registry & registry = GetRegistry();
+  const std::lock_guard<std::mutex> lock(registry.mutex);
+  std::vector<LatencySnapshot> snapshots;
+  snapshots.reserve(registry.histograms.size());
+  for (const std::unique_ptr<LatencyHistogram> & histogram : registry.histograms) {
+    snapshots.push_back(histogram->Snapshot());
+  }
+  return snapshots;
+}
+
+void ResetLatencyHistograms()
+{
+  Registry & registry = GetRegistry();
+  const std::lock_guard<std::mutex> lock(registry.mutex);
+  for (const std::unique_ptr<LatencyHistogram> & histogram : registry.histograms) {
+    histogram->Reset();
+  }
+}
+
+const std::string LatencyReport(const std::vector<LatencySnapshot> & snapshots)
+{
+  size_t width = 4;
+  for (const LatencySnapshot & snapshot : snapshots) {
+    width = std::max(width, snapshot.name.size());
+  }
+
+  std::string report;
+  char line[256];
+  std::snprintf(
+    line, sizeof(line), "%-*s %10s %10s %10s %10s %10s %10s %10s %10s\n",
+    static_cast<int>(width), "name", "count", "min_us", "mean_us", "p50_us", "p90_us", "p99_us",
+    "p99.9_us", "max_us");
+  report += line;
+  for (const LatencySnapshot & s : snapshots) {
+    std::snprintf(
+      line, sizeof(line), "%-*s %10llu %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+      static_cast<int>(width), s.name.c_str(), static_cast<unsigned long long>(s.count),
+      1e6 * s.min, 1e6 * s.mean, 1e6 * s.p50, 1e6 * s.p90, 1e6 * s.p99, 1e6 * s.p999,
+      1e6 * s.max);
+    report += line;
+  }
+  return report;
+}
+
+const std::string LatencyReportJson(const std::vector<LatencySnapshot> & snapshots)
+{
+  std::string json = "{\"histograms\":[";
+  for (size_t i = 0; i < snapshots.size(); ++i) {
+    const LatencySnapshot & s = snapshots[i];
+    json += i == 0 ? "{" : ",{";
+    json += "\"name\":" + Quote(s.name);
+    json += ",\"count\":" + std::to_string(s.count);
+    json += ",\"min\":" + Number(s.min);
+    json += ",\"mean\":" + Number(s.mean);
+    json += ",\"p50\":" + Number(s.p50);
+    json += ",\"p90\":" + Number(s.p90);
+    json += ",\"p99\":" + Number(s.p99);
+    json += ",\"p99.9\":" + Number(s.p999);
+    json += ",\"max\":" + Number(s.max);
+    json += ",\"buckets\":[";
+    for (size_t b = 0; b < s.buckets.size(); ++b) {
+      json += b == 0 ? "[" : ",[";
+      json += Number(s.buckets[b].first) + "," + std::to_string(s.buckets[b].second) + "]";
+    }
+    json += "]}";
+  }
+  return json + "]}";
+}
+}
@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+#include "modern_robotics/utils.hpp"
+#include "modern_robotics/rigid_body_motions.hpp"
+#include "modern_robotics/inverse_kinematics.hpp"
+#include "modern_robotics/manipulability_map.hpp"
+
+namespace mr
+{
+namespace
+{
+constexpr char kMagic[8] = {'M', 'R', 'M', 'A', 'N', 'I', 'P', '\0'};
+constexpr uint32_t kVersion = 1;
+
+/// \brief Fixed-size file header, followed by the axes and the cells
+struct GridFileHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t space;
+  uint32_t part;
+  uint32_t naxes;
+};
+
+/// \brief On-disk layout of one grid axis
+struct GridFileAxis
+{
+  double lower;
+  double upper;
+  uint64_t count;
+};
+
+static_assert(sizeof(GridFileHeader) == 24, "grid file header must stay 8-byte aligned");
+static_assert(sizeof(GridFileAxis) == 24, "grid file axis must stay 8-byte aligned");
+
+size_t GridSize(const std::vector<GridAxis> & axes)
+{
+  size_t size = axes.empty() ? 0 : 1;
+  for (const GridAxis & axis : axes) {
+    size *= axis.count;
+  }
+  return size;
+}
+
+double GridValue(const GridAxis & axis, const size_t i)
+{
+  if (axis.count <= 1) {
+    return axis.lower;
+  }
+  return axis.lower + static_cast<double>(i) * (axis.upper - axis.lower) /
+         static_cast<double>(axis.count - 1);
+}
+}
+
+const arma::vec GridPoint(const std::vector<GridAxis> & axes, const size_t index)
+{
+  arma::vec point{axes.size(), arma::fill::zeros};
+  size_t rest = index;
+
+  for (size_t d = 0; d < axes.size(); ++d) {
+    const size_t count = std::max<size_t>(1, axes.at(d).count);
+    point.at(d) = GridValue(axes.at(d), rest % count);
+    rest /= count;
+  }
+
+  return point;
+}
+
+const ManipulabilityMap JointManipulabilityMap(
+  const std::vector<arma::vec6> & Blist,
+  const std::vector<GridAxis> & axes,
+  const ManipulabilityPart part,
+  const size_t num_threads
+)
+{
+  const std::vector<Joint> joints = ClassifyJoints(Blist);
+  ManipulabilityMap map{GridSpace::Joint, part, axes, {}};
+  map.cells.resize(GridSize(axes));
+
+  ParallelFor(
+    map.cells.size(),
+    [&](const size_t i) {
+      const arma::vec thetalist = GridPoint(axes, i);
+      const arma::mat Jb = JacobianBody(joints, thetalist);
+      map.cells.at(i) = Manipulability(Jb, part);
+    },
+    num_threads
+  );
+
+  return map;
+}
+
+const ManipulabilityMap CartesianManipulabilityMap(
+  const std::vector<arma::vec6> & Blist,
+  const arma::mat44 & M,
+  const arma::mat33 & R,
+  const std::vector<GridAxis> & axes,
+  const arma::vec & thetalist0,
+  const double eomg,
+  const double ev,
+  const ManipulabilityPart part,
+  const size_t num_threads
+)
+{
+  if (axes.size() != 3) {
+    throw std::invalid_argument(
+            "CartesianManipulabilityMap: axes must hold the x, y and z axes");
+  }
+
+  constexpr double nan = std::numeric_limits<double>::quiet_NaN();
+  const std::vector<Joint> joints = ClassifyJoints(Blist);
+  ManipulabilityMap map{GridSpace::Cartesian, part, axes, {}};
+  map.cells.resize(GridSize(axes));
+
+  ParallelFor(
+    map.cells.size(),
+    [&](const size_t i) {
+      const arma::vec3 p = GridPoint(axes, i);
+      const arma::mat44 T = RpToTrans(R, p);
+      const auto &[thetalist, success] = IKinBody(Blist, M, T, thetalist0, eomg, ev);
+
+      if (success) {
+        const arma::mat Jb = JacobianBody(joints, thetalist);
+        map.cells.at(i) = Manipulability(Jb, part);
+      } else {
+        map.cells.at(i) = {nan, nan, nan};
+      }
+    },
+    num_threads
+  );
+
+  return map;
+}
+
+void SaveManipulabilityMap(const ManipulabilityMap & map, const std::string & filename)
+{
+  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    throw std::runtime_error("SaveManipulabilityMap: cannot open " + filename);
+  }
+
+  GridFileHeader header{};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.space = static_cast<uint32_t>(map.space);
+  header.part = static_cast<uint32_t>(map.part);
+  header.naxes = static_cast<uint32_t>(map.axes.size());
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  for (const GridAxis & axis : map.axes) {
+    const GridFileAxis record{axis.lower, axis.upper, axis.count};
+    file.write(reinterpret_cast<const char *>(&record), sizeof(record));
+  }
+
+  std::vector<float> cells;
+  cells.reserve(3 * map.cells.size());
+  for (const ManipulabilityMeasures & cell : map.cells) {
+    cells.push_back(static_cast<float>(cell.manipulability));
+    cells.push_back(static_cast<float>(cell.condition_number));
+    cells.push_back(static_cast<float>(cell.min_singular_value));
+  }
+  file.write(
+    reinterpret_cast<const char *>(cells.data()),
+    static_cast<std::streamsize>(cells.size() * sizeof(float)));
+
+  if (!file) {
+    throw std::runtime_error("SaveManipulabilityMap: failed to write " + filename);
+  }
+}
+
+ManipulabilityMapView::ManipulabilityMapView(const std::string & filename)
+: file_(filename)
+{
+  if (file_.size() < sizeof(GridFileHeader)) {
+    throw std::runtime_error("ManipulabilityMapView: not a grid file " + filename);
+  }
+
+  const char * bytes = file_.data();
+  const GridFileHeader * header = reinterpret_cast<const GridFileHeader *>(bytes);
+
+  if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 ||
+    header->version != kVersion ||
+    header->naxes > (file_.size() - sizeof(GridFileHeader)) / sizeof(GridFileAxis))
+  {
+    throw std::runtime_error("ManipulabilityMapView: not a grid file " + filename);
+  }
+  const size_t axes_end = sizeof(GridFileHeader) + header->naxes * sizeof(GridFileAxis);
+
+  space_ = static_cast<GridSpace>(header->space);
+  part_ = static_cast<ManipulabilityPart>(header->part);
+  const GridFileAxis * records =
+    reinterpret_cast<const GridFileAxis *>(bytes + sizeof(GridFileHeader));
+  for (uint32_t d = 0; d < header->naxes; ++d) {
+    axes_.push_back({records[d].lower, records[d].upper, records[d].count});
+  }
+
+  size_ = GridSize(axes_);
+  if (size_ > (file_.size() - axes_end) / (3 * sizeof(float))) {
+    throw std::runtime_error("ManipulabilityMapView: truncated grid file " + filename);
+  }
+  cells_ = reinterpret_cast<const float *>(bytes + axes_end);
+}
+
+ManipulabilityMapView::ManipulabilityMapView(ManipulabilityMapView && other) noexcept
+: file_(std::move(other.file_)),
+  space_(other.space_),
+  part_(other.part_),
+  axes_(std::move(other.axes_)),
+  cells_(std::exchange(other.cells_, nullptr)),
+  size_(std::exchange(other.size_, 0))
+{
+}
+
+ManipulabilityMapView & ManipulabilityMapView::operator=(ManipulabilityMapView && other) noexcept
+{
+  if (this != &other) {
+    file_ = std::move(other.file_);
+    space_ = other.space_;
+    part_ = other.part_;
+    axes_ = std::move(other.axes_);
+    cells_ = std::exchange(other.cells_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+  }
+  return *this;
+}
+
+ManipulabilityMapView::~ManipulabilityMapView() = default;
+
+GridSpace ManipulabilityMapView::space() const
+{
+  return space_;
+}
+
+ManipulabilityPart ManipulabilityMapView::part() const
+{
+  return part_;
+}
+
+const std::vector<GridAxis> & ManipulabilityMapView::axes() const
+{
+  return axes_;
+}
+
+size_t ManipulabilityMapView::size() const
+{
+  return size_;
+}
+
+const ManipulabilityMeasures ManipulabilityMapView::at(const size_t index) const
+{
+  if (index >= size_) {
+    throw std::out_of_range("ManipulabilityMapView::at: index out of range");
+  }
+
+  const float * cell = cells_ + 3 * index;
+  return {cell[0], cell[1], cell[2]};
+}
+
+const ManipulabilityMeasures ManipulabilityMapView::Lookup(const arma::vec & point) const
+{
+  if (point.n_elem != axes_.size() || !point.is_finite()) {
+    throw std::invalid_argument(
+            "ManipulabilityMapView::Lookup: point must hold one finite value per axis");
+  }
+
+  size_t index = 0;
+  size_t stride = 1;
+
+  for (size_t d = 0; d < axes_.size(); ++d) {
+    const GridAxis & axis = axes_.at(d);
+    size_t i = 0;
+
+    if (axis.count > 1 && axis.upper != axis.lower) {
+      const double s = (point.at(d) - axis.lower) / (axis.upper - axis.lower) *
+        static_cast<double>(axis.count - 1);
+      const double clamped = std::clamp(std::round(s), 0.0, static_cast<double>(axis.count - 1));
+      i = static_cast<size_t>(clamped);
+    }
+
+    index += i * stride;
+    stride *= std::max<uint64_t>(1, axis.count);
+  }
+
+  return at(index);
+}
+}
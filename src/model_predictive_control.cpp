@@ -0,0 +1,298 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "modern_robotics/utils.hpp"
+#include "modern_robotics/dynamics_of_open_chains.hpp"
+#include "modern_robotics/model_predictive_control.hpp"
+
+namespace mr
+{
+LinearMPC::LinearMPC(
+  const arma::vec3 & g,
+  const std::vector<arma::mat44> & Mlist,
+  const std::vector<arma::mat66> & Glist,
+  const std::vector<arma::vec6> & Slist,
+  const LinearMPCOptions & options
+)
+: dynamics_(Mlist, Glist, Slist),
+  g_(g),
+  options_(options),
+  n_(Slist.size()),
+  H_(options.horizon),
+  bounded_(!options.tau_min.is_empty() || !options.tau_max.is_empty())
+{
+  const size_t n = n_;
+  const size_t s = 2 * n;
+  const size_t m = n * H_;
+
+  if (H_ == 0 || !(options.dt > 0.0)) {
+    throw std::invalid_argument("LinearMPC: horizon and dt must be positive");
+  }
+  if (options.Q.n_rows != s || options.Q.n_cols != s ||
+    options.Qf.n_rows != s || options.Qf.n_cols != s ||
+    options.R.n_rows != n || options.R.n_cols != n)
+  {
+    throw std::invalid_argument("LinearMPC: Q and Qf must be 2n x 2n and R n x n");
+  }
+  if ((!options.tau_min.is_empty() && options.tau_min.n_elem != n) ||
+    (!options.tau_max.is_empty() && options.tau_max.n_elem != n))
+  {
+    throw std::invalid_argument("LinearMPC: torque limits must have one entry per joint");
+  }
+
+  ddthetalist_.zeros(n);
+  Dtheta_.zeros(n, n);
+  Ddtheta_.zeros(n, n);
+  Dtau_.zeros(n, n);
+  A_.zeros(s, s);
+  B_.zeros(s, n);
+  Gamma_.zeros(s * H_, m);
+  QGamma_.zeros(s * H_, m);
+  L_.zeros(m, m);
+  xref_.zeros(s * (H_ + 1));
+  tauref_.zeros(m);
+  z_.zeros(s * (H_ + 1));
+  qz_.zeros(s * H_);
+  f_.zeros(m);
+  lo_.zeros(m);
+  hi_.zeros(m);
+  u_.zeros(m);
+  zeta_.zeros(m);
+  y_.zeros(m);
+  taulist_.zeros(n);
+}
+
+const arma::vec & LinearMPC::Step(
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist,
+  const std::vector<arma::vec> & thetamatd,
+  const std::vector<arma::vec> & dthetamatd,
+  const std::vector<arma::vec> & ddthetamatd,
+  const size_t i
+)
+{
+  const size_t n = n_;
+  const size_t s = 2 * n;
+  const size_t H = H_;
+  const size_t m = n * H;
+  const size_t N = thetamatd.size();
+  const double dt = options_.dt;
+
+  if (i >= N || dthetamatd.size() != N || ddthetamatd.size() != N) {
+    throw std::invalid_argument(
+            "LinearMPC::Step: i must index reference trajectories of equal length");
+  }
+  if (thetalist.n_elem != n || dthetalist.n_elem != n) {
+    throw std::invalid_argument(
+            "LinearMPC::Step: joint vectors must have one entry per joint");
+  }
+
+  // The reference states over the horizon and their feedforward torques
+  const arma::vec6 Ftip{arma::fill::zeros};
+  for (size_t k = 0; k <= H; ++k) {
+    const size_t j = std::min(i + k, N - 1);
+    for (size_t r = 0; r < n; ++r) {
+      xref_.at(s * k + r) = thetamatd.at(j).at(r);
+      xref_.at(s * k + n + r) = dthetamatd.at(j).at(r);
+    }
+    if (k < H) {
+      dynamics_.InverseDynamics(
+        thetamatd.at(j), dthetamatd.at(j), ddthetamatd.at(j), g_, Ftip, taulist_);
+      for (size_t r = 0; r < n; ++r) {
+        tauref_.at(n * k + r) = taulist_.at(r);
+      }
+    }
+  }
+
+  // The Euler step linearized at the current reference point
+  for (size_t r = 0; r < n; ++r) {
+    taulist_.at(r) = tauref_.at(r);
+  }
+  dynamics_.ForwardDynamicsDerivatives(
+    thetamatd.at(i), dthetamatd.at(i), taulist_, g_, Ftip, ddthetalist_, Dtheta_, Ddtheta_, Dtau_);
+  A_.eye();
+  B_.zeros();
+  for (size_t r = 0; r < n; ++r) {
+    A_.at(r, n + r) = dt;
+    for (size_t c = 0; c < n; ++c) {
+      A_.at(n + r, c) = dt * Dtheta_.at(r, c);
+      A_.at(n + r, n + c) += dt * Ddtheta_.at(r, c);
+      B_.at(n + r, c) = dt * Dtau_.at(r, c);
+    }
+  }
+
+  // The free response z_(k+1) = A z_k + c_k, where c_k is the error of the
+  // Euler step along the reference itself
+  for (size_t r = 0; r < n; ++r) {
+    z_.at(r) = thetalist.at(r) - xref_.at(r);
+    z_.at(n + r) = dthetalist.at(r) - xref_.at(n + r);
+  }
+  for (size_t k = 0; k < H; ++k) {
+    const size_t j = std::min(i + k, N - 1);
+    for (size_t r = 0; r < s; ++r) {
+      double sum = 0.0;
+      for (size_t c = 0; c < s; ++c) {
+        sum += A_.at(r, c) * z_.at(s * k + c);
+      }
+      const double rate = r < n ? xref_.at(s * k + n + r) : ddthetamatd.at(j).at(r - n);
+      sum += xref_.at(s * k + r) + dt * rate - xref_.at(s * (k + 1) + r);
+      z_.at(s * (k + 1) + r) = sum;
+    }
+  }
+
+  // Gamma is block Toeplitz: block (k, j) is A^(k-j) B for j <= k
+  for (size_t r = 0; r < s; ++r) {
+    for (size_t c = 0; c < n; ++c) {
+      Gamma_.at(r, c) = B_.at(r, c);
+    }
+  }
+  for (size_t k = 1; k < H; ++k) {
+    for (size_t r = 0; r < s; ++r) {
+      for (size_t c = 0; c < n; ++c) {
+        double sum = 0.0;
+        for (size_t l = 0; l < s; ++l) {
+          sum += A_.at(r, l) * Gamma_.at(s * (k - 1) + l, c);
+        }
+        Gamma_.at(s * k + r, c) = sum;
+      }
+    }
+  }
+  for (size_t j = 1; j < H; ++j) {
+    for (size_t k = j; k < H; ++k) {
+      for (size_t r = 0; r < s; ++r) {
+        for (size_t c = 0; c < n; ++c) {
+          Gamma_.at(s * k + r, n * j + c) = Gamma_.at(s * (k - j) + r, c);
+        }
+      }
+    }
+  }
+
+  // Qbar Gamma and Qbar z, with Qf on the last step
+  for (size_t k = 0; k < H; ++k) {
+    const arma::mat & Q = k + 1 == H ? options_.Qf : options_.Q;
+    for (size_t r = 0; r < s; ++r) {
+      for (size_t c = 0; c < n * (k + 1); ++c) {
+        double sum = 0.0;
+        for (size_t l = 0; l < s; ++l) {
+          sum += Q.at(r, l) * Gamma_.at(s * k + l, c);
+        }
+        QGamma_.at(s * k + r, c) = sum;
+      }
+      double sum = 0.0;
+      for (size_t l = 0; l < s; ++l) {
+        sum += Q.at(r, l) * z_.at(s * (k + 1) + l);
+      }
+      qz_.at(s * k + r) = sum;
+    }
+  }
+
+  // Hessian Gamma^T Qbar Gamma + Rbar and gradient Gamma^T Qbar z, skipping
+  // the zero blocks above the diagonal of Gamma
+  double trace = 0.0;
+  for (size_t a = 0; a < m; ++a) {
+    const size_t ja = a / n;
+    for (size_t b = 0; b <= a; ++b) {
+      double sum = ja == b / n ? options_.R.at(a % n, b % n) : 0.0;
+      for (size_t row = s * ja; row < s * H; ++row) {
+        sum += Gamma_.at(row, a) * QGamma_.at(row, b);
+      }
+      L_.at(a, b) = sum;
+      L_.at(b, a) = sum;
+    }
+    trace += L_.at(a, a);
+
+    double sum = 0.0;
+    for (size_t row = s * ja; row < s * H; ++row) {
+      sum += Gamma_.at(row, a) * qz_.at(row);
+    }
+    f_.at(a) = sum;
+  }
+
+  if (!bounded_) {
+    if (!CholeskyDecompose(L_)) {
+      throw std::runtime_error("LinearMPC::Step: QP Hessian is not positive definite");
+    }
+    for (size_t a = 0; a < m; ++a) {
+      u_.at(a) = -f_.at(a);
+    }
+    CholeskySolve(L_, u_);
+    zeta_ = u_;
+    iterations_ = 0;
+    converged_ = true;
+  } else {
+    const double rho = options_.rho > 0.0 ? options_.rho : trace / static_cast<double>(m);
+    for (size_t a = 0; a < m; ++a) {
+      L_.at(a, a) += rho;
+      const size_t r = a % n;
+      lo_.at(a) = options_.tau_min.is_empty() ? -arma::datum::inf :
+        options_.tau_min.at(r) - tauref_.at(a);
+      hi_.at(a) = options_.tau_max.is_empty() ? arma::datum::inf :
+        options_.tau_max.at(r) - tauref_.at(a);
+    }
+    if (!CholeskyDecompose(L_)) {
+      throw std::runtime_error("LinearMPC::Step: QP Hessian is not positive definite");
+    }
+
+    // Warm start from the previous solution shifted by one step
+    if (warm_) {
+      for (size_t a = 0; a < m; ++a) {
+        const size_t from = std::min(a + n, m - n + a % n);
+        zeta_.at(a) = zeta_.at(from);
+        y_.at(a) = y_.at(from);
+      }
+    } else {
+      zeta_.zeros();
+      y_.zeros();
+    }
+    for (size_t a = 0; a < m; ++a) {
+      zeta_.at(a) = std::clamp(zeta_.at(a), lo_.at(a), hi_.at(a));
+    }
+
+    converged_ = false;
+    iterations_ = 0;
+    while (iterations_ < options_.max_iterations && !converged_) {
+      ++iterations_;
+
+      // u = (H + rho I)^-1 (rho zeta - y - f)
+      for (size_t a = 0; a < m; ++a) {
+        u_.at(a) = rho * zeta_.at(a) - y_.at(a) - f_.at(a);
+      }
+      CholeskySolve(L_, u_);
+
+      double primal = 0.0;
+      double dual = 0.0;
+      for (size_t a = 0; a < m; ++a) {
+        const double zeta = std::clamp(u_.at(a) + y_.at(a) / rho, lo_.at(a), hi_.at(a));
+        dual = std::max(dual, rho * std::abs(zeta - zeta_.at(a)));
+        zeta_.at(a) = zeta;
+        y_.at(a) += rho * (u_.at(a) - zeta);
+        primal = std::max(primal, std::abs(u_.at(a) - zeta));
+      }
+      converged_ = primal < options_.tolerance && dual < options_.tolerance;
+    }
+  }
+  warm_ = true;
+
+  for (size_t r = 0; r < n; ++r) {
+    taulist_.at(r) = tauref_.at(r) + zeta_.at(r);
+  }
+
+  return taulist_;
+}
+
+void LinearMPC::Reset()
+{
+  warm_ = false;
+}
+
+size_t LinearMPC::iterations() const
+{
+  return iterations_;
+}
+
+bool LinearMPC::converged() const
+{
+  return converged_;
+}
+}
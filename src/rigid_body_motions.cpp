@@ -155,6 +155,36 @@ const arma::mat66 Adjoint(const arma::mat44 & T)
   return AdT;
 }
 
+const arma::vec6 AdjointMap(const arma::mat44 & T, const arma::vec6 & V)
+{
+  const double wx = V.at(0);
+  const double wy = V.at(1);
+  const double wz = V.at(2);
+  const double vx = V.at(3);
+  const double vy = V.at(4);
+  const double vz = V.at(5);
+  const double px = T.at(0, 3);
+  const double py = T.at(1, 3);
+  const double pz = T.at(2, 3);
+
+  const double Rwx = T.at(0, 0) * wx + T.at(0, 1) * wy + T.at(0, 2) * wz;
+  const double Rwy = T.at(1, 0) * wx + T.at(1, 1) * wy + T.at(1, 2) * wz;
+  const double Rwz = T.at(2, 0) * wx + T.at(2, 1) * wy + T.at(2, 2) * wz;
+  const double Rvx = T.at(0, 0) * vx + T.at(0, 1) * vy + T.at(0, 2) * vz;
+  const double Rvy = T.at(1, 0) * vx + T.at(1, 1) * vy + T.at(1, 2) * vz;
+  const double Rvz = T.at(2, 0) * vx + T.at(2, 1) * vy + T.at(2, 2) * vz;
+
+  const arma::vec6 AdTV{
+    Rwx,
+    Rwy,
+    Rwz,
+    py * Rwz - pz * Rwy + Rvx,
+    pz * Rwx - px * Rwz + Rvy,
+    px * Rwy - py * Rwx + Rvz
+  };
+  return AdTV;
+}
+
 const arma::vec6 ScrewToAxis(const arma::vec3 & q, const arma::vec3 & s, const double h)
 {
   const arma::vec3 omg(s);
@@ -221,9 +251,10 @@ const arma::mat44 MatrixLog6(const arma::mat44 & T)
   double theta;
 
   if (NearZero(arma::max(arma::max(arma::abs(R - I33))))) {
+    // Pure translation: [S] theta = [0 p; 0 0], also when p is zero
     omgmat = Z33;
-    v = p / arma::norm(p);
-    theta = arma::norm(p);
+    v = p;
+    theta = 1.0;
   } else {
     theta = std::acos((arma::trace(R) - 1.0) / 2.0);
     omgmat = MatrixLog3(R) / theta;
@@ -1,8 +1,27 @@
-#include "modern_robotics/robot_control.hpp"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+
+#include "modern_robotics/utils.hpp"
+#include "modern_robotics/latency_histogram.hpp"
+#include "modern_robotics/rigid_body_motions.hpp"
+#include "modern_robotics/velocity_kinematics_and_statics.hpp"
 #include "modern_robotics/dynamics_of_open_chains.hpp"
+#include "modern_robotics/robot_control.hpp"
 
 namespace mr
 {
+namespace
+{
+const arma::vec Constant(const size_t n, const double value)
+{
+  arma::vec v{n, arma::fill::zeros};
+  v.fill(value);
+  return v;
+}
+}
+
 const arma::vec ComputeTorque(
   const arma::vec & thetalist,
   const arma::vec & dthetalist,
@@ -19,6 +38,7 @@ const arma::vec ComputeTorque(
   const double kd
 )
 {
+  MR_LATENCY_SCOPE("ComputeTorque");
   const size_t n = thetalist.size();
   const arma::mat I{n, n, arma::fill::eye};
   const arma::mat Kp = kp * I;
@@ -65,69 +85,571 @@ SimulateControl(
   const double ki,
   const double kd,
   const double dt,
-  const unsigned int intRes
+  const size_t intRes
 )
 {
   const size_t m = thetalist.size();
   const size_t n = thetamatd.size();
 
+  // With an exact model the controller and the plant evaluate the same terms
+  // at the start of each step, so they share one cache
+  DynamicsCache plant(Mlist, Glist, Slist);
+  std::unique_ptr<DynamicsCache> model;
+  if (!Identical(gtilde, g) || !Identical(Mtildelist, Mlist) || !Identical(Gtildelist, Glist)) {
+    model = std::make_unique<DynamicsCache>(Mtildelist, Gtildelist, Slist);
+  }
+  DynamicsCache & controller = model ? *model : plant;
+
   arma::vec thetacurrent(thetalist);
   arma::vec dthetacurrent(dthetalist);
   arma::vec eint{m, arma::fill::zeros};
+  arma::vec ddthetalist{m, arma::fill::zeros};
+  const double h = dt / static_cast<double>(intRes);
 
   std::vector<arma::vec> taumat;
   std::vector<arma::vec> thetamat;
 
   for (size_t i = 0; i < n; ++i) {
-    const arma::vec thetalistd = thetamatd.at(i);
-    const arma::vec dthetalistd = dthetamatd.at(i);
-    const arma::vec ddthetalistd = ddthetamatd.at(i);
-    const arma::vec taulist = ComputeTorque(
-      thetacurrent,
-      dthetacurrent,
-      eint,
-      gtilde,
-      Mtildelist,
-      Gtildelist,
-      Slist,
-      thetalistd,
-      dthetalistd,
-      ddthetalistd,
-      kp,
-      ki,
-      kd
-    );
+    const arma::vec & thetalistd = thetamatd.at(i);
+    const arma::vec & dthetalistd = dthetamatd.at(i);
 
+    // ComputeTorque as M(theta) (ddthetalistd + Kp ep + Ki ei + Kd ed) + c + g
+    const arma::vec ep = thetalistd - thetacurrent;
+    const arma::vec u = ddthetamatd.at(i) + kp * ep + ki * (eint + ep) +
+      kd * (dthetalistd - dthetacurrent);
+    arma::vec taulist;
+    controller.InverseDynamics(thetacurrent, dthetacurrent, u, gtilde, taulist);
+
+    const arma::vec6 & Ftip = Ftipmat.at(i);
     for (size_t j = 0; j < intRes; ++j) {
-      const arma::vec6 Ftip = Ftipmat.at(i);
-      const arma::vec ddthetalist = ForwardDynamics(
-        thetacurrent,
-        dthetacurrent,
-        taulist,
-        g,
-        Ftip,
-        Mlist,
-        Glist,
-        Slist
-      );
-
-      const auto res = EulerStep(
-        thetacurrent,
-        dthetacurrent,
-        ddthetalist,
-        dt / static_cast<double>(intRes)
-      );
-
-      thetacurrent = std::get<0>(res);
-      dthetacurrent = std::get<1>(res);
+      plant.ForwardDynamics(thetacurrent, dthetacurrent, taulist, g, Ftip, ddthetalist);
+      thetacurrent += h * dthetacurrent;
+      dthetacurrent += h * ddthetalist;
     }
 
     taumat.push_back(taulist);
-    thetamat.push_back(thetalist);
+    thetamat.push_back(thetacurrent);
     const arma::vec e = thetalistd - thetacurrent;
     eint += e;
   }
 
   return {taumat, thetamat};
 }
+
+ComputedTorqueController::ComputedTorqueController(
+  const arma::vec3 & g,
+  const std::vector<arma::mat44> & Mlist,
+  const std::vector<arma::mat66> & Glist,
+  const std::vector<arma::vec6> & Slist,
+  const double kp,
+  const double ki,
+  const double kd
+)
+: ComputedTorqueController(
+    g, Mlist, Glist, Slist,
+    Constant(Slist.size(), kp), Constant(Slist.size(), ki), Constant(Slist.size(), kd))
+{
+}
+
+ComputedTorqueController::ComputedTorqueController(
+  const arma::vec3 & g,
+  const std::vector<arma::mat44> & Mlist,
+  const std::vector<arma::mat66> & Glist,
+  const std::vector<arma::vec6> & Slist,
+  const arma::vec & kp,
+  const arma::vec & ki,
+  const arma::vec & kd
+)
+: dynamics_(Mlist, Glist, Slist),
+  g_(g),
+  diagonal_(true),
+  kp_(kp),
+  ki_(ki),
+  kd_(kd),
+  eint_(Slist.size(), arma::fill::zeros),
+  ep_(Slist.size(), arma::fill::zeros),
+  ed_(Slist.size(), arma::fill::zeros),
+  ddthetalist_(Slist.size(), arma::fill::zeros),
+  taulist_(Slist.size(), arma::fill::zeros)
+{
+  const size_t n = Slist.size();
+  if (kp.n_elem != n || ki.n_elem != n || kd.n_elem != n) {
+    throw std::invalid_argument(
+            "ComputedTorqueController: gains must have one entry per joint");
+  }
+}
+
+ComputedTorqueController::ComputedTorqueController(
+  const arma::vec3 & g,
+  const std::vector<arma::mat44> & Mlist,
+  const std::vector<arma::mat66> & Glist,
+  const std::vector<arma::vec6> & Slist,
+  const arma::mat & Kp,
+  const arma::mat & Ki,
+  const arma::mat & Kd
+)
+: dynamics_(Mlist, Glist, Slist),
+  g_(g),
+  diagonal_(false),
+  Kp_(Kp),
+  Ki_(Ki),
+  Kd_(Kd),
+  eint_(Slist.size(), arma::fill::zeros),
+  ep_(Slist.size(), arma::fill::zeros),
+  ed_(Slist.size(), arma::fill::zeros),
+  ddthetalist_(Slist.size(), arma::fill::zeros),
+  taulist_(Slist.size(), arma::fill::zeros)
+{
+  const size_t n = Slist.size();
+  for (const arma::mat * K : {&Kp, &Ki, &Kd}) {
+    if (K->n_rows != n || K->n_cols != n) {
+      throw std::invalid_argument("ComputedTorqueController: gain matrices must be nxn");
+    }
+  }
+}
+
+const arma::vec & ComputedTorqueController::Step(
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist,
+  const arma::vec & thetalistd,
+  const arma::vec & dthetalistd,
+  const arma::vec & ddthetalistd
+)
+{
+  MR_LATENCY_SCOPE("ComputedTorqueController::Step");
+  const size_t n = eint_.n_elem;
+  if (thetalist.n_elem != n || dthetalist.n_elem != n || thetalistd.n_elem != n ||
+    dthetalistd.n_elem != n || ddthetalistd.n_elem != n)
+  {
+    throw std::invalid_argument(
+            "ComputedTorqueController::Step: inputs must have one entry per joint");
+  }
+
+  // ep_, eint_ and ed_ become the errors ep, ei = eint + ep and ed
+  for (size_t i = 0; i < n; ++i) {
+    ep_.at(i) = thetalistd.at(i) - thetalist.at(i);
+    eint_.at(i) += ep_.at(i);
+    ed_.at(i) = dthetalistd.at(i) - dthetalist.at(i);
+  }
+
+  for (size_t i = 0; i < n; ++i) {
+    double u = ddthetalistd.at(i);
+    if (diagonal_) {
+      u += kp_.at(i) * ep_.at(i) + ki_.at(i) * eint_.at(i) + kd_.at(i) * ed_.at(i);
+    } else {
+      for (size_t j = 0; j < n; ++j) {
+        u += Kp_.at(i, j) * ep_.at(j) + Ki_.at(i, j) * eint_.at(j) + Kd_.at(i, j) * ed_.at(j);
+      }
+    }
+    ddthetalist_.at(i) = u;
+  }
+
+  const arma::vec6 Ftip{arma::fill::zeros};
+  dynamics_.InverseDynamics(thetalist, dthetalist, ddthetalist_, g_, Ftip, taulist_);
+
+  return taulist_;
+}
+
+void ComputedTorqueController::SetGains(
+  const arma::vec & kp,
+  const arma::vec & ki,
+  const arma::vec & kd
+)
+{
+  const size_t n = eint_.n_elem;
+  if (kp.n_elem != n || ki.n_elem != n || kd.n_elem != n) {
+    throw std::invalid_argument(
+            "ComputedTorqueController::SetGains: gains must have one entry per joint");
+  }
+
+  diagonal_ = true;
+  kp_ = kp;
+  ki_ = ki;
+  kd_ = kd;
+}
+
+void ComputedTorqueController::SetActuators(const ActuatorModel & actuators)
+{
+  dynamics_.SetActuators(actuators);
+}
+
+const arma::vec & ComputedTorqueController::eint() const
+{
+  return eint_;
+}
+
+void ComputedTorqueController::SetIntegralError(const arma::vec & eint)
+{
+  if (eint.n_elem != eint_.n_elem) {
+    throw std::invalid_argument(
+            "ComputedTorqueController::SetIntegralError: eint must have one entry per joint");
+  }
+  eint_ = eint;
+}
+
+void ComputedTorqueController::Reset()
+{
+  eint_.zeros();
+}
+
+ResolvedRateController::ResolvedRateController(
+  const std::vector<arma::vec6> & list,
+  const arma::mat44 & M,
+  const IKFrame frame,
+  const arma::vec & thetalist0,
+  const ResolvedRateOptions & options
+)
+: joints_(ClassifyJoints(list)),
+  M_(M),
+  frame_(frame),
+  options_(options),
+  thetalist_(thetalist0),
+  dthetalist_(list.size(), arma::fill::zeros),
+  zero_(list.size(), arma::fill::zeros),
+  J_(6, list.size(), arma::fill::zeros),
+  G_(std::min<size_t>(6, list.size()), std::min<size_t>(6, list.size()), arma::fill::zeros),
+  L_(std::min<size_t>(6, list.size()), std::min<size_t>(6, list.size()), arma::fill::zeros)
+{
+  const size_t n = list.size();
+  if (thetalist0.n_elem != n) {
+    throw std::invalid_argument(
+            "ResolvedRateController: thetalist0 must have one entry per joint");
+  }
+  if (!options.max_velocity.is_empty() && options.max_velocity.n_elem != n) {
+    throw std::invalid_argument(
+            "ResolvedRateController: max_velocity must have one entry per joint");
+  }
+
+  Update();
+}
+
+void ResolvedRateController::SetJointState(const arma::vec & thetalist)
+{
+  if (thetalist.n_elem != thetalist_.n_elem) {
+    throw std::invalid_argument(
+            "ResolvedRateController::SetJointState: thetalist must have one entry per joint");
+  }
+
+  thetalist_ = thetalist;
+  Update();
+}
+
+const arma::vec & ResolvedRateController::Step(const arma::vec6 & V, const double dt)
+{
+  return Step(V, dt, zero_);
+}
+
+const arma::vec & ResolvedRateController::Step(
+  const arma::vec6 & V,
+  const double dt,
+  const arma::vec & z
+)
+{
+  const size_t n = thetalist_.n_elem;
+  if (z.n_elem != n) {
+    throw std::invalid_argument(
+            "ResolvedRateController::Step: z must have one entry per joint");
+  }
+
+  // The Gram matrix of the short side of J, which is nonsingular away from
+  // singularities: J J^T, or J^T J with fewer than six joints
+  const size_t m = G_.n_rows;
+  const bool wide = n >= 6;
+  for (size_t r = 0; r < m; ++r) {
+    for (size_t c = 0; c <= r; ++c) {
+      double sum = 0.0;
+      if (wide) {
+        for (size_t k = 0; k < n; ++k) {
+          sum += J_.at(r, k) * J_.at(c, k);
+        }
+      } else {
+        for (size_t k = 0; k < 6; ++k) {
+          sum += J_.at(k, r) * J_.at(k, c);
+        }
+      }
+      G_.at(r, c) = sum;
+      G_.at(c, r) = sum;
+    }
+  }
+
+  // Manipulability from the Cholesky factor of the Gram matrix: w = prod(L_ii)
+  double w = 0.0;
+  L_ = G_;
+  bool factored = CholeskyDecompose(L_);
+  if (factored) {
+    w = 1.0;
+    for (size_t i = 0; i < m; ++i) {
+      w *= L_.at(i, i);
+    }
+  }
+
+  const double w0 = options_.manipulability_threshold;
+  damping_ = 0.0;
+  if (w < w0) {
+    const double ratio = w / w0;
+    damping_ = options_.max_damping * (1.0 - ratio * ratio);
+  }
+
+  // The undamped factor is reused unless damping is applied
+  if (damping_ > 0.0) {
+    L_ = G_;
+    for (size_t i = 0; i < m; ++i) {
+      L_.at(i, i) += damping_;
+    }
+    factored = CholeskyDecompose(L_);
+  }
+
+  if (!factored) {
+    dthetalist_.zeros();
+  } else if (wide) {
+    NullSpaceResolvedRate(J_, V, z, L_, dthetalist_);
+  } else {
+    // z + (J^T J + damping I)^-1 J^T (V - J z) = (J^T J + damping I)^-1 (J^T V + damping z)
+    for (size_t k = 0; k < n; ++k) {
+      double sum = damping_ * z.at(k);
+      for (size_t r = 0; r < 6; ++r) {
+        sum += J_.at(r, k) * V.at(r);
+      }
+      dthetalist_.at(k) = sum;
+    }
+    CholeskySolve(L_, dthetalist_);
+  }
+
+  scale_ = 1.0;
+  if (!options_.max_velocity.is_empty()) {
+    for (size_t i = 0; i < n; ++i) {
+      const double speed = std::abs(dthetalist_.at(i));
+      if (speed * scale_ > options_.max_velocity.at(i)) {
+        scale_ = options_.max_velocity.at(i) / speed;
+      }
+    }
+    dthetalist_ *= scale_;
+  }
+
+  thetalist_ += dt * dthetalist_;
+  Update();
+
+  return dthetalist_;
+}
+
+const arma::vec & ResolvedRateController::thetalist() const
+{
+  return thetalist_;
+}
+
+const arma::vec & ResolvedRateController::dthetalist() const
+{
+  return dthetalist_;
+}
+
+const arma::mat44 & ResolvedRateController::T() const
+{
+  return T_;
+}
+
+const arma::mat & ResolvedRateController::jacobian() const
+{
+  return J_;
+}
+
+double ResolvedRateController::damping() const
+{
+  return damping_;
+}
+
+double ResolvedRateController::scale() const
+{
+  return scale_;
+}
+
+void ResolvedRateController::Update()
+{
+  if (frame_ == IKFrame::Body) {
+    FKinAndJacobianBody(M_, joints_, thetalist_, T_, J_);
+  } else {
+    FKinAndJacobianSpace(M_, joints_, thetalist_, T_, J_);
+  }
+}
+
+OperationalSpaceController::OperationalSpaceController(
+  const arma::vec3 & g,
+  const std::vector<arma::mat44> & Mlist,
+  const std::vector<arma::mat66> & Glist,
+  const std::vector<arma::vec6> & Slist,
+  const arma::mat66 & Kp,
+  const arma::mat66 & Kd,
+  const double damping
+)
+: dynamics_(Mlist, Glist, Slist),
+  g_(g),
+  M_(arma::fill::eye),
+  Kp_(Kp),
+  Kd_(Kd),
+  damping_(damping),
+  T_(arma::fill::eye),
+  J_(6, Slist.size(), arma::fill::zeros),
+  L_(Slist.size(), Slist.size(), arma::fill::zeros),
+  Y_(Slist.size(), 6, arma::fill::zeros),
+  A_(arma::fill::zeros),
+  lambda_(arma::fill::zeros),
+  zeros_(Slist.size(), arma::fill::zeros),
+  h_(Slist.size(), arma::fill::zeros),
+  x_(Slist.size(), arma::fill::zeros),
+  y_(6, arma::fill::zeros),
+  taulist_(Slist.size(), arma::fill::zeros)
+{
+  for (const arma::mat44 & Mi : Mlist) {
+    M_ *= Mi;
+  }
+
+  // The screw axes in the end-effector frame, Bi = [Ad_M^-1] Si
+  const arma::mat66 AdMinv = Adjoint(TransInv(M_));
+  std::vector<arma::vec6> Blist;
+  Blist.reserve(Slist.size());
+  for (const arma::vec6 & S : Slist) {
+    Blist.push_back(AdMinv * S);
+  }
+  joints_ = ClassifyJoints(Blist);
+}
+
+const arma::vec & OperationalSpaceController::Step(
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist,
+  const arma::mat44 & Td,
+  const arma::vec6 & Vd,
+  const arma::vec6 & dVd,
+  const arma::vec6 & Fd
+)
+{
+  return Step(thetalist, dthetalist, Td, Vd, dVd, Fd, zeros_);
+}
+
+const arma::vec & OperationalSpaceController::Step(
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist,
+  const arma::mat44 & Td,
+  const arma::vec6 & Vd,
+  const arma::vec6 & dVd,
+  const arma::vec6 & Fd,
+  const arma::vec & tau0
+)
+{
+  const size_t n = joints_.size();
+  if (thetalist.n_elem != n || dthetalist.n_elem != n || tau0.n_elem != n) {
+    throw std::invalid_argument(
+            "OperationalSpaceController::Step: joint vectors must have one entry per joint");
+  }
+
+  FKinAndJacobianBody(M_, joints_, thetalist, T_, J_);
+
+  // M = L L^T
+  dynamics_.MassMatrix(thetalist, L_);
+  if (!CholeskyDecompose(L_)) {
+    throw std::runtime_error(
+            "OperationalSpaceController::Step: mass matrix is not positive definite");
+  }
+
+  // Y = L^-1 Jb^T, so that Lambda^-1 = Jb M^-1 Jb^T = Y^T Y
+  for (size_t c = 0; c < 6; ++c) {
+    for (size_t i = 0; i < n; ++i) {
+      double s = J_.at(c, i);
+      for (size_t k = 0; k < i; ++k) {
+        s -= L_.at(i, k) * Y_.at(k, c);
+      }
+      Y_.at(i, c) = s / L_.at(i, i);
+    }
+  }
+  for (size_t r = 0; r < 6; ++r) {
+    for (size_t c = 0; c <= r; ++c) {
+      double sum = r == c ? damping_ : 0.0;
+      for (size_t k = 0; k < n; ++k) {
+        sum += Y_.at(k, r) * Y_.at(k, c);
+      }
+      A_.at(r, c) = sum;
+      A_.at(c, r) = sum;
+    }
+  }
+  if (!CholeskyDecompose(A_)) {
+    throw std::runtime_error(
+            "OperationalSpaceController::Step: task-space inertia is singular");
+  }
+  for (size_t c = 0; c < 6; ++c) {
+    y_.zeros();
+    y_.at(c) = 1.0;
+    CholeskySolve(A_, y_);
+    for (size_t r = 0; r < 6; ++r) {
+      lambda_.at(r, c) = y_.at(r);
+    }
+  }
+
+  // The Coriolis and gravity torques
+  dynamics_.InverseDynamics(
+    thetalist, dthetalist, zeros_, g_, arma::vec6{arma::fill::zeros}, h_);
+
+  // The body twist of the end-effector
+  arma::vec6 Vb{arma::fill::zeros};
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t r = 0; r < 6; ++r) {
+      Vb.at(r) += J_.at(r, i) * dthetalist.at(i);
+    }
+  }
+
+  // The desired twist in the end-effector frame, its time derivative and the
+  // impedance acceleration about it
+  const arma::mat44 Tbd = TransInv(T_) * Td;
+  const arma::vec6 Xe = se3ToVec(MatrixLog6(Tbd));
+  const arma::vec6 Vdb = AdjointMap(Tbd, Vd);
+  const arma::vec6 a = AdjointMap(Tbd, dVd) + adMap(Vdb, Vb) + Kp_ * Xe + Kd_ * (Vdb - Vb) -
+    JacobianBodyDotProduct(joints_, thetalist, dthetalist);
+  const arma::vec6 F = lambda_ * a + Fd;
+
+  for (size_t i = 0; i < n; ++i) {
+    double tau = h_.at(i) + tau0.at(i);
+    for (size_t r = 0; r < 6; ++r) {
+      tau += J_.at(r, i) * F.at(r);
+    }
+    taulist_.at(i) = tau;
+  }
+
+  // Remove the part of tau0 that accelerates the end-effector,
+  // Jb^T Lambda Jb M^-1 tau0
+  bool secondary = false;
+  for (size_t i = 0; i < n; ++i) {
+    secondary = secondary || tau0.at(i) != 0.0;
+  }
+  if (secondary) {
+    x_ = tau0;
+    CholeskySolve(L_, x_);
+    for (size_t r = 0; r < 6; ++r) {
+      double sum = 0.0;
+      for (size_t k = 0; k < n; ++k) {
+        sum += J_.at(r, k) * x_.at(k);
+      }
+      y_.at(r) = sum;
+    }
+    CholeskySolve(A_, y_);
+    for (size_t i = 0; i < n; ++i) {
+      for (size_t r = 0; r < 6; ++r) {
+        taulist_.at(i) -= J_.at(r, i) * y_.at(r);
+      }
+    }
+  }
+
+  return taulist_;
+}
+
+const arma::mat44 & OperationalSpaceController::T() const
+{
+  return T_;
+}
+
+const arma::mat & OperationalSpaceController::jacobian() const
+{
+  return J_;
+}
+
+const arma::mat66 & OperationalSpaceController::lambda() const
+{
+  return lambda_;
+}
 }
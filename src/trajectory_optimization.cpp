@@ -0,0 +1,458 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+#include "modern_robotics/utils.hpp"
+#include "modern_robotics/dynamics_of_open_chains.hpp"
+#include "modern_robotics/trajectory_optimization.hpp"
+
+namespace mr
+{
+namespace
+{
+/// \brief The buffers one thread needs to roll out and linearize the dynamics
+struct ILQRWorker
+{
+  explicit ILQRWorker(const ILQRProblem & problem)
+  : dynamics(problem.Mlist, problem.Glist, problem.Slist),
+    theta(problem.Slist.size(), arma::fill::zeros),
+    dtheta(problem.Slist.size(), arma::fill::zeros),
+    ddtheta(problem.Slist.size(), arma::fill::zeros),
+    Dtheta(problem.Slist.size(), problem.Slist.size(), arma::fill::zeros),
+    Ddtheta(problem.Slist.size(), problem.Slist.size(), arma::fill::zeros),
+    Dtau(problem.Slist.size(), problem.Slist.size(), arma::fill::zeros),
+    dx(2 * problem.Slist.size(), arma::fill::zeros),
+    e(2 * problem.Slist.size(), arma::fill::zeros)
+  {
+  }
+
+  DynamicsWorkspace dynamics;
+  arma::vec theta;
+  arma::vec dtheta;
+  arma::vec ddtheta;
+  arma::mat Dtheta; /// The derivatives of the accelerations
+  arma::mat Ddtheta;
+  arma::mat Dtau;
+  arma::vec dx;
+  arma::vec e;
+};
+
+/// \brief A rollout: N + 1 states and N torques
+struct Trajectory
+{
+  Trajectory(const size_t n, const size_t N)
+  : xs(N + 1, arma::vec(2 * n, arma::fill::zeros)),
+    us(N, arma::vec(n, arma::fill::zeros))
+  {
+  }
+
+  std::vector<arma::vec> xs;
+  std::vector<arma::vec> us;
+  double cost = 0.0;
+};
+
+/// \brief Runs f(worker, i) for every i in [0, count) on the workers
+void ForEach(
+  std::vector<ILQRWorker> & workers,
+  const size_t count,
+  const std::function<void(ILQRWorker &, const size_t)> & f)
+{
+  const size_t used = std::min(workers.size(), count);
+  std::atomic<size_t> next{0};
+
+  ParallelFor(
+    used,
+    [&](const size_t w) {
+      for (size_t i = next++; i < count; i = next++) {
+        f(workers.at(w), i);
+      }
+    },
+    used
+  );
+}
+
+double QuadraticForm(const arma::mat & Q, const arma::vec & e)
+{
+  double sum = 0.0;
+  for (size_t c = 0; c < e.n_elem; ++c) {
+    for (size_t r = 0; r < e.n_elem; ++r) {
+      sum += e.at(r) * Q.at(r, c) * e.at(c);
+    }
+  }
+  return 0.5 * sum;
+}
+
+/// \brief Sets e to x minus the desired state of knot k
+void StateError(const ILQRProblem & problem, const size_t k, const arma::vec & x, arma::vec & e)
+{
+  const size_t n = problem.Slist.size();
+  for (size_t i = 0; i < n; ++i) {
+    e.at(i) = x.at(i) - problem.thetamatd.at(k).at(i);
+    e.at(n + i) = x.at(n + i) - problem.dthetamatd.at(k).at(i);
+  }
+}
+
+/// \brief Sets theta and dtheta of the worker from the state x
+void Unpack(ILQRWorker & worker, const arma::vec & x)
+{
+  const size_t n = worker.theta.n_elem;
+  for (size_t i = 0; i < n; ++i) {
+    worker.theta.at(i) = x.at(i);
+    worker.dtheta.at(i) = x.at(n + i);
+  }
+}
+
+/// \brief Advances the state x by one Euler step under the torques u
+void Step(
+  const ILQRProblem & problem,
+  ILQRWorker & worker,
+  const arma::vec & x,
+  const arma::vec & u,
+  arma::vec & xnext)
+{
+  const size_t n = worker.theta.n_elem;
+  Unpack(worker, x);
+  worker.dynamics.ForwardDynamics(
+    worker.theta, worker.dtheta, u, problem.g, arma::vec6{arma::fill::zeros}, worker.ddtheta);
+
+  for (size_t i = 0; i < n; ++i) {
+    xnext.at(i) = x.at(i) + problem.dt * x.at(n + i);
+    xnext.at(n + i) = x.at(n + i) + problem.dt * worker.ddtheta.at(i);
+  }
+}
+
+/// \brief Computes the Jacobians A = df/dx and B = df/du of the Euler step
+void Linearize(
+  const ILQRProblem & problem,
+  ILQRWorker & worker,
+  const arma::vec & x,
+  const arma::vec & u,
+  arma::mat & A,
+  arma::mat & B)
+{
+  const size_t n = worker.theta.n_elem;
+  const double dt = problem.dt;
+
+  Unpack(worker, x);
+  worker.dynamics.ForwardDynamicsDerivatives(
+    worker.theta, worker.dtheta, u, problem.g, arma::vec6{arma::fill::zeros}, worker.ddtheta,
+    worker.Dtheta, worker.Ddtheta, worker.Dtau);
+
+  A.eye();
+  B.zeros();
+  for (size_t i = 0; i < n; ++i) {
+    A.at(i, n + i) = dt;
+    for (size_t j = 0; j < n; ++j) {
+      A.at(n + i, j) = dt * worker.Dtheta.at(i, j);
+      A.at(n + i, n + j) += dt * worker.Ddtheta.at(i, j);
+      B.at(n + i, j) = dt * worker.Dtau.at(i, j);
+    }
+  }
+}
+
+/// \brief Rolls out u_k = ubar_k + alpha k_k + K_k (x_k - xbar_k) from the
+///        initial state and returns its cost, inf if the rollout fails
+double Rollout(
+  const ILQRProblem & problem,
+  ILQRWorker & worker,
+  const Trajectory & nominal,
+  const std::vector<arma::vec> & kff,
+  const std::vector<arma::mat> & K,
+  const double alpha,
+  Trajectory & rollout)
+{
+  const size_t n = problem.Slist.size();
+  const size_t N = rollout.us.size();
+  double cost = 0.0;
+
+  try {
+    rollout.xs.at(0) = nominal.xs.at(0);
+    for (size_t k = 0; k < N; ++k) {
+      const arma::vec & x = rollout.xs.at(k);
+      arma::vec & u = rollout.us.at(k);
+      for (size_t i = 0; i < 2 * n; ++i) {
+        worker.dx.at(i) = x.at(i) - nominal.xs.at(k).at(i);
+      }
+      for (size_t i = 0; i < n; ++i) {
+        double ui = nominal.us.at(k).at(i) + alpha * kff.at(k).at(i);
+        for (size_t j = 0; j < 2 * n; ++j) {
+          ui += K.at(k).at(i, j) * worker.dx.at(j);
+        }
+        u.at(i) = ui;
+      }
+
+      StateError(problem, k, x, worker.e);
+      cost += QuadraticForm(problem.Q, worker.e) + QuadraticForm(problem.R, u);
+      Step(problem, worker, x, u, rollout.xs.at(k + 1));
+    }
+    StateError(problem, N, rollout.xs.at(N), worker.e);
+    cost += QuadraticForm(problem.Qf, worker.e);
+  } catch (const std::runtime_error &) {
+    cost = std::numeric_limits<double>::infinity();
+  }
+
+  rollout.cost = std::isfinite(cost) ? cost : std::numeric_limits<double>::infinity();
+  return rollout.cost;
+}
+
+void CheckProblem(const ILQRProblem & problem, const std::vector<arma::vec> & taumat0)
+{
+  const size_t n = problem.Slist.size();
+  const size_t knots = problem.thetamatd.size();
+
+  if (problem.thetalist.n_elem != n || problem.dthetalist.n_elem != n) {
+    throw std::invalid_argument("ILQR: initial state must have one entry per joint");
+  }
+  if (knots < 2 || problem.dthetamatd.size() != knots) {
+    throw std::invalid_argument(
+            "ILQR: thetamatd and dthetamatd must have N + 1 >= 2 equal entries");
+  }
+  for (size_t k = 0; k < knots; ++k) {
+    if (problem.thetamatd.at(k).n_elem != n || problem.dthetamatd.at(k).n_elem != n) {
+      throw std::invalid_argument("ILQR: desired states must have one entry per joint");
+    }
+  }
+  if (problem.Q.n_rows != 2 * n || problem.Q.n_cols != 2 * n ||
+    problem.Qf.n_rows != 2 * n || problem.Qf.n_cols != 2 * n ||
+    problem.R.n_rows != n || problem.R.n_cols != n)
+  {
+    throw std::invalid_argument("ILQR: Q and Qf must be 2n x 2n and R n x n");
+  }
+  if (!(problem.dt > 0.0)) {
+    throw std::invalid_argument("ILQR: dt must be positive");
+  }
+  if (!taumat0.empty() && taumat0.size() != knots - 1) {
+    throw std::invalid_argument("ILQR: taumat0 must be empty or have N entries");
+  }
+  for (const arma::vec & taulist : taumat0) {
+    if (taulist.n_elem != n) {
+      throw std::invalid_argument("ILQR: taumat0 must have one entry per joint");
+    }
+  }
+}
+}
+
+const ILQRResult ILQR(
+  const ILQRProblem & problem,
+  const std::vector<arma::vec> & taumat0,
+  const ILQROptions & options
+)
+{
+  CheckProblem(problem, taumat0);
+
+  const size_t n = problem.Slist.size();
+  const size_t s = 2 * n;
+  const size_t N = problem.thetamatd.size() - 1;
+  const size_t J = std::max<size_t>(1, options.line_search_steps);
+
+  const size_t hardware = std::max<size_t>(1, std::thread::hardware_concurrency());
+  const size_t threads = std::min(
+    std::max(N, J), options.num_threads == 0 ? hardware : options.num_threads);
+  std::vector<ILQRWorker> workers;
+  workers.reserve(threads);
+  for (size_t w = 0; w < threads; ++w) {
+    workers.emplace_back(problem);
+  }
+
+  Trajectory nominal(n, N);
+  std::vector<Trajectory> candidates(J, Trajectory(n, N));
+  std::vector<arma::mat> A(N, arma::mat(s, s, arma::fill::zeros));
+  std::vector<arma::mat> B(N, arma::mat(s, n, arma::fill::zeros));
+  std::vector<arma::vec> kff(N, arma::vec(n, arma::fill::zeros));
+  std::vector<arma::mat> K(N, arma::mat(n, s, arma::fill::zeros));
+
+  // The initial rollout, from the given torques or gravity compensation
+  for (size_t i = 0; i < n; ++i) {
+    nominal.xs.at(0).at(i) = problem.thetalist.at(i);
+    nominal.xs.at(0).at(n + i) = problem.dthetalist.at(i);
+  }
+  if (taumat0.empty()) {
+    const arma::vec zeros{n, arma::fill::zeros};
+    for (size_t k = 0; k < N; ++k) {
+      workers.front().dynamics.InverseDynamics(
+        problem.thetamatd.at(k), zeros, zeros, problem.g, arma::vec6{arma::fill::zeros},
+        nominal.us.at(k));
+    }
+  } else {
+    nominal.us = taumat0;
+  }
+  Rollout(problem, workers.front(), nominal, kff, K, 0.0, candidates.front());
+  std::swap(nominal.xs, candidates.front().xs);
+  nominal.cost = candidates.front().cost;
+  if (!std::isfinite(nominal.cost)) {
+    throw std::runtime_error("ILQR: the initial rollout diverges");
+  }
+
+  arma::vec Vx{s, arma::fill::zeros};
+  arma::mat Vxx{s, s, arma::fill::zeros};
+  arma::vec Qx{s, arma::fill::zeros};
+  arma::vec Qu{n, arma::fill::zeros};
+  arma::mat Qxx{s, s, arma::fill::zeros};
+  arma::mat Quu{n, n, arma::fill::zeros};
+  arma::mat Qux{n, s, arma::fill::zeros};
+  arma::mat Luu{n, n, arma::fill::zeros};
+  arma::vec column{n, arma::fill::zeros};
+  arma::vec e{s, arma::fill::zeros};
+
+  ILQRResult result;
+  result.iterations = 0;
+  result.converged = false;
+
+  double mu = options.regularization;
+  bool linearized = false;
+
+  while (true) {
+    if (!linearized) {
+      ForEach(
+        workers, N, [&](ILQRWorker & worker, const size_t k) {
+          Linearize(problem, worker, nominal.xs.at(k), nominal.us.at(k), A.at(k), B.at(k));
+        });
+      linearized = true;
+    }
+
+    // Backward pass, raising the regularization until every Quu is positive definite
+    double dV1 = 0.0;
+    double dV2 = 0.0;
+    bool backward = false;
+    while (!backward && mu <= options.max_regularization) {
+      StateError(problem, N, nominal.xs.at(N), e);
+      Vx = problem.Qf * e;
+      Vxx = problem.Qf;
+      dV1 = 0.0;
+      dV2 = 0.0;
+      backward = true;
+
+      for (size_t j = 0; j < N && backward; ++j) {
+        const size_t k = N - 1 - j;
+        const arma::mat & Ak = A.at(k);
+        const arma::mat & Bk = B.at(k);
+
+        StateError(problem, k, nominal.xs.at(k), e);
+        Qx = problem.Q * e + Ak.t() * Vx;
+        Qu = problem.R * nominal.us.at(k) + Bk.t() * Vx;
+        Qxx = problem.Q + Ak.t() * Vxx * Ak;
+        Quu = problem.R + Bk.t() * Vxx * Bk;
+        Qux = Bk.t() * Vxx * Ak;
+
+        Luu = Quu;
+        Luu.diag() += mu;
+        if (!CholeskyDecompose(Luu)) {
+          backward = false;
+          break;
+        }
+
+        arma::vec & kk = kff.at(k);
+        arma::mat & Kk = K.at(k);
+        kk = -Qu;
+        CholeskySolve(Luu, kk);
+        for (size_t c = 0; c < s; ++c) {
+          for (size_t r = 0; r < n; ++r) {
+            column.at(r) = -Qux.at(r, c);
+          }
+          CholeskySolve(Luu, column);
+          for (size_t r = 0; r < n; ++r) {
+            Kk.at(r, c) = column.at(r);
+          }
+        }
+
+        dV1 += arma::dot(kk, Qu);
+        dV2 += 0.5 * arma::dot(kk, Quu * kk);
+
+        Vx = Qx + Kk.t() * Quu * kk + Kk.t() * Qu + Qux.t() * kk;
+        Vxx = Qxx + Kk.t() * Quu * Kk + Kk.t() * Qux + Qux.t() * Kk;
+        Vxx = 0.5 * (Vxx + Vxx.t());
+      }
+
+      if (!backward) {
+        mu = std::max(10.0 * mu, 1e-12);
+      }
+    }
+    if (!backward) {
+      break;
+    }
+
+    // The gains now belong to the nominal trajectory, so stop here once the
+    // cost cannot decrease by more than the tolerance along this step
+    const double expected = -(dV1 + dV2);
+    if (expected < options.tolerance * nominal.cost) {
+      result.converged = true;
+    }
+    if (result.converged || result.iterations >= options.max_iterations) {
+      break;
+    }
+    ++result.iterations;
+
+    // Parallel line search over alpha = 1, 1/2, 1/4, ...
+    ForEach(
+      workers, J, [&](ILQRWorker & worker, const size_t c) {
+        const double alpha = std::pow(0.5, static_cast<double>(c));
+        Rollout(problem, worker, nominal, kff, K, alpha, candidates.at(c));
+      });
+
+    size_t accepted = J;
+    for (size_t c = 0; c < J && accepted == J; ++c) {
+      const double alpha = std::pow(0.5, static_cast<double>(c));
+      const double predicted = -(alpha * dV1 + alpha * alpha * dV2);
+      const double actual = nominal.cost - candidates.at(c).cost;
+      if (actual > 0.0 && actual >= 1e-4 * predicted) {
+        accepted = c;
+      }
+    }
+
+    if (accepted == J) {
+      mu = std::max(10.0 * mu, 1e-12);
+      if (mu > options.max_regularization) {
+        break;
+      }
+      continue;
+    }
+
+    const double decrease = nominal.cost - candidates.at(accepted).cost;
+    std::swap(nominal, candidates.at(accepted));
+    linearized = false;
+    mu = std::max(0.1 * mu, 1e-12);
+    result.converged = decrease < options.tolerance * nominal.cost;
+  }
+
+  result.taumat = nominal.us;
+  result.Kmat = K;
+  result.cost = nominal.cost;
+  result.thetamat.reserve(N + 1);
+  result.dthetamat.reserve(N + 1);
+  for (const arma::vec & x : nominal.xs) {
+    result.thetamat.push_back(x.head(n));
+    result.dthetamat.push_back(x.tail(n));
+  }
+
+  return result;
+}
+
+const arma::vec ILQRTorque(
+  const ILQRResult & result,
+  const size_t i,
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist
+)
+{
+  const arma::vec & taulist = result.taumat.at(i);
+  const arma::mat & K = result.Kmat.at(i);
+  const size_t n = taulist.n_elem;
+  if (thetalist.n_elem != n || dthetalist.n_elem != n) {
+    throw std::invalid_argument("ILQRTorque: joint vectors must have one entry per joint");
+  }
+
+  arma::vec tau = taulist;
+  for (size_t r = 0; r < n; ++r) {
+    for (size_t j = 0; j < n; ++j) {
+      tau.at(r) += K.at(r, j) * (thetalist.at(j) - result.thetamat.at(i).at(j)) +
+        K.at(r, n + j) * (dthetalist.at(j) - result.dthetamat.at(i).at(j));
+    }
+  }
+
+  return tau;
+}
+}
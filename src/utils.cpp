@@ -1,5 +1,18 @@
 #include "modern_robotics/utils.hpp"
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace mr
 {
@@ -8,4 +21,197 @@ const arma::vec Normalize(const arma::vec & vec)
   const arma::vec result = vec / arma::norm(vec);
   return result;
 }
+
+bool Identical(const arma::mat & a, const arma::mat & b)
+{
+  if (a.n_rows != b.n_rows || a.n_cols != b.n_cols) {
+    return false;
+  }
+  for (size_t i = 0; i < a.n_elem; ++i) {
+    if (a.at(i) != b.at(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool CholeskyDecompose(arma::mat & A)
+{
+  const size_t n = A.n_rows;
+
+  for (size_t j = 0; j < n; ++j) {
+    double d = A.at(j, j);
+    for (size_t k = 0; k < j; ++k) {
+      d -= A.at(j, k) * A.at(j, k);
+    }
+    if (!(d > 0.0)) {
+      return false;
+    }
+
+    const double ljj = std::sqrt(d);
+    A.at(j, j) = ljj;
+    for (size_t i = j + 1; i < n; ++i) {
+      double s = A.at(i, j);
+      for (size_t k = 0; k < j; ++k) {
+        s -= A.at(i, k) * A.at(j, k);
+      }
+      A.at(i, j) = s / ljj;
+    }
+  }
+
+  return true;
+}
+
+void CholeskySolve(const arma::mat & L, arma::vec & b)
+{
+  const size_t n = L.n_rows;
+
+  // L y = b
+  for (size_t i = 0; i < n; ++i) {
+    double s = b.at(i);
+    for (size_t k = 0; k < i; ++k) {
+      s -= L.at(i, k) * b.at(k);
+    }
+    b.at(i) = s / L.at(i, i);
+  }
+
+  // L^T x = y
+  for (size_t j = 0; j < n; ++j) {
+    const size_t i = n - 1 - j;
+    double s = b.at(i);
+    for (size_t k = i + 1; k < n; ++k) {
+      s -= L.at(k, i) * b.at(k);
+    }
+    b.at(i) = s / L.at(i, i);
+  }
+}
+
+void ParallelFor(
+  const size_t n,
+  const std::function<void(const size_t)> & f,
+  const size_t num_threads
+)
+{
+  const size_t hardware = std::max<size_t>(1, std::thread::hardware_concurrency());
+  const size_t nthreads = std::min(n, num_threads == 0 ? hardware : num_threads);
+
+  if (nthreads <= 1) {
+    for (size_t i = 0; i < n; ++i) {
+      f(i);
+    }
+    return;
+  }
+
+  const size_t chunk = std::max<size_t>(1, n / (8 * nthreads));
+  std::atomic<size_t> next{0};
+  std::exception_ptr error;
+  std::mutex error_mutex;
+
+  const auto worker = [&]() {
+      for (;;) {
+        const size_t begin = next.fetch_add(chunk);
+        if (begin >= n) {
+          return;
+        }
+
+        const size_t end = std::min(n, begin + chunk);
+        try {
+          for (size_t i = begin; i < end; ++i) {
+            f(i);
+          }
+        } catch (...) {
+          const std::lock_guard<std::mutex> lock(error_mutex);
+          if (!error) {
+            error = std::current_exception();
+          }
+          next.store(n);
+          return;
+        }
+      }
+    };
+
+  std::vector<std::thread> workers;
+  workers.reserve(nthreads - 1);
+  try {
+    for (size_t t = 0; t < nthreads - 1; ++t) {
+      workers.emplace_back(worker);
+    }
+  } catch (...) {
+    next.store(n);
+    for (std::thread & t : workers) {
+      t.join();
+    }
+    throw;
+  }
+  worker();
+
+  for (std::thread & t : workers) {
+    t.join();
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+MappedFile::MappedFile(const std::string & filename)
+{
+  const int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("MappedFile: cannot open " + filename);
+  }
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    ::close(fd);
+    throw std::runtime_error("MappedFile: cannot open " + filename);
+  }
+
+  const size_t bytes = static_cast<size_t>(st.st_size);
+  if (bytes > 0) {
+    void * data = ::mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      ::close(fd);
+      throw std::runtime_error("MappedFile: cannot map " + filename);
+    }
+    data_ = data;
+    bytes_ = bytes;
+  }
+  ::close(fd);
+}
+
+MappedFile::MappedFile(MappedFile && other) noexcept
+: data_(std::exchange(other.data_, nullptr)),
+  bytes_(std::exchange(other.bytes_, 0))
+{
+}
+
+MappedFile & MappedFile::operator=(MappedFile && other) noexcept
+{
+  if (this != &other) {
+    if (data_ != nullptr) {
+      ::munmap(data_, bytes_);
+    }
+    data_ = std::exchange(other.data_, nullptr);
+    bytes_ = std::exchange(other.bytes_, 0);
+  }
+  return *this;
+}
+
+MappedFile::~MappedFile()
+{
+  if (data_ != nullptr) {
+    ::munmap(data_, bytes_);
+  }
+}
+
+const char * MappedFile::data() const
+{
+  return static_cast<const char *>(data_);
+}
+
+size_t MappedFile::size() const
+{
+  return bytes_;
+}
 } /// namespace modern_robotics
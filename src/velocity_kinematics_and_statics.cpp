@@ -1,4 +1,11 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "modern_robotics/utils.hpp"
 #include "modern_robotics/rigid_body_motions.hpp"
+#include "modern_robotics/dynamics_of_open_chains.hpp"
 #include "modern_robotics/velocity_kinematics_and_statics.hpp"
 
 namespace mr
@@ -7,6 +14,22 @@ const arma::mat JacobianBody(
   const std::vector<arma::vec6> & Blist,
   const arma::vec & thetalist
 )
+{
+  return JacobianBody(ClassifyJoints(Blist), thetalist);
+}
+
+const arma::mat JacobianSpace(
+  const std::vector<arma::vec6> & Slist,
+  const arma::vec & thetalist
+)
+{
+  return JacobianSpace(ClassifyJoints(Slist), thetalist);
+}
+
+const arma::mat JacobianBody(
+  const std::vector<Joint> & Blist,
+  const arma::vec & thetalist
+)
 {
   const size_t n = Blist.size();
   arma::mat Jb{6, n, arma::fill::zeros};
@@ -14,24 +37,19 @@ const arma::mat JacobianBody(
 
   for (size_t j = 0; j < n - 1; ++j) {
     const size_t i = n - 2 - j;
-    const arma::vec6 B = Blist.at(i + 1);
-    const double theta = thetalist.at(i + 1);
-
-    const arma::mat44 se3mat = VecTose3(B * -theta);
-    const arma::mat44 Tij = MatrixExp6(se3mat);
+    const arma::mat44 Tij = JointExp6(Blist.at(i + 1), -thetalist.at(i + 1));
 
     T *= Tij;
-    const arma::mat66 AdT = Adjoint(T);
 
-    Jb.col(i) = AdT * Blist.at(i);
+    Jb.col(i) = AdjointMap(T, Blist.at(i).S);
   }
 
-  Jb.col(n - 1) = Blist.at(n - 1);
+  Jb.col(n - 1) = Blist.at(n - 1).S;
   return Jb;
 }
 
 const arma::mat JacobianSpace(
-  const std::vector<arma::vec6> & Slist,
+  const std::vector<Joint> & Slist,
   const arma::vec & thetalist
 )
 {
@@ -40,19 +58,576 @@ const arma::mat JacobianSpace(
   arma::mat44 T{arma::fill::eye};
 
   for (size_t i = 1; i < n; ++i) {
-    const arma::vec6 S = Slist.at(i - 1);
-    const double theta = thetalist.at(i - 1);
-
-    const arma::mat44 se3mat = VecTose3(S * theta);
-    const arma::mat44 Tij = MatrixExp6(se3mat);
+    const arma::mat44 Tij = JointExp6(Slist.at(i - 1), thetalist.at(i - 1));
 
     T *= Tij;
-    const arma::mat66 AdT = Adjoint(T);
 
-    Js.col(i) = AdT * Slist.at(i);
+    Js.col(i) = AdjointMap(T, Slist.at(i).S);
   }
 
-  Js.col(0) = Slist.at(0);
+  Js.col(0) = Slist.at(0).S;
   return Js;
 }
+
+/// \brief Closed-form eigenvalues of a symmetric 3x3 matrix, in ascending order
+static const arma::vec3 SymmetricEigenvalues3(const arma::mat33 & A)
+{
+  const double p1 = A.at(0, 1) * A.at(0, 1) + A.at(0, 2) * A.at(0, 2) + A.at(1, 2) * A.at(1, 2);
+
+  if (p1 == 0.0) {
+    arma::vec3 eig{A.at(0, 0), A.at(1, 1), A.at(2, 2)};
+    std::sort(eig.begin(), eig.end());
+    return eig;
+  }
+
+  const double q = arma::trace(A) / 3.0;
+  const double d0 = A.at(0, 0) - q;
+  const double d1 = A.at(1, 1) - q;
+  const double d2 = A.at(2, 2) - q;
+  const double p = std::sqrt((d0 * d0 + d1 * d1 + d2 * d2 + 2.0 * p1) / 6.0);
+
+  const arma::mat33 I33{arma::fill::eye};
+  const arma::mat33 B = (A - q * I33) / p;
+  const double r = std::clamp(arma::det(B) / 2.0, -1.0, 1.0);
+  const double phi = std::acos(r) / 3.0;
+
+  const double lmax = q + 2.0 * p * std::cos(phi);
+  const double lmin = q + 2.0 * p * std::cos(phi + 2.0 * M_PI / 3.0);
+  const arma::vec3 eig{lmin, 3.0 * q - lmax - lmin, lmax};
+  return eig;
+}
+
+const ManipulabilityMeasures Manipulability(
+  const arma::mat & J,
+  const ManipulabilityPart part
+)
+{
+  arma::vec eig;
+
+  if (part == ManipulabilityPart::Twist) {
+    const arma::mat A = J * J.t();
+    arma::eig_sym(eig, A);
+  } else {
+    const size_t row = part == ManipulabilityPart::Angular ? 0 : 3;
+    const arma::mat Jpart = J.rows(row, row + 2);
+    const arma::mat33 A = Jpart * Jpart.t();
+    eig = SymmetricEigenvalues3(A);
+  }
+
+  // eigenvalues of J J^T are the squared singular values of J
+  const double lmin = std::max(eig.at(0), 0.0);
+  const double lmax = std::max(eig.at(eig.n_elem - 1), 0.0);
+  double det = 1.0;
+  for (const double l : eig) {
+    det *= std::max(l, 0.0);
+  }
+
+  const double condition = lmin > 0.0 ?
+    std::sqrt(lmax / lmin) : std::numeric_limits<double>::infinity();
+  return {std::sqrt(det), condition, std::sqrt(lmin)};
+}
+
+const arma::vec ManipulabilityGradient(const arma::mat & Jb)
+{
+  const size_t n = Jb.n_cols;
+  arma::vec gradient{n, arma::fill::zeros};
+
+  arma::mat66 A;
+  for (size_t r = 0; r < 6; ++r) {
+    for (size_t c = 0; c <= r; ++c) {
+      A.at(r, c) = arma::dot(Jb.row(r), Jb.row(c));
+      A.at(c, r) = A.at(r, c);
+    }
+  }
+
+  double det = 1.0;
+  if (!CholeskyDecompose(A)) {
+    return gradient;
+  }
+  for (size_t i = 0; i < 6; ++i) {
+    det *= A.at(i, i) * A.at(i, i);
+  }
+  const double w = std::sqrt(det);
+
+  // X = (Jb Jb^T)^-1 Jb, one column at a time
+  arma::mat X{6, n, arma::fill::zeros};
+  arma::vec6 x;
+  for (size_t i = 0; i < n; ++i) {
+    x = Jb.col(i);
+    CholeskySolve(A, x);
+    X.col(i) = x;
+  }
+
+  for (size_t i = 0; i < n; ++i) {
+    const arma::vec6 Jbi = Jb.col(i);
+    const arma::vec6 adX = ad(Jbi).t() * X.col(i);
+    for (size_t j = i + 1; j < n; ++j) {
+      gradient.at(j) += w * arma::dot(adX, Jb.col(j));
+    }
+  }
+
+  return gradient;
+}
+
+const arma::vec JointCenteringGradient(
+  const arma::vec & thetalist,
+  const arma::vec & lower,
+  const arma::vec & upper
+)
+{
+  const size_t n = thetalist.n_elem;
+  if (lower.n_elem != n || upper.n_elem != n) {
+    throw std::invalid_argument("JointCenteringGradient: limits must have one entry per joint");
+  }
+
+  arma::vec gradient{n, arma::fill::zeros};
+  for (size_t i = 0; i < n; ++i) {
+    const double range = upper.at(i) - lower.at(i);
+    const double middle = 0.5 * (upper.at(i) + lower.at(i));
+    gradient.at(i) = -(thetalist.at(i) - middle) / (static_cast<double>(n) * range * range);
+  }
+
+  return gradient;
+}
+
+const arma::vec NullSpaceResolvedRate(
+  const arma::mat & J,
+  const arma::vec6 & V,
+  const arma::vec & z,
+  const double damping
+)
+{
+  if (J.n_rows != 6 || z.n_elem != J.n_cols) {
+    throw std::invalid_argument(
+            "NullSpaceResolvedRate: J must be 6xn and z must have one entry per joint");
+  }
+
+  arma::mat66 A;
+  arma::vec dtheta{J.n_cols, arma::fill::zeros};
+  if (!NullSpaceResolvedRate(J, V, z, damping, A, dtheta)) {
+    throw std::runtime_error("NullSpaceResolvedRate: J J^T + damping I is singular");
+  }
+
+  return dtheta;
+}
+
+bool NullSpaceResolvedRate(
+  const arma::mat & J,
+  const arma::vec6 & V,
+  const arma::vec & z,
+  const double damping,
+  arma::mat66 & A,
+  arma::vec & dtheta
+)
+{
+  const size_t n = J.n_cols;
+  for (size_t r = 0; r < 6; ++r) {
+    for (size_t c = 0; c <= r; ++c) {
+      double sum = 0.0;
+      for (size_t k = 0; k < n; ++k) {
+        sum += J.at(r, k) * J.at(c, k);
+      }
+      A.at(r, c) = sum;
+      A.at(c, r) = sum;
+    }
+    A.at(r, r) += damping;
+  }
+  if (!CholeskyDecompose(A)) {
+    return false;
+  }
+
+  NullSpaceResolvedRate(J, V, z, A, dtheta);
+  return true;
+}
+
+void NullSpaceResolvedRate(
+  const arma::mat & J,
+  const arma::vec6 & V,
+  const arma::vec & z,
+  const arma::mat & L,
+  arma::vec & dtheta
+)
+{
+  const size_t n = J.n_cols;
+  if (dtheta.n_elem != n) {
+    dtheta.set_size(n);
+  }
+
+  // dtheta = z + J^T (J J^T + damping I)^-1 (V - J z)
+  arma::vec6 b = V;
+  for (size_t k = 0; k < n; ++k) {
+    for (size_t r = 0; r < 6; ++r) {
+      b.at(r) -= J.at(r, k) * z.at(k);
+    }
+  }
+  CholeskySolve(L, b);
+
+  for (size_t k = 0; k < n; ++k) {
+    double sum = z.at(k);
+    for (size_t r = 0; r < 6; ++r) {
+      sum += J.at(r, k) * b.at(r);
+    }
+    dtheta.at(k) = sum;
+  }
+}
+
+const std::tuple<const arma::mat44, const arma::mat> FKinAndJacobianBody(
+  const arma::mat44 & M,
+  const std::vector<arma::vec6> & Blist,
+  const arma::vec & thetalist
+)
+{
+  return FKinAndJacobianBody(M, ClassifyJoints(Blist), thetalist);
+}
+
+const std::tuple<const arma::mat44, const arma::mat> FKinAndJacobianBody(
+  const arma::mat44 & M,
+  const std::vector<Joint> & Blist,
+  const arma::vec & thetalist
+)
+{
+  arma::mat44 Tsb;
+  arma::mat Jb;
+  FKinAndJacobianBody(M, Blist, thetalist, Tsb, Jb);
+  return {Tsb, Jb};
+}
+
+void FKinAndJacobianBody(
+  const arma::mat44 & M,
+  const std::vector<Joint> & Blist,
+  const arma::vec & thetalist,
+  arma::mat44 & Tsb,
+  arma::mat & Jb
+)
+{
+  const size_t n = Blist.size();
+  if (thetalist.n_elem != n) {
+    throw std::invalid_argument(
+            "FKinAndJacobianBody: thetalist must have one entry per joint");
+  }
+  if (Jb.n_rows != 6 || Jb.n_cols != n) {
+    Jb.set_size(6, n);
+  }
+
+  arma::mat44 T{arma::fill::eye};
+
+  for (size_t j = 0; j < n; ++j) {
+    const size_t i = n - 1 - j;
+    Jb.col(i) = AdjointMap(T, Blist.at(i).S);
+
+    const arma::mat44 Tij = JointExp6(Blist.at(i), -thetalist.at(i));
+    T *= Tij;
+  }
+
+  // T now holds e^{-[Bn]thetan}...e^{-[B1]theta1}, the inverse of the product
+  Tsb = M * TransInv(T);
+}
+
+const std::tuple<const arma::mat44, const arma::mat> FKinAndJacobianSpace(
+  const arma::mat44 & M,
+  const std::vector<arma::vec6> & Slist,
+  const arma::vec & thetalist
+)
+{
+  return FKinAndJacobianSpace(M, ClassifyJoints(Slist), thetalist);
+}
+
+const std::tuple<const arma::mat44, const arma::mat> FKinAndJacobianSpace(
+  const arma::mat44 & M,
+  const std::vector<Joint> & Slist,
+  const arma::vec & thetalist
+)
+{
+  arma::mat44 Tsb;
+  arma::mat Js;
+  FKinAndJacobianSpace(M, Slist, thetalist, Tsb, Js);
+  return {Tsb, Js};
+}
+
+void FKinAndJacobianSpace(
+  const arma::mat44 & M,
+  const std::vector<Joint> & Slist,
+  const arma::vec & thetalist,
+  arma::mat44 & Tsb,
+  arma::mat & Js
+)
+{
+  const size_t n = Slist.size();
+  if (thetalist.n_elem != n) {
+    throw std::invalid_argument(
+            "FKinAndJacobianSpace: thetalist must have one entry per joint");
+  }
+  if (Js.n_rows != 6 || Js.n_cols != n) {
+    Js.set_size(6, n);
+  }
+
+  arma::mat44 T{arma::fill::eye};
+
+  for (size_t i = 0; i < n; ++i) {
+    Js.col(i) = AdjointMap(T, Slist.at(i).S);
+
+    const arma::mat44 Tij = JointExp6(Slist.at(i), thetalist.at(i));
+    T *= Tij;
+  }
+
+  Tsb = T * M;
+}
+
+const arma::vec6 JacobianBodyProduct(
+  const std::vector<arma::vec6> & Blist,
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist
+)
+{
+  return JacobianBodyProduct(ClassifyJoints(Blist), thetalist, dthetalist);
+}
+
+const arma::vec6 JacobianBodyProduct(
+  const std::vector<Joint> & Blist,
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist
+)
+{
+  const size_t n = Blist.size();
+  arma::vec6 Vb{arma::fill::zeros};
+  arma::mat44 T{arma::fill::eye};
+
+  for (size_t j = 0; j < n; ++j) {
+    const size_t i = n - 1 - j;
+    Vb += AdjointMap(T, Blist.at(i).S) * dthetalist.at(i);
+
+    if (i > 0) {
+      const arma::mat44 Tij = JointExp6(Blist.at(i), -thetalist.at(i));
+      T *= Tij;
+    }
+  }
+
+  return Vb;
+}
+
+const arma::vec JacobianBodyTransposeProduct(
+  const std::vector<arma::vec6> & Blist,
+  const arma::vec & thetalist,
+  const arma::vec6 & Fb
+)
+{
+  return JacobianBodyTransposeProduct(ClassifyJoints(Blist), thetalist, Fb);
+}
+
+const arma::vec JacobianBodyTransposeProduct(
+  const std::vector<Joint> & Blist,
+  const arma::vec & thetalist,
+  const arma::vec6 & Fb
+)
+{
+  const size_t n = Blist.size();
+  arma::vec taulist{n, arma::fill::zeros};
+  arma::mat44 T{arma::fill::eye};
+
+  for (size_t j = 0; j < n; ++j) {
+    const size_t i = n - 1 - j;
+    taulist.at(i) = arma::dot(AdjointMap(T, Blist.at(i).S), Fb);
+
+    if (i > 0) {
+      const arma::mat44 Tij = JointExp6(Blist.at(i), -thetalist.at(i));
+      T *= Tij;
+    }
+  }
+
+  return taulist;
+}
+
+const arma::vec6 JacobianSpaceProduct(
+  const std::vector<arma::vec6> & Slist,
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist
+)
+{
+  return JacobianSpaceProduct(ClassifyJoints(Slist), thetalist, dthetalist);
+}
+
+const arma::vec6 JacobianSpaceProduct(
+  const std::vector<Joint> & Slist,
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist
+)
+{
+  const size_t n = Slist.size();
+  arma::vec6 Vs{arma::fill::zeros};
+  arma::mat44 T{arma::fill::eye};
+
+  for (size_t i = 0; i < n; ++i) {
+    Vs += AdjointMap(T, Slist.at(i).S) * dthetalist.at(i);
+
+    if (i + 1 < n) {
+      const arma::mat44 Tij = JointExp6(Slist.at(i), thetalist.at(i));
+      T *= Tij;
+    }
+  }
+
+  return Vs;
+}
+
+const arma::vec JacobianSpaceTransposeProduct(
+  const std::vector<arma::vec6> & Slist,
+  const arma::vec & thetalist,
+  const arma::vec6 & Fs
+)
+{
+  return JacobianSpaceTransposeProduct(ClassifyJoints(Slist), thetalist, Fs);
+}
+
+const arma::vec JacobianSpaceTransposeProduct(
+  const std::vector<Joint> & Slist,
+  const arma::vec & thetalist,
+  const arma::vec6 & Fs
+)
+{
+  const size_t n = Slist.size();
+  arma::vec taulist{n, arma::fill::zeros};
+  arma::mat44 T{arma::fill::eye};
+
+  for (size_t i = 0; i < n; ++i) {
+    taulist.at(i) = arma::dot(AdjointMap(T, Slist.at(i).S), Fs);
+
+    if (i + 1 < n) {
+      const arma::mat44 Tij = JointExp6(Slist.at(i), thetalist.at(i));
+      T *= Tij;
+    }
+  }
+
+  return taulist;
+}
+
+const arma::mat JacobianBodyDot(
+  const std::vector<arma::vec6> & Blist,
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist
+)
+{
+  return JacobianBodyDot(ClassifyJoints(Blist), thetalist, dthetalist);
+}
+
+const arma::mat JacobianBodyDot(
+  const std::vector<Joint> & Blist,
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist
+)
+{
+  const size_t n = Blist.size();
+  const arma::mat Jb = JacobianBody(Blist, thetalist);
+  arma::mat dJb{6, n, arma::fill::zeros};
+  arma::vec6 V{arma::fill::zeros};
+
+  for (size_t j = 0; j < n; ++j) {
+    const size_t i = n - 1 - j;
+    const arma::vec6 Jbi = Jb.col(i);
+
+    dJb.col(i) = ad(Jbi) * V;
+    V += Jbi * dthetalist.at(i);
+  }
+
+  return dJb;
+}
+
+const arma::vec6 JacobianBodyDotProduct(
+  const std::vector<arma::vec6> & Blist,
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist
+)
+{
+  return JacobianBodyDotProduct(ClassifyJoints(Blist), thetalist, dthetalist);
+}
+
+const arma::vec6 JacobianBodyDotProduct(
+  const std::vector<Joint> & Blist,
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist
+)
+{
+  const size_t n = Blist.size();
+  arma::vec6 dJbdtheta{arma::fill::zeros};
+  arma::vec6 V{arma::fill::zeros};
+  arma::mat44 T{arma::fill::eye};
+
+  for (size_t j = 0; j < n; ++j) {
+    const size_t i = n - 1 - j;
+    const arma::vec6 Jbi = AdjointMap(T, Blist.at(i).S);
+
+    dJbdtheta += adMap(Jbi, V) * dthetalist.at(i);
+    V += Jbi * dthetalist.at(i);
+
+    if (i > 0) {
+      const arma::mat44 Tij = JointExp6(Blist.at(i), -thetalist.at(i));
+      T *= Tij;
+    }
+  }
+
+  return dJbdtheta;
+}
+
+const arma::mat JacobianSpaceDot(
+  const std::vector<arma::vec6> & Slist,
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist
+)
+{
+  return JacobianSpaceDot(ClassifyJoints(Slist), thetalist, dthetalist);
+}
+
+const arma::mat JacobianSpaceDot(
+  const std::vector<Joint> & Slist,
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist
+)
+{
+  const size_t n = Slist.size();
+  const arma::mat Js = JacobianSpace(Slist, thetalist);
+  arma::mat dJs{6, n, arma::fill::zeros};
+  arma::vec6 V{arma::fill::zeros};
+
+  for (size_t i = 0; i < n; ++i) {
+    const arma::vec6 Jsi = Js.col(i);
+
+    dJs.col(i) = ad(V) * Jsi;
+    V += Jsi * dthetalist.at(i);
+  }
+
+  return dJs;
+}
+
+const arma::vec6 JacobianSpaceDotProduct(
+  const std::vector<arma::vec6> & Slist,
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist
+)
+{
+  return JacobianSpaceDotProduct(ClassifyJoints(Slist), thetalist, dthetalist);
+}
+
+const arma::vec6 JacobianSpaceDotProduct(
+  const std::vector<Joint> & Slist,
+  const arma::vec & thetalist,
+  const arma::vec & dthetalist
+)
+{
+  const size_t n = Slist.size();
+  arma::vec6 dJsdtheta{arma::fill::zeros};
+  arma::vec6 V{arma::fill::zeros};
+  arma::mat44 T{arma::fill::eye};
+
+  for (size_t i = 0; i < n; ++i) {
+    const arma::vec6 Jsi = AdjointMap(T, Slist.at(i).S);
+
+    dJsdtheta += adMap(V, Jsi) * dthetalist.at(i);
+    V += Jsi * dthetalist.at(i);
+
+    if (i + 1 < n) {
+      const arma::mat44 Tij = JointExp6(Slist.at(i), thetalist.at(i));
+      T *= Tij;
+    }
+  }
+
+  return dJsdtheta;
+}
 }
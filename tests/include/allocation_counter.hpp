@@ -0,0 +1,88 @@
+#ifndef MODERN_ROBOTICS__TESTS__ALLOCATION_COUNTER_HPP___
+#define MODERN_ROBOTICS__TESTS__ALLOCATION_COUNTER_HPP___
+
+/// Interposes the C allocation functions of the test executable that includes
+/// this header, so that tests can check the claims of allocation-free functions.
+/// Armadillo takes the storage of objects over 16 elements from posix_memalign
+/// and every form of operator new ends in malloc or aligned_alloc, so counting
+/// at this level sees both. Include it from one source file per executable only.
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+
+#if !defined(__GLIBC__)
+#error "allocation_counter.hpp interposes the glibc allocator"
+#endif
+
+namespace mr_test
+{
+/// \brief The number of heap allocations so far, on any thread
+inline std::atomic<size_t> & Allocations()
+{
+  static std::atomic<size_t> count{0};
+  return count;
+}
+
+/// \brief Counts the heap allocations made while running f
+template<typename F>
+size_t CountAllocations(F && f)
+{
+  const size_t before = Allocations().load();
+  f();
+  return Allocations().load() - before;
+}
+}
+
+extern "C" {
+void * __libc_malloc(size_t size);
+void * __libc_calloc(size_t count, size_t size);
+void * __libc_realloc(void * p, size_t size);
+void * __libc_memalign(size_t alignment, size_t size);
+
+void * malloc(size_t size)
+{
+  mr_test::Allocations().fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void * calloc(size_t count, size_t size)
+{
+  mr_test::Allocations().fetch_add(1, std::memory_order_relaxed);
+  return __libc_calloc(count, size);
+}
+
+void * realloc(void * p, size_t size)
+{
+  mr_test::Allocations().fetch_add(1, std::memory_order_relaxed);
+  return __libc_realloc(p, size);
+}
+
+void * memalign(size_t alignment, size_t size)
+{
+  mr_test::Allocations().fetch_add(1, std::memory_order_relaxed);
+  return __libc_memalign(alignment, size);
+}
+
+void * aligned_alloc(size_t alignment, size_t size)
+{
+  mr_test::Allocations().fetch_add(1, std::memory_order_relaxed);
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void ** p, size_t alignment, size_t size)
+{
+  if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0) {
+    return EINVAL;
+  }
+  mr_test::Allocations().fetch_add(1, std::memory_order_relaxed);
+  void * memptr = __libc_memalign(alignment, size);
+  if (memptr == nullptr) {
+    return ENOMEM;
+  }
+  *p = memptr;
+  return 0;
+}
+}
+
+#endif /// MODERN_ROBOTICS__TESTS__ALLOCATION_COUNTER_HPP___
@@ -0,0 +1,130 @@
+#ifndef MODERN_ROBOTICS__TESTS__UR5_HPP___
+#define MODERN_ROBOTICS__TESTS__UR5_HPP___
+
+/// UR5 models shared by the dynamics, control and optimization tests.
+
+#include <vector>
+#include <armadillo>
+
+#include "modern_robotics/rigid_body_motions.hpp"
+
+namespace mr_test
+{
+/// \brief The model of an open chain and its initial state
+struct Arm
+{
+  std::vector<arma::mat44> Mlist;
+  std::vector<arma::mat66> Glist;
+  std::vector<arma::vec6> Slist;
+  arma::vec3 g;
+  arma::vec thetalist;
+  arma::vec dthetalist;
+};
+
+/// \brief The first three joints of a UR5, moving from thetalist {0.1, 0.1, 0.1}
+///        at rates {0.1, 0.2, 0.3}
+inline const Arm UR5FirstThreeJoints()
+{
+  const arma::mat44 M01{
+    {1, 0, 0, 0},
+    {0, 1, 0, 0},
+    {0, 0, 1, 0.089159},
+    {0, 0, 0, 1}
+  };
+  const arma::mat44 M12{
+    {0, 0, 1, 0.28},
+    {0, 1, 0, 0.13585},
+    {-1, 0, 0, 0},
+    {0, 0, 0, 1}
+  };
+  const arma::mat44 M23{
+    {1, 0, 0, 0},
+    {0, 1, 0, -0.1197},
+    {0, 0, 1, 0.395},
+    {0, 0, 0, 1}
+  };
+  const arma::mat44 M34{
+    {1, 0, 0, 0},
+    {0, 1, 0, 0},
+    {0, 0, 1, 0.14225},
+    {0, 0, 0, 1}
+  };
+  const arma::mat66 G1 = arma::diagmat(arma::vec6{0.010267, 0.010267, 0.00666, 3.7, 3.7, 3.7});
+  const arma::mat66 G2 = arma::diagmat(
+    arma::vec6{0.22689, 0.22689, 0.0151074, 8.393, 8.393, 8.393}
+  );
+  const arma::mat66 G3 = arma::diagmat(
+    arma::vec6{0.0494433, 0.0494433, 0.004095, 2.275, 2.275, 2.275}
+  );
+  const std::vector<arma::mat44> Mlist{M01, M12, M23, M34};
+  const std::vector<arma::mat66> Glist{G1, G2, G3};
+  const std::vector<arma::vec6> Slist{
+    {1, 0, 1, 0, 1, 0},
+    {0, 1, 0, -0.089, 0, 0},
+    {0, 1, 0, -0.089, 0, 0.425}
+  };
+  const arma::vec3 g{0, 0, -9.8};
+  return {Mlist, Glist, Slist, g, arma::vec{0.1, 0.1, 0.1}, arma::vec{0.1, 0.2, 0.3}};
+}
+
+/// \brief The six joints of a UR5, moving from thetalist
+///        {0.4, -1.1, 1.3, -0.7, 0.6, 0.2}; the last frame of Mlist is the flange
+inline const Arm UR5()
+{
+  const std::vector<arma::mat44> Mlist{
+    {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0.089159}, {0, 0, 0, 1}},
+    {{0, 0, 1, 0.28}, {0, 1, 0, 0.13585}, {-1, 0, 0, 0}, {0, 0, 0, 1}},
+    {{1, 0, 0, 0}, {0, 1, 0, -0.1197}, {0, 0, 1, 0.395}, {0, 0, 0, 1}},
+    {{0, 0, 1, 0}, {0, 1, 0, 0}, {-1, 0, 0, 0.14225}, {0, 0, 0, 1}},
+    {{1, 0, 0, 0}, {0, 1, 0, 0.093}, {0, 0, 1, 0}, {0, 0, 0, 1}},
+    {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0.09465}, {0, 0, 0, 1}},
+    {{1, 0, 0, 0}, {0, 0, 1, 0.0823}, {0, -1, 0, 0}, {0, 0, 0, 1}}
+  };
+  const std::vector<arma::mat66> Glist{
+    arma::diagmat(arma::vec6{0.010267, 0.010267, 0.00666, 3.7, 3.7, 3.7}),
+    arma::diagmat(arma::vec6{0.22689, 0.22689, 0.0151074, 8.393, 8.393, 8.393}),
+    arma::diagmat(arma::vec6{0.0494433, 0.0494433, 0.004095, 2.275, 2.275, 2.275}),
+    arma::diagmat(arma::vec6{0.111172, 0.111172, 0.21942, 1.219, 1.219, 1.219}),
+    arma::diagmat(arma::vec6{0.111172, 0.111172, 0.21942, 1.219, 1.219, 1.219}),
+    arma::diagmat(arma::vec6{0.0171364, 0.0171364, 0.033822, 0.1879, 0.1879, 0.1879})
+  };
+  const std::vector<arma::vec6> Slist{
+    {0, 0, 1, 0, 0, 0},
+    {0, 1, 0, -0.089159, 0, 0},
+    {0, 1, 0, -0.089159, 0, 0.425},
+    {0, 1, 0, -0.089159, 0, 0.81725},
+    {0, 0, -1, -0.10915, 0.81725, 0},
+    {0, 1, 0, 0.005491, 0, 0.81725}
+  };
+  const arma::vec3 g{0, 0, -9.81};
+  return {Mlist, Glist, Slist, g, arma::vec{0.4, -1.1, 1.3, -0.7, 0.6, 0.2},
+    arma::vec{0.2, -0.1, 0.3, 0.1, -0.2, 0.4}};
+}
+
+/// \brief The end-effector configuration of an arm at its home position
+inline const arma::mat44 HomeConfiguration(const Arm & arm)
+{
+  arma::mat44 M{arma::fill::eye};
+  for (const arma::mat44 & Mi : arm.Mlist) {
+    M *= Mi;
+  }
+  return M;
+}
+
+/// \brief The UR5 with a seventh revolute joint about the x-axis of its flange,
+///        moving from thetalist {0.4, -1.1, 1.3, -0.7, 0.6, 0.2, 0.3}
+inline const Arm UR5WithFlangeJoint()
+{
+  Arm arm = UR5();
+  const arma::mat44 flange = HomeConfiguration(arm);
+
+  arm.Mlist.push_back(arma::mat44{arma::fill::eye});
+  arm.Glist.push_back(arma::diagmat(arma::vec6{0.002, 0.002, 0.002, 0.5, 0.5, 0.5}));
+  arm.Slist.push_back(mr::Adjoint(flange) * arma::vec6{1, 0, 0, 0, 0, 0});
+  arm.thetalist = arma::vec{0.4, -1.1, 1.3, -0.7, 0.6, 0.2, 0.3};
+  arm.dthetalist = arma::vec{0.2, -0.1, 0.3, 0.1, -0.2, 0.4, 0.1};
+  return arm;
+}
+} // namespace mr_test
+
+#endif /// MODERN_ROBOTICS__TESTS__UR5_HPP___
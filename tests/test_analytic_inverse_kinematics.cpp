@@ -0,0 +1,162 @@
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include <catch2/catch_all.hpp>
+
+#include "modern_robotics/rigid_body_motions.hpp"
+#include "modern_robotics/forward_kinematics.hpp"
+#include "modern_robotics/analytic_inverse_kinematics.hpp"
+
+constexpr double TOLERANCE = 1e-6;
+
+namespace
+{
+bool ContainsSolution(const std::vector<arma::vec> & solutions, const arma::vec & thetalist)
+{
+  for (const arma::vec & solution : solutions) {
+    const arma::vec diff = solution - thetalist;
+    bool same = true;
+    for (size_t i = 0; i < diff.size(); ++i) {
+      same = same && std::fabs(std::remainder(diff.at(i), 2.0 * arma::datum::pi)) < TOLERANCE;
+    }
+    if (same) {
+      return true;
+    }
+  }
+  return false;
+}
+}
+
+TEST_CASE("Test analytic inverse kinematics of an offset wrist", "[AnalyticIK]")
+{
+  const arma::mat44 M{
+    {-1, 0, 0, 0.817},
+    {0, 0, 1, 0.191},
+    {0, 1, 0, -0.006},
+    {0, 0, 0, 1}
+  };
+  const std::vector<arma::vec6> Slist{
+    {0, 0, 1, 0, 0, 0},
+    {0, 1, 0, -0.089, 0, 0},
+    {0, 1, 0, -0.089, 0, 0.425},
+    {0, 1, 0, -0.089, 0, 0.817},
+    {0, 0, -1, -0.109, 0.817, 0},
+    {0, 1, 0, 0.006, 0, 0.817}
+  };
+  const arma::vec thetalist{0.4, -1.1, 1.3, -0.7, 0.6, 0.2};
+  const arma::mat44 T = mr::FKinSpace(M, Slist, thetalist);
+
+  const mr::AnalyticIK solver(Slist, M);
+  REQUIRE(solver.geometry() == mr::ArmGeometry::OffsetWrist);
+
+  const std::vector<arma::vec> solutions = solver.SolveAll(T);
+  REQUIRE(solutions.size() == 8);
+  REQUIRE(ContainsSolution(solutions, thetalist));
+  for (const arma::vec & solution : solutions) {
+    const arma::mat44 Tsol = mr::FKinSpace(M, Slist, solution);
+    REQUIRE(arma::approx_equal(Tsol, T, "absdiff", TOLERANCE));
+  }
+
+  const arma::vec thetalist0 = thetalist + 0.1;
+  const mr::IKResult result = solver.Solve(T, thetalist0);
+  REQUIRE(result.success);
+  REQUIRE(result.iterations == 0);
+  REQUIRE(arma::approx_equal(result.thetalist, thetalist, "absdiff", TOLERANCE));
+
+  // The limit status is reported like the damped least-squares solvers do
+  mr::IKOptions options;
+  options.lower = thetalist - 0.5;
+  options.upper = thetalist + 0.5;
+  options.upper.at(0) = thetalist.at(0);
+  const mr::IKResult limited = solver.Solve(T, thetalist0, options);
+  REQUIRE(limited.success);
+  REQUIRE(limited.iterations == 0);
+  REQUIRE(limited.limits.at(0) == mr::JointLimitStatus::AtUpper);
+  for (size_t i = 1; i < limited.limits.size(); ++i) {
+    REQUIRE(limited.limits.at(i) == mr::JointLimitStatus::Free);
+  }
+  options.upper.reset();
+  REQUIRE_THROWS_AS(solver.Solve(T, thetalist0, options), std::invalid_argument);
+
+  // The same arm described by its body screw axes
+  std::vector<arma::vec6> Blist;
+  const arma::mat66 AdMinv = mr::Adjoint(mr::TransInv(M));
+  for (const arma::vec6 & S : Slist) {
+    Blist.push_back(AdMinv * S);
+  }
+  const mr::AnalyticIK body_solver(Blist, M, mr::IKFrame::Body);
+  REQUIRE(body_solver.geometry() == mr::ArmGeometry::OffsetWrist);
+  REQUIRE(body_solver.SolveAll(T).size() == 8);
+}
+
+TEST_CASE("Test analytic inverse kinematics of a spherical wrist", "[AnalyticIK]")
+{
+  const arma::mat44 M{
+    {1, 0, 0, 0.9},
+    {0, 1, 0, 0},
+    {0, 0, 1, 0.5},
+    {0, 0, 0, 1}
+  };
+  const std::vector<arma::vec6> Slist{
+    {0, 0, 1, 0, 0, 0},
+    {0, 1, 0, -0.5, 0, 0},
+    {0, 1, 0, -0.5, 0, 0.4},
+    {1, 0, 0, 0, 0.5, 0},
+    {0, 1, 0, -0.5, 0, 0.8},
+    {1, 0, 0, 0, 0.5, 0}
+  };
+  const arma::vec thetalist{0.3, -0.6, 0.9, 0.5, -0.7, 1.2};
+  const arma::mat44 T = mr::FKinSpace(M, Slist, thetalist);
+
+  const mr::AnalyticIK solver(Slist, M);
+  REQUIRE(solver.geometry() == mr::ArmGeometry::SphericalWrist);
+
+  const std::vector<arma::vec> solutions = solver.SolveAll(T);
+  REQUIRE(solutions.size() == 8);
+  REQUIRE(ContainsSolution(solutions, thetalist));
+  for (const arma::vec & solution : solutions) {
+    const arma::mat44 Tsol = mr::FKinSpace(M, Slist, solution);
+    REQUIRE(arma::approx_equal(Tsol, T, "absdiff", TOLERANCE));
+  }
+
+  // Out of reach
+  arma::mat44 Tfar = T;
+  Tfar.at(0, 3) = 5.0;
+  REQUIRE(solver.SolveAll(Tfar).empty());
+}
+
+TEST_CASE("Test analytic inverse kinematics fallback", "[AnalyticIK]")
+{
+  const arma::mat44 M{
+    {1, 0, 0, 0.9},
+    {0, 1, 0, 0.1},
+    {0, 0, 1, 0.5},
+    {0, 0, 0, 1}
+  };
+  const std::vector<arma::vec6> Slist{
+    {0, 0, 1, 0, 0, 0},
+    {0, 1, 0, -0.5, 0, 0},
+    {1, 0, 0, 0, 0.5, -0.1},
+    {0, 0, 1, 0.1, -0.4, 0},
+    {0, 1, 0, -0.5, 0, 0.8},
+    {1, 0, 0, 0, 0.45, -0.1}
+  };
+  const arma::vec thetalist{0.3, -0.6, 0.9, 0.5, -0.7, 1.2};
+  const arma::mat44 T = mr::FKinSpace(M, Slist, thetalist);
+
+  const mr::AnalyticIK solver(Slist, M);
+  REQUIRE(solver.geometry() == mr::ArmGeometry::General);
+  REQUIRE(solver.SolveAll(T).empty());
+
+  mr::IKOptions options;
+  options.max_iterations = 50;
+  options.eomg = TOLERANCE;
+  options.ev = TOLERANCE;
+  const mr::IKResult result = solver.Solve(T, thetalist + 0.05, options);
+  REQUIRE(result.success);
+  REQUIRE(result.iterations > 0);
+  REQUIRE(arma::approx_equal(result.thetalist, thetalist, "absdiff", 1e-4));
+
+  REQUIRE_THROWS_AS(solver.Solve(T, arma::vec{0.1, 0.2}, options), std::invalid_argument);
+}
@@ -0,0 +1,188 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <catch2/catch_all.hpp>
+
+#include "modern_robotics/robot_control.hpp"
+#include "modern_robotics/control_loop.hpp"
+#include "allocation_counter.hpp"
+#include "ur5.hpp"
+
+/// Whether every entry of v equals x
+static bool Uniform(const arma::vec & v, const double x)
+{
+  return v.min() == x && v.max() == x;
+}
+
+TEST_CASE("Test triple buffer", "[TripleBuffer]")
+{
+  mr::TripleBuffer<arma::vec> buffer(arma::vec(4, arma::fill::zeros));
+  REQUIRE_FALSE(buffer.Update());
+  REQUIRE(Uniform(buffer.front(), 0.0));
+
+  // Only the latest of several writes is delivered
+  buffer.Write(arma::vec(4, arma::fill::ones));
+  buffer.back().fill(2.0);
+  buffer.Publish();
+  REQUIRE(buffer.Update());
+  REQUIRE(Uniform(buffer.front(), 2.0));
+  REQUIRE_FALSE(buffer.Update());
+
+  // A reader racing a writer always sees whole values, in order
+  const size_t count = 100000;
+  std::thread writer(
+    [&]() {
+      arma::vec value(4, arma::fill::zeros);
+      for (size_t k = 3; k <= count; ++k) {
+        value.fill(static_cast<double>(k));
+        buffer.Write(value);
+      }
+    });
+  double last = 2.0;
+  bool consistent = true;
+  while (last < count) {
+    if (buffer.Update()) {
+      const double first = buffer.front().at(0);
+      consistent = consistent && Uniform(buffer.front(), first) && first > last;
+      last = first;
+    }
+  }
+  writer.join();
+  REQUIRE(consistent);
+}
+
+TEST_CASE("Test sequence lock", "[SeqLock]")
+{
+  mr::SeqLock lock(8);
+  arma::vec data;
+  REQUIRE(lock.TryRead(data));
+  REQUIRE(data.n_elem == 8);
+  REQUIRE(Uniform(data, 0.0));
+  REQUIRE_THROWS_AS(lock.Write(arma::vec(3, arma::fill::zeros)), std::invalid_argument);
+
+  const size_t count = 100000;
+  std::atomic<bool> done{false};
+  std::thread writer(
+    [&]() {
+      arma::vec value(8, arma::fill::zeros);
+      for (size_t k = 1; k <= count; ++k) {
+        value.fill(static_cast<double>(k));
+        lock.Write(value);
+      }
+      done.store(true);
+    });
+  double last = 0.0;
+  bool consistent = true;
+  while (!done.load()) {
+    lock.Read(data);
+    consistent = consistent && Uniform(data, data.at(0)) && data.at(0) >= last;
+    last = data.at(0);
+  }
+  writer.join();
+  REQUIRE(consistent);
+  lock.Read(data);
+  REQUIRE(data.at(7) == count);
+}
+
+TEST_CASE("Test control loop", "[ControlLoop]")
+{
+  const mr_test::Arm arm = mr_test::UR5FirstThreeJoints();
+  const std::vector<arma::mat44> & Mlist = arm.Mlist;
+  const std::vector<arma::mat66> & Glist = arm.Glist;
+  const std::vector<arma::vec6> & Slist = arm.Slist;
+  const arma::vec3 g{0, 0, -9.8};
+  const arma::vec zeros(3, arma::fill::zeros);
+
+  const double period = 1e-3;
+  mr::SimulatedRobot robot(zeros, zeros, g, Mlist, Glist, Slist, period, 4);
+  mr::ComputedTorqueController controller(g, Mlist, Glist, Slist, 400.0, 0.0, 40.0);
+  const mr::ControlLaw law =
+    [&](const mr::ControlLoopState & state, const mr::ControlSetpoint & setpoint,
+      arma::vec & taulist) {
+      taulist = controller.Step(
+        state.thetalist, state.dthetalist, setpoint.thetalistd, setpoint.dthetalistd,
+        setpoint.ddthetalistd);
+    };
+
+  mr::ControlLoopOptions options;
+  options.period = period;
+  mr::ControlLoop loop(robot, law, mr::ControlSetpoint{arma::vec{0.2, -0.1, 0.3}, zeros, zeros},
+    options);
+  REQUIRE_THROWS_AS(
+    loop.SetSetpoint(mr::ControlSetpoint{arma::vec{0.0, 0.0}, zeros, zeros}),
+    std::invalid_argument);
+
+  // Waits until the loop has run the given cycle and returns the latest
+  // state; every cycle advances the plant by one period
+  mr::ControlLoopState state;
+  const auto wait = [&](const uint64_t cycle) {
+      do {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        loop.State(state);
+      } while (state.cycle < cycle);
+    };
+
+  loop.Start();
+  REQUIRE(loop.running());
+  REQUIRE(loop.scheduled());
+  REQUIRE_THROWS_AS(loop.Start(), std::runtime_error);
+  wait(500);
+  REQUIRE(arma::approx_equal(state.thetalist, arma::vec{0.2, -0.1, 0.3}, "absdiff", 1e-3));
+
+  // A planner thread moves the setpoint while the loop runs
+  std::thread planner(
+    [&]() {
+      loop.SetSetpoint(mr::ControlSetpoint{arma::vec{-0.3, 0.2, 0.5}, zeros, zeros});
+    });
+  planner.join();
+  wait(state.cycle + 500);
+  REQUIRE(arma::approx_equal(state.thetalist, arma::vec{-0.3, 0.2, 0.5}, "absdiff", 1e-3));
+  loop.Stop();
+  REQUIRE_FALSE(loop.running());
+
+  // The statistics cover every cycle
+  const mr::ControlLoopStats stats = loop.stats();
+  loop.State(state);
+  REQUIRE(stats.cycles == state.cycle + 1);
+  REQUIRE(stats.cycles > 1000);
+  REQUIRE(stats.period_mean >= 0.9 * period);
+  REQUIRE(stats.period_min <= stats.period_mean);
+  REQUIRE(stats.period_max >= stats.period_mean);
+  REQUIRE(stats.period_stddev >= 0.0);
+  REQUIRE(stats.latency_max >= stats.latency_mean);
+  REQUIRE(stats.latency_mean >= 0.0);
+  REQUIRE(stats.compute_max >= stats.compute_mean);
+  REQUIRE(stats.compute_mean > 0.0);
+
+  // Errors in the control law end the loop and are rethrown by Stop
+  const mr::ControlLaw failing =
+    [](const mr::ControlLoopState & state, const mr::ControlSetpoint &, arma::vec &) {
+      if (state.cycle == 10) {
+        throw std::runtime_error("failure");
+      }
+    };
+  mr::ControlLoop broken(robot, failing, mr::ControlSetpoint{zeros, zeros, zeros}, options);
+  broken.Start();
+  while (broken.running()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  // A loop that ended can be restarted without Stop
+  REQUIRE_NOTHROW(broken.Start());
+  while (broken.running()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  REQUIRE_THROWS_AS(broken.Stop(), std::runtime_error);
+
+  // The plant steps in preallocated storage, as the loop thread requires
+  arma::vec thetalist(3);
+  arma::vec dthetalist(3);
+  robot.Read(thetalist, dthetalist);
+  const size_t allocations = mr_test::CountAllocations([&]() {
+        for (size_t k = 0; k < 10; ++k) {
+          robot.Write(zeros);
+          robot.Read(thetalist, dthetalist);
+        }
+      });
+  REQUIRE(allocations == 0);
+}
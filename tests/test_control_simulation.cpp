@@ -0,0 +1,297 @@
+#include <cmath>
+#include <catch2/catch_all.hpp>
+
+#include "modern_robotics/dynamics_of_open_chains.hpp"
+#include "modern_robotics/robot_control.hpp"
+#include "modern_robotics/control_simulation.hpp"
+#include "allocation_counter.hpp"
+#include "ur5.hpp"
+
+constexpr double TOLERANCE = 1e-6;
+
+TEST_CASE("Test closed-loop simulation against SimulateControl", "[SimulateClosedLoop]")
+{
+  const mr_test::Arm arm = mr_test::UR5FirstThreeJoints();
+
+  // The model of the controller is 20% off
+  const std::vector<arma::mat66> Gtildelist{
+    0.8 * arm.Glist.at(0), 0.8 * arm.Glist.at(1), 0.8 * arm.Glist.at(2)};
+  const arma::vec3 gtilde{0, 0, -9.5};
+  const double dt = 0.01;
+  const size_t intRes = 8;
+  const size_t N = 100;
+  std::vector<arma::vec> thetamatd;
+  std::vector<arma::vec> dthetamatd;
+  std::vector<arma::vec> ddthetamatd;
+  for (size_t i = 0; i < N; ++i) {
+    const double t = dt * static_cast<double>(i);
+    thetamatd.push_back(arma::vec{std::sin(t), std::cos(t), 0.5 * t});
+    dthetamatd.push_back(arma::vec{std::cos(t), -std::sin(t), 0.5});
+    ddthetamatd.push_back(arma::vec{-std::sin(t), -std::cos(t), 0.0});
+  }
+  const std::vector<arma::vec6> Ftipmat(N, arma::vec6{arma::fill::zeros});
+
+  const auto [taumat, thetamat] = mr::SimulateControl(
+    arm.thetalist, arm.dthetalist, arm.g, Ftipmat, arm.Mlist, arm.Glist, arm.Slist, thetamatd,
+    dthetamatd, ddthetamatd, gtilde, arm.Mlist, Gtildelist, 20, 10, 18, dt, intRes);
+  REQUIRE(taumat.size() == N);
+  REQUIRE(thetamat.size() == N);
+  REQUIRE_FALSE(arma::approx_equal(thetamat.at(1), thetamat.at(0), "absdiff", 1e-3));
+
+  // Computed torque control with the integral of the errors after each step
+  arma::vec eint(3, arma::fill::zeros);
+  std::vector<arma::vec> taus;
+  std::vector<arma::vec> thetas;
+  const mr::ControllerFunction controller =
+    [&](const size_t i, const double, const arma::vec & theta, const arma::vec & dtheta,
+      arma::vec & taulist) {
+      if (i > 0) {
+        thetas.push_back(theta);
+        eint += thetamatd.at(i - 1) - theta;
+      }
+      taulist = mr::ComputeTorque(
+        theta, dtheta, eint, gtilde, arm.Mlist, Gtildelist, arm.Slist, thetamatd.at(i),
+        dthetamatd.at(i), ddthetamatd.at(i), 20, 10, 18);
+    };
+  const mr::SimulationObserver observer =
+    [&](const size_t, const double, const arma::vec &, const arma::vec &,
+      const arma::vec & taulist) {
+      taus.push_back(taulist);
+    };
+  mr::SimulationOptions options;
+  options.controller_dt = dt;
+  options.plant_dt = dt / intRes;
+  const mr::SimulationResult result = mr::SimulateClosedLoop(
+    arm.thetalist, arm.dthetalist, arm.g, arm.Mlist, arm.Glist, arm.Slist, controller, N, options,
+    observer);
+  thetas.push_back(result.thetalist);
+
+  REQUIRE(result.plant_steps == N * intRes);
+  REQUIRE(taus.size() == N);
+  for (size_t i = 0; i < N; ++i) {
+    REQUIRE(arma::approx_equal(taus.at(i), taumat.at(i), "absdiff", TOLERANCE));
+    REQUIRE(arma::approx_equal(thetas.at(i), thetamat.at(i), "absdiff", TOLERANCE));
+  }
+}
+
+TEST_CASE("Test SimulateControl with an exact model", "[SimulateControl]")
+{
+  const mr_test::Arm arm = mr_test::UR5FirstThreeJoints();
+  const double dt = 0.01;
+  const size_t intRes = 4;
+  const size_t N = 50;
+  const double kp = 20.0;
+  const double ki = 10.0;
+  const double kd = 18.0;
+  std::vector<arma::vec> thetamatd;
+  std::vector<arma::vec> dthetamatd;
+  std::vector<arma::vec> ddthetamatd;
+  for (size_t i = 0; i < N; ++i) {
+    const double t = dt * static_cast<double>(i);
+    thetamatd.push_back(arma::vec{std::sin(t), std::cos(t), 0.5 * t});
+    dthetamatd.push_back(arma::vec{std::cos(t), -std::sin(t), 0.5});
+    ddthetamatd.push_back(arma::vec{-std::sin(t), -std::cos(t), 0.0});
+  }
+  const std::vector<arma::vec6> Ftipmat(N, arma::vec6{0, 0, 0, 0, 0, 1});
+
+  // The controller and the plant share one cache when the models are equal
+  const auto [taumat, thetamat] = mr::SimulateControl(
+    arm.thetalist, arm.dthetalist, arm.g, Ftipmat, arm.Mlist, arm.Glist, arm.Slist, thetamatd,
+    dthetamatd, ddthetamatd, arm.g, arm.Mlist, arm.Glist, kp, ki, kd, dt, intRes);
+  REQUIRE(taumat.size() == N);
+  REQUIRE(thetamat.size() == N);
+
+  // ...and give the same result as ComputeTorque and ForwardDynamics
+  arma::vec theta = arm.thetalist;
+  arma::vec dtheta = arm.dthetalist;
+  arma::vec eint(3, arma::fill::zeros);
+  const double h = dt / static_cast<double>(intRes);
+  for (size_t i = 0; i < N; ++i) {
+    const arma::vec taulist = mr::ComputeTorque(
+      theta, dtheta, eint, arm.g, arm.Mlist, arm.Glist, arm.Slist, thetamatd.at(i),
+      dthetamatd.at(i), ddthetamatd.at(i), kp, ki, kd);
+    for (size_t j = 0; j < intRes; ++j) {
+      const arma::vec ddtheta = mr::ForwardDynamics(
+        theta, dtheta, taulist, arm.g, Ftipmat.at(i), arm.Mlist, arm.Glist, arm.Slist);
+      theta += h * dtheta;
+      dtheta += h * ddtheta;
+    }
+    eint += thetamatd.at(i) - theta;
+
+    REQUIRE(arma::approx_equal(taumat.at(i), taulist, "absdiff", 1e-9));
+    REQUIRE(arma::approx_equal(thetamat.at(i), theta, "absdiff", 1e-9));
+  }
+}
+
+TEST_CASE("Test closed-loop simulation with a shared dynamics cache", "[SimulateClosedLoop]")
+{
+  const mr_test::Arm arm = mr_test::UR5FirstThreeJoints();
+  const size_t N = 50;
+
+  // Computed torque control of the actual model towards a fixed setpoint
+  mr::DynamicsCache cache(arm.Mlist, arm.Glist, arm.Slist);
+  const arma::vec thetalistd{0.5, -0.3, 0.2};
+  arma::vec u(3, arma::fill::zeros);
+  const mr::ControllerFunction controller =
+    [&](const size_t, const double, const arma::vec & theta, const arma::vec & dtheta,
+      arma::vec & taulist) {
+      u = 100.0 * (thetalistd - theta) - 20.0 * dtheta;
+      cache.InverseDynamics(theta, dtheta, u, arm.g, taulist);
+    };
+  mr::SimulationOptions options;
+  options.controller_dt = 0.01;
+  options.plant_dt = 1e-3;
+  const mr::SimulationResult separate = mr::SimulateClosedLoop(
+    arm.thetalist, arm.dthetalist, arm.g, arm.Mlist, arm.Glist, arm.Slist, controller, N, options);
+  REQUIRE(cache.hits() == 0);
+
+  // The first plant step after each sample reuses the mass matrix and bias
+  cache.Invalidate();
+  options.cache = &cache;
+  const mr::SimulationResult shared = mr::SimulateClosedLoop(
+    arm.thetalist, arm.dthetalist, arm.g, arm.Mlist, arm.Glist, arm.Slist, controller, N, options);
+  REQUIRE(cache.hits() == 2 * N);
+  REQUIRE(arma::approx_equal(shared.thetalist, separate.thetalist, "absdiff", 1e-12));
+  REQUIRE(arma::approx_equal(shared.dthetalist, separate.dthetalist, "absdiff", 1e-12));
+
+  // Only the setup allocates, however many steps are simulated
+  const auto simulate = [&](const size_t steps) {
+      return mr_test::CountAllocations([&]() {
+            mr::SimulateClosedLoop(
+              arm.thetalist, arm.dthetalist, arm.g, arm.Mlist, arm.Glist, arm.Slist, controller,
+              steps, options);
+          });
+    };
+  REQUIRE(simulate(10 * N) == simulate(N));
+
+  mr::DynamicsCache other(
+    {arm.Mlist.at(0), arm.Mlist.at(1)}, {arm.Glist.at(0)}, {arm.Slist.at(0)});
+  options.cache = &other;
+  REQUIRE_THROWS_AS(
+    mr::SimulateClosedLoop(
+      arm.thetalist, arm.dthetalist, arm.g, arm.Mlist, arm.Glist, arm.Slist, controller, N,
+      options),
+    std::invalid_argument);
+}
+
+TEST_CASE("Test closed-loop simulation rates", "[SimulateClosedLoop]")
+{
+  const mr_test::Arm arm = mr_test::UR5FirstThreeJoints();
+  size_t calls = 0;
+  double last = -1.0;
+  bool uniform = true;
+  const mr::ControllerFunction controller =
+    [&](const size_t i, const double t, const arma::vec &, const arma::vec &,
+      arma::vec & taulist) {
+      uniform = uniform && std::abs(t - 3e-3 * static_cast<double>(i)) < 1e-4 && t > last;
+      last = t;
+      ++calls;
+      taulist.zeros();
+    };
+  mr::SimulationOptions options;
+  options.controller_dt = 3e-3;
+  options.plant_dt = 1e-3;
+  const mr::SimulationResult result = mr::SimulateClosedLoop(
+    arm.thetalist, arm.dthetalist, arm.g, arm.Mlist, arm.Glist, arm.Slist, controller, 50, options);
+  REQUIRE(calls == 50);
+  REQUIRE(uniform);
+  REQUIRE(result.plant_steps == 150);
+
+  // A non-integer ratio samples at the first plant step after each period
+  options.controller_dt = 2.5e-3;
+  calls = 0;
+  size_t samples = 0;
+  const mr::SimulationObserver observer =
+    [&](const size_t i, const double t, const arma::vec &, const arma::vec &,
+      const arma::vec &) {
+      samples += std::abs(t - 1e-3 * std::ceil(2.5 * static_cast<double>(i) - 1e-9)) < 1e-12;
+    };
+  mr::SimulateClosedLoop(
+    arm.thetalist, arm.dthetalist, arm.g, arm.Mlist, arm.Glist, arm.Slist,
+    [&](const size_t, const double, const arma::vec &, const arma::vec &, arma::vec & taulist) {
+      ++calls;
+      taulist.zeros();
+    },
+    40, options, observer);
+  REQUIRE(calls == 40);
+  REQUIRE(samples == 40);
+}
+
+TEST_CASE("Test closed-loop simulation integrators", "[SimulateClosedLoop]")
+{
+  const mr_test::Arm arm = mr_test::UR5FirstThreeJoints();
+
+  // The free motion under gravity, against a fine RK4 reference
+  const mr::ControllerFunction idle =
+    [](const size_t, const double, const arma::vec &, const arma::vec &, arma::vec & taulist) {
+      taulist.zeros();
+    };
+  mr::SimulationOptions options;
+  options.controller_dt = 0.01;
+  options.integrator = mr::Integrator::RK4;
+  options.plant_dt = 1e-4;
+  const arma::vec reference = mr::SimulateClosedLoop(
+    arm.thetalist, arm.dthetalist, arm.g, arm.Mlist, arm.Glist, arm.Slist, idle, 50,
+    options).thetalist;
+
+  const auto error = [&](const mr::Integrator integrator, const double h) {
+      options.integrator = integrator;
+      options.plant_dt = h;
+      return arma::norm(
+        mr::SimulateClosedLoop(
+          arm.thetalist, arm.dthetalist, arm.g, arm.Mlist, arm.Glist, arm.Slist, idle, 50,
+          options).thetalist -
+        reference);
+    };
+  const double euler = error(mr::Integrator::Euler, 2e-3);
+  REQUIRE(error(mr::Integrator::Euler, 1e-3) < 0.6 * euler);
+  const double semi = error(mr::Integrator::SemiImplicitEuler, 2e-3);
+  REQUIRE(error(mr::Integrator::SemiImplicitEuler, 1e-3) < 0.6 * semi);
+  const double rk4 = error(mr::Integrator::RK4, 2e-3);
+  REQUIRE(rk4 < 1e-3 * euler);
+  REQUIRE(error(mr::Integrator::RK4, 1e-3) < 0.1 * rk4);
+}
+
+TEST_CASE("Test closed-loop simulation actuator delay", "[SimulateClosedLoop]")
+{
+  // A single prismatic joint along z with no gravity: a unit force from
+  // t = d on moves the 2 kg link by (t - d)^2 / 4
+  const std::vector<arma::mat44> Mslider{
+    arma::mat44{arma::fill::eye}, arma::mat44{arma::fill::eye}};
+  const std::vector<arma::mat66> Gslider{
+    arma::diagmat(arma::vec6{1.0, 1.0, 1.0, 2.0, 2.0, 2.0})};
+  const std::vector<arma::vec6> Sslider{{0, 0, 0, 0, 0, 1}};
+  const arma::vec3 g0{0, 0, 0};
+  const arma::vec zero(1, arma::fill::zeros);
+  const mr::ControllerFunction push =
+    [](const size_t, const double, const arma::vec &, const arma::vec &, arma::vec & taulist) {
+      taulist.fill(1.0);
+    };
+
+  mr::SimulationOptions options;
+  options.controller_dt = 1e-3;
+  options.plant_dt = 5e-4;
+  options.integrator = mr::Integrator::RK4;
+  for (const double delay : {0.0, 0.02, 0.0507}) {
+    options.actuator_delay = delay;
+    const mr::SimulationResult result = mr::SimulateClosedLoop(
+      zero, zero, g0, Mslider, Gslider, Sslider, push, 200, options);
+    const double onset = 5e-4 * std::ceil(delay / 5e-4 - 1e-9);
+    REQUIRE_THAT(
+      result.thetalist.at(0),
+      Catch::Matchers::WithinAbs(std::pow(0.2 - onset, 2) / 4.0, 1e-12));
+    REQUIRE_THAT(result.dthetalist.at(0), Catch::Matchers::WithinAbs((0.2 - onset) / 2.0, 1e-12));
+  }
+
+  // Before the first command arrives the initial torque is held
+  options.actuator_delay = 0.1;
+  options.initial_torque = arma::vec{-1.0};
+  const mr::SimulationResult result = mr::SimulateClosedLoop(
+    zero, zero, g0, Mslider, Gslider, Sslider, push, 200, options);
+  REQUIRE_THAT(result.dthetalist.at(0), Catch::Matchers::WithinAbs(0.0, 1e-12));
+
+  options.actuator_delay = -1.0;
+  REQUIRE_THROWS_AS(
+    mr::SimulateClosedLoop(zero, zero, g0, Mslider, Gslider, Sslider, push, 1, options),
+    std::invalid_argument);
+}
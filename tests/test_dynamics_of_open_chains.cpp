@@ -1,8 +1,11 @@
 #include <iostream>
 #include <iomanip>
+#include <stdexcept>
 #include <catch2/catch_all.hpp>
 
 #include "modern_robotics/dynamics_of_open_chains.hpp"
+#include "allocation_counter.hpp"
+#include "ur5.hpp"
 
 constexpr double TOLERANCE = 1e-6;
 
@@ -49,6 +52,9 @@ TEST_CASE("Test adV", "[ad]")
   REQUIRE_THAT(adV.at(5, 3), Catch::Matchers::WithinAbs(-2, TOLERANCE));
   REQUIRE_THAT(adV.at(5, 4), Catch::Matchers::WithinAbs(1, TOLERANCE));
   REQUIRE_THAT(adV.at(5, 5), Catch::Matchers::WithinAbs(0, TOLERANCE));
+
+  const arma::vec6 W{-2, 0.5, 1, 3, -1, 0.25};
+  REQUIRE(arma::approx_equal(mr::adMap(V, W), adV * W, "absdiff", TOLERANCE));
 }
 
 TEST_CASE("Test inverse dynamics", "[InverseDynamics]")
@@ -116,6 +122,277 @@ TEST_CASE("Test inverse dynamics", "[InverseDynamics]")
   REQUIRE_THAT(taulist.at(2), Catch::Matchers::WithinAbs(-3.23057314, TOLERANCE));
 }
 
+TEST_CASE("Test inverse dynamics workspace", "[DynamicsWorkspace]")
+{
+  const arma::vec thetalist{0.1, 0.1, 0.1};
+  const arma::vec dthetalist{0.1, 0.2, 0.3};
+  const arma::vec ddthetalist{2, 1.5, 1};
+  const arma::vec3 g{0, 0, -9.8};
+  const arma::vec6 Ftip{1, 1, 1, 1, 1, 1};
+
+  const mr_test::Arm arm = mr_test::UR5FirstThreeJoints();
+  const std::vector<arma::mat44> & Mlist = arm.Mlist;
+  const std::vector<arma::mat66> & Glist = arm.Glist;
+  const std::vector<arma::vec6> & Slist = arm.Slist;
+
+  mr::DynamicsWorkspace workspace(Mlist, Glist, Slist);
+  REQUIRE(workspace.size() == 3);
+
+  arma::vec taulist;
+  workspace.InverseDynamics(thetalist, dthetalist, ddthetalist, g, Ftip, taulist);
+
+  REQUIRE(taulist.size() == 3);
+  REQUIRE_THAT(taulist.at(0), Catch::Matchers::WithinAbs(74.69616155, TOLERANCE));
+  REQUIRE_THAT(taulist.at(1), Catch::Matchers::WithinAbs(-33.06766016, TOLERANCE));
+  REQUIRE_THAT(taulist.at(2), Catch::Matchers::WithinAbs(-3.23057314, TOLERANCE));
+
+  // Repeated calls reuse the storage and match the reference implementation
+  const arma::vec thetalist2{-0.7, 1.2, 0.4};
+  const arma::vec dthetalist2{0.5, -0.3, 0.9};
+  workspace.InverseDynamics(thetalist2, dthetalist2, ddthetalist, g, Ftip, taulist);
+  const arma::vec expected = mr::InverseDynamics(
+    thetalist2, dthetalist2, ddthetalist, g, Ftip, Mlist, Glist, Slist);
+  for (size_t i = 0; i < 3; ++i) {
+    REQUIRE_THAT(taulist.at(i), Catch::Matchers::WithinAbs(expected.at(i), 1e-9));
+  }
+
+  // The composite rigid body mass matrix and the Cholesky forward dynamics
+  arma::mat M;
+  workspace.MassMatrix(thetalist2, M);
+  const arma::mat Mexpected = mr::MassMatrix(thetalist2, Mlist, Glist, Slist);
+  for (size_t i = 0; i < 3; ++i) {
+    for (size_t j = 0; j < 3; ++j) {
+      REQUIRE_THAT(M.at(i, j), Catch::Matchers::WithinAbs(Mexpected.at(i, j), 1e-9));
+    }
+  }
+
+  const arma::vec taulist2{0.5, 0.6, 0.7};
+  arma::vec ddtheta;
+  workspace.ForwardDynamics(thetalist2, dthetalist2, taulist2, g, Ftip, ddtheta);
+  const arma::vec ddexpected = mr::ForwardDynamics(
+    thetalist2, dthetalist2, taulist2, g, Ftip, Mlist, Glist, Slist);
+  for (size_t i = 0; i < 3; ++i) {
+    REQUIRE_THAT(ddtheta.at(i), Catch::Matchers::WithinAbs(ddexpected.at(i), 1e-9));
+  }
+
+  // The derivatives match finite differences of ForwardDynamics
+  arma::mat Dtheta;
+  arma::mat Ddtheta;
+  arma::mat Dtau;
+  workspace.ForwardDynamicsDerivatives(
+    thetalist2, dthetalist2, taulist2, g, Ftip, ddtheta, Dtheta, Ddtheta, Dtau);
+  REQUIRE(arma::approx_equal(ddtheta, ddexpected, "absdiff", 1e-9));
+  REQUIRE(arma::approx_equal(
+      Dtau, arma::inv(mr::MassMatrix(thetalist2, Mlist, Glist, Slist)), "absdiff", 1e-9));
+  const double h = 1e-6;
+  for (size_t j = 0; j < 3; ++j) {
+    arma::vec thetaplus = thetalist2;
+    arma::vec thetaminus = thetalist2;
+    thetaplus.at(j) += h;
+    thetaminus.at(j) -= h;
+    const arma::vec dtheta = (
+      mr::ForwardDynamics(thetaplus, dthetalist2, taulist2, g, Ftip, Mlist, Glist, Slist) -
+      mr::ForwardDynamics(thetaminus, dthetalist2, taulist2, g, Ftip, Mlist, Glist, Slist)) /
+      (2.0 * h);
+
+    arma::vec dthetaplus = dthetalist2;
+    arma::vec dthetaminus = dthetalist2;
+    dthetaplus.at(j) += h;
+    dthetaminus.at(j) -= h;
+    const arma::vec ddthetaj = (
+      mr::ForwardDynamics(thetalist2, dthetaplus, taulist2, g, Ftip, Mlist, Glist, Slist) -
+      mr::ForwardDynamics(thetalist2, dthetaminus, taulist2, g, Ftip, Mlist, Glist, Slist)) /
+      (2.0 * h);
+
+    for (size_t i = 0; i < 3; ++i) {
+      REQUIRE_THAT(Dtheta.at(i, j), Catch::Matchers::WithinAbs(dtheta.at(i), 1e-5));
+      REQUIRE_THAT(Ddtheta.at(i, j), Catch::Matchers::WithinAbs(ddthetaj.at(i), 1e-5));
+    }
+  }
+
+  // Once the outputs are sized, none of the recursions touch the heap
+  const size_t allocations = mr_test::CountAllocations([&]() {
+        workspace.InverseDynamics(thetalist, dthetalist, ddthetalist, g, Ftip, taulist);
+        workspace.MassMatrix(thetalist, M);
+        workspace.ForwardDynamics(thetalist, dthetalist, taulist2, g, Ftip, ddtheta);
+        workspace.ForwardDynamicsDerivatives(
+          thetalist, dthetalist, taulist2, g, Ftip, ddtheta, Dtheta, Ddtheta, Dtau);
+      });
+  REQUIRE(allocations == 0);
+
+  // The counter sees the storage Armadillo takes for objects over 16 elements
+  REQUIRE(mr_test::CountAllocations([]() {arma::mat Jb(6, 7, arma::fill::zeros);}) > 0);
+
+  REQUIRE_THROWS_AS(
+    mr::DynamicsWorkspace(Mlist, Glist, {Slist.at(0), Slist.at(1)}), std::invalid_argument);
+}
+
+TEST_CASE("Test dynamics cache", "[DynamicsCache]")
+{
+  const arma::vec thetalist{0.1, 0.1, 0.1};
+  const arma::vec dthetalist{0.1, 0.2, 0.3};
+  const arma::vec ddthetalist{2, 1.5, 1};
+  const arma::vec taulist{0.5, 0.6, 0.7};
+  const arma::vec3 g{0, 0, -9.8};
+  const arma::vec6 Ftip{1, 1, 1, 1, 1, 1};
+  const arma::vec6 zero{arma::fill::zeros};
+
+  const mr_test::Arm arm = mr_test::UR5FirstThreeJoints();
+  const std::vector<arma::mat44> & Mlist = arm.Mlist;
+  const std::vector<arma::mat66> & Glist = arm.Glist;
+  const std::vector<arma::vec6> & Slist = arm.Slist;
+
+  mr::DynamicsCache cache(Mlist, Glist, Slist);
+  REQUIRE(cache.size() == 3);
+
+  // The controller computes the mass matrix and the bias forces...
+  arma::vec tau;
+  cache.InverseDynamics(thetalist, dthetalist, ddthetalist, g, tau);
+  REQUIRE(arma::approx_equal(
+      tau, mr::InverseDynamics(thetalist, dthetalist, ddthetalist, g, zero, Mlist, Glist, Slist),
+      "absdiff", 1e-9));
+  REQUIRE(cache.hits() == 0);
+  REQUIRE(cache.misses() == 2);
+
+  // ...which the plant reuses at the same state, with or without a tip force
+  arma::vec ddtheta;
+  cache.ForwardDynamics(thetalist, dthetalist, taulist, g, zero, ddtheta);
+  REQUIRE(arma::approx_equal(
+      ddtheta, mr::ForwardDynamics(thetalist, dthetalist, taulist, g, zero, Mlist, Glist, Slist),
+      "absdiff", 1e-9));
+  REQUIRE(cache.hits() == 2);
+  REQUIRE(cache.misses() == 3);
+  cache.ForwardDynamics(thetalist, dthetalist, taulist, g, Ftip, ddtheta);
+  REQUIRE(arma::approx_equal(
+      ddtheta, mr::ForwardDynamics(thetalist, dthetalist, taulist, g, Ftip, Mlist, Glist, Slist),
+      "absdiff", 1e-9));
+  REQUIRE(cache.hits() == 4);
+
+  // A new velocity only recomputes the bias, even when changed in place
+  arma::vec dtheta = dthetalist;
+  cache.Bias(thetalist, dtheta, g);
+  dtheta.at(1) = -0.4;
+  cache.ForwardDynamics(thetalist, dtheta, taulist, g, Ftip, ddtheta);
+  REQUIRE(arma::approx_equal(
+      ddtheta, mr::ForwardDynamics(thetalist, dtheta, taulist, g, Ftip, Mlist, Glist, Slist),
+      "absdiff", 1e-9));
+  REQUIRE(cache.hits() == 6);
+  REQUIRE(cache.misses() == 4);
+
+  const arma::vec thetalist2{-0.7, 1.2, 0.4};
+  REQUIRE(arma::approx_equal(
+      cache.MassMatrix(thetalist2), mr::MassMatrix(thetalist2, Mlist, Glist, Slist), "absdiff",
+      1e-9));
+  REQUIRE(arma::approx_equal(
+      cache.Bias(thetalist2, dthetalist, g),
+      mr::InverseDynamics(
+        thetalist2, dthetalist, arma::vec(3, arma::fill::zeros), g, zero, Mlist, Glist, Slist),
+      "absdiff", 1e-9));
+  REQUIRE(cache.misses() == 6);
+
+  // Invalidation drops every term
+  cache.Invalidate();
+  cache.MassMatrix(thetalist2);
+  cache.Bias(thetalist2, dthetalist, g);
+  REQUIRE(cache.misses() == 8);
+  REQUIRE(cache.hits() == 6);
+
+  // Neither the misses nor the hits of a warmed-up cache allocate
+  const size_t allocations = mr_test::CountAllocations([&]() {
+        cache.InverseDynamics(thetalist, dthetalist, ddthetalist, g, tau);
+        cache.ForwardDynamics(thetalist, dthetalist, taulist, g, Ftip, ddtheta);
+        cache.InverseDynamics(thetalist2, dthetalist, ddthetalist, g, tau);
+        cache.ForwardDynamics(thetalist2, dthetalist, taulist, g, zero, ddtheta);
+      });
+  REQUIRE(allocations == 0);
+
+  REQUIRE_THROWS_AS(
+    mr::DynamicsCache(Mlist, Glist, {Slist.at(0), Slist.at(1)}), std::invalid_argument);
+}
+
+TEST_CASE("Test actuator model", "[ActuatorModel]")
+{
+  const arma::vec thetalist{0.1, 0.1, 0.1};
+  const arma::vec dthetalist{0.1, -0.2, 0.0};
+  const arma::vec ddthetalist{2, 1.5, 1};
+  const arma::vec taulist{0.5, 0.6, 0.7};
+  const arma::vec3 g{0, 0, -9.8};
+  const arma::vec6 Ftip{1, 1, 1, 1, 1, 1};
+
+  const mr_test::Arm arm = mr_test::UR5FirstThreeJoints();
+  const std::vector<arma::mat44> & Mlist = arm.Mlist;
+  const std::vector<arma::mat66> & Glist = arm.Glist;
+  const std::vector<arma::vec6> & Slist = arm.Slist;
+
+  mr::ActuatorModel actuators;
+  actuators.gear_ratio = {100, 50, 50};
+  actuators.rotor_inertia = {1e-5, 2e-5, 4e-5};
+  actuators.coulomb = {1.0, 0.5, 0.2};
+  actuators.viscous = {2.0, 1.0, 0.5};
+  actuators.static_friction = {1.5, 0.5, 0.3};
+  actuators.stribeck_velocity = {0.1, 0.0, 0.05};
+
+  // G^2 I_rotor and the Stribeck curve, which vanishes at rest
+  const arma::vec armature = mr::ApparentRotorInertias(actuators, 3);
+  REQUIRE_THAT(armature.at(0), Catch::Matchers::WithinAbs(0.1, 1e-12));
+  REQUIRE_THAT(armature.at(1), Catch::Matchers::WithinAbs(0.05, 1e-12));
+  REQUIRE_THAT(armature.at(2), Catch::Matchers::WithinAbs(0.1, 1e-12));
+  const arma::vec friction = mr::FrictionForces(dthetalist, actuators);
+  REQUIRE_THAT(friction.at(0), Catch::Matchers::WithinAbs(1.0 + 0.5 * std::exp(-1.0) + 0.2, 1e-12));
+  REQUIRE_THAT(friction.at(1), Catch::Matchers::WithinAbs(-0.5 - 0.2, 1e-12));
+  REQUIRE_THAT(friction.at(2), Catch::Matchers::WithinAbs(0.0, 1e-12));
+  actuators.smoothing = 0.01;
+  REQUIRE_THAT(
+    mr::FrictionForces(dthetalist, actuators).at(1),
+    Catch::Matchers::WithinAbs(-0.5 * std::tanh(20.0) - 0.2, 1e-12));
+
+  // The actuated dynamics add to the rigid-body ones and invert each other
+  const arma::vec6 zero{arma::fill::zeros};
+  const arma::mat M = mr::MassMatrix(thetalist, Mlist, Glist, Slist, actuators);
+  REQUIRE(arma::approx_equal(
+      M, mr::MassMatrix(thetalist, Mlist, Glist, Slist) + arma::diagmat(armature), "absdiff",
+      1e-12));
+  const arma::vec tau = mr::InverseDynamics(
+    thetalist, dthetalist, ddthetalist, g, Ftip, Mlist, Glist, Slist, actuators);
+  REQUIRE(arma::approx_equal(
+      tau,
+      mr::InverseDynamics(thetalist, dthetalist, ddthetalist, g, Ftip, Mlist, Glist, Slist) +
+      armature % ddthetalist + mr::FrictionForces(dthetalist, actuators), "absdiff", 1e-12));
+  const arma::vec ddtheta = mr::ForwardDynamics(
+    thetalist, dthetalist, tau, g, Ftip, Mlist, Glist, Slist, actuators);
+  REQUIRE(arma::approx_equal(ddtheta, ddthetalist, "absdiff", 1e-9));
+
+  // The workspace and the cache evaluate the same model
+  mr::DynamicsWorkspace workspace(Mlist, Glist, Slist);
+  workspace.SetActuators(actuators);
+  arma::vec out;
+  workspace.InverseDynamics(thetalist, dthetalist, ddthetalist, g, Ftip, out);
+  REQUIRE(arma::approx_equal(out, tau, "absdiff", 1e-9));
+  arma::mat Mout;
+  workspace.MassMatrix(thetalist, Mout);
+  REQUIRE(arma::approx_equal(Mout, M, "absdiff", 1e-9));
+  workspace.ForwardDynamics(thetalist, dthetalist, taulist, g, Ftip, out);
+  const arma::vec expected = mr::ForwardDynamics(
+    thetalist, dthetalist, taulist, g, Ftip, Mlist, Glist, Slist, actuators);
+  REQUIRE(arma::approx_equal(out, expected, "absdiff", 1e-9));
+
+  mr::DynamicsCache cache(Mlist, Glist, Slist);
+  cache.SetActuators(actuators);
+  cache.InverseDynamics(thetalist, dthetalist, ddthetalist, g, out);
+  REQUIRE(arma::approx_equal(
+      out, mr::InverseDynamics(
+        thetalist, dthetalist, ddthetalist, g, zero, Mlist, Glist, Slist, actuators),
+      "absdiff", 1e-9));
+  cache.ForwardDynamics(thetalist, dthetalist, taulist, g, Ftip, out);
+  REQUIRE(arma::approx_equal(out, expected, "absdiff", 1e-9));
+
+  actuators.coulomb = arma::vec{1.0, 0.5};
+  REQUIRE_THROWS_AS(workspace.SetActuators(actuators), std::invalid_argument);
+  actuators.coulomb.reset();
+  actuators.smoothing = -1.0;
+  REQUIRE_THROWS_AS(mr::FrictionForces(dthetalist, actuators), std::invalid_argument);
+}
+
 TEST_CASE("Test constructing mass matrix", "[MassMatrix]")
 {
   const arma::vec thetalist{0.1, 0.1, 0.1};
@@ -1,5 +1,6 @@
 #include <catch2/catch_all.hpp>
 
+#include "modern_robotics/rigid_body_motions.hpp"
 #include "modern_robotics/forward_kinematics.hpp"
 
 constexpr double TOLERANCE = 1e-6;
@@ -75,3 +76,68 @@ TEST_CASE("Test forward kinematics on space", "[FKinSpace]")
   REQUIRE_THAT(T.at(3, 2), Catch::Matchers::WithinAbs(0, TOLERANCE));
   REQUIRE_THAT(T.at(3, 3), Catch::Matchers::WithinAbs(1, TOLERANCE));
 }
+
+TEST_CASE("Test joint classification", "[ClassifyJoint]")
+{
+  const mr::Joint revolute = mr::ClassifyJoint({0, 0, -1, -6, 0, -0.1});
+  const mr::Joint skewed = mr::ClassifyJoint({0.6, 0.8, 0, 1, 2, 3});
+  const mr::Joint prismatic = mr::ClassifyJoint({0, 0, 0, 0, 1, 0});
+  const mr::Joint general = mr::ClassifyJoint({1, 0, 1, 0, 1, 0});
+
+  REQUIRE(revolute.type == mr::JointType::Revolute);
+  REQUIRE(revolute.axis == 2);
+  REQUIRE(skewed.type == mr::JointType::Revolute);
+  REQUIRE(skewed.axis == -1);
+  REQUIRE(prismatic.type == mr::JointType::Prismatic);
+  REQUIRE(general.type == mr::JointType::General);
+}
+
+TEST_CASE("Test joint exponential", "[JointExp6]")
+{
+  const std::vector<arma::vec6> Slist{
+    {0, 0, -1, -6, 0, -0.1},
+    {1, 0, 0, 0, 2, 0.5},
+    {0, -1, 0, 0.3, 0, 0.2},
+    {0.6, 0.8, 0, 1, 2, 3},
+    {0, 0, 0, 0.2, 0.3, 0.4},
+    {1, 0, 1, 0, 1, 0}
+  };
+  const double theta = 0.7;
+
+  for (const arma::vec6 & S : Slist) {
+    const arma::mat44 T = mr::JointExp6(mr::ClassifyJoint(S), theta);
+    const arma::mat44 Texp = mr::MatrixExp6(mr::VecTose3(S * theta));
+
+    for (size_t i = 0; i < 4; ++i) {
+      for (size_t j = 0; j < 4; ++j) {
+        REQUIRE_THAT(T.at(i, j), Catch::Matchers::WithinAbs(Texp.at(i, j), TOLERANCE));
+      }
+    }
+  }
+}
+
+TEST_CASE("Test forward kinematics with classified joints", "[FKinSpace]")
+{
+  const arma::mat44 M{
+    {-1, 0, 0, 0},
+    {0, 1, 0, 6},
+    {0, 0, -1, 2},
+    {0, 0, 0, 1}
+  };
+  const std::vector<mr::Joint> Slist = mr::ClassifyJoints(
+    {
+      {0, 0, 1, 4, 0, 0},
+      {0, 0, 0, 0, 1, 0},
+      {0, 0, -1, -6, 0, -0.1}
+    });
+  const arma::vec thetalist{M_PI_2, 3, M_PI};
+
+  const arma::mat44 T = mr::FKinSpace(M, Slist, thetalist);
+
+  REQUIRE_THAT(T.at(0, 1), Catch::Matchers::WithinAbs(1, TOLERANCE));
+  REQUIRE_THAT(T.at(0, 3), Catch::Matchers::WithinAbs(-5, TOLERANCE));
+  REQUIRE_THAT(T.at(1, 0), Catch::Matchers::WithinAbs(1, TOLERANCE));
+  REQUIRE_THAT(T.at(1, 3), Catch::Matchers::WithinAbs(4, TOLERANCE));
+  REQUIRE_THAT(T.at(2, 2), Catch::Matchers::WithinAbs(-1, TOLERANCE));
+  REQUIRE_THAT(T.at(2, 3), Catch::Matchers::WithinAbs(1.68584073, TOLERANCE));
+}
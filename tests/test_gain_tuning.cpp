@@ -0,0 +1,150 @@
+#include <cmath>
+#include <catch2/catch_all.hpp>
+
+#include "modern_robotics/dynamics_of_open_chains.hpp"
+#include "modern_robotics/robot_control.hpp"
+#include "modern_robotics/gain_tuning.hpp"
+#include "ur5.hpp"
+
+constexpr double TOLERANCE = 1e-6;
+
+namespace
+{
+const mr::GainTuningProblem UR5Problem()
+{
+  const mr_test::Arm arm = mr_test::UR5FirstThreeJoints();
+
+  mr::GainTuningProblem problem;
+  problem.thetalist = arm.thetalist;
+  problem.dthetalist = arm.dthetalist;
+  problem.g = arm.g;
+  problem.Mlist = arm.Mlist;
+  problem.Glist = arm.Glist;
+  problem.Slist = arm.Slist;
+  problem.gtilde = arma::vec3{0.8, 0.2, -8.8};
+  problem.Mtildelist = problem.Mlist;
+  problem.Gtildelist = {1.1 * arm.Glist.at(0), 0.9 * arm.Glist.at(1), 1.2 * arm.Glist.at(2)};
+  problem.dt = 0.01;
+  problem.intRes = 4;
+
+  const size_t N = 100;
+  for (size_t i = 0; i < N; ++i) {
+    const double t = problem.dt * static_cast<double>(i);
+    problem.thetamatd.push_back(arma::vec{std::sin(t), 0.5 * std::sin(t), -std::sin(t)});
+    problem.dthetamatd.push_back(arma::vec{std::cos(t), 0.5 * std::cos(t), -std::cos(t)});
+    problem.ddthetamatd.push_back(arma::vec{-std::sin(t), -0.5 * std::sin(t), std::sin(t)});
+    problem.Ftipmat.push_back(arma::vec6{1, 1, 1, 1, 1, 1});
+  }
+
+  return problem;
+}
+}
+
+TEST_CASE("Test gain grid", "[GainGrid]")
+{
+  const std::vector<mr::ControlGains> grid = mr::GainGrid(3, {1, 2}, {0.1}, {3, 4, 5});
+
+  REQUIRE(grid.size() == 6);
+  REQUIRE(grid.at(0).kp.n_elem == 3);
+  REQUIRE(grid.at(1).kp.at(2) == 2.0);
+  REQUIRE(grid.at(1).kd.at(0) == 3.0);
+  REQUIRE(grid.at(2).kp.at(0) == 1.0);
+  REQUIRE(grid.at(2).kd.at(1) == 4.0);
+  REQUIRE(grid.at(5).ki.at(2) == 0.1);
+}
+
+TEST_CASE("Test gain sweep", "[GainSweep]")
+{
+  const mr::GainTuningProblem problem = UR5Problem();
+  const std::vector<mr::ControlGains> grid =
+    mr::GainGrid(3, {5, 20, 80}, {0, 1}, {2, 8, 30});
+
+  const mr::GainTuningResult result = mr::GainSweep(problem, grid, 4);
+  REQUIRE(result.candidates.size() == grid.size());
+
+  // The scores match the loop of SimulateControl with the same gains
+  const mr::GainScore & score = result.candidates.at(7);
+  arma::vec thetalist = problem.thetalist;
+  arma::vec dthetalist = problem.dthetalist;
+  arma::vec eint{3, arma::fill::zeros};
+  double error2 = 0.0;
+  double effort2 = 0.0;
+  for (size_t i = 0; i < problem.thetamatd.size(); ++i) {
+    const arma::vec taulist = mr::ComputeTorque(
+      thetalist, dthetalist, eint, problem.gtilde, problem.Mtildelist, problem.Gtildelist,
+      problem.Slist, problem.thetamatd.at(i), problem.dthetamatd.at(i), problem.ddthetamatd.at(i),
+      score.gains.kp.at(0), score.gains.ki.at(0), score.gains.kd.at(0));
+    for (size_t j = 0; j < problem.intRes; ++j) {
+      const arma::vec ddthetalist = mr::ForwardDynamics(
+        thetalist, dthetalist, taulist, problem.g, problem.Ftipmat.at(i), problem.Mlist,
+        problem.Glist, problem.Slist);
+      thetalist += (problem.dt / problem.intRes) * dthetalist;
+      dthetalist += (problem.dt / problem.intRes) * ddthetalist;
+    }
+    const arma::vec e = problem.thetamatd.at(i) - thetalist;
+    eint += e;
+    error2 += arma::dot(e, e);
+    effort2 += arma::dot(taulist, taulist);
+  }
+  const double samples = 3.0 * problem.thetamatd.size();
+  REQUIRE_THAT(
+    score.tracking_error, Catch::Matchers::WithinAbs(std::sqrt(error2 / samples), TOLERANCE));
+  REQUIRE_THAT(score.effort, Catch::Matchers::WithinAbs(std::sqrt(effort2 / samples), TOLERANCE));
+
+  // The thread count does not change the scores
+  const mr::GainTuningResult serial = mr::GainSweep(problem, grid, 1);
+  for (size_t k = 0; k < grid.size(); ++k) {
+    REQUIRE(serial.candidates.at(k).tracking_error == result.candidates.at(k).tracking_error);
+    REQUIRE(serial.candidates.at(k).effort == result.candidates.at(k).effort);
+  }
+
+  // No candidate beats a Pareto candidate in both scores
+  REQUIRE_FALSE(result.pareto.empty());
+  for (const size_t p : result.pareto) {
+    for (const mr::GainScore & score : result.candidates) {
+      REQUIRE_FALSE(
+        (score.tracking_error < result.candidates.at(p).tracking_error &&
+        score.effort < result.candidates.at(p).effort));
+    }
+  }
+
+  mr::GainTuningProblem inconsistent = problem;
+  inconsistent.Ftipmat.pop_back();
+  REQUIRE_THROWS_AS(mr::GainSweep(inconsistent, grid), std::invalid_argument);
+  inconsistent = problem;
+  inconsistent.Gtildelist.pop_back();
+  REQUIRE_THROWS_AS(mr::GainSweep(inconsistent, grid), std::invalid_argument);
+  inconsistent = problem;
+  inconsistent.Mtildelist.pop_back();
+  REQUIRE_THROWS_AS(mr::GainSweep(inconsistent, grid), std::invalid_argument);
+  inconsistent = problem;
+  inconsistent.ddthetamatd.at(3) = arma::vec{0.0, 0.0};
+  REQUIRE_THROWS_AS(mr::GainSweep(inconsistent, grid), std::invalid_argument);
+}
+
+TEST_CASE("Test gain search", "[GainSearch]")
+{
+  const mr::GainTuningProblem problem = UR5Problem();
+
+  mr::GainSearchOptions options;
+  options.initial = mr::GainGrid(3, {2}, {0.1}, {1}).front();
+  options.population = 8;
+  options.generations = 8;
+  options.random_seed = 7;
+
+  const mr::GainTuningResult initial = mr::GainSweep(problem, {options.initial}, 1);
+  const double initial_fitness = initial.candidates.front().tracking_error +
+    options.effort_weight * initial.candidates.front().effort;
+
+  const mr::GainTuningResult result = mr::GainSearch(problem, options);
+  REQUIRE(result.candidates.size() == 64);
+
+  double best = std::numeric_limits<double>::infinity();
+  for (const mr::GainScore & score : result.candidates) {
+    best = std::min(best, score.tracking_error + options.effort_weight * score.effort);
+  }
+  REQUIRE(best < initial_fitness);
+
+  options.initial.kp.at(0) = 0.0;
+  REQUIRE_THROWS_AS(mr::GainSearch(problem, options), std::invalid_argument);
+}
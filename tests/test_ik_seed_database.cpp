@@ -0,0 +1,156 @@
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <catch2/catch_all.hpp>
+
+#include "modern_robotics/rigid_body_motions.hpp"
+#include "modern_robotics/forward_kinematics.hpp"
+#include "modern_robotics/ik_seed_database.hpp"
+
+constexpr double TOLERANCE = 1e-9;
+
+namespace
+{
+const arma::mat44 M{
+  {-1, 0, 0, 0.817},
+  {0, 0, 1, 0.191},
+  {0, 1, 0, -0.006},
+  {0, 0, 0, 1}
+};
+const std::vector<arma::vec6> Slist{
+  {0, 0, 1, 0, 0, 0},
+  {0, 1, 0, -0.089, 0, 0},
+  {0, 1, 0, -0.089, 0, 0.425},
+  {0, 1, 0, -0.089, 0, 0.817},
+  {0, 0, -1, -0.109, 0.817, 0},
+  {0, 1, 0, 0.006, 0, 0.817}
+};
+
+double PoseDistance(const arma::mat44 & T1, const arma::mat44 & T2, const double weight)
+{
+  const arma::vec3 dp = T1.submat(0, 3, 2, 3) - T2.submat(0, 3, 2, 3);
+  const arma::mat33 R = T1.submat(0, 0, 2, 2).t() * T2.submat(0, 0, 2, 2);
+  const double angle = arma::norm(mr::so3ToVec(mr::MatrixLog3(R)));
+  return std::sqrt(arma::dot(dp, dp) + weight * weight * angle * angle);
+}
+
+arma::vec RecordJoints(const mr::IKSeedDatabase & database, const size_t k)
+{
+  const size_t stride = 7 + database.num_joints;
+  arma::vec thetalist{database.num_joints, arma::fill::zeros};
+  for (size_t i = 0; i < database.num_joints; ++i) {
+    thetalist.at(i) = database.records.at(k * stride + 7 + i);
+  }
+  return thetalist;
+}
+}
+
+TEST_CASE("Test nearest inverse kinematics seed", "[NearestIKSeed]")
+{
+  mr::IKSeedDatabaseOptions options;
+  options.lower = arma::vec(6, arma::fill::ones) * -arma::datum::pi;
+  options.upper = arma::vec(6, arma::fill::ones) * arma::datum::pi;
+  options.num_samples = 500;
+  options.random_seed = 7;
+
+  const mr::IKSeedDatabase database =
+    mr::BuildIKSeedDatabase(Slist, M, mr::IKFrame::Space, options);
+
+  REQUIRE(database.num_joints == 6);
+  REQUIRE(database.records.size() == 500 * (7 + 6));
+
+  // The seed matches a brute-force search over every record
+  const std::vector<arma::vec> queries{
+    {0.4, -1.1, 1.3, -0.7, 0.6, 0.2},
+    {-2.0, 0.3, -0.5, 1.9, -1.2, 2.5},
+    {1.0, -0.4, 2.2, 0.1, 0.8, -3.0}
+  };
+  for (const arma::vec & query : queries) {
+    const arma::mat44 T = mr::FKinSpace(M, Slist, query);
+    const arma::vec seed = mr::NearestIKSeed(database, T);
+    const double distance =
+      PoseDistance(T, mr::FKinSpace(M, Slist, seed), options.orientation_weight);
+
+    double best = std::numeric_limits<double>::infinity();
+    for (size_t k = 0; k < options.num_samples; ++k) {
+      const arma::vec thetalist = RecordJoints(database, k);
+      best = std::min(
+        best, PoseDistance(T, mr::FKinSpace(M, Slist, thetalist), options.orientation_weight));
+    }
+    REQUIRE_THAT(distance, Catch::Matchers::WithinAbs(best, 1e-6));
+  }
+
+  // A sampled pose finds its own joint coordinates
+  const arma::vec stored = RecordJoints(database, 42);
+  const arma::vec found = mr::NearestIKSeed(database, mr::FKinSpace(M, Slist, stored));
+  for (size_t i = 0; i < 6; ++i) {
+    REQUIRE_THAT(found.at(i), Catch::Matchers::WithinAbs(stored.at(i), TOLERANCE));
+  }
+
+  options.upper = arma::vec(5, arma::fill::ones);
+  REQUIRE_THROWS_AS(
+    mr::BuildIKSeedDatabase(Slist, M, mr::IKFrame::Space, options), std::invalid_argument);
+}
+
+TEST_CASE("Test memory-mapped inverse kinematics seed database", "[IKSeedDatabaseView]")
+{
+  mr::IKSeedDatabaseOptions options;
+  options.lower = arma::vec(6, arma::fill::ones) * -arma::datum::pi;
+  options.upper = arma::vec(6, arma::fill::ones) * arma::datum::pi;
+  options.num_samples = 5000;
+
+  const mr::IKSeedDatabase database =
+    mr::BuildIKSeedDatabase(Slist, M, mr::IKFrame::Space, options);
+
+  const std::string filename =
+    (std::filesystem::temp_directory_path() / "test_ik_seed_database.bin").string();
+  mr::SaveIKSeedDatabase(database, filename);
+  {
+    const mr::IKSeedDatabaseView view(filename);
+
+    REQUIRE(view.num_joints() == 6);
+    REQUIRE(view.size() == options.num_samples);
+    REQUIRE(view.orientation_weight() == options.orientation_weight);
+
+    const arma::vec thetalist{0.4, -1.1, 1.3, -0.7, 0.6, 0.2};
+    const arma::mat44 T = mr::FKinSpace(M, Slist, thetalist);
+    const arma::vec seed = view.Nearest(T);
+    const arma::vec expected = mr::NearestIKSeed(database, T);
+    for (size_t i = 0; i < 6; ++i) {
+      REQUIRE(seed.at(i) == expected.at(i));
+    }
+
+    // The seed feeds straight into the numerical solver
+    mr::IKOptions ik;
+    ik.eomg = 1e-6;
+    ik.ev = 1e-6;
+    ik.max_iterations = 100;
+    const mr::IKResult seeded = mr::IKinSpace(Slist, M, T, seed, ik);
+    REQUIRE(seeded.success);
+    const mr::IKResult cold = mr::IKinSpaceDLS(Slist, M, T, arma::vec(6, arma::fill::zeros), ik);
+    const mr::IKResult warm = mr::IKinSpaceDLS(Slist, M, T, seed, ik);
+    REQUIRE(warm.success);
+    REQUIRE(warm.iterations < cold.iterations);
+  }
+
+  // A record count whose byte size wraps around is rejected, not read past the mapping
+  const auto corrupt = [&](const std::streamoff offset, const auto value) {
+      std::fstream file(filename, std::ios::binary | std::ios::in | std::ios::out);
+      file.seekp(offset);
+      file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    };
+  corrupt(16, uint64_t{177372539170284151});
+  REQUIRE_THROWS_AS(mr::IKSeedDatabaseView(filename), std::runtime_error);
+  corrupt(16, uint64_t{options.num_samples});
+  REQUIRE_NOTHROW(mr::IKSeedDatabaseView(filename));
+  corrupt(12, uint32_t{0});
+  REQUIRE_THROWS_AS(mr::IKSeedDatabaseView(filename), std::runtime_error);
+  std::filesystem::remove(filename);
+
+  REQUIRE_THROWS(mr::IKSeedDatabaseView(filename));
+}
@@ -1,9 +1,14 @@
+#include <atomic>
 #include <iostream>
+#include <stdexcept>
 #include <vector>
 
 #include <catch2/catch_all.hpp>
 
+#include "modern_robotics/forward_kinematics.hpp"
 #include "modern_robotics/inverse_kinematics.hpp"
+#include "modern_robotics/trajectory_generation.hpp"
+#include "allocation_counter.hpp"
 
 constexpr double TOLERANCE = 1e-3;
 
@@ -74,3 +79,414 @@ TEST_CASE("Testing space inverse kinematics", "[IKinSpace]")
   REQUIRE_THAT(thetalist.at(1), Catch::Matchers::WithinAbs(2.999667, TOLERANCE));
   REQUIRE_THAT(thetalist.at(2), Catch::Matchers::WithinAbs(3.14153913, TOLERANCE));
 }
+
+TEST_CASE("Test body damped least-squares inverse kinematics", "[IKinBodyDLS]")
+{
+  const std::vector<arma::vec6> Blist{
+    {0, 0, -1, 2, 0, 0},
+    {0, 0, 0, 0, 1, 0},
+    {0, 0, 1, 0, 0, 0.1}
+  };
+  const arma::mat44 M{
+    {-1, 0, 0, 0},
+    {0, 1, 0, 6},
+    {0, 0, -1, 2},
+    {0, 0, 0, 1}
+  };
+  const arma::mat44 T{
+    {0, 1, 0, -5},
+    {1, 0, 0, 4},
+    {0, 0, -1, 1.6858},
+    {0, 0, 0, 1}
+  };
+  const arma::vec thetalist0{1.5, 2.5, 3};
+
+  const mr::IKResult result = mr::IKinBodyDLS(Blist, M, T, thetalist0, TOLERANCE, TOLERANCE);
+
+  REQUIRE(result.success);
+  REQUIRE(result.iterations > 0);
+  REQUIRE(result.angular_error <= TOLERANCE);
+  REQUIRE(result.linear_error <= TOLERANCE);
+  REQUIRE(result.thetalist.size() == Blist.size());
+  REQUIRE_THAT(result.thetalist.at(0), Catch::Matchers::WithinAbs(1.57073819, TOLERANCE));
+  REQUIRE_THAT(result.thetalist.at(1), Catch::Matchers::WithinAbs(2.999667, TOLERANCE));
+  REQUIRE_THAT(result.thetalist.at(2), Catch::Matchers::WithinAbs(3.14153913, TOLERANCE));
+}
+
+TEST_CASE("Test space damped least-squares inverse kinematics", "[IKinSpaceDLS]")
+{
+  const arma::mat44 M{
+    {-1, 0, 0, 0.817},
+    {0, 0, 1, 0.191},
+    {0, 1, 0, -0.006},
+    {0, 0, 0, 1}
+  };
+  const std::vector<arma::vec6> Slist{
+    {0, 0, 1, 0, 0, 0},
+    {0, 1, 0, -0.089, 0, 0},
+    {0, 1, 0, -0.089, 0, 0.425},
+    {0, 1, 0, -0.089, 0, 0.817},
+    {0, 0, -1, -0.109, 0.817, 0},
+    {0, 1, 0, 0.006, 0, 0.817}
+  };
+  const arma::vec thetalist{0.4, -1.1, 1.3, -0.7, 0.6, 0.2};
+  const arma::mat44 T = mr::FKinSpace(M, Slist, thetalist);
+
+  // The home configuration is singular: the arm is stretched out and the
+  // first and last joint axes are parallel
+  const arma::vec thetalist0{0, 0, 0, 0, 0, 0};
+  const double eomg = 1e-6;
+  const double ev = 1e-6;
+
+  const mr::IKResult result = mr::IKinSpaceDLS(Slist, M, T, thetalist0, eomg, ev);
+
+  REQUIRE(result.success);
+  REQUIRE(result.angular_error <= eomg);
+  REQUIRE(result.linear_error <= ev);
+
+  const arma::mat44 Tsol = mr::FKinSpace(M, Slist, result.thetalist);
+  for (size_t i = 0; i < 3; ++i) {
+    REQUIRE_THAT(Tsol.at(i, 3), Catch::Matchers::WithinAbs(T.at(i, 3), TOLERANCE));
+  }
+}
+
+TEST_CASE("Test inverse kinematics options and statistics", "[IKOptions]")
+{
+  const std::vector<arma::vec6> Slist{
+    {0, 0, 1, 4, 0, 0},
+    {0, 0, 0, 0, 1, 0},
+    {0, 0, -1, -6, 0, -0.1}
+  };
+  const arma::mat44 M{
+    {-1, 0, 0, 0},
+    {0, 1, 0, 6},
+    {0, 0, -1, 2},
+    {0, 0, 0, 1}
+  };
+  const arma::mat44 T{
+    {0, 1, 0, -5},
+    {1, 0, 0, 4},
+    {0, 0, -1, 1.6858},
+    {0, 0, 0, 1}
+  };
+  const arma::vec thetalist0{1.5, 2.5, 3};
+
+  mr::IKOptions options;
+  options.eomg = TOLERANCE;
+  options.ev = TOLERANCE;
+  options.max_step = 0.1;
+
+  const mr::IKResult result = mr::IKinSpace(Slist, M, T, thetalist0, options);
+
+  REQUIRE(result.success);
+  REQUIRE(result.termination == mr::IKTermination::Converged);
+  REQUIRE(result.iterations > 0);
+  REQUIRE(result.iterations <= options.max_iterations);
+  REQUIRE(result.angular_error <= TOLERANCE);
+  REQUIRE(result.linear_error <= TOLERANCE);
+  REQUIRE(result.wall_time >= 0.0);
+  REQUIRE_THAT(result.thetalist.at(0), Catch::Matchers::WithinAbs(1.57073819, TOLERANCE));
+  REQUIRE_THAT(result.thetalist.at(1), Catch::Matchers::WithinAbs(2.999667, TOLERANCE));
+  REQUIRE_THAT(result.thetalist.at(2), Catch::Matchers::WithinAbs(3.14153913, TOLERANCE));
+
+  options.max_iterations = 1;
+  const mr::IKResult limited = mr::IKinSpaceDLS(Slist, M, T, thetalist0, options);
+  REQUIRE_FALSE(limited.success);
+  REQUIRE(limited.termination == mr::IKTermination::MaxIterations);
+  REQUIRE(limited.iterations == 1);
+  REQUIRE(arma::abs(limited.thetalist - thetalist0).max() <= 0.1 + 1e-12);
+
+  options.max_iterations = 20;
+  options.time_budget = 0.0;
+  const mr::IKResult timed_out = mr::IKinSpace(Slist, M, T, thetalist0, options);
+  REQUIRE_FALSE(timed_out.success);
+  REQUIRE(timed_out.termination == mr::IKTermination::Timeout);
+  REQUIRE(timed_out.iterations == 0);
+}
+
+TEST_CASE("Test joint-limited inverse kinematics", "[IKJointLimits]")
+{
+  const std::vector<arma::vec6> Slist{
+    {0, 0, 1, 4, 0, 0},
+    {0, 0, 0, 0, 1, 0},
+    {0, 0, -1, -6, 0, -0.1}
+  };
+  const arma::mat44 M{
+    {-1, 0, 0, 0},
+    {0, 1, 0, 6},
+    {0, 0, -1, 2},
+    {0, 0, 0, 1}
+  };
+  const arma::mat44 T{
+    {0, 1, 0, -5},
+    {1, 0, 0, 4},
+    {0, 0, -1, 1.6858},
+    {0, 0, 0, 1}
+  };
+  const arma::vec thetalist0{1.5, 2.5, 3};
+
+  mr::IKOptions options;
+  options.eomg = TOLERANCE;
+  options.ev = TOLERANCE;
+  options.max_iterations = 100;
+  options.lower = {0, 0, 0};
+  options.upper = {4, 4, 4};
+
+  const mr::IKResult free = mr::IKinSpaceDLS(Slist, M, T, thetalist0, options);
+  REQUIRE(free.success);
+  REQUIRE(free.limits.size() == 3);
+  for (const mr::JointLimitStatus status : free.limits) {
+    REQUIRE(status == mr::JointLimitStatus::Free);
+  }
+
+  // The solution needs the prismatic joint at 3, beyond its upper limit
+  options.upper = {4, 2.8, 4};
+  const mr::IKResult limited = mr::IKinSpaceDLS(Slist, M, T, thetalist0, options);
+  REQUIRE_FALSE(limited.success);
+  for (size_t i = 0; i < 3; ++i) {
+    REQUIRE(limited.thetalist.at(i) >= options.lower.at(i));
+    REQUIRE(limited.thetalist.at(i) <= options.upper.at(i));
+  }
+  REQUIRE(limited.limits.at(0) == mr::JointLimitStatus::Free);
+  REQUIRE(limited.limits.at(1) == mr::JointLimitStatus::AtUpper);
+  REQUIRE(limited.limits.at(2) == mr::JointLimitStatus::Free);
+  REQUIRE_THAT(limited.thetalist.at(1), Catch::Matchers::WithinAbs(2.8, 1e-9));
+
+  const mr::IKResult projected = mr::IKinSpace(Slist, M, T, thetalist0, options);
+  for (size_t i = 0; i < 3; ++i) {
+    REQUIRE(projected.thetalist.at(i) >= options.lower.at(i));
+    REQUIRE(projected.thetalist.at(i) <= options.upper.at(i));
+  }
+
+  options.upper = arma::vec{4, 4};
+  REQUIRE_THROWS_AS(
+    mr::IKinSpaceDLS(Slist, M, T, thetalist0, options), std::invalid_argument);
+}
+
+TEST_CASE("Test inverse kinematics with a null-space objective", "[IKNullSpace]")
+{
+  // A 7R arm with a spherical shoulder and wrist
+  const std::vector<arma::vec6> Slist{
+    {0, 0, 1, 0, 0, 0},
+    {0, 1, 0, -0.34, 0, 0},
+    {0, 0, 1, 0, 0, 0},
+    {0, -1, 0, 0.74, 0, 0},
+    {0, 0, 1, 0, 0, 0},
+    {0, 1, 0, -1.14, 0, 0},
+    {0, 0, 1, 0, 0, 0}
+  };
+  const arma::mat44 M{
+    {1, 0, 0, 0},
+    {0, 1, 0, 0},
+    {0, 0, 1, 1.266},
+    {0, 0, 0, 1}
+  };
+  const arma::vec thetalist{0.3, 0.8, 0.5, -1.2, 0.4, 0.9, -0.2};
+  const arma::mat44 T = mr::FKinSpace(M, Slist, thetalist);
+  const arma::vec thetalist0{1.2, 0.4, 1.5, -0.6, 1.1, 0.3, 0.6};
+
+  mr::IKOptions options;
+  options.eomg = 1e-6;
+  options.ev = 1e-6;
+  options.max_iterations = 100;
+
+  const mr::IKResult plain = mr::IKinSpaceDLS(Slist, M, T, thetalist0, options);
+
+  // Pull every joint towards zero while the task is solved
+  options.null_space = [](const arma::vec & theta, arma::vec & z) {
+      z = -0.5 * theta;
+    };
+  const mr::IKResult centered = mr::IKinSpaceDLS(Slist, M, T, thetalist0, options);
+
+  REQUIRE(plain.success);
+  REQUIRE(centered.success);
+  REQUIRE(arma::norm(centered.thetalist) < arma::norm(plain.thetalist));
+
+  const arma::mat44 Tsol = mr::FKinSpace(M, Slist, centered.thetalist);
+  for (size_t i = 0; i < 3; ++i) {
+    REQUIRE_THAT(Tsol.at(i, 3), Catch::Matchers::WithinAbs(T.at(i, 3), TOLERANCE));
+  }
+}
+
+TEST_CASE("Test real-time inverse kinematics", "[RealTimeIK]")
+{
+  const arma::mat44 M{
+    {-1, 0, 0, 0.817},
+    {0, 0, 1, 0.191},
+    {0, 1, 0, -0.006},
+    {0, 0, 0, 1}
+  };
+  const std::vector<arma::vec6> Slist{
+    {0, 0, 1, 0, 0, 0},
+    {0, 1, 0, -0.089, 0, 0},
+    {0, 1, 0, -0.089, 0, 0.425},
+    {0, 1, 0, -0.089, 0, 0.817},
+    {0, 0, -1, -0.109, 0.817, 0},
+    {0, 1, 0, 0.006, 0, 0.817}
+  };
+  const arma::vec thetalist{0.4, -1.1, 1.3, -0.7, 0.6, 0.2};
+  const arma::mat44 T = mr::FKinSpace(M, Slist, thetalist);
+  const arma::vec thetalist0{0.3, -1.0, 1.1, -0.5, 0.5, 0.1};
+
+  mr::IKOptions options;
+  options.max_iterations = 50;
+  options.eomg = 1e-6;
+  options.ev = 1e-6;
+
+  mr::RealTimeIK solver(Slist, M, mr::IKFrame::Space, options);
+  const mr::IKResult expected = mr::IKinSpaceDLS(Slist, M, T, thetalist0, options);
+
+  for (int run = 0; run < 2; ++run) {
+    const mr::IKResult & result = solver.Solve(T, thetalist0);
+
+    REQUIRE(result.success);
+    REQUIRE(result.termination == mr::IKTermination::Converged);
+    REQUIRE(result.iterations == expected.iterations);
+    for (size_t i = 0; i < thetalist.size(); ++i) {
+      REQUIRE_THAT(result.thetalist.at(i), Catch::Matchers::WithinAbs(thetalist.at(i), TOLERANCE));
+    }
+  }
+
+  const mr::IKResult & late = solver.Solve(T, thetalist0, mr::RealTimeIK::Clock::now());
+  REQUIRE_FALSE(late.success);
+  REQUIRE(late.termination == mr::IKTermination::Timeout);
+  REQUIRE(late.iterations == 0);
+  REQUIRE(arma::approx_equal(late.thetalist, thetalist0, "absdiff", 0.0));
+
+  const std::atomic<bool> cancel{true};
+  const mr::IKResult & cancelled = solver.Solve(
+    T, thetalist0, mr::RealTimeIK::Clock::time_point::max(), cancel);
+  REQUIRE_FALSE(cancelled.success);
+  REQUIRE(cancelled.termination == mr::IKTermination::Cancelled);
+  REQUIRE(cancelled.iterations == 0);
+
+  // Every solve after the first runs in the solver's own storage
+  const size_t allocations = mr_test::CountAllocations([&]() {
+        solver.Solve(T, thetalist0);
+      });
+  REQUIRE(allocations == 0);
+
+  REQUIRE_THROWS_AS(solver.Solve(T, arma::vec{0.1, 0.2}), std::invalid_argument);
+}
+
+TEST_CASE("Test inverse kinematics along a path", "[IKinPath]")
+{
+  const arma::mat44 M{
+    {-1, 0, 0, 0.817},
+    {0, 0, 1, 0.191},
+    {0, 1, 0, -0.006},
+    {0, 0, 0, 1}
+  };
+  const std::vector<arma::vec6> Slist{
+    {0, 0, 1, 0, 0, 0},
+    {0, 1, 0, -0.089, 0, 0},
+    {0, 1, 0, -0.089, 0, 0.425},
+    {0, 1, 0, -0.089, 0, 0.817},
+    {0, 0, -1, -0.109, 0.817, 0},
+    {0, 1, 0, 0.006, 0, 0.817}
+  };
+  const arma::vec thetastart{0.4, -1.1, 1.3, -0.7, 0.6, 0.2};
+  const arma::vec thetaend{0.9, -0.8, 1.0, -0.9, 0.9, -0.3};
+  const std::vector<arma::mat44> traj = mr::CartesianTrajectory(
+    mr::FKinSpace(M, Slist, thetastart), mr::FKinSpace(M, Slist, thetaend), 1.0, 40,
+    mr::Method::Quintic);
+
+  mr::PathIKOptions options;
+  options.ik.max_iterations = 50;
+  options.ik.eomg = 1e-6;
+  options.ik.ev = 1e-6;
+  options.max_joint_step = 0.2;
+  options.segment_length = 8;
+  options.num_threads = 4;
+
+  const mr::PathIKResult result = mr::IKinPath(
+    Slist, M, mr::IKFrame::Space, traj, thetastart, options);
+
+  REQUIRE(result.success);
+  REQUIRE(result.failures.empty());
+  REQUIRE(result.discontinuities.empty());
+  REQUIRE(result.thetamat.size() == traj.size());
+  for (size_t i = 0; i < traj.size(); ++i) {
+    const arma::mat44 T = mr::FKinSpace(M, Slist, result.thetamat.at(i));
+    REQUIRE(arma::approx_equal(T, traj.at(i), "absdiff", TOLERANCE));
+  }
+  REQUIRE(arma::approx_equal(result.thetamat.front(), thetastart, "absdiff", TOLERANCE));
+
+  options.segment_length = 0;
+  const mr::PathIKResult serial = mr::IKinPath(
+    Slist, M, mr::IKFrame::Space, traj, thetastart, options);
+  REQUIRE(serial.success);
+  for (size_t i = 0; i < traj.size(); ++i) {
+    REQUIRE(arma::approx_equal(serial.thetamat.at(i), result.thetamat.at(i), "absdiff", TOLERANCE));
+  }
+
+  options.max_joint_step = 1e-4;
+  const mr::PathIKResult jumpy = mr::IKinPath(
+    Slist, M, mr::IKFrame::Space, traj, thetastart, options);
+  REQUIRE_FALSE(jumpy.success);
+  REQUIRE_FALSE(jumpy.discontinuities.empty());
+}
+
+TEST_CASE("Test multi-start inverse kinematics", "[IKinMultiStart]")
+{
+  const arma::mat44 M{
+    {-1, 0, 0, 0.817},
+    {0, 0, 1, 0.191},
+    {0, 1, 0, -0.006},
+    {0, 0, 0, 1}
+  };
+  const std::vector<arma::vec6> Slist{
+    {0, 0, 1, 0, 0, 0},
+    {0, 1, 0, -0.089, 0, 0},
+    {0, 1, 0, -0.089, 0, 0.425},
+    {0, 1, 0, -0.089, 0, 0.817},
+    {0, 0, -1, -0.109, 0.817, 0},
+    {0, 1, 0, 0.006, 0, 0.817}
+  };
+  const arma::vec thetalist{0.4, -1.1, 1.3, -0.7, 0.6, 0.2};
+  const arma::mat44 T = mr::FKinSpace(M, Slist, thetalist);
+
+  mr::MultiStartIKOptions options;
+  options.ik.max_iterations = 100;
+  options.ik.eomg = 1e-6;
+  options.ik.ev = 1e-6;
+  options.seeds = {
+    {0.3, -1.0, 1.2, -0.6, 0.5, 0.1},
+    {-2.0, 2.0, -2.0, 2.0, -2.0, 2.0},
+    {1.0, 1.0, 1.0, 1.0, 1.0, 1.0}
+  };
+  options.num_threads = 1;
+
+  const mr::MultiStartIKResult first = mr::IKinMultiStart(
+    Slist, M, mr::IKFrame::Space, T, options);
+
+  REQUIRE(first.best.success);
+  REQUIRE(first.attempts == 1);
+  REQUIRE(first.solutions.size() == 1);
+  REQUIRE(arma::approx_equal(first.best.thetalist, thetalist, "absdiff", TOLERANCE));
+
+  options.seeds.clear();
+  options.num_seeds = 32;
+  options.random_seed = 7;
+  options.collect_all = true;
+  options.num_threads = 4;
+
+  const mr::MultiStartIKResult all = mr::IKinMultiStart(
+    Slist, M, mr::IKFrame::Space, T, options);
+
+  REQUIRE(all.best.success);
+  REQUIRE(all.attempts == 32);
+  REQUIRE_FALSE(all.solutions.empty());
+  for (size_t i = 0; i < all.solutions.size(); ++i) {
+    const arma::mat44 Tsol = mr::FKinSpace(M, Slist, all.solutions.at(i));
+    REQUIRE(arma::approx_equal(Tsol, T, "absdiff", TOLERANCE));
+    for (size_t j = 0; j < i; ++j) {
+      REQUIRE(
+        arma::abs(all.solutions.at(i) - all.solutions.at(j)).max() > options.distinct_tolerance);
+    }
+  }
+
+  options.seeds = {{0.1, 0.2}};
+  REQUIRE_THROWS_AS(
+    mr::IKinMultiStart(Slist, M, mr::IKFrame::Space, T, options), std::invalid_argument);
+}
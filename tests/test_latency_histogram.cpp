@@ -0,0 +1,110 @@
+#include <cmath>
+#include <thread>
+#include <vector>
+#include <catch2/catch_all.hpp>
+
+#ifndef MODERN_ROBOTICS_LATENCY_HISTOGRAMS
+#define MODERN_ROBOTICS_LATENCY_HISTOGRAMS
+#endif
+#include "modern_robotics/latency_histogram.hpp"
+
+TEST_CASE("Test latency histogram", "[LatencyHistogram]")
+{
+  mr::LatencyHistogram histogram("test");
+  REQUIRE(histogram.count() == 0);
+  REQUIRE(histogram.Percentile(0.5) == 0.0);
+  REQUIRE(histogram.Snapshot().count == 0);
+
+  // 1 to 100000 ns, so the q-th percentile is 1e-4 q seconds
+  for (uint64_t ns = 1; ns <= 100000; ++ns) {
+    histogram.Record(ns);
+  }
+  const mr::LatencySnapshot snapshot = histogram.Snapshot();
+  REQUIRE(snapshot.name == "test");
+  REQUIRE(snapshot.count == 100000);
+  REQUIRE_THAT(snapshot.min, Catch::Matchers::WithinRel(1e-9));
+  REQUIRE_THAT(snapshot.max, Catch::Matchers::WithinRel(1e-4));
+  REQUIRE_THAT(snapshot.mean, Catch::Matchers::WithinRel(0.5 * 100001 * 1e-9));
+  REQUIRE_THAT(snapshot.p50, Catch::Matchers::WithinRel(5e-5, 0.016));
+  REQUIRE_THAT(snapshot.p90, Catch::Matchers::WithinRel(9e-5, 0.016));
+  REQUIRE_THAT(snapshot.p99, Catch::Matchers::WithinRel(9.9e-5, 0.016));
+  REQUIRE_THAT(snapshot.p999, Catch::Matchers::WithinRel(9.99e-5, 0.016));
+  REQUIRE(snapshot.p999 <= snapshot.max);
+  REQUIRE(histogram.Percentile(0.99) == snapshot.p99);
+  REQUIRE(histogram.Percentile(1.0) == snapshot.max);
+
+  // Small durations are exact and buckets are ordered
+  uint64_t total = 0;
+  for (size_t b = 0; b < snapshot.buckets.size(); ++b) {
+    total += snapshot.buckets[b].second;
+    REQUIRE((b == 0 || snapshot.buckets[b].first > snapshot.buckets[b - 1].first));
+  }
+  REQUIRE(total == snapshot.count);
+  REQUIRE_THAT(snapshot.buckets.front().first, Catch::Matchers::WithinRel(1e-9));
+  REQUIRE(snapshot.buckets.front().second == 1);
+
+  // Durations past the range are clamped rather than dropped
+  histogram.Reset();
+  REQUIRE(histogram.Snapshot().count == 0);
+  histogram.Record(uint64_t{1} << 50);
+  REQUIRE(histogram.Snapshot().buckets.size() == 1);
+  REQUIRE_THAT(histogram.Snapshot().max, Catch::Matchers::WithinRel(std::ldexp(1e-9, 50)));
+
+  // Concurrent recording loses nothing
+  histogram.Reset();
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < 4; ++t) {
+    threads.emplace_back(
+      [&histogram, t]() {
+        for (uint64_t i = 0; i < 50000; ++i) {
+          histogram.Record(1000 * (t + 1));
+        }
+      });
+  }
+  for (std::thread & thread : threads) {
+    thread.join();
+  }
+  REQUIRE(histogram.count() == 200000);
+  REQUIRE(histogram.Snapshot().buckets.size() == 4);
+  REQUIRE_THAT(histogram.Snapshot().min, Catch::Matchers::WithinRel(1e-6));
+}
+
+TEST_CASE("Test latency registry and reports", "[LatencyReport]")
+{
+  // Registered histograms are shared by name
+  mr::LatencyHistogram & a = mr::RegisterLatencyHistogram("test::a");
+  REQUIRE(&mr::RegisterLatencyHistogram("test::a") == &a);
+  mr::ResetLatencyHistograms();
+
+  for (size_t i = 0; i < 3; ++i) {
+    MR_LATENCY_SCOPE("test::scope");
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  a.Record(2000);
+
+  const std::vector<mr::LatencySnapshot> snapshots = mr::LatencySnapshots();
+  const auto find = [&](const std::string & name) {
+      for (const mr::LatencySnapshot & snapshot : snapshots) {
+        if (snapshot.name == name) {
+          return snapshot;
+        }
+      }
+      return mr::LatencySnapshot();
+    };
+  const mr::LatencySnapshot scope = find("test::scope");
+  REQUIRE(scope.name == "test::scope");
+  REQUIRE(scope.count == 3);
+  REQUIRE(scope.min >= 1e-4);
+  REQUIRE(find("test::a").count == 1);
+
+  const std::string text = mr::LatencyReport(snapshots);
+  REQUIRE(text.find("p99.9_us") != std::string::npos);
+  REQUIRE(text.find("test::scope") != std::string::npos);
+  REQUIRE(text.find("2.000") != std::string::npos);
+
+  const std::string json = mr::LatencyReportJson(snapshots);
+  REQUIRE(json.rfind("{\"histograms\":[{\"name\":", 0) == 0);
+  REQUIRE(json.find("{\"name\":\"test::a\",\"count\":1,\"min\":2e-06,") != std::string::npos);
+  REQUIRE(json.find("\"buckets\":[[2e-06,1]]") != std::string::npos);
+  REQUIRE(json.back() == '}');
+}
@@ -0,0 +1,151 @@
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <catch2/catch_all.hpp>
+
+#include "modern_robotics/forward_kinematics.hpp"
+#include "modern_robotics/manipulability_map.hpp"
+
+constexpr double TOLERANCE = 1e-6;
+constexpr double FLOAT_TOLERANCE = 1e-4;
+
+TEST_CASE("Test grid point", "[GridPoint]")
+{
+  const std::vector<mr::GridAxis> axes{{0, 1, 3}, {-1, 1, 2}, {0.5, 0.5, 1}};
+
+  const arma::vec point = mr::GridPoint(axes, 4);
+
+  REQUIRE(point.size() == 3);
+  REQUIRE_THAT(point.at(0), Catch::Matchers::WithinAbs(0.5, TOLERANCE));
+  REQUIRE_THAT(point.at(1), Catch::Matchers::WithinAbs(1, TOLERANCE));
+  REQUIRE_THAT(point.at(2), Catch::Matchers::WithinAbs(0.5, TOLERANCE));
+}
+
+TEST_CASE("Test joint manipulability map", "[JointManipulabilityMap]")
+{
+  const std::vector<arma::vec6> Blist{
+    {0, 0, 1, 0, 0.2, 0.2},
+    {1, 0, 0, 2, 0, 3},
+    {0, 1, 0, 0, 2, 1},
+    {1, 0, 0, 0.2, 0.3, 0.4}
+  };
+  const std::vector<mr::GridAxis> axes{{0, 1, 3}, {0.5, 1.5, 4}, {0.1, 0.1, 1}, {-1, 1, 2}};
+
+  const mr::ManipulabilityMap map = mr::JointManipulabilityMap(
+    Blist, axes, mr::ManipulabilityPart::Linear, 2);
+
+  REQUIRE(map.space == mr::GridSpace::Joint);
+  REQUIRE(map.cells.size() == 24);
+  for (size_t i = 0; i < map.cells.size(); ++i) {
+    const arma::mat Jb = mr::JacobianBody(Blist, mr::GridPoint(axes, i));
+    const mr::ManipulabilityMeasures expected =
+      mr::Manipulability(Jb, mr::ManipulabilityPart::Linear);
+
+    REQUIRE_THAT(
+      map.cells.at(i).manipulability,
+      Catch::Matchers::WithinAbs(expected.manipulability, TOLERANCE));
+    REQUIRE_THAT(
+      map.cells.at(i).min_singular_value,
+      Catch::Matchers::WithinAbs(expected.min_singular_value, TOLERANCE));
+  }
+}
+
+TEST_CASE("Test cartesian manipulability map file", "[ManipulabilityMapView]")
+{
+  const arma::mat44 M{
+    {-1, 0, 0, 0.817},
+    {0, 0, 1, 0.191},
+    {0, 1, 0, -0.006},
+    {0, 0, 0, 1}
+  };
+  const std::vector<arma::vec6> Blist{
+    {0, 1, 0, 0.191, 0, 0.817},
+    {0, 0, 1, 0.095, -0.817, 0},
+    {0, 0, 1, 0.095, -0.392, 0},
+    {0, 0, 1, 0.095, 0, 0},
+    {0, -1, 0, -0.082, 0, 0},
+    {0, 0, 1, 0, 0, 0}
+  };
+  const arma::vec thetalist0{0.3, -0.8, 1.2, -0.4, 0.5, 0.1};
+  const arma::mat44 T0 = mr::FKinBody(M, Blist, thetalist0);
+  const arma::mat33 R = T0.submat(0, 0, 2, 2);
+  const std::vector<mr::GridAxis> axes{
+    {T0.at(0, 3) - 0.02, T0.at(0, 3) + 0.02, 3},
+    {T0.at(1, 3) - 0.02, T0.at(1, 3) + 0.02, 3},
+    {T0.at(2, 3), T0.at(2, 3) + 0.02, 2}
+  };
+
+  const mr::ManipulabilityMap map = mr::CartesianManipulabilityMap(
+    Blist, M, R, axes, thetalist0, 1e-6, 1e-6);
+
+  REQUIRE(map.space == mr::GridSpace::Cartesian);
+  REQUIRE(map.cells.size() == 18);
+  for (const mr::ManipulabilityMeasures & cell : map.cells) {
+    REQUIRE(std::isfinite(cell.manipulability));
+    REQUIRE(cell.manipulability > 0);
+  }
+
+  const std::string filename =
+    (std::filesystem::temp_directory_path() / "test_manipulability_map.bin").string();
+  mr::SaveManipulabilityMap(map, filename);
+  {
+    const mr::ManipulabilityMapView view(filename);
+
+    REQUIRE(view.space() == mr::GridSpace::Cartesian);
+    REQUIRE(view.part() == mr::ManipulabilityPart::Twist);
+    REQUIRE(view.axes().size() == 3);
+    REQUIRE(view.size() == map.cells.size());
+    for (size_t i = 0; i < view.size(); ++i) {
+      REQUIRE_THAT(
+        view.at(i).manipulability,
+        Catch::Matchers::WithinRel(map.cells.at(i).manipulability, FLOAT_TOLERANCE));
+      REQUIRE_THAT(
+        view.at(i).condition_number,
+        Catch::Matchers::WithinRel(map.cells.at(i).condition_number, FLOAT_TOLERANCE));
+    }
+
+    const arma::vec point = mr::GridPoint(axes, 13) + 0.001;
+    REQUIRE_THAT(
+      view.Lookup(point).min_singular_value,
+      Catch::Matchers::WithinRel(map.cells.at(13).min_singular_value, FLOAT_TOLERANCE));
+    REQUIRE_THROWS_AS(view.Lookup(arma::vec{0.1, 0.2}), std::invalid_argument);
+    REQUIRE_THROWS_AS(
+      view.Lookup(arma::vec{0.1, 0.2, arma::datum::nan}), std::invalid_argument);
+  }
+  std::filesystem::remove(filename);
+
+  REQUIRE_THROWS(mr::ManipulabilityMapView(filename));
+}
+
+TEST_CASE("Test manipulability map validation", "[ManipulabilityMapView]")
+{
+  const std::vector<arma::vec6> Blist{
+    {0, 0, 1, 0, 2, 0},
+    {0, 0, 1, 0, 1, 0}
+  };
+  const std::vector<mr::GridAxis> axes{
+    {-1, 1, 3},
+    {-1, 1, 3}
+  };
+
+  const arma::mat44 M = arma::eye(4, 4);
+  const arma::mat33 R = arma::eye(3, 3);
+  const arma::vec thetalist0{0, 0};
+  REQUIRE_THROWS_AS(
+    mr::CartesianManipulabilityMap(Blist, M, R, axes, thetalist0, 1e-6, 1e-6),
+    std::invalid_argument);
+
+  const std::string filename =
+    (std::filesystem::temp_directory_path() / "test_manipulability_map_naxes.bin").string();
+  mr::SaveManipulabilityMap(mr::JointManipulabilityMap(Blist, axes), filename);
+  {
+    std::fstream file(filename, std::ios::binary | std::ios::in | std::ios::out);
+    const uint32_t naxes = 0xffffffff;
+    file.seekp(20);
+    file.write(reinterpret_cast<const char *>(&naxes), sizeof(naxes));
+  }
+
+  REQUIRE_THROWS_AS(mr::ManipulabilityMapView(filename), std::runtime_error);
+  std::filesystem::remove(filename);
+}
@@ -0,0 +1,99 @@
+#include <catch2/catch_all.hpp>
+
+#include "modern_robotics/dynamics_of_open_chains.hpp"
+#include "modern_robotics/trajectory_generation.hpp"
+#include "modern_robotics/model_predictive_control.hpp"
+#include "allocation_counter.hpp"
+#include "ur5.hpp"
+
+TEST_CASE("Test linear MPC", "[LinearMPC]")
+{
+  const mr_test::Arm arm = mr_test::UR5FirstThreeJoints();
+  const std::vector<arma::mat44> & Mlist = arm.Mlist;
+  const std::vector<arma::mat66> & Glist = arm.Glist;
+  const std::vector<arma::vec6> & Slist = arm.Slist;
+  const arma::vec3 g{0, 0, -9.8};
+
+  // A quintic reference, differentiated numerically
+  const double dt = 1e-3;
+  const size_t N = 501;
+  const std::vector<arma::vec> thetamatd = mr::JointTrajectory(
+    arma::vec{0.0, 0.0, 0.0}, arma::vec{0.6, -0.5, 0.9}, dt * (N - 1), N, mr::Method::Quintic);
+  std::vector<arma::vec> dthetamatd(N, arma::vec(3, arma::fill::zeros));
+  std::vector<arma::vec> ddthetamatd(N, arma::vec(3, arma::fill::zeros));
+  for (size_t i = 1; i + 1 < N; ++i) {
+    dthetamatd.at(i) = (thetamatd.at(i + 1) - thetamatd.at(i - 1)) / (2.0 * dt);
+    ddthetamatd.at(i) =
+      (thetamatd.at(i + 1) - 2.0 * thetamatd.at(i) + thetamatd.at(i - 1)) / (dt * dt);
+  }
+
+  // The plant is 20% heavier than the model and carries a tip load
+  const std::vector<arma::mat66> Gplant{1.2 * Glist.at(0), 1.2 * Glist.at(1), 1.2 * Glist.at(2)};
+  const arma::vec6 Ftip{0, 0, 0, 0, 0, 5};
+
+  mr::LinearMPCOptions options;
+  options.horizon = 10;
+  options.dt = dt;
+  options.Q = arma::diagmat(arma::vec{1e4, 1e4, 1e4, 1e1, 1e1, 1e1});
+  options.Qf = 10.0 * options.Q;
+  options.R = 1e-4 * arma::mat{3, 3, arma::fill::eye};
+
+  // Runs the loop of SimulateControl and returns the RMS joint error
+  const auto simulate = [&](mr::LinearMPC * mpc, double & taumax) {
+      arma::vec thetalist = thetamatd.front();
+      arma::vec dthetalist = dthetamatd.front();
+      mr::DynamicsWorkspace model(Mlist, Glist, Slist);
+      arma::vec taulist;
+      double error2 = 0.0;
+      taumax = 0.0;
+      for (size_t i = 0; i < N; ++i) {
+        if (mpc != nullptr) {
+          taulist = mpc->Step(thetalist, dthetalist, thetamatd, dthetamatd, ddthetamatd, i);
+        } else {
+          model.InverseDynamics(
+            thetamatd.at(i), dthetamatd.at(i), ddthetamatd.at(i), g, arma::vec6{arma::fill::zeros},
+            taulist);
+        }
+        taumax = std::max(taumax, arma::abs(taulist).max());
+        const arma::vec ddthetalist = mr::ForwardDynamics(
+          thetalist, dthetalist, taulist, g, Ftip, Mlist, Gplant, Slist);
+        const auto [thetanext, dthetanext] = mr::EulerStep(
+          thetalist, dthetalist, ddthetalist, dt);
+        thetalist = thetanext;
+        dthetalist = dthetanext;
+        const arma::vec e = thetamatd.at(std::min(i + 1, N - 1)) - thetalist;
+        error2 += arma::dot(e, e);
+      }
+      return std::sqrt(error2 / N);
+    };
+
+  double taumax = 0.0;
+  const double feedforward = simulate(nullptr, taumax);
+
+  mr::LinearMPC mpc(g, Mlist, Glist, Slist, options);
+  const double unbounded = simulate(&mpc, taumax);
+  REQUIRE(unbounded < 0.2 * feedforward);
+  REQUIRE(mpc.converged());
+
+  // The warm-started solve runs in storage sized by the constructor
+  const arma::vec thetalist = thetamatd.at(N / 2);
+  const arma::vec dthetalist = dthetamatd.at(N / 2);
+  const size_t allocations = mr_test::CountAllocations([&]() {
+        mpc.Step(thetalist, dthetalist, thetamatd, dthetamatd, ddthetamatd, N / 2);
+      });
+  REQUIRE(allocations == 0);
+
+  // Torque limits below the unconstrained peak are respected
+  const double limit = 0.8 * taumax;
+  options.tau_min = arma::vec{-limit, -limit, -limit};
+  options.tau_max = arma::vec{limit, limit, limit};
+  options.max_iterations = 30;
+  mr::LinearMPC bounded(g, Mlist, Glist, Slist, options);
+  const double constrained = simulate(&bounded, taumax);
+  REQUIRE(taumax <= limit + 1e-9);
+  REQUIRE(bounded.iterations() <= 30);
+  REQUIRE(constrained < feedforward);
+
+  options.R = arma::mat{2, 2, arma::fill::eye};
+  REQUIRE_THROWS_AS(mr::LinearMPC(g, Mlist, Glist, Slist, options), std::invalid_argument);
+}
@@ -322,6 +322,24 @@ TEST_CASE("Test adjoint", "[Adjoint]")
   REQUIRE_THAT(AdT.at(5, 5), Catch::Matchers::WithinAbs(0, TOLERANCE));
 }
 
+TEST_CASE("Test adjoint map", "[AdjointMap]")
+{
+  const arma::mat44 T{
+    {1, 0, 0, 0},
+    {0, 0, -1, 0},
+    {0, 1, 0, 3},
+    {0, 0, 0, 1}
+  };
+  const arma::vec6 V{1, 2, 3, 4, 5, 6};
+
+  const arma::vec6 AdTV = mr::AdjointMap(T, V);
+  const arma::vec6 AdTVexp = mr::Adjoint(T) * V;
+
+  for (size_t i = 0; i < 6; ++i) {
+    REQUIRE_THAT(AdTV.at(i), Catch::Matchers::WithinAbs(AdTVexp.at(i), TOLERANCE));
+  }
+}
+
 TEST_CASE("Test screw axis", "[ScrewToAxis]")
 {
   const arma::vec3 q{3, 0, 0};
@@ -417,6 +435,28 @@ TEST_CASE("Test matrix log", "[MatrixLog6]")
   REQUIRE_THAT(se3mat.at(3, 3), Catch::Matchers::WithinAbs(0, TOLERANCE));
 }
 
+TEST_CASE("Test matrix log of a pure translation", "[MatrixLog6]")
+{
+  const arma::mat44 I{arma::fill::eye};
+  const arma::mat44 T{
+    {1, 0, 0, 1},
+    {0, 1, 0, -2},
+    {0, 0, 1, 0.5},
+    {0, 0, 0, 1}
+  };
+
+  const arma::mat44 se3zero = mr::MatrixLog6(I);
+  const arma::mat44 se3mat = mr::MatrixLog6(T);
+
+  REQUIRE(se3zero.is_finite());
+  REQUIRE_THAT(arma::abs(se3zero).max(), Catch::Matchers::WithinAbs(0, TOLERANCE));
+  REQUIRE_THAT(
+    arma::abs(se3mat.submat(0, 0, 2, 2)).max(), Catch::Matchers::WithinAbs(0, TOLERANCE));
+  REQUIRE_THAT(se3mat.at(0, 3), Catch::Matchers::WithinAbs(1, TOLERANCE));
+  REQUIRE_THAT(se3mat.at(1, 3), Catch::Matchers::WithinAbs(-2, TOLERANCE));
+  REQUIRE_THAT(se3mat.at(2, 3), Catch::Matchers::WithinAbs(0.5, TOLERANCE));
+}
+
 TEST_CASE("Test project to SO3", "[ProjectToSO3]")
 {
   const arma::mat33 mat{
@@ -1,7 +1,13 @@
 #include <iostream>
+#include <stdexcept>
 #include <catch2/catch_all.hpp>
 
+#include "modern_robotics/rigid_body_motions.hpp"
+#include "modern_robotics/velocity_kinematics_and_statics.hpp"
+#include "modern_robotics/dynamics_of_open_chains.hpp"
 #include "modern_robotics/robot_control.hpp"
+#include "allocation_counter.hpp"
+#include "ur5.hpp"
 
 constexpr double TOLERANCE = 1e-6;
 
@@ -81,3 +87,259 @@ TEST_CASE("Testing computing torque", "[ComputeTorque]")
   REQUIRE_THAT(taulist.at(1), Catch::Matchers::WithinAbs(-29.94223324, TOLERANCE));
   REQUIRE_THAT(taulist.at(2), Catch::Matchers::WithinAbs(-3.03276856, TOLERANCE));
 }
+
+TEST_CASE("Test computed torque controller", "[ComputedTorqueController]")
+{
+  const arma::vec thetalist{0.1, 0.1, 0.1};
+  const arma::vec dthetalist{0.1, 0.2, 0.3};
+  const arma::vec eint{0.2, 0.2, 0.2};
+  const arma::vec3 g{0, 0, -9.8};
+
+  const mr_test::Arm arm = mr_test::UR5FirstThreeJoints();
+  const std::vector<arma::mat44> & Mlist = arm.Mlist;
+  const std::vector<arma::mat66> & Glist = arm.Glist;
+  const std::vector<arma::vec6> & Slist = arm.Slist;
+
+  const arma::vec thetalistd{1.0, 1.0, 1.0};
+  const arma::vec dthetalistd{2, 1.2, 2};
+  const arma::vec ddthetalistd{0.1, 0.1, 0.1};
+  const double kp = 1.3;
+  const double ki = 1.2;
+  const double kd = 1.1;
+
+  mr::ComputedTorqueController controller(g, Mlist, Glist, Slist, kp, ki, kd);
+  controller.SetIntegralError(eint);
+  const arma::vec taulist =
+    controller.Step(thetalist, dthetalist, thetalistd, dthetalistd, ddthetalistd);
+
+  REQUIRE_THAT(taulist.at(0), Catch::Matchers::WithinAbs(133.00525246, TOLERANCE));
+  REQUIRE_THAT(taulist.at(1), Catch::Matchers::WithinAbs(-29.94223324, TOLERANCE));
+  REQUIRE_THAT(taulist.at(2), Catch::Matchers::WithinAbs(-3.03276856, TOLERANCE));
+  for (size_t i = 0; i < 3; ++i) {
+    REQUIRE_THAT(
+      controller.eint().at(i),
+      Catch::Matchers::WithinAbs(eint.at(i) + thetalistd.at(i) - thetalist.at(i), TOLERANCE));
+  }
+
+  // Per-joint and full gains match ComputeTorque with the accumulated error
+  const arma::vec kpvec{1.3, 2.0, 0.5};
+  const arma::vec kivec{1.2, 0.1, 0.3};
+  const arma::vec kdvec{1.1, 0.7, 2.2};
+  mr::ComputedTorqueController diagonal(g, Mlist, Glist, Slist, kpvec, kivec, kdvec);
+  mr::ComputedTorqueController full(
+    g, Mlist, Glist, Slist,
+    arma::mat(arma::diagmat(kpvec)), arma::mat(arma::diagmat(kivec)),
+    arma::mat(arma::diagmat(kdvec)));
+  const arma::vec tau1 =
+    diagonal.Step(thetalist, dthetalist, thetalistd, dthetalistd, ddthetalistd);
+  const arma::vec tau2 = full.Step(thetalist, dthetalist, thetalistd, dthetalistd, ddthetalistd);
+  const arma::mat Mmat = mr::MassMatrix(thetalist, Mlist, Glist, Slist);
+  const arma::vec ep = thetalistd - thetalist;
+  const arma::vec ed = dthetalistd - dthetalist;
+  const arma::vec u = kpvec % ep + kivec % ep + kdvec % ed;
+  const arma::vec expected = Mmat * u + mr::InverseDynamics(
+    thetalist, dthetalist, ddthetalistd, g, arma::vec6(arma::fill::zeros), Mlist, Glist, Slist);
+  for (size_t i = 0; i < 3; ++i) {
+    REQUIRE_THAT(tau1.at(i), Catch::Matchers::WithinAbs(expected.at(i), TOLERANCE));
+    REQUIRE_THAT(tau2.at(i), Catch::Matchers::WithinAbs(expected.at(i), TOLERANCE));
+  }
+
+  // The mass matrix and the bias forces are computed in the controller's storage
+  const size_t allocations = mr_test::CountAllocations([&]() {
+        diagonal.Step(thetalist, dthetalist, thetalistd, dthetalistd, ddthetalistd);
+        full.Step(thetalist, dthetalist, thetalistd, dthetalistd, ddthetalistd);
+      });
+  REQUIRE(allocations == 0);
+
+  diagonal.Reset();
+  REQUIRE(arma::abs(diagonal.eint()).max() == 0.0);
+  REQUIRE_THROWS_AS(
+    mr::ComputedTorqueController(g, Mlist, Glist, Slist, kpvec, kivec, arma::vec{1.0}),
+    std::invalid_argument);
+}
+
+TEST_CASE("Test resolved-rate controller", "[ResolvedRateController]")
+{
+  const arma::mat44 M{
+    {-1, 0, 0, 0.817},
+    {0, 0, 1, 0.191},
+    {0, 1, 0, -0.006},
+    {0, 0, 0, 1}
+  };
+  const std::vector<arma::vec6> Slist{
+    {0, 0, 1, 0, 0, 0},
+    {0, 1, 0, -0.089, 0, 0},
+    {0, 1, 0, -0.089, 0, 0.425},
+    {0, 1, 0, -0.089, 0, 0.817},
+    {0, 0, -1, -0.109, 0.817, 0},
+    {0, 1, 0, 0.006, 0, 0.817}
+  };
+  const arma::vec thetalist0{0.4, -1.1, 1.3, -0.7, 0.6, 0.2};
+
+  mr::ResolvedRateController controller(Slist, M, mr::IKFrame::Space, thetalist0);
+  const arma::mat44 T0 = controller.T();
+
+  // A constant spatial twist moves the end-effector along exp([V] t) T0
+  const arma::vec6 V{0.05, -0.1, 0.02, 0.01, 0.03, -0.02};
+  const double dt = 1e-3;
+  for (size_t k = 0; k < 1000; ++k) {
+    controller.Step(V, dt);
+  }
+  REQUIRE(controller.damping() == 0.0);
+  REQUIRE(controller.scale() == 1.0);
+
+  const arma::mat44 expected = mr::MatrixExp6(mr::VecTose3(V)) * T0;
+  for (size_t i = 0; i < 3; ++i) {
+    for (size_t j = 0; j < 4; ++j) {
+      REQUIRE_THAT(controller.T().at(i, j), Catch::Matchers::WithinAbs(expected.at(i, j), 1e-3));
+    }
+  }
+
+  // A fast command is scaled to the velocity limits without changing direction
+  mr::ResolvedRateOptions options;
+  options.max_velocity = arma::vec(6, arma::fill::ones) * 0.5;
+  mr::ResolvedRateController limited(Slist, M, mr::IKFrame::Space, thetalist0, options);
+  const arma::vec6 fast = 20.0 * V;
+  const arma::vec dthetalist = limited.Step(fast, dt);
+  REQUIRE(limited.scale() < 1.0);
+  REQUIRE(arma::abs(dthetalist).max() <= 0.5 + 1e-12);
+  const arma::vec6 twist = mr::JacobianSpace(Slist, thetalist0) * dthetalist;
+  for (size_t i = 0; i < 6; ++i) {
+    REQUIRE_THAT(twist.at(i), Catch::Matchers::WithinAbs(limited.scale() * fast.at(i), 1e-9));
+  }
+
+  // The home configuration is singular; damping keeps the rates finite
+  limited.SetJointState(arma::vec(6, arma::fill::zeros));
+  limited.Step(V, dt);
+  REQUIRE(limited.damping() > 0.0);
+  REQUIRE(limited.dthetalist().is_finite());
+
+  REQUIRE_THROWS_AS(limited.SetJointState(arma::vec(5, arma::fill::zeros)), std::invalid_argument);
+
+  // With fewer than six joints the step is the least-squares solution
+  const std::vector<arma::vec6> Sarm{Slist.at(0), Slist.at(1), Slist.at(2)};
+  const arma::vec thetaarm{0.4, -1.1, 1.3};
+  mr::ResolvedRateController arm(Sarm, M, mr::IKFrame::Space, thetaarm);
+  const arma::mat Jarm = mr::JacobianSpace(Sarm, thetaarm);
+  const arma::vec dthetaarm = arm.Step(V, dt);
+  REQUIRE(arm.damping() == 0.0);
+  REQUIRE(arma::approx_equal(dthetaarm, arma::pinv(Jarm) * V, "absdiff", 1e-9));
+
+  // ...damped when sqrt(det(J^T J)) falls below the threshold
+  options = mr::ResolvedRateOptions();
+  options.manipulability_threshold = 10.0;
+  mr::ResolvedRateController damped(Sarm, M, mr::IKFrame::Space, thetaarm, options);
+  const arma::vec dthetadamped = damped.Step(V, dt);
+  const double lambda2 = damped.damping();
+  REQUIRE(lambda2 > 0.0);
+  REQUIRE(lambda2 < options.max_damping);
+  const arma::mat JtJ = Jarm.t() * Jarm + lambda2 * arma::mat(3, 3, arma::fill::eye);
+  REQUIRE(arma::approx_equal(dthetadamped, arma::solve(JtJ, Jarm.t() * V), "absdiff", 1e-9));
+
+  const size_t allocations = mr_test::CountAllocations([&]() {
+        controller.Step(V, dt);
+        limited.Step(V, dt);
+        damped.Step(V, dt);
+      });
+  REQUIRE(allocations == 0);
+}
+
+TEST_CASE("Test operational-space controller", "[OperationalSpaceController]")
+{
+  // The UR5 with a seventh revolute joint about the x-axis of its flange
+  const mr_test::Arm arm = mr_test::UR5WithFlangeJoint();
+  const std::vector<arma::mat44> & Mlist = arm.Mlist;
+  const std::vector<arma::mat66> & Glist = arm.Glist;
+  const std::vector<arma::vec6> & Slist = arm.Slist;
+  const arma::vec3 & g = arm.g;
+  const arma::vec & thetalist = arm.thetalist;
+  const arma::vec & dthetalist = arm.dthetalist;
+  const arma::mat44 Mee = mr_test::HomeConfiguration(arm);
+  const arma::mat66 Kp = 100.0 * arma::mat66{arma::fill::eye};
+  const arma::mat66 Kd = 20.0 * arma::mat66{arma::fill::eye};
+  const arma::vec6 zero{arma::fill::zeros};
+
+  const arma::mat44 Td = mr::FKinSpace(
+    Mee, Slist, arma::vec{0.5, -1.0, 1.2, -0.6, 0.5, 0.3, 0.2});
+  const arma::vec6 Vd{0.1, 0.0, -0.1, 0.05, 0.02, 0.0};
+  const arma::vec6 dVd{0.0, 0.2, 0.0, -0.1, 0.0, 0.05};
+
+  mr::OperationalSpaceController controller(g, Mlist, Glist, Slist, Kp, Kd, 0.0);
+  const arma::vec taulist = controller.Step(thetalist, dthetalist, Td, Vd, dVd, zero);
+
+  std::vector<arma::vec6> Blist;
+  for (const arma::vec6 & S : Slist) {
+    Blist.push_back(mr::Adjoint(mr::TransInv(Mee)) * S);
+  }
+  const arma::mat Jb = mr::JacobianBody(Blist, thetalist);
+  REQUIRE(arma::approx_equal(controller.jacobian(), Jb, "absdiff", TOLERANCE));
+
+  // Lambda = (Jb M^-1 Jb^T)^-1
+  const arma::mat M = mr::MassMatrix(thetalist, Mlist, Glist, Slist);
+  const arma::mat lambda = arma::inv(Jb * arma::inv(M) * Jb.t());
+  REQUIRE(arma::approx_equal(controller.lambda(), lambda, "reldiff", TOLERANCE));
+
+  // The end-effector accelerates at the impedance plus feedforward acceleration
+  const arma::vec ddthetalist = mr::ForwardDynamics(
+    thetalist, dthetalist, taulist, g, zero, Mlist, Glist, Slist);
+  const arma::vec6 Vb = Jb * dthetalist;
+  const arma::mat44 Tbd = mr::TransInv(controller.T()) * Td;
+  const arma::vec6 Vdb = mr::Adjoint(Tbd) * Vd;
+  const arma::vec6 a = mr::Adjoint(Tbd) * dVd + mr::ad(Vdb) * Vb +
+    Kp * mr::se3ToVec(mr::MatrixLog6(Tbd)) + Kd * (Vdb - Vb);
+  const arma::vec6 dVb = Jb * ddthetalist +
+    mr::JacobianBodyDotProduct(Blist, thetalist, dthetalist);
+  REQUIRE(arma::approx_equal(dVb, a, "absdiff", 1e-5));
+
+  // A secondary torque leaves the end-effector acceleration unchanged
+  const arma::vec tau0{1.0, -2.0, 0.5, 1.5, -0.5, 0.3, 2.0};
+  const arma::vec tausecondary = controller.Step(thetalist, dthetalist, Td, Vd, dVd, zero, tau0);
+  REQUIRE(arma::norm(tausecondary - taulist) > 1e-3);
+  const arma::vec ddthetasecondary = mr::ForwardDynamics(
+    thetalist, dthetalist, tausecondary, g, zero, Mlist, Glist, Slist);
+  REQUIRE(arma::approx_equal(Jb * ddthetasecondary, Jb * ddthetalist, "absdiff", 1e-5));
+
+  // A feedforward wrench is mapped by Jb^T
+  const arma::vec6 Fd{0.0, 0.0, 0.0, 0.0, 0.0, 5.0};
+  const arma::vec tauforce = controller.Step(thetalist, dthetalist, Td, Vd, dVd, Fd);
+  REQUIRE(arma::approx_equal(tauforce - taulist, Jb.t() * Fd, "absdiff", TOLERANCE));
+
+  // Once warmed up, a step runs in the controller's own storage
+  const size_t allocations = mr_test::CountAllocations([&]() {
+        controller.Step(thetalist, dthetalist, Td, Vd, dVd, zero);
+        controller.Step(thetalist, dthetalist, Td, Vd, dVd, Fd, tau0);
+      });
+  REQUIRE(allocations == 0);
+
+  REQUIRE_THROWS_AS(
+    controller.Step(arma::vec{0.1, 0.2}, dthetalist, Td, Vd, dVd, zero), std::invalid_argument);
+}
+
+TEST_CASE("Benchmark operational-space controller", "[OperationalSpaceController][!benchmark]")
+{
+  // Run with the [!benchmark] tag to report the time of one control cycle
+  const mr_test::Arm arm6 = mr_test::UR5();
+  const mr_test::Arm arm7 = mr_test::UR5WithFlangeJoint();
+  const arma::mat66 Kp = 100.0 * arma::mat66{arma::fill::eye};
+  const arma::mat66 Kd = 20.0 * arma::mat66{arma::fill::eye};
+  const arma::vec6 Vd{0.1, 0.0, -0.1, 0.05, 0.02, 0.0};
+  const arma::vec6 dVd{0.0, 0.2, 0.0, -0.1, 0.0, 0.05};
+  const arma::vec6 zero{arma::fill::zeros};
+
+  mr::OperationalSpaceController controller6(
+    arm6.g, arm6.Mlist, arm6.Glist, arm6.Slist, Kp, Kd);
+  const arma::mat44 Td6 = mr::FKinSpace(
+    mr_test::HomeConfiguration(arm6), arm6.Slist, arm6.thetalist + 0.1);
+  mr::OperationalSpaceController controller7(
+    arm7.g, arm7.Mlist, arm7.Glist, arm7.Slist, Kp, Kd);
+  const arma::mat44 Td7 = mr::FKinSpace(
+    mr_test::HomeConfiguration(arm7), arm7.Slist, arm7.thetalist + 0.1);
+  const arma::vec tau0{1.0, -2.0, 0.5, 1.5, -0.5, 0.3, 2.0};
+
+  BENCHMARK("6-DOF step") {
+    return controller6.Step(arm6.thetalist, arm6.dthetalist, Td6, Vd, dVd, zero).at(0);
+  };
+  BENCHMARK("7-DOF step with a secondary torque") {
+    return controller7.Step(arm7.thetalist, arm7.dthetalist, Td7, Vd, dVd, zero, tau0).at(0);
+  };
+}
@@ -0,0 +1,104 @@
+#include <catch2/catch_all.hpp>
+
+#include "modern_robotics/dynamics_of_open_chains.hpp"
+#include "modern_robotics/trajectory_optimization.hpp"
+#include "ur5.hpp"
+
+constexpr double TOLERANCE = 1e-6;
+
+namespace
+{
+const mr::ILQRProblem UR5Problem()
+{
+  const mr_test::Arm arm = mr_test::UR5FirstThreeJoints();
+
+  mr::ILQRProblem problem;
+  problem.thetalist = arma::vec{0.0, 0.0, 0.0};
+  problem.dthetalist = arma::vec{0.0, 0.0, 0.0};
+  problem.g = arm.g;
+  problem.Mlist = arm.Mlist;
+  problem.Glist = arm.Glist;
+  problem.Slist = arm.Slist;
+  problem.dt = 0.01;
+
+  // Reach a goal at rest after one second, spending as little effort as possible
+  const size_t N = 100;
+  problem.thetamatd.assign(N + 1, arma::vec{0.5, -0.4, 0.8});
+  problem.dthetamatd.assign(N + 1, arma::vec{0.0, 0.0, 0.0});
+  problem.Q = arma::mat{6, 6, arma::fill::zeros};
+  problem.R = 1e-4 * arma::mat{3, 3, arma::fill::eye};
+  problem.Qf = 1e5 * arma::mat{6, 6, arma::fill::eye};
+
+  return problem;
+}
+}
+
+TEST_CASE("Test iterative LQR", "[ILQR]")
+{
+  const mr::ILQRProblem problem = UR5Problem();
+  const size_t N = problem.thetamatd.size() - 1;
+
+  mr::ILQROptions options;
+  options.num_threads = 4;
+  const mr::ILQRResult result = mr::ILQR(problem, {}, options);
+
+  REQUIRE(result.converged);
+  REQUIRE(result.taumat.size() == N);
+  REQUIRE(result.Kmat.size() == N);
+  REQUIRE(result.Kmat.front().n_rows == 3);
+  REQUIRE(result.Kmat.front().n_cols == 6);
+  REQUIRE(result.thetamat.size() == N + 1);
+  REQUIRE(arma::norm(result.thetamat.back() - problem.thetamatd.back()) < 1e-2);
+  REQUIRE(arma::norm(result.dthetamat.back()) < 1e-2);
+
+  // The nominal rollout is the Euler integration of ForwardDynamics
+  arma::vec thetalist = problem.thetalist;
+  arma::vec dthetalist = problem.dthetalist;
+  for (size_t k = 0; k < N; ++k) {
+    const arma::vec ddthetalist = mr::ForwardDynamics(
+      thetalist, dthetalist, result.taumat.at(k), problem.g, arma::vec6{arma::fill::zeros},
+      problem.Mlist, problem.Glist, problem.Slist);
+    const auto [thetanext, dthetanext] = mr::EulerStep(
+      thetalist, dthetalist, ddthetalist, problem.dt);
+    thetalist = thetanext;
+    dthetalist = dthetanext;
+  }
+  REQUIRE(arma::approx_equal(thetalist, result.thetamat.back(), "absdiff", TOLERANCE));
+
+  // The feedback gains correct a perturbed start better than the open-loop torques
+  const arma::vec offset{0.03, -0.02, 0.02};
+  arma::vec thetaopen = problem.thetalist + offset;
+  arma::vec dthetaopen = problem.dthetalist;
+  arma::vec thetaclosed = thetaopen;
+  arma::vec dthetaclosed = dthetaopen;
+  for (size_t k = 0; k < N; ++k) {
+    const arma::vec ddthetaopen = mr::ForwardDynamics(
+      thetaopen, dthetaopen, result.taumat.at(k), problem.g, arma::vec6{arma::fill::zeros},
+      problem.Mlist, problem.Glist, problem.Slist);
+    const auto [thetaopennext, dthetaopennext] = mr::EulerStep(
+      thetaopen, dthetaopen, ddthetaopen, problem.dt);
+    thetaopen = thetaopennext;
+    dthetaopen = dthetaopennext;
+
+    const arma::vec taulist = mr::ILQRTorque(result, k, thetaclosed, dthetaclosed);
+    const arma::vec ddthetaclosed = mr::ForwardDynamics(
+      thetaclosed, dthetaclosed, taulist, problem.g, arma::vec6{arma::fill::zeros},
+      problem.Mlist, problem.Glist, problem.Slist);
+    const auto [thetaclosednext, dthetaclosednext] = mr::EulerStep(
+      thetaclosed, dthetaclosed, ddthetaclosed, problem.dt);
+    thetaclosed = thetaclosednext;
+    dthetaclosed = dthetaclosednext;
+  }
+  const arma::vec goal = problem.thetamatd.back();
+  REQUIRE(arma::norm(thetaclosed - goal) < 0.5 * arma::norm(thetaopen - goal));
+
+  // The thread count does not change the solution
+  options.num_threads = 1;
+  const mr::ILQRResult serial = mr::ILQR(problem, {}, options);
+  REQUIRE(serial.iterations == result.iterations);
+  REQUIRE(serial.cost == result.cost);
+
+  mr::ILQRProblem inconsistent = problem;
+  inconsistent.R = arma::mat{2, 2, arma::fill::eye};
+  REQUIRE_THROWS_AS(mr::ILQR(inconsistent), std::invalid_argument);
+}
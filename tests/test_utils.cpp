@@ -29,3 +29,25 @@ TEST_CASE("Test normalize vector", "[Normalize]") {
   REQUIRE_THAT(normalized_vec.at(1) - 2.0 / norm, Catch::Matchers::WithinAbs(0.0, TOLERANCE));
   REQUIRE_THAT(normalized_vec.at(2) - 3.0 / norm, Catch::Matchers::WithinAbs(0.0, TOLERANCE));
 }
+
+TEST_CASE("Test cholesky solve", "[CholeskyDecompose]") {
+  const arma::mat A{
+    {4.0, 2.0, 0.6},
+    {2.0, 5.0, 1.0},
+    {0.6, 1.0, 3.0}
+  };
+  const arma::vec b{1.0, -2.0, 0.5};
+
+  arma::mat L{A};
+  REQUIRE(mr::CholeskyDecompose(L));
+  arma::vec x{b};
+  mr::CholeskySolve(L, x);
+
+  const arma::vec r = A * x - b;
+  REQUIRE_THAT(arma::norm(r), Catch::Matchers::WithinAbs(0.0, TOLERANCE));
+  REQUIRE_THAT(L.at(0, 0), Catch::Matchers::WithinAbs(2.0, TOLERANCE));
+  REQUIRE_THAT(L.at(1, 0), Catch::Matchers::WithinAbs(1.0, TOLERANCE));
+
+  arma::mat B{{1.0, 2.0}, {2.0, 1.0}};
+  REQUIRE_FALSE(mr::CholeskyDecompose(B));
+}
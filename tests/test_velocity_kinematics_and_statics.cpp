@@ -1,4 +1,7 @@
+#include <stdexcept>
+
 #include <catch2/catch_all.hpp>
+#include "modern_robotics/forward_kinematics.hpp"
 #include "modern_robotics/velocity_kinematics_and_statics.hpp"
 
 constexpr double TOLERANCE = 1e-6;
@@ -80,3 +83,313 @@ TEST_CASE("Test jacobian space", "[JacobianSpace]")
   REQUIRE_THAT(Js.at(4, 3), Catch::Matchers::WithinAbs(2.77535713, TOLERANCE));
   REQUIRE_THAT(Js.at(5, 3), Catch::Matchers::WithinAbs(2.22512443, TOLERANCE));
 }
+
+TEST_CASE("Test fused body forward kinematics and jacobian", "[FKinAndJacobianBody]")
+{
+  const arma::mat44 M{
+    {-1, 0, 0, 0},
+    {0, 1, 0, 6},
+    {0, 0, -1, 2},
+    {0, 0, 0, 1}
+  };
+  const std::vector<arma::vec6> Blist{
+    {0, 0, 1, 0, 0.2, 0.2},
+    {1, 0, 0, 2, 0, 3},
+    {0, 1, 0, 0, 2, 1},
+    {1, 0, 0, 0.2, 0.3, 0.4}
+  };
+  const arma::vec thetalist{0.2, 1.1, 0.1, 1.2};
+
+  const auto &[T, Jb] = mr::FKinAndJacobianBody(M, Blist, thetalist);
+  const arma::mat44 Texp = mr::FKinBody(M, Blist, thetalist);
+  const arma::mat Jbexp = mr::JacobianBody(Blist, thetalist);
+
+  for (size_t i = 0; i < 4; ++i) {
+    for (size_t j = 0; j < 4; ++j) {
+      REQUIRE_THAT(T.at(i, j), Catch::Matchers::WithinAbs(Texp.at(i, j), TOLERANCE));
+    }
+  }
+  for (size_t i = 0; i < 6; ++i) {
+    for (size_t j = 0; j < 4; ++j) {
+      REQUIRE_THAT(Jb.at(i, j), Catch::Matchers::WithinAbs(Jbexp.at(i, j), TOLERANCE));
+    }
+  }
+
+  // The output is sized on the first call and reused afterwards
+  const std::vector<mr::Joint> joints = mr::ClassifyJoints(Blist);
+  arma::mat44 Tsb;
+  arma::mat Jbout;
+  mr::FKinAndJacobianBody(M, joints, thetalist, Tsb, Jbout);
+  REQUIRE(arma::approx_equal(Jbout, Jbexp, "absdiff", TOLERANCE));
+  const double * memptr = Jbout.memptr();
+  mr::FKinAndJacobianBody(M, joints, thetalist, Tsb, Jbout);
+  REQUIRE(Jbout.memptr() == memptr);
+  REQUIRE_THROWS_AS(
+    mr::FKinAndJacobianBody(M, joints, arma::vec{0.2, 1.1}, Tsb, Jbout), std::invalid_argument);
+}
+
+TEST_CASE("Test fused space forward kinematics and jacobian", "[FKinAndJacobianSpace]")
+{
+  const arma::mat44 M{
+    {-1, 0, 0, 0},
+    {0, 1, 0, 6},
+    {0, 0, -1, 2},
+    {0, 0, 0, 1}
+  };
+  const std::vector<arma::vec6> Slist{
+    {0, 0, 1, 0, 0.2, 0.2},
+    {1, 0, 0, 2, 0, 3},
+    {0, 1, 0, 0, 2, 1},
+    {1, 0, 0, 0.2, 0.3, 0.4}
+  };
+  const arma::vec thetalist{0.2, 1.1, 0.1, 1.2};
+
+  const auto &[T, Js] = mr::FKinAndJacobianSpace(M, Slist, thetalist);
+  const arma::mat44 Texp = mr::FKinSpace(M, Slist, thetalist);
+  const arma::mat Jsexp = mr::JacobianSpace(Slist, thetalist);
+
+  for (size_t i = 0; i < 4; ++i) {
+    for (size_t j = 0; j < 4; ++j) {
+      REQUIRE_THAT(T.at(i, j), Catch::Matchers::WithinAbs(Texp.at(i, j), TOLERANCE));
+    }
+  }
+  for (size_t i = 0; i < 6; ++i) {
+    for (size_t j = 0; j < 4; ++j) {
+      REQUIRE_THAT(Js.at(i, j), Catch::Matchers::WithinAbs(Jsexp.at(i, j), TOLERANCE));
+    }
+  }
+
+  // A wrongly shaped output is resized
+  const std::vector<mr::Joint> joints = mr::ClassifyJoints(Slist);
+  arma::mat44 Tsb;
+  arma::mat Jsout{3, 2, arma::fill::zeros};
+  mr::FKinAndJacobianSpace(M, joints, thetalist, Tsb, Jsout);
+  REQUIRE(arma::approx_equal(Jsout, Jsexp, "absdiff", TOLERANCE));
+  REQUIRE_THROWS_AS(
+    mr::FKinAndJacobianSpace(M, joints, arma::vec{0.2, 1.1}, Tsb, Jsout), std::invalid_argument);
+}
+
+TEST_CASE("Test matrix-free body jacobian products", "[JacobianBodyProduct]")
+{
+  const std::vector<arma::vec6> Blist{
+    {0, 0, 1, 0, 0.2, 0.2},
+    {1, 0, 0, 2, 0, 3},
+    {0, 1, 0, 0, 2, 1},
+    {1, 0, 0, 0.2, 0.3, 0.4}
+  };
+  const arma::vec thetalist{0.2, 1.1, 0.1, 1.2};
+  const arma::vec dthetalist{0.3, -0.5, 1.2, 0.7};
+  const arma::vec6 Fb{1, -2, 0.5, 3, 0.1, -1};
+
+  const arma::mat Jb = mr::JacobianBody(Blist, thetalist);
+  const arma::vec6 Vb = mr::JacobianBodyProduct(Blist, thetalist, dthetalist);
+  const arma::vec taulist = mr::JacobianBodyTransposeProduct(Blist, thetalist, Fb);
+  const arma::vec6 Vbexp = Jb * dthetalist;
+  const arma::vec tauexp = Jb.t() * Fb;
+
+  REQUIRE(taulist.size() == Blist.size());
+  for (size_t i = 0; i < 6; ++i) {
+    REQUIRE_THAT(Vb.at(i), Catch::Matchers::WithinAbs(Vbexp.at(i), TOLERANCE));
+  }
+  for (size_t i = 0; i < Blist.size(); ++i) {
+    REQUIRE_THAT(taulist.at(i), Catch::Matchers::WithinAbs(tauexp.at(i), TOLERANCE));
+  }
+}
+
+TEST_CASE("Test matrix-free space jacobian products", "[JacobianSpaceProduct]")
+{
+  const std::vector<arma::vec6> Slist{
+    {0, 0, 1, 0, 0.2, 0.2},
+    {1, 0, 0, 2, 0, 3},
+    {0, 1, 0, 0, 2, 1},
+    {1, 0, 0, 0.2, 0.3, 0.4}
+  };
+  const arma::vec thetalist{0.2, 1.1, 0.1, 1.2};
+  const arma::vec dthetalist{0.3, -0.5, 1.2, 0.7};
+  const arma::vec6 Fs{1, -2, 0.5, 3, 0.1, -1};
+
+  const arma::mat Js = mr::JacobianSpace(Slist, thetalist);
+  const arma::vec6 Vs = mr::JacobianSpaceProduct(Slist, thetalist, dthetalist);
+  const arma::vec taulist = mr::JacobianSpaceTransposeProduct(Slist, thetalist, Fs);
+  const arma::vec6 Vsexp = Js * dthetalist;
+  const arma::vec tauexp = Js.t() * Fs;
+
+  REQUIRE(taulist.size() == Slist.size());
+  for (size_t i = 0; i < 6; ++i) {
+    REQUIRE_THAT(Vs.at(i), Catch::Matchers::WithinAbs(Vsexp.at(i), TOLERANCE));
+  }
+  for (size_t i = 0; i < Slist.size(); ++i) {
+    REQUIRE_THAT(taulist.at(i), Catch::Matchers::WithinAbs(tauexp.at(i), TOLERANCE));
+  }
+}
+
+TEST_CASE("Test body jacobian time derivative", "[JacobianBodyDot]")
+{
+  const std::vector<arma::vec6> Blist{
+    {0, 0, 1, 0, 0.2, 0.2},
+    {1, 0, 0, 2, 0, 3},
+    {0, 1, 0, 0, 2, 1},
+    {1, 0, 0, 0.2, 0.3, 0.4}
+  };
+  const arma::vec thetalist{0.2, 1.1, 0.1, 1.2};
+  const arma::vec dthetalist{0.3, -0.5, 1.2, 0.7};
+  const double h = 1e-6;
+
+  const arma::mat dJb = mr::JacobianBodyDot(Blist, thetalist, dthetalist);
+  const arma::vec6 dJbdtheta = mr::JacobianBodyDotProduct(Blist, thetalist, dthetalist);
+  const arma::mat dJbexp = (mr::JacobianBody(Blist, thetalist + h * dthetalist) -
+    mr::JacobianBody(Blist, thetalist - h * dthetalist)) / (2.0 * h);
+  const arma::vec6 dJbdthetaexp = dJbexp * dthetalist;
+
+  for (size_t i = 0; i < 6; ++i) {
+    for (size_t j = 0; j < Blist.size(); ++j) {
+      REQUIRE_THAT(dJb.at(i, j), Catch::Matchers::WithinAbs(dJbexp.at(i, j), TOLERANCE));
+    }
+    REQUIRE_THAT(dJbdtheta.at(i), Catch::Matchers::WithinAbs(dJbdthetaexp.at(i), TOLERANCE));
+  }
+}
+
+TEST_CASE("Test space jacobian time derivative", "[JacobianSpaceDot]")
+{
+  const std::vector<arma::vec6> Slist{
+    {0, 0, 1, 0, 0.2, 0.2},
+    {1, 0, 0, 2, 0, 3},
+    {0, 1, 0, 0, 2, 1},
+    {1, 0, 0, 0.2, 0.3, 0.4}
+  };
+  const arma::vec thetalist{0.2, 1.1, 0.1, 1.2};
+  const arma::vec dthetalist{0.3, -0.5, 1.2, 0.7};
+  const double h = 1e-6;
+
+  const arma::mat dJs = mr::JacobianSpaceDot(Slist, thetalist, dthetalist);
+  const arma::vec6 dJsdtheta = mr::JacobianSpaceDotProduct(Slist, thetalist, dthetalist);
+  const arma::mat dJsexp = (mr::JacobianSpace(Slist, thetalist + h * dthetalist) -
+    mr::JacobianSpace(Slist, thetalist - h * dthetalist)) / (2.0 * h);
+  const arma::vec6 dJsdthetaexp = dJsexp * dthetalist;
+
+  for (size_t i = 0; i < 6; ++i) {
+    for (size_t j = 0; j < Slist.size(); ++j) {
+      REQUIRE_THAT(dJs.at(i, j), Catch::Matchers::WithinAbs(dJsexp.at(i, j), TOLERANCE));
+    }
+    REQUIRE_THAT(dJsdtheta.at(i), Catch::Matchers::WithinAbs(dJsdthetaexp.at(i), TOLERANCE));
+  }
+}
+
+TEST_CASE("Test manipulability measures", "[Manipulability]")
+{
+  const std::vector<arma::vec6> Blist{
+    {0, 0, 1, 0, 0.2, 0.2},
+    {1, 0, 0, 2, 0, 3},
+    {0, 1, 0, 0, 2, 1},
+    {1, 0, 0, 0.2, 0.3, 0.4}
+  };
+  const arma::vec thetalist{0.2, 1.1, 0.1, 1.2};
+  const arma::mat Jb = mr::JacobianBody(Blist, thetalist);
+
+  const mr::ManipulabilityMeasures twist = mr::Manipulability(Jb);
+  REQUIRE_THAT(twist.manipulability, Catch::Matchers::WithinAbs(0, TOLERANCE));
+  REQUIRE_THAT(twist.min_singular_value, Catch::Matchers::WithinAbs(0, TOLERANCE));
+
+  for (const auto part : {mr::ManipulabilityPart::Angular, mr::ManipulabilityPart::Linear}) {
+    const size_t row = part == mr::ManipulabilityPart::Angular ? 0 : 3;
+    const arma::vec s = arma::svd(arma::mat(Jb.rows(row, row + 2)));
+    const mr::ManipulabilityMeasures measures = mr::Manipulability(Jb, part);
+
+    REQUIRE_THAT(
+      measures.manipulability,
+      Catch::Matchers::WithinAbs(s.at(0) * s.at(1) * s.at(2), TOLERANCE));
+    REQUIRE_THAT(
+      measures.condition_number,
+      Catch::Matchers::WithinAbs(s.at(0) / s.at(2), TOLERANCE));
+    REQUIRE_THAT(measures.min_singular_value, Catch::Matchers::WithinAbs(s.at(2), TOLERANCE));
+  }
+}
+
+TEST_CASE("Test manipulability gradient", "[ManipulabilityGradient]")
+{
+  const std::vector<arma::vec6> Blist{
+    {0, 0, 1, 0, 0.2, 0.2},
+    {1, 0, 0, 2, 0, 3},
+    {0, 1, 0, 0, 2, 1},
+    {1, 0, 0, 0.2, 0.3, 0.4},
+    {0, 0, 1, 1, 0, 0.5},
+    {0, 1, 0, 0.3, 0, 0.1},
+    {1, 0, 0, 0, 0.5, 0.2}
+  };
+  const arma::vec thetalist{0.2, 1.1, 0.1, 1.2, -0.4, 0.7, 0.3};
+  const double h = 1e-6;
+
+  const arma::vec gradient = mr::ManipulabilityGradient(mr::JacobianBody(Blist, thetalist));
+
+  REQUIRE(gradient.n_elem == Blist.size());
+  for (size_t j = 0; j < Blist.size(); ++j) {
+    arma::vec plus = thetalist;
+    arma::vec minus = thetalist;
+    plus.at(j) += h;
+    minus.at(j) -= h;
+    const double expected = (
+      mr::Manipulability(mr::JacobianBody(Blist, plus)).manipulability -
+      mr::Manipulability(mr::JacobianBody(Blist, minus)).manipulability) / (2.0 * h);
+    REQUIRE_THAT(gradient.at(j), Catch::Matchers::WithinAbs(expected, 1e-5));
+  }
+
+  // The measure vanishes at a singularity and so does the gradient
+  const arma::vec zero = mr::ManipulabilityGradient(mr::JacobianBody(Blist, thetalist).cols(0, 3));
+  REQUIRE(arma::abs(zero).max() == 0.0);
+
+  const arma::vec lower{-1, -2, -3};
+  const arma::vec upper{1, 0, 1};
+  const arma::vec centering = mr::JointCenteringGradient(arma::vec{0.5, -1, -2}, lower, upper);
+  REQUIRE_THAT(centering.at(0), Catch::Matchers::WithinAbs(-0.5 / 12.0, TOLERANCE));
+  REQUIRE_THAT(centering.at(1), Catch::Matchers::WithinAbs(0.0, TOLERANCE));
+  REQUIRE_THAT(centering.at(2), Catch::Matchers::WithinAbs(1.0 / 48.0, TOLERANCE));
+}
+
+TEST_CASE("Test null-space resolved rates", "[NullSpaceResolvedRate]")
+{
+  const std::vector<arma::vec6> Blist{
+    {0, 0, 1, 0, 0.2, 0.2},
+    {1, 0, 0, 2, 0, 3},
+    {0, 1, 0, 0, 2, 1},
+    {1, 0, 0, 0.2, 0.3, 0.4},
+    {0, 0, 1, 1, 0, 0.5},
+    {0, 1, 0, 0.3, 0, 0.1},
+    {1, 0, 0, 0, 0.5, 0.2}
+  };
+  const arma::vec thetalist{0.2, 1.1, 0.1, 1.2, -0.4, 0.7, 0.3};
+  const arma::mat Jb = mr::JacobianBody(Blist, thetalist);
+  const arma::vec6 V{0.1, -0.2, 0.3, 0.5, 0.1, -0.4};
+  const arma::vec z{1, -1, 0.5, 0.2, -0.3, 0.8, 0.1};
+
+  const arma::vec pinv = arma::pinv(Jb) * V;
+  const arma::vec dtheta = mr::NullSpaceResolvedRate(Jb, V, z);
+  const arma::vec expected = pinv + (arma::eye(7, 7) - arma::pinv(Jb) * Jb) * z;
+
+  // The twist is achieved exactly and z only adds null-space motion
+  const arma::vec6 twist = Jb * dtheta;
+  for (size_t i = 0; i < 6; ++i) {
+    REQUIRE_THAT(twist.at(i), Catch::Matchers::WithinAbs(V.at(i), TOLERANCE));
+  }
+  for (size_t i = 0; i < 7; ++i) {
+    REQUIRE_THAT(dtheta.at(i), Catch::Matchers::WithinAbs(expected.at(i), TOLERANCE));
+  }
+
+  const arma::vec nothing{7, arma::fill::zeros};
+  const arma::vec minimum = mr::NullSpaceResolvedRate(Jb, V, nothing);
+  for (size_t i = 0; i < 7; ++i) {
+    REQUIRE_THAT(minimum.at(i), Catch::Matchers::WithinAbs(pinv.at(i), TOLERANCE));
+  }
+
+  // The in-place form matches and the damped form stays finite at a singularity
+  arma::mat66 A;
+  arma::vec inplace{7, arma::fill::zeros};
+  REQUIRE(mr::NullSpaceResolvedRate(Jb, V, z, 0.0, A, inplace));
+  REQUIRE(arma::abs(inplace - dtheta).max() < TOLERANCE);
+
+  const arma::mat singular = Jb.cols(0, 3);
+  const arma::vec zsingular{1, 2, 3, 4};
+  REQUIRE_THROWS_AS(mr::NullSpaceResolvedRate(singular, V, zsingular), std::runtime_error);
+  const arma::vec damped = mr::NullSpaceResolvedRate(singular, V, zsingular, 1e-4);
+  REQUIRE(damped.is_finite());
+  REQUIRE_THROWS_AS(mr::NullSpaceResolvedRate(Jb, V, zsingular), std::invalid_argument);
+}